@@ -0,0 +1,209 @@
+/**
+ * arena.c -- bump allocation of the memory held by a document
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "errors.h"
+
+
+/************************************************************************
+ * # Arenas
+ *
+ *  A document allocates a node for every block, plus the text of the
+ *  block. Taking those from an arena replaces millions of calls to
+ *  `malloc()` with one per chunk, and lets a document that fails part
+ *  of the way through be discarded with a single call.
+ *
+ *  Every byte the arena requests from the system is counted, so the
+ *  memory a document may hold can be capped. An allocation that would
+ *  exceed the cap fails just like one the system refused.
+ *
+ ************************************************************************/
+
+/** The smallest number of bytes requested for a chunk. */
+#define ARENA_CHUNK 65536
+
+/** The alignment of every allocation -- enough for any type we store. */
+#define ARENA_ALIGN 16
+
+/** A block of memory that allocations are taken from. */
+typedef struct Chunk
+{
+    struct Chunk *prev;     /* The previous chunk of the arena. */
+    size_t size;            /* Bytes that can be allocated. */
+    size_t used;            /* Bytes already allocated. */
+} Chunk;
+
+/** The bytes before the first allocation of a chunk. */
+#define CHUNK_HEADER \
+    ((sizeof(Chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static bool add_chunk(Arena *a, const size_t size);
+
+
+/** Round a size up to the alignment of every allocation. */
+static size_t align_size(const size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+
+/** Get the first byte of a chunk that can be allocated. */
+static uint8_t *chunk_data(Chunk *c)
+{
+    return (uint8_t *)c + CHUNK_HEADER;
+}
+
+
+/**
+ * Allocate an empty arena.
+ *
+ * No chunk is requested until the first allocation.
+ *
+ * - parameter limit: The cap on the bytes requested from the system,
+ *   or zero for no cap.
+ *
+ * - returns: A pointer to the new arena, or `NULL` if memory could not
+ *   be allocated.
+ */
+Arena *init_arena(const size_t limit)
+{
+    Arena *a = malloc(sizeof(Arena));
+    if (!a) return NULL;
+
+    a->chunk  = NULL;
+    a->allocd = 0;
+    a->limit  = limit;
+    a->error  = PD_OK;
+    return a;
+}
+
+
+/**
+ * Free an arena and every allocation taken from it, if it exists.
+ *
+ * - parameter a: The arena to be free'd.
+ */
+void free_arena(Arena *a)
+{
+    Chunk *prev = NULL;
+
+    if (!a) return;
+    while (a->chunk) {
+        prev = a->chunk->prev;
+        free(a->chunk);
+        a->chunk = prev;
+    }
+    free(a);
+}
+
+
+/**
+ * Allocate size bytes from an arena.
+ *
+ * - parameter a: The arena to allocate from.
+ * - parameter size: The number of bytes to allocate.
+ *
+ * - returns: A pointer to the bytes, or `NULL` if they could not be
+ *   allocated -- `a->error` then holds the reason.
+ */
+void *arena_alloc(Arena *a, const size_t size)
+{
+    size_t need = align_size(size);
+    Chunk *c = a->chunk;
+    void *ptr = NULL;
+
+    if (!c || c->size - c->used < need) {
+        if (!add_chunk(a, need)) return NULL;
+        c = a->chunk;
+    }
+    ptr = chunk_data(c) + c->used;
+    c->used += need;
+    return ptr;
+}
+
+
+/**
+ * Grow an allocation from an arena.
+ *
+ * The last allocation of the current chunk grows in place when the
+ * chunk has room. Any other allocation is copied to a new one, and its
+ * old bytes are only reclaimed with the arena.
+ *
+ * - parameter a: The arena the allocation was taken from.
+ * - parameter ptr: The allocation, or `NULL` for a new allocation.
+ * - parameter old: The size the allocation was made with.
+ * - parameter size: The new size of the allocation.
+ *
+ * - returns: A pointer to the grown allocation, or `NULL` if it could
+ *   not be grown -- the old allocation is then unchanged.
+ */
+void *arena_extend(Arena *a, void *ptr, const size_t old, const size_t size)
+{
+    Chunk *c = a->chunk;
+    uint8_t *end = NULL;    /* End of the allocation, if it was last. */
+    void *grown  = NULL;
+
+    if (!ptr) return arena_alloc(a, size);
+
+    end = (uint8_t *)ptr + align_size(old);
+    if (c && end == chunk_data(c) + c->used &&
+        c->size - c->used >= align_size(size) - align_size(old)) {
+        c->used += align_size(size) - align_size(old);
+        return ptr;
+    }
+
+    if (!(grown = arena_alloc(a, size))) return NULL;
+    memcpy(grown, ptr, old);
+    return grown;
+}
+
+
+/**
+ * Request a new chunk that can hold at least size bytes.
+ *
+ * Chunks are `ARENA_CHUNK` bytes unless a larger allocation needs more,
+ * or the arena's cap leaves room for less.
+ *
+ * - returns: `false` if the chunk would exceed the arena's cap, or if
+ *   memory could not be allocated.
+ */
+static bool add_chunk(Arena *a, const size_t size)
+{
+    Chunk *c = NULL;
+    size_t want = (size < ARENA_CHUNK) ? ARENA_CHUNK : size;
+    size_t room = 0;        /* Bytes the cap leaves for a chunk. */
+
+    if (a->limit) {
+        if (a->allocd + CHUNK_HEADER < a->limit) {
+            room = a->limit - a->allocd - CHUNK_HEADER;
+        }
+        if (size > room) {
+            a->error = PD_ERR_ARENA_LIMIT;
+            return false;
+        }
+        if (want > room) want = room;
+    }
+    if (!(c = malloc(CHUNK_HEADER + want))) {
+        a->error = PD_ERR_NOMEM;
+        return false;
+    }
+
+    c->prev  = a->chunk;
+    c->size  = want;
+    c->used  = 0;
+    a->chunk = c;
+    a->allocd += CHUNK_HEADER + want;
+    return true;
+}
@@ -0,0 +1,54 @@
+/**
+ * arena.h -- bump allocation of the memory held by a document
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef ARENA_DOT_H
+#define ARENA_DOT_H
+
+#include <stddef.h>
+
+#include "errors.h"
+
+/************************************************************************
+ * # Arenas
+ ************************************************************************/
+
+/**
+ * A type to hold memory that is free'd all at once.
+ *
+ * Memory is requested from the system in large chunks, and each
+ * allocation takes the next bytes of the current chunk. Nothing is
+ * free'd until the whole arena is.
+ *
+ * - member chunk: The chunk allocations are taken from.
+ * - member allocd: The number of bytes requested from the system.
+ * - member limit: The cap on `allocd`, or zero for no cap.
+ * - member error: Why the last allocation failed, if it did.
+ */
+typedef struct Arena
+{
+    struct Chunk *chunk;    /* Chunk allocations are taken from. */
+    size_t allocd;          /* Bytes requested from the system. */
+    size_t limit;           /* Cap on `allocd`, or zero for no cap. */
+    PdError error;          /* Why the last allocation failed. */
+} Arena;
+
+/** Allocate an empty arena, or return `NULL` if memory runs out. */
+Arena *init_arena(const size_t limit);
+
+/** Free an arena and every allocation taken from it, if it exists. */
+void free_arena(Arena *a);
+
+/** Allocate size bytes from an arena, or return `NULL`. */
+void *arena_alloc(Arena *a, const size_t size);
+
+/** Grow an allocation from an arena to size bytes, or return `NULL`. */
+void *arena_extend(Arena *a, void *ptr, const size_t old, const size_t size);
+
+#endif
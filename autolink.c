@@ -0,0 +1,578 @@
+/**
+ * autolink.c -- detection of autolinks in text
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "autolink.h"
+
+
+/************************************************************************
+ * # Autolinks
+ *
+ *  Two kinds of autolink are found in text:
+ *
+ *  1. CommonMark's, in angle brackets: `<scheme:anything>` and
+ *     `<local@domain>`.
+ *
+ *  2. GitHub's extended autolinks, with no brackets: `www.` followed by
+ *     a domain, `http://`, `https://` or `ftp://` followed by a domain,
+ *     and bare email addresses. These must start a line, follow
+ *     whitespace, or follow one of `*_~(`, and they lose trailing
+ *     punctuation, unbalanced `)` and anything that looks like an
+ *     entity reference at their end.
+ *
+ *  Every autolink has a byte that gives it away: `<`, `@`, the `:` of
+ *  `://`, or the first `w` of `www.`. Text is first skipped a vector at
+ *  a time, looking for those candidates, and only at a candidate is the
+ *  text around it checked byte-by-byte. Most prose has none, so it
+ *  costs a few instructions every sixteen bytes.
+ *
+ *  A link must lie within a single span of text. Blocks report all of
+ *  their text in one span, so this only misses a link that a pipelined
+ *  stream split between two pieces of a very long block.
+ *
+ ************************************************************************/
+
+/** The bytes of text searched for autolinks before they are written. */
+#define LINK_WINDOW 4096
+
+/** The most bytes of a URI scheme. */
+#define MOST_SCHEME 32
+
+/** The most bytes of a label of a domain in an email autolink. */
+#define MOST_LABEL 63
+
+/** Bytes with the low bit set in each lane of a 64-bit word. */
+#define LOW_BITS  0x0101010101010101ULL
+
+/** Bytes with the high bit set in each lane of a 64-bit word. */
+#define HIGH_BITS 0x8080808080808080ULL
+
+
+/** Check if a byte is an ASCII letter. */
+static bool is_alpha(const uint8_t c)
+{
+    return (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+}
+
+
+/** Check if a byte is an ASCII letter or digit. */
+static bool is_alnum(const uint8_t c)
+{
+    return is_alpha(c) || (c >= '0' && c <= '9');
+}
+
+
+/** Check if a byte is whitespace. */
+static bool is_space(const uint8_t c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+
+/** Check if a byte may be in a domain of an extended autolink. */
+static bool is_domain(const uint8_t c)
+{
+    return is_alnum(c) || c == '-' || c == '_' || c >= 0x80;
+}
+
+
+/** Check if a byte may be in the local part of a bare email. */
+static bool is_local(const uint8_t c)
+{
+    return is_alnum(c) || c == '.' || c == '+' || c == '-' || c == '_';
+}
+
+
+/** Check if a byte is one of a set of bytes. */
+static bool is_one_of(const uint8_t c, const char *set)
+{
+    return c && strchr(set, c);
+}
+
+
+/** Check if a byte may be in the local part of an email autolink. */
+static bool is_angle_local(const uint8_t c)
+{
+    return is_alnum(c) || is_one_of(c, ".!#$%&'*+/=?^_`{|}~-");
+}
+
+
+/**
+ * Check if an extended autolink may start at an offset: at the start
+ * of the text, after whitespace, or after one of `*_~(`.
+ */
+static bool is_boundary(const uint8_t *data, const size_t at)
+{
+    uint8_t c = at ? data[at - 1] : ' ';
+
+    return is_space(c) || c == '*' || c == '_' || c == '~' || c == '(';
+}
+
+
+/** Check if a span starts with a lowercase word, in any case. */
+static bool starts_with(const uint8_t *data, const size_t length,
+                        const char *word)
+{
+    size_t i = 0;
+
+    for (i = 0; i < length && word[i]; i++) {
+        if ((data[i] | 0x20) != word[i]) return false;
+    }
+    return i == length && !word[i];
+}
+
+
+/** Check if the bytes at an offset start a candidate autolink. */
+static bool is_candidate(const uint8_t *data, const size_t at,
+                         const size_t length)
+{
+    switch (data[at]) {
+        case '<':
+        case '@':
+            return true;
+        case ':':
+            return length - at >= 3 && data[at + 1] == '/' &&
+                   data[at + 2] == '/';
+        case 'w':
+            return length - at >= 4 && !memcmp(data + at, "www.", 4);
+        default:
+            return false;
+    }
+}
+
+
+#if !defined(__SSE2__)
+/** Check if any byte of a 64-bit word is a given byte. */
+static bool has_byte(const uint64_t w, const uint8_t c)
+{
+    uint64_t x = w ^ (LOW_BITS * c);
+
+    return ((x - LOW_BITS) & ~x & HIGH_BITS) != 0;
+}
+#endif
+
+
+#if defined(__SSE2__)
+/**
+ * Get a mask of the bytes of a block of sixteen that may start a
+ * candidate. `://` is rare enough to stop at any `:`, but `w` is too
+ * common, so only a `w` followed by another is stopped at.
+ *
+ * - parameter data: The block, and the byte after it.
+ */
+static int block_hits(const uint8_t *data)
+{
+    const __m128i v0 = _mm_loadu_si128((const __m128i *)data);
+    const __m128i v1 = _mm_loadu_si128((const __m128i *)(data + 1));
+    const __m128i w  = _mm_set1_epi8('w');
+    __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v0, _mm_set1_epi8('<')),
+                               _mm_cmpeq_epi8(v0, _mm_set1_epi8('@')));
+
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v0, _mm_set1_epi8(':')));
+    hit = _mm_or_si128(hit, _mm_and_si128(_mm_cmpeq_epi8(v0, w),
+                                          _mm_cmpeq_epi8(v1, w)));
+    return _mm_movemask_epi8(hit);
+}
+#endif
+
+
+/**
+ * Skip the blocks of text that hold no candidate.
+ *
+ * With SSE2 sixteen bytes are checked at once, and the last few bytes
+ * are copied into a block of their own, so short spans of text are
+ * checked at once too. Otherwise eight bytes are checked at once as a
+ * 64-bit word, for any `<`, `@`, `:` or `w`.
+ *
+ * - parameter at: The offset to skip from.
+ * - parameter to: The offset to skip up to, at most.
+ * - parameter length: The bytes of the text, which loads may reach.
+ *
+ * - returns: The offset of the first block that may hold a candidate,
+ *   or `to` if there is none.
+ */
+static size_t skip_blocks(const uint8_t *data, size_t at, const size_t to,
+                          const size_t length)
+{
+#if defined(__SSE2__)
+    uint8_t last[32] = { 0 };   /* The last few bytes, and zeroes. */
+    size_t n = 0;
+
+    while (to - at >= 16 && length - at >= 17) {
+        if (block_hits(data + at)) return at;
+        at += 16;
+    }
+    if (at == to) return to;
+
+    /* At most sixteen bytes are left before `to`. */
+    n = (length - at < 17) ? length - at : 17;
+    memcpy(last, data + at, n);
+    return (block_hits(last) & ((1 << (to - at)) - 1)) ? at : to;
+#else
+    (void)length;
+    while (to - at >= 8) {
+        uint64_t word;
+        memcpy(&word, data + at, sizeof(word));
+
+        if (has_byte(word, '<') || has_byte(word, '@') ||
+            has_byte(word, ':') || has_byte(word, 'w')) break;
+        at += 8;
+    }
+    return at;
+#endif
+}
+
+
+/** Find the offset of the next candidate before `to`, or `to`. */
+static size_t next_candidate(const uint8_t *data, size_t at, const size_t to,
+                             const size_t length)
+{
+    size_t stop = 0;
+
+    while (at < to) {
+        at = skip_blocks(data, at, to, length);
+        stop = (to - at > 16) ? at + 16 : to;
+        for (; at < stop; at++) {
+            if (is_candidate(data, at, length)) return at;
+        }
+    }
+    return to;
+}
+
+
+/************************************************************************
+ * ## Validation
+ ************************************************************************/
+
+/**
+ * Match a `<scheme:anything>` or `<local@domain>` autolink.
+ *
+ * - parameter at: The offset of the `<`.
+ */
+static bool match_angle(const uint8_t *data, const size_t length,
+                        const size_t at, Autolink *link)
+{
+    size_t i = at + 1;
+    size_t label = 0;       /* Bytes of the current label. */
+
+    /* A scheme: a letter, then letters, digits, `+`, `.` or `-`. */
+    if (i < length && is_alpha(data[i])) {
+        for (i++; i < length && i - at - 1 < MOST_SCHEME; i++) {
+            if (!is_alnum(data[i]) && !is_one_of(data[i], "+.-")) break;
+        }
+        if (i < length && data[i] == ':' && i - at - 1 >= 2) {
+            for (i++; i < length; i++) {
+                if (data[i] <= ' ' || data[i] == '<' || data[i] == '>' ||
+                    data[i] == 0x7F) break;
+            }
+            if (i < length && data[i] == '>') {
+                link->type = AUTOLINK_URI;
+                goto found;
+            }
+        }
+    }
+
+    /* An email: a local part, `@`, and labels of up to 63 bytes. */
+    for (i = at + 1; i < length && is_angle_local(data[i]); i++) continue;
+    if (i == at + 1 || i == length || data[i] != '@') return false;
+    for (i++; i < length; i++) {
+        if (is_alnum(data[i])) label++;
+        else if (data[i] == '-' && label > 0) label++;
+        else if (data[i] == '.' && label > 0 && data[i - 1] != '-') label = 0;
+        else break;
+        if (label > MOST_LABEL) return false;
+    }
+    if (i == length || data[i] != '>' || label == 0 || data[i - 1] == '-') {
+        return false;
+    }
+    link->type = AUTOLINK_EMAIL;
+
+found:
+    link->start  = at;
+    link->end    = i + 1;
+    link->text   = at + 1;
+    link->length = i - at - 1;
+    return true;
+}
+
+
+/**
+ * Get the end of the valid domain at an offset: segments of letters,
+ * digits, `_` and `-` separated by `.`, with no `_` in the last two.
+ *
+ * - parameter period: The domain must have a `.`.
+ *
+ * - returns: The offset just past the domain, or zero if there is none.
+ */
+static size_t match_domain(const uint8_t *data, const size_t length,
+                           const size_t at, const bool period)
+{
+    bool under_last = false;    /* The last segment has a `_`. */
+    bool under_prev = false;    /* The segment before it has a `_`. */
+    bool dotted = false;
+    size_t i = at;
+
+    for (; i < length; i++) {
+        if (data[i] == '.' && i > at && i + 1 < length &&
+            is_domain(data[i + 1])) {
+            under_prev = under_last;
+            under_last = false;
+            dotted = true;
+        }
+        else if (data[i] == '_') under_last = true;
+        else if (!is_domain(data[i])) break;
+    }
+    if (i == at || under_last || under_prev || (period && !dotted)) return 0;
+    return i;
+}
+
+
+/**
+ * Extend a link to the first whitespace or `<`, then trim what GitHub
+ * trims from its end: `?!.,:*_~'"`, `)` with no `(` to match, and a
+ * trailing `&name;`.
+ *
+ * - returns: The offset just past the link.
+ */
+static size_t match_path(const uint8_t *data, const size_t length,
+                         const size_t at)
+{
+    size_t end = at;
+    size_t opens = 0;
+    size_t closes = 0;
+    size_t k = 0;
+
+    for (; end < length && !is_space(data[end]) && data[end] != '<'; end++) {
+        opens  += (data[end] == '(');
+        closes += (data[end] == ')');
+    }
+
+    while (end > at) {
+        if (is_one_of(data[end - 1], "?!.,:*_~'\"")) end--;
+        else if (data[end - 1] == ')' && closes > opens) {
+            closes--;
+            end--;
+        }
+        else if (data[end - 1] == ';') {
+            for (k = end - 1; k > at && is_alnum(data[k - 1]); k--) continue;
+            if (k == end - 1 || k == at || data[k - 1] != '&') break;
+            end = k - 1;
+        }
+        else break;
+    }
+    return end;
+}
+
+
+/**
+ * Match a `www.` extended autolink.
+ *
+ * - parameter at: The offset of the first `w`.
+ */
+static bool match_www(const uint8_t *data, const size_t length,
+                      const size_t at, Autolink *link)
+{
+    size_t end = 0;
+
+    if (!is_boundary(data, at) || !match_domain(data, length, at, true)) {
+        return false;
+    }
+    if ((end = match_path(data, length, at)) <= at + 4) return false;
+
+    link->type   = AUTOLINK_WWW;
+    link->start  = link->text = at;
+    link->end    = end;
+    link->length = end - at;
+    return true;
+}
+
+
+/**
+ * Match a `http://`, `https://` or `ftp://` extended autolink.
+ *
+ * - parameter from: The first offset the link may start at.
+ * - parameter at: The offset of the `:` of `://`.
+ */
+static bool match_url(const uint8_t *data, const size_t length,
+                      const size_t from, const size_t at, Autolink *link)
+{
+    static const char *schemes[] = { "http", "https", "ftp" };
+    size_t start = at;
+    size_t end = 0;
+    size_t i = 0;
+
+    while (start > from && at - start < 5 && is_alpha(data[start - 1])) {
+        start--;
+    }
+    for (i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++) {
+        if (starts_with(data + start, at - start, schemes[i])) break;
+    }
+    if (i == sizeof(schemes) / sizeof(schemes[0]) ||
+        !is_boundary(data, start) ||
+        !match_domain(data, length, at + 3, false)) return false;
+    if ((end = match_path(data, length, at + 3)) == at + 3) return false;
+
+    link->type   = AUTOLINK_URL;
+    link->start  = link->text = start;
+    link->end    = end;
+    link->length = end - start;
+    return true;
+}
+
+
+/**
+ * Match a bare email extended autolink.
+ *
+ * - parameter from: The first offset the link may start at.
+ * - parameter at: The offset of the `@`.
+ */
+static bool match_email(const uint8_t *data, const size_t length,
+                        const size_t from, const size_t at, Autolink *link)
+{
+    size_t start = at;
+    size_t end = at + 1;
+    bool dotted = false;
+
+    while (start > from && is_local(data[start - 1])) start--;
+    if (start == at || (start > 0 && is_local(data[start - 1]))) {
+        return false;
+    }
+
+    for (; end < length; end++) {
+        if (data[end] == '.' && end + 1 < length && is_alnum(data[end + 1]) &&
+            data[end - 1] != '@') {
+            dotted = true;
+        }
+        else if (!is_alnum(data[end]) && data[end] != '-' &&
+                 data[end] != '_') break;
+    }
+    if (!dotted || data[end - 1] == '-' || data[end - 1] == '_') {
+        return false;
+    }
+
+    link->type   = AUTOLINK_BARE_EMAIL;
+    link->start  = link->text = start;
+    link->end    = end;
+    link->length = end - start;
+    return true;
+}
+
+
+/**
+ * Find the first autolink in a span of text, between two offsets.
+ *
+ * - parameter data: The span of text.
+ * - parameter length: The bytes of the span.
+ * - parameter from: The first offset a link may start at.
+ * - parameter to: The offset candidates are looked for up to. A link
+ *   found before it may run past it, up to `length`.
+ * - parameter link: Receives the link, if there is one.
+ *
+ * - returns: `true` if a link was found.
+ */
+bool find_autolink(const uint8_t *data, const size_t length,
+                   const size_t from, const size_t to, Autolink *link)
+{
+    size_t at = from;
+    bool found = false;
+
+    for (; (at = next_candidate(data, at, to, length)) < to; at++) {
+        switch (data[at]) {
+            case '<':
+                found = match_angle(data, length, at, link);
+                break;
+            case '@':
+                found = match_email(data, length, from, at, link);
+                break;
+            case ':':
+                found = match_url(data, length, from, at, link);
+                break;
+            default:
+                found = match_www(data, length, at, link);
+                break;
+        }
+        if (found) return true;
+    }
+    return false;
+}
+
+
+/**
+ * Get the prefix a kind of autolink adds to its text to make its URL.
+ *
+ * - parameter type: The kind of link.
+ *
+ * - returns: `mailto:` for emails, `http://` for `www.` links, and
+ *   nothing for the rest.
+ */
+const char *autolink_prefix(const autolink_t type)
+{
+    switch (type) {
+        case AUTOLINK_EMAIL:
+        case AUTOLINK_BARE_EMAIL:
+            return "mailto:";
+        case AUTOLINK_WWW:
+            return "http://";
+        default:
+            return "";
+    }
+}
+
+
+/**
+ * Write a span of text: each autolink with a renderer's own function,
+ * and the text between them decoded.
+ *
+ * The text is searched for links a window at a time, and each window
+ * written before the next is searched, so that long text is written
+ * while it is still in cache.
+ *
+ * - parameter d: The decoder of the text between links.
+ * - parameter data: The span of text.
+ * - parameter length: The bytes of the span.
+ * - parameter more: More text of the block may follow the span.
+ * - parameter write_link: Writes a link found in the span; it is passed
+ *   the span, the link, and the userdata of the decoder's sink.
+ */
+void write_autolinked(Decoder *d, const uint8_t *data, const size_t length,
+                      const bool more, LinkWrite write_link)
+{
+    Autolink link;
+    size_t at = 0;      /* Offset of the text not yet written. */
+    size_t to = 0;      /* Offset of the end of the window. */
+
+    if (d->held) {
+        at = finish_reference(d, data, length, more);
+        if (d->held) return;
+    }
+
+    /* Windows end at whitespace, which no link or reference spans. */
+    while (at < length) {
+        to = (length - at > LINK_WINDOW) ? at + LINK_WINDOW : length;
+        while (to < length && !is_space(data[to])) to++;
+
+        if (!find_autolink(data, length, at, to, &link)) {
+            write_decoded(d, data + at, to - at, more && to == length);
+            at = to;
+            continue;
+        }
+        write_decoded(d, data + at, link.start - at, false);
+        write_link(data, &link, d->out.userdata);
+        at = link.end;
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * autolink.h -- detection of autolinks in text
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef AUTOLINK_DOT_H
+#define AUTOLINK_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "entities.h"
+
+/************************************************************************
+ * # Autolinks
+ ************************************************************************/
+
+/** Kinds of autolink. */
+typedef enum
+{
+    AUTOLINK_URI,           /* <scheme:anything> */
+    AUTOLINK_EMAIL,         /* <local@domain> */
+    AUTOLINK_WWW,           /* www.domain/path, linked with http:// */
+    AUTOLINK_URL,           /* http://, https:// or ftp://domain/path */
+    AUTOLINK_BARE_EMAIL     /* local@domain, linked with mailto: */
+} autolink_t;
+
+/**
+ * A type to hold an autolink found in a span of text.
+ *
+ * - member start: Offset of the first byte of the link, including `<`.
+ * - member end: Offset just past the link, including `>`.
+ * - member text: Offset of the first byte of the link's text.
+ * - member length: Bytes of the link's text.
+ * - member type: The kind of link.
+ */
+typedef struct Autolink
+{
+    size_t start;       /* First byte of the link, including `<`. */
+    size_t end;         /* Just past the link, including `>`. */
+    size_t text;        /* First byte of the text of the link. */
+    size_t length;      /* Bytes of the text of the link. */
+    autolink_t type;    /* The kind of link. */
+} Autolink;
+
+/** A function that writes an autolink found in a span of text. */
+typedef void (*LinkWrite)(const uint8_t *data, const Autolink *link,
+                          void *userdata);
+
+/** Find the first autolink in a span of text, between two offsets. */
+bool find_autolink(const uint8_t *data, const size_t length,
+                   const size_t from, const size_t to, Autolink *link);
+
+/** Get the prefix a kind of autolink adds to its text to make its URL. */
+const char *autolink_prefix(const autolink_t type);
+
+/** Write a span of text: its autolinks as links, the rest decoded. */
+void write_autolinked(Decoder *d, const uint8_t *data, const size_t length,
+                      const bool more, LinkWrite write_link);
+
+#endif
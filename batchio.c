@@ -0,0 +1,551 @@
+/**
+ * batchio.c -- reading and writing files in batches
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#define _GNU_SOURCE     /* syscall() and MAP_POPULATE. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "batchio.h"
+#include "errors.h"
+
+
+/************************************************************************
+ * # Batched File I/O
+ *
+ *  Converting many small files spends more time in system calls than
+ *  in parsing: each file is opened, read and closed, and its output is
+ *  opened, written, closed and renamed into place. A batch does each of
+ *  these steps for every file at once.
+ *
+ *  With io_uring, each step of a batch is a single system call that
+ *  submits every file's request and waits for all of them -- three for
+ *  a batch read, and three for a batch written. Without it, or if the
+ *  kernel lacks any of the requests, the same steps are made one file
+ *  at a time with `pread()` and `pwrite()`.
+ *
+ *  A file whose size is not the size it was expected to have fails
+ *  with `EAGAIN`, so that it can be read again on its own.
+ *
+ *  Each thread keeps a `BatchIo` of its own; none of it is shared.
+ *
+ ************************************************************************/
+
+#ifdef HAVE_IO_URING
+
+/**
+ * A type to hold an io_uring, mapped from the kernel.
+ *
+ * The submission and completion queues are rings of indices shared
+ * with the kernel: the tail of the submission queue and the head of the
+ * completion queue are only written here, with release ordering, and
+ * the others are only written by the kernel.
+ */
+typedef struct Uring
+{
+    int fd;                         /* The ring. */
+    unsigned *sq_tail;              /* Tail of the submission queue. */
+    const unsigned *sq_mask;        /* Mask of its indices. */
+    unsigned *sq_array;             /* Its entries, as indices of `sqes`. */
+    unsigned *cq_head;              /* Head of the completion queue. */
+    const unsigned *cq_tail;        /* Tail of the completion queue. */
+    const unsigned *cq_mask;        /* Mask of its indices. */
+    struct io_uring_sqe *sqes;      /* The submission entries. */
+    const struct io_uring_cqe *cqes;    /* The completion entries. */
+    void *sq_map;                   /* Mapping of the submission queue. */
+    size_t sq_size;                 /* Bytes of `sq_map`. */
+    void *cq_map;                   /* Mapping of the completion queue. */
+    size_t cq_size;                 /* Bytes of `cq_map`. */
+    size_t sqes_size;               /* Bytes of `sqes`. */
+    unsigned queued;                /* Entries not submitted yet. */
+} Uring;
+
+#endif
+
+/** The state of the batches of one thread. */
+struct BatchIo
+{
+    size_t depth;       /* Most files of a batch. */
+    int *fds;           /* The descriptor of each file of a batch. */
+    int *results;       /* The result of each request of a batch. */
+    bool uring;         /* Batches are submitted to `ring`. */
+#ifdef HAVE_IO_URING
+    Uring ring;         /* The ring, if `uring`. */
+#endif
+};
+
+
+/************************************************************************
+ * ## io_uring
+ ************************************************************************/
+
+#ifdef HAVE_IO_URING
+
+/** The requests a batch makes of the kernel. */
+static const uint8_t uring_ops[] = {
+    IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE,
+    IORING_OP_RENAMEAT
+};
+
+
+/** Check that the kernel supports every request a batch makes. */
+static bool probe_ring(const int fd)
+{
+    size_t size = sizeof(struct io_uring_probe) +
+                  256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    bool ok = false;
+    size_t i = 0;
+
+    if (!probe) return false;
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+                256) == 0) {
+        ok = true;
+        for (i = 0; i < sizeof(uring_ops); i++) {
+            ok = ok && uring_ops[i] <= probe->last_op &&
+                 (probe->ops[uring_ops[i]].flags & IO_URING_OP_SUPPORTED);
+        }
+    }
+    free(probe);
+    return ok;
+}
+
+
+/** Unmap and close a ring. */
+static void close_ring(Uring *r)
+{
+    if (r->sqes) munmap(r->sqes, r->sqes_size);
+    if (r->cq_map && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_size);
+    if (r->sq_map) munmap(r->sq_map, r->sq_size);
+    if (r->fd >= 0) close(r->fd);
+}
+
+
+/**
+ * Set up a ring, and map its queues.
+ *
+ * - returns: `false` if the kernel has no io_uring, or lacks any of the
+ *   requests of a batch.
+ */
+static bool open_ring(Uring *r, const unsigned entries)
+{
+    struct io_uring_params p;
+    void *map = NULL;
+    uint8_t *sq = NULL;
+    uint8_t *cq = NULL;
+
+    memset(r, 0, sizeof(Uring));
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0 || !probe_ring(r->fd)) {
+        close_ring(r);
+        return false;
+    }
+
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+        r->cq_size = r->sq_size;
+    }
+
+    map = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (map == MAP_FAILED) {
+        close_ring(r);
+        return false;
+    }
+    r->sq_map = r->cq_map = map;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        map = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (map == MAP_FAILED) {
+            r->cq_map = NULL;
+            close_ring(r);
+            return false;
+        }
+        r->cq_map = map;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    map = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (map == MAP_FAILED) {
+        close_ring(r);
+        return false;
+    }
+    r->sqes = map;
+
+    sq = r->sq_map;
+    cq = r->cq_map;
+    r->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask  = (const unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head  = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail  = (const unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask  = (const unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes     = (const struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+}
+
+
+/**
+ * Queue a request, to be submitted with the rest of its step.
+ *
+ * - returns: The entry of the request, cleared, with its opcode, file
+ *   and tag set. It is handed to the kernel by `run_ring()`.
+ */
+static struct io_uring_sqe *queue_op(Uring *r, const uint8_t op,
+                                     const int fd, const size_t tag)
+{
+    unsigned tail = *r->sq_tail + r->queued;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = op;
+    sqe->fd        = fd;
+    sqe->user_data = tag;
+    r->sq_array[index] = index;
+    r->queued++;
+    return sqe;
+}
+
+
+/**
+ * Submit every queued request, and wait for all of them to complete.
+ *
+ * - parameter r: The ring.
+ * - parameter results: Receives the result of each request, by tag.
+ */
+static void run_ring(Uring *r, int *results)
+{
+    unsigned pending = r->queued;   /* Requests not completed yet. */
+    unsigned head = 0;
+    const struct io_uring_cqe *cqe = NULL;
+    long ret = 0;
+
+    __atomic_store_n(r->sq_tail, *r->sq_tail + r->queued, __ATOMIC_RELEASE);
+    while (pending > 0) {
+        ret = syscall(__NR_io_uring_enter, r->fd, r->queued, pending,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret > 0) r->queued -= ret;
+        else if (ret < 0 && errno != EINTR && errno != EAGAIN &&
+                 errno != EBUSY) {
+            /* Requests may be in flight, so their buffers are not free. */
+            fprintf(stderr, "FATAL: io_uring failed: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        head = *r->cq_head;
+        while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            cqe = &r->cqes[head & *r->cq_mask];
+            results[cqe->user_data] = cqe->res;
+            head++;
+            pending--;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+
+/** Read a batch of files, a step at a time, through a ring. */
+static void read_uring(BatchIo *io, IoFile *files, const size_t count)
+{
+    Uring *r = &io->ring;
+    int *res = io->results;
+    struct io_uring_sqe *sqe = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        if (files[i].error) continue;
+        sqe = queue_op(r, IORING_OP_OPENAT, AT_FDCWD, i);
+        sqe->addr       = (uintptr_t)files[i].path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    }
+    run_ring(r, res);
+
+    /* One byte more than expected, to notice a file that grew. */
+    for (i = 0; i < count; i++) {
+        if (files[i].error) continue;
+        if (res[i] < 0) {
+            files[i].error = -res[i];
+            continue;
+        }
+        io->fds[i] = res[i];
+        sqe = queue_op(r, IORING_OP_READ, io->fds[i], i);
+        sqe->addr = (uintptr_t)files[i].data;
+        sqe->len  = files[i].length + 1;
+    }
+    run_ring(r, res);
+
+    for (i = 0; i < count; i++) {
+        if (files[i].error) continue;
+        if (res[i] < 0) files[i].error = -res[i];
+        else if ((size_t)res[i] != files[i].length) files[i].error = EAGAIN;
+        queue_op(r, IORING_OP_CLOSE, io->fds[i], i);
+    }
+    run_ring(r, res);
+}
+
+
+/** Write a batch of files, a step at a time, through a ring. */
+static void write_uring(BatchIo *io, IoFile *files, const size_t count)
+{
+    Uring *r = &io->ring;
+    int *res = io->results;
+    struct io_uring_sqe *sqe = NULL;
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        if (files[i].error) continue;
+        sqe = queue_op(r, IORING_OP_OPENAT, AT_FDCWD, i);
+        sqe->addr       = (uintptr_t)files[i].temp;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        sqe->len        = 0666;
+    }
+    run_ring(r, res);
+
+    for (i = 0; i < count; i++) {
+        if (files[i].error) continue;
+        if (res[i] < 0) {
+            files[i].error = -res[i];
+            continue;
+        }
+        io->fds[i] = res[i];
+        sqe = queue_op(r, IORING_OP_WRITE, io->fds[i], i);
+        sqe->addr = (uintptr_t)files[i].data;
+        sqe->len  = files[i].length;
+    }
+    run_ring(r, res);
+
+    /* The rename is linked to the close, so it only follows a success. */
+    for (i = 0; i < count; i++) {
+        if (files[i].error) continue;
+        if (res[i] < 0) files[i].error = -res[i];
+        else if ((size_t)res[i] != files[i].length) files[i].error = EIO;
+
+        sqe = queue_op(r, IORING_OP_CLOSE, io->fds[i], i);
+        if (files[i].error) continue;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe = queue_op(r, IORING_OP_RENAMEAT, AT_FDCWD, count + i);
+        sqe->addr  = (uintptr_t)files[i].temp;
+        sqe->len   = AT_FDCWD;
+        sqe->addr2 = (uintptr_t)files[i].path;
+    }
+    run_ring(r, res);
+
+    for (i = 0; i < count; i++) {
+        if (files[i].error) continue;
+        if (res[i] < 0) files[i].error = -res[i];
+        else if (res[count + i] < 0) files[i].error = -res[count + i];
+    }
+}
+
+#endif
+
+
+/************************************************************************
+ * ## Plain System Calls
+ ************************************************************************/
+
+/** Read a batch of files, one at a time. */
+static void read_plain(IoFile *files, const size_t count)
+{
+    size_t i = 0;
+    size_t got = 0;     /* Bytes of the file read so far. */
+    ssize_t n = 0;
+    int fd = -1;
+
+    for (i = 0; i < count; i++) {
+        if (files[i].error) continue;
+        if ((fd = open(files[i].path, O_RDONLY | O_CLOEXEC)) < 0) {
+            files[i].error = errno;
+            continue;
+        }
+        got = 0;
+        while (got <= files[i].length &&
+               (n = pread(fd, files[i].data + got,
+                          files[i].length + 1 - got, got)) > 0) {
+            got += n;
+        }
+        if (n < 0) files[i].error = errno;
+        else if (got != files[i].length) files[i].error = EAGAIN;
+        close(fd);
+    }
+}
+
+
+/** Write a batch of files, one at a time. */
+static void write_plain(IoFile *files, const size_t count)
+{
+    size_t i = 0;
+    size_t put = 0;     /* Bytes of the file written so far. */
+    ssize_t n = 0;
+    int fd = -1;
+
+    for (i = 0; i < count; i++) {
+        fd = open(files[i].temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0666);
+        if (fd < 0) {
+            files[i].error = errno;
+            continue;
+        }
+        for (put = 0, n = 0; put < files[i].length && n >= 0; put += n) {
+            n = pwrite(fd, files[i].data + put, files[i].length - put, put);
+            if (n < 0 && errno == EINTR) n = 0;
+            else if (n < 0) files[i].error = errno;
+        }
+        if (close(fd) < 0 && !files[i].error) files[i].error = errno;
+        if (!files[i].error && rename(files[i].temp, files[i].path) < 0) {
+            files[i].error = errno;
+        }
+    }
+}
+
+
+/************************************************************************
+ * ## Batches
+ ************************************************************************/
+
+/**
+ * Allocate the state of batches of at most `depth` files.
+ *
+ * - parameter depth: The most files of a batch.
+ * - parameter uring: Submit batches to io_uring, if the kernel can.
+ *
+ * - throws fatal_memory_error: Memory could not be allocated.
+ *
+ * - returns: The state, to be free'd with `free_batch_io()`.
+ */
+BatchIo *init_batch_io(const size_t depth, const bool uring)
+{
+    BatchIo *io = malloc(sizeof(BatchIo));
+
+    if (!io) throw_fatal_memory_error();
+    io->depth   = depth;
+    io->fds     = malloc(depth * sizeof(int));
+    io->results = malloc(2 * depth * sizeof(int));
+    io->uring   = false;
+    if (!io->fds || !io->results) throw_fatal_memory_error();
+
+#ifdef HAVE_IO_URING
+    /* A written file needs two requests in the last step. */
+    if (uring) io->uring = open_ring(&io->ring, 2 * depth);
+#else
+    (void)uring;
+#endif
+    return io;
+}
+
+
+/**
+ * Free the state of batches, if it exists.
+ *
+ * - parameter io: The state to be free'd.
+ */
+void free_batch_io(BatchIo *io)
+{
+    if (!io) return;
+#ifdef HAVE_IO_URING
+    if (io->uring) close_ring(&io->ring);
+#endif
+    free(io->fds);
+    free(io->results);
+    free(io);
+}
+
+
+/**
+ * Read each file of a batch into memory.
+ *
+ * - parameter io: The state of the batches.
+ * - parameter files: The files, at most the depth of the batches. Each
+ *   `length` is the size the file is expected to have. On return, each
+ *   file that was read has its `data`; any other has an `error`, and an
+ *   error of `EAGAIN` if its size was not the one expected, or of
+ *   `ENOMEM` if there was no memory to read it into.
+ * - parameter count: The number of files.
+ */
+void read_batch(BatchIo *io, IoFile *files, const size_t count)
+{
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        files[i].data  = NULL;
+        files[i].error = 0;
+        if (files[i].length >= UINT32_MAX) files[i].error = EFBIG;
+        else if (!(files[i].data = malloc(files[i].length + 1))) {
+            files[i].error = ENOMEM;
+        }
+    }
+
+#ifdef HAVE_IO_URING
+    if (io->uring) read_uring(io, files, count);
+    else read_plain(files, count);
+#else
+    read_plain(files, count);
+#endif
+
+    for (i = 0; i < count; i++) {
+        if (!files[i].error) continue;
+        free(files[i].data);
+        files[i].data = NULL;
+    }
+}
+
+
+/**
+ * Write each file of a batch through a temporary file.
+ *
+ * Each file's bytes are written to its `temp`, which is then renamed
+ * over its `path`, so a file is always either its old bytes or its new.
+ *
+ * - parameter io: The state of the batches.
+ * - parameter files: The files, at most the depth of the batches. On
+ *   return, each file that could not be written has an `error`, and
+ *   its `temp` is removed.
+ * - parameter count: The number of files.
+ */
+void write_batch(BatchIo *io, IoFile *files, const size_t count)
+{
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        files[i].error = (files[i].length >= UINT32_MAX) ? EFBIG : 0;
+    }
+
+#ifdef HAVE_IO_URING
+    if (io->uring) write_uring(io, files, count);
+    else write_plain(files, count);
+#else
+    write_plain(files, count);
+#endif
+
+    for (i = 0; i < count; i++) {
+        if (files[i].error) unlink(files[i].temp);
+    }
+}
@@ -0,0 +1,56 @@
+/**
+ * batchio.h -- reading and writing files in batches
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef BATCHIO_DOT_H
+#define BATCHIO_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/************************************************************************
+ * # Batched File I/O
+ ************************************************************************/
+
+/**
+ * A type to hold a file read, or written, as part of a batch.
+ *
+ * - member path: The file to read, or the file to write.
+ * - member temp: The file written first, then renamed to `path`.
+ * - member data: The bytes read, to be free'd, or the bytes to write.
+ * - member length: The bytes expected to be read, then the bytes that
+ *   were, or the bytes to write.
+ * - member error: Zero, or the `errno` of the call that failed.
+ */
+typedef struct IoFile
+{
+    const char *path;   /* File to read, or to write. */
+    const char *temp;   /* File written, then renamed to `path`. */
+    uint8_t *data;      /* Bytes read, or to write. */
+    size_t length;      /* Bytes expected, then read, or to write. */
+    int error;          /* Zero, or the `errno` of the failed call. */
+} IoFile;
+
+/** The state of the batches of one thread. */
+typedef struct BatchIo BatchIo;
+
+/** Allocate the state of batches of at most `depth` files. */
+BatchIo *init_batch_io(const size_t depth, const bool uring);
+
+/** Free the state of batches, if it exists. */
+void free_batch_io(BatchIo *io);
+
+/** Read each file of a batch into memory. */
+void read_batch(BatchIo *io, IoFile *files, const size_t count);
+
+/** Write each file of a batch through a temporary file. */
+void write_batch(BatchIo *io, IoFile *files, const size_t count);
+
+#endif
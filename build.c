@@ -0,0 +1,959 @@
+/**
+ * build.c -- incremental conversion of a directory tree
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#define _GNU_SOURCE     /* fstatat(), openat(), fdopendir() and getline(). */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "batchio.h"
+#include "build.h"
+#include "errors.h"
+#include "hash.h"
+#include "libpatdown.h"
+#include "strings.h"
+
+
+/************************************************************************
+ * # Directory Builds
+ *
+ *  A build converts each Markdown file under the source directory into
+ *  an HTML file at the same relative path under the output directory --
+ *  or, for a link checker, into a `.jsonl` file of each of its links.
+ *  The output directory keeps a manifest of every file converted: its
+ *  path, size, modification time and a 128-bit hash of its contents.
+ *
+ *  A rebuild only has to list the tree and compare: a file whose size
+ *  and modification time match the manifest, and whose output exists,
+ *  is skipped without being read. A file whose stat changed is read and
+ *  hashed, and is converted only if its contents changed too. Files are
+ *  converted in parallel, each written to a temporary file and renamed
+ *  into place, so an interrupted build never leaves half an output.
+ *
+ *  Each thread takes the files it converts in batches: every file of a
+ *  batch is read at once, each is converted into memory, and then every
+ *  output is written at once -- see batchio.c.
+ *
+ *  Outputs of files in the manifest that no longer exist are removed.
+ *  Nothing that patdown did not write is ever removed.
+ *
+ *  Hidden files and directories are skipped, as are paths containing a
+ *  newline, which the manifest cannot hold. A `.markdown` file beside a
+ *  `.md` file of the same name fails, as both would have one output.
+ *
+ ************************************************************************/
+
+/** The most files a thread converts in a batch. */
+#define BUILD_BATCH 64
+
+/** The first line of a manifest, and the options it was built with. */
+#define MANIFEST_HEADER \
+    "patdown-manifest 1 raw=%d excerpt=%zu,%zu,%d only=%u links=%d\n"
+
+/** The state of a file in a build. */
+typedef enum
+{
+    FILE_UNCHANGED,     /* Matches the manifest; skipped. */
+    FILE_CHECK,         /* Must be read to know if it changed. */
+    FILE_TOUCHED,       /* Its stat changed, but not its contents. */
+    FILE_CONVERTED,     /* Was converted by this build. */
+    FILE_FAILED         /* Could not be converted. */
+} filestate_t;
+
+/** A Markdown file of the source tree, or of the manifest. */
+typedef struct BuildFile
+{
+    char *path;             /* Path relative to the source directory. */
+    long long size;         /* Size in bytes. */
+    long long mtime_sec;    /* Modification time, in seconds, */
+    long mtime_nsec;        /* ... and nanoseconds. */
+    uint64_t hash[2];       /* Hash of the contents, if `known`. */
+    bool known;             /* The hash is from a compatible manifest. */
+    filestate_t state;      /* The state of the file in this build. */
+} BuildFile;
+
+/** A growable list of files. */
+typedef struct FileList
+{
+    BuildFile *files;
+    size_t length;
+    size_t allocd;
+} FileList;
+
+/** The state shared by the threads of a build. */
+typedef struct Build
+{
+    const char *src;        /* The source directory. */
+    const char *out;        /* The output directory. */
+    PdOptions opts;         /* The options every file is parsed with. */
+    bool links;             /* Outputs are links, not HTML. */
+    const char *ext;        /* The extension of each output. */
+    FileList *list;         /* Every file of the source tree. */
+    size_t *todo;           /* Indices of the files to check. */
+    size_t ntodo;           /* Number of files to check. */
+    size_t next;            /* Next index of `todo` to take. */
+    size_t batch;           /* Files taken at once, or 0 for single. */
+    bool uring;             /* Batches are made through io_uring. */
+    pthread_mutex_t lock;   /* Guards `next`. */
+} Build;
+
+/** The output of a file, held in memory until it is written. */
+typedef struct Output
+{
+    String *str;            /* The output so far. */
+    bool nomem;             /* Some of it could not be appended. */
+} Output;
+
+static void walk_dir(FileList *list, const int fd, char *rel,
+                     const size_t length, const struct stat *skip);
+static bool load_manifest(FileList *old, const char *out,
+                          const BuildOptions *opts);
+static bool save_manifest(const FileList *list, const char *out,
+                          const BuildOptions *opts);
+static void *run_builder(void *arg);
+static char *output_path(const char *out, const char *rel,
+                         const char *ext);
+static bool output_exists(const char *out, const char *rel,
+                          const char *ext);
+static void remove_output(const char *out, const char *rel,
+                          const char *ext);
+static void make_parents(char *path, const size_t from);
+static bool has_twin(const FileList *list, const char *path);
+static void free_files(FileList *list);
+
+
+/** Sort files by path. */
+static int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const BuildFile *)a)->path,
+                  ((const BuildFile *)b)->path);
+}
+
+
+/**
+ * Convert every Markdown file of a tree that changed since last time.
+ *
+ * - parameter src: The directory to convert.
+ * - parameter out: The directory to write to, created if it is missing.
+ *   It may be inside `src`; it is never walked.
+ * - parameter opts: The options of the build.
+ *
+ * - returns: `EXIT_SUCCESS` if every file was converted, or skipped as
+ *   unchanged, else `EXIT_FAILURE`.
+ */
+int build_tree(const char *src, const char *out, const BuildOptions *opts)
+{
+    FileList list = { NULL, 0, 0 };     /* Files of the source tree. */
+    FileList old  = { NULL, 0, 0 };     /* Files of the manifest. */
+    Build b;
+    pthread_t *threads = NULL;
+    BuildFile *f = NULL;
+    const char *ext = opts->links ? ".jsonl" : ".html";
+    char *manifest = output_path(out, NULL, NULL);
+    char rel[4096];             /* A path relative to `src`. */
+    struct stat skip;           /* The output directory. */
+    size_t workers = opts->workers;
+    size_t counts[FILE_FAILED + 1] = { 0 };
+    size_t removed = 0;
+    size_t started = 0;
+    size_t i = 0;
+    size_t j = 0;
+    bool compatible = false;    /* The manifest's options match. */
+    long cpus = 0;
+    int fd = -1;
+    int cmp = 0;
+
+    memset(&b, 0, sizeof(b));
+
+    /* Making the manifest's parents makes the output directory. */
+    make_parents(manifest, 0);
+    free(manifest);
+    if (stat(out, &skip) < 0) {
+        fprintf(stderr, "FATAL: directory could not be created: '%s'\n",
+                out);
+        return EXIT_FAILURE;
+    }
+    if ((fd = open(src, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "FATAL: directory could not be opened: '%s'\n",
+                src);
+        return EXIT_FAILURE;
+    }
+
+    rel[0] = '\0';
+    walk_dir(&list, fd, rel, 0, &skip);
+    compatible = load_manifest(&old, out, opts);
+    if (list.length) {
+        qsort(list.files, list.length, sizeof(BuildFile), compare_files);
+    }
+    if (old.length) {
+        qsort(old.files, old.length, sizeof(BuildFile), compare_files);
+    }
+
+    /* Merge the tree with the manifest: both are sorted by path. */
+    if (!(b.todo = malloc((list.length + 1) * sizeof(size_t)))) {
+        throw_fatal_memory_error();
+    }
+    while (i < list.length || j < old.length) {
+        if (i == list.length) cmp = 1;
+        else if (j == old.length) cmp = -1;
+        else cmp = strcmp(list.files[i].path, old.files[j].path);
+
+        if (cmp > 0) {
+            remove_output(out, old.files[j++].path, ext);
+            removed++;
+            continue;
+        }
+
+        f = &list.files[i];
+        if (has_twin(&list, f->path)) {
+            fprintf(stderr, "ERROR: %s/%s: has the same output as the "
+                    ".md file beside it.\n", src, f->path);
+            f->state = FILE_FAILED;
+            if (cmp == 0) j++;
+            i++;
+            continue;
+        }
+        f->state = FILE_CHECK;
+        if (cmp == 0) {
+            const BuildFile *o = &old.files[j++];
+            if (compatible) {
+                f->hash[0] = o->hash[0];
+                f->hash[1] = o->hash[1];
+                f->known   = true;
+            }
+            if (f->known && f->size == o->size &&
+                f->mtime_sec == o->mtime_sec &&
+                f->mtime_nsec == o->mtime_nsec &&
+                output_exists(out, f->path, ext)) {
+                f->state = FILE_UNCHANGED;
+            }
+        }
+        if (f->state == FILE_CHECK) b.todo[b.ntodo++] = i;
+        i++;
+    }
+
+    b.src  = src;
+    b.out  = out;
+    b.list = &list;
+    b.links = opts->links;
+    b.ext  = ext;
+    b.opts.size           = sizeof(PdOptions);
+    b.opts.raw            = opts->raw;
+    b.opts.excerpt_blocks = opts->excerpt_blocks;
+    b.opts.excerpt_bytes  = opts->excerpt_bytes;
+    b.opts.excerpt_refs   = opts->excerpt_refs;
+    b.opts.only           = opts->only;
+    pthread_mutex_init(&b.lock, NULL);
+
+    if (workers == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    if (workers > b.ntodo) workers = b.ntodo;
+
+    /* Batches small enough that every thread gets a few. */
+    if (opts->io != BUILD_IO_SINGLE) {
+        b.batch = workers ? b.ntodo / (4 * workers) : 0;
+        if (b.batch > BUILD_BATCH) b.batch = BUILD_BATCH;
+        if (b.batch < 1) b.batch = 1;
+        b.uring = (opts->io == BUILD_IO_URING);
+    }
+    if (workers > 0 && !(threads = calloc(workers, sizeof(pthread_t)))) {
+        throw_fatal_memory_error();
+    }
+    for (started = 0; started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, run_builder, &b)) break;
+    }
+    if (started == 0) run_builder(&b);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&b.lock);
+
+    for (i = 0; i < list.length; i++) counts[list.files[i].state]++;
+
+    /* A rebuild that changed nothing leaves the manifest alone. */
+    if (counts[FILE_TOUCHED] || counts[FILE_CONVERTED] || removed ||
+        !compatible || old.length != list.length - counts[FILE_FAILED]) {
+        if (!save_manifest(&list, out, opts)) {
+            fprintf(stderr, "ERROR: manifest could not be written: "
+                    "'%s/%s'\n", out, BUILD_MANIFEST);
+            counts[FILE_FAILED]++;
+        }
+    }
+
+    fprintf(stderr, "patdown: %zu converted, %zu unchanged, %zu removed, "
+            "%zu failed\n", counts[FILE_CONVERTED],
+            counts[FILE_UNCHANGED] + counts[FILE_TOUCHED], removed,
+            counts[FILE_FAILED]);
+
+    free(threads);
+    free(b.todo);
+    free_files(&list);
+    free_files(&old);
+    return counts[FILE_FAILED] ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+/************************************************************************
+ * # Walking the Source Tree
+ ************************************************************************/
+
+/** Check if a file name has the extension of a Markdown file. */
+static bool is_markdown(const char *name)
+{
+    size_t length = strlen(name);
+
+    return (length > 3 && strcmp(name + length - 3, ".md") == 0) ||
+           (length > 9 && strcmp(name + length - 9, ".markdown") == 0);
+}
+
+
+/**
+ * Check if a `.markdown` file has a `.md` file beside it in a list
+ * sorted by path. Both would be converted to the same output.
+ *
+ * - throws fatal_memory_error: Memory could not be allocated.
+ */
+static bool has_twin(const FileList *list, const char *path)
+{
+    size_t length = strlen(path);
+    BuildFile key;
+    bool found = false;
+
+    if (length <= 9 || strcmp(path + length - 9, ".markdown") != 0) {
+        return false;
+    }
+    memset(&key, 0, sizeof(key));
+    if (!(key.path = malloc(length - 5))) throw_fatal_memory_error();
+    memcpy(key.path, path, length - 9);
+    strcpy(key.path + length - 9, ".md");
+    found = bsearch(&key, list->files, list->length, sizeof(BuildFile),
+                    compare_files) != NULL;
+    free(key.path);
+    return found;
+}
+
+
+/** Add a file to the end of a list. */
+static void add_file(FileList *list, const char *path, const struct stat *st)
+{
+    BuildFile *f = NULL;
+
+    if (list->length == list->allocd) {
+        list->allocd = list->allocd ? list->allocd * 2 : 1024;
+        list->files  = realloc(list->files, list->allocd * sizeof(BuildFile));
+        if (!list->files) throw_fatal_memory_error();
+    }
+
+    f = &list->files[list->length++];
+    memset(f, 0, sizeof(BuildFile));
+    if (!(f->path = strdup(path))) throw_fatal_memory_error();
+    if (st) {
+        f->size       = st->st_size;
+        f->mtime_sec  = st->st_mtim.tv_sec;
+        f->mtime_nsec = st->st_mtim.tv_nsec;
+    }
+}
+
+
+/** Free every file of a list. */
+static void free_files(FileList *list)
+{
+    size_t i = 0;
+
+    for (i = 0; i < list->length; i++) free(list->files[i].path);
+    free(list->files);
+}
+
+
+/**
+ * Add every Markdown file under a directory to a list.
+ *
+ * Symbolic links to files are followed, but links to directories are
+ * not, so the walk cannot loop.
+ *
+ * - parameter list: The list to add to.
+ * - parameter fd: The open directory, closed here.
+ * - parameter rel: The directory's path relative to the source, with
+ *   room for `PATH_MAX` bytes. It is restored before returning.
+ * - parameter length: The length of `rel`.
+ * - parameter skip: A directory never to walk: the output directory.
+ */
+static void walk_dir(FileList *list, const int fd, char *rel,
+                     const size_t length, const struct stat *skip)
+{
+    DIR *dir = fdopendir(fd);
+    struct dirent *ent = NULL;
+    struct stat st;
+    size_t name = 0;        /* Length of an entry's name. */
+    int sub = -1;
+
+    if (!dir) {
+        close(fd);
+        return;
+    }
+    while ((ent = readdir(dir))) {
+        if (ent->d_name[0] == '.') continue;
+        if (fstatat(fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) continue;
+        if (S_ISLNK(st.st_mode) &&
+            (fstatat(fd, ent->d_name, &st, 0) < 0 || !S_ISREG(st.st_mode))) {
+            continue;
+        }
+
+        name = strlen(ent->d_name);
+        if (length + name + 2 > 4096 || strchr(ent->d_name, '\n')) continue;
+        if (length > 0) rel[length] = '/';
+        memcpy(rel + length + (length > 0), ent->d_name, name + 1);
+
+        if (S_ISDIR(st.st_mode)) {
+            if (st.st_dev == skip->st_dev && st.st_ino == skip->st_ino) {
+                continue;
+            }
+            sub = openat(fd, ent->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (sub >= 0) {
+                walk_dir(list, sub, rel, length + (length > 0) + name, skip);
+            }
+        }
+        else if (S_ISREG(st.st_mode) && is_markdown(ent->d_name)) {
+            add_file(list, rel, &st);
+        }
+    }
+    rel[length] = '\0';
+    closedir(dir);
+}
+
+
+/************************************************************************
+ * # Manifests
+ *
+ *  A manifest is a text file with a header line, then one line for
+ *  each file: its hash in hex, its size, its modification time in
+ *  seconds and nanoseconds, and its path -- last, so it may hold
+ *  spaces.
+ *
+ ************************************************************************/
+
+/**
+ * Read the files of the manifest in an output directory.
+ *
+ * - parameter old: The list to add the manifest's files to.
+ * - parameter out: The output directory.
+ * - parameter opts: The options of this build.
+ *
+ * - returns: `true` if the manifest was built with the same options, so
+ *   its hashes can be trusted. Its paths are read either way, so the
+ *   outputs of deleted files can still be removed.
+ */
+static bool load_manifest(FileList *old, const char *out,
+                          const BuildOptions *opts)
+{
+    char *path = output_path(out, NULL, NULL);
+    char header[128];
+    char *line = NULL;
+    size_t allocd = 0;
+    ssize_t length = 0;
+    bool compatible = false;
+    FILE *fp = fopen(path, "r");
+
+    free(path);
+    if (!fp) return false;
+
+    snprintf(header, sizeof(header), MANIFEST_HEADER, opts->raw,
+             opts->excerpt_blocks, opts->excerpt_bytes, opts->excerpt_refs,
+             opts->only, opts->links);
+    if ((length = getline(&line, &allocd, fp)) > 0) {
+        compatible = (strcmp(line, header) == 0);
+    }
+
+    while ((length = getline(&line, &allocd, fp)) > 0) {
+        uint64_t hash[2];
+        long long size = 0;
+        long long sec  = 0;
+        long nsec = 0;
+        int at = 0;         /* Offset of the path in the line. */
+
+        if (line[length - 1] == '\n') line[--length] = '\0';
+        if (sscanf(line, "%16" SCNx64 "%16" SCNx64 " %lld %lld %ld %n",
+                   &hash[0], &hash[1], &size, &sec, &nsec, &at) < 5 ||
+            at == 0 || line[at] == '\0') {
+            continue;
+        }
+
+        add_file(old, line + at, NULL);
+        old->files[old->length - 1].hash[0]    = hash[0];
+        old->files[old->length - 1].hash[1]    = hash[1];
+        old->files[old->length - 1].size       = size;
+        old->files[old->length - 1].mtime_sec  = sec;
+        old->files[old->length - 1].mtime_nsec = nsec;
+    }
+    free(line);
+    fclose(fp);
+    return compatible;
+}
+
+
+/**
+ * Write the manifest of a build, replacing the old one at once.
+ *
+ * Files that failed are left out, so the next build tries them again.
+ *
+ * - returns: `false` if the manifest could not be written.
+ */
+static bool save_manifest(const FileList *list, const char *out,
+                          const BuildOptions *opts)
+{
+    char *path = output_path(out, NULL, NULL);
+    char *temp = malloc(strlen(path) + 5);
+    const BuildFile *f = NULL;
+    bool ok = false;
+    size_t i = 0;
+    FILE *fp = NULL;
+
+    if (!temp) throw_fatal_memory_error();
+    sprintf(temp, "%s.tmp", path);
+
+    if ((fp = fopen(temp, "w"))) {
+        fprintf(fp, MANIFEST_HEADER, opts->raw, opts->excerpt_blocks,
+                opts->excerpt_bytes, opts->excerpt_refs, opts->only,
+                opts->links);
+        for (i = 0; i < list->length; i++) {
+            f = &list->files[i];
+            if (f->state == FILE_FAILED) continue;
+            fprintf(fp, "%016" PRIx64 "%016" PRIx64 " %lld %lld %ld %s\n",
+                    f->hash[0], f->hash[1], f->size, f->mtime_sec,
+                    f->mtime_nsec, f->path);
+        }
+        ok = !ferror(fp);
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && rename(temp, path) == 0;
+        if (!ok) unlink(temp);
+    }
+    free(temp);
+    free(path);
+    return ok;
+}
+
+
+/************************************************************************
+ * # Output Files
+ ************************************************************************/
+
+/**
+ * Get the path of the output of a source file.
+ *
+ * - parameter out: The output directory.
+ * - parameter rel: The path of the source file relative to the source
+ *   directory, or `NULL` for the path of the manifest.
+ * - parameter ext: The extension of the output, such as `.html`.
+ *
+ * - returns: A new path, to be free'd, with the Markdown extension
+ *   replaced by `ext`.
+ */
+static char *output_path(const char *out, const char *rel,
+                         const char *ext)
+{
+    const char *name = rel ? rel : BUILD_MANIFEST;
+    size_t length = strlen(out) + strlen(name) + 2;
+    char *path = NULL;
+    char *dot  = NULL;
+
+    if (rel) length += strlen(ext);
+    if (!(path = malloc(length))) throw_fatal_memory_error();
+    else snprintf(path, length, "%s/%s", out, name);
+    if (rel && (dot = strrchr(path, '.'))) strcpy(dot, ext);
+    return path;
+}
+
+
+/** Check if the output of a source file exists. */
+static bool output_exists(const char *out, const char *rel,
+                          const char *ext)
+{
+    char *path = output_path(out, rel, ext);
+    bool exists = (access(path, F_OK) == 0);
+
+    free(path);
+    return exists;
+}
+
+
+/**
+ * Remove the output of a source file that no longer exists, along with
+ * any directories that it leaves empty.
+ */
+static void remove_output(const char *out, const char *rel,
+                          const char *ext)
+{
+    char *path = output_path(out, rel, ext);
+    size_t root = strlen(out);
+    char *slash = NULL;
+
+    unlink(path);
+    while ((slash = strrchr(path, '/')) && (size_t)(slash - path) > root) {
+        *slash = '\0';
+        if (rmdir(path) < 0) break;
+    }
+    free(path);
+}
+
+
+/**
+ * Create every missing directory of a path.
+ *
+ * - parameter path: The path of a file. It is modified while the
+ *   directories are made, then restored.
+ * - parameter from: The offset of the first directory that may be
+ *   missing.
+ */
+static void make_parents(char *path, const size_t from)
+{
+    char *slash = path + from;
+
+    while ((slash = strchr(slash + 1, '/'))) {
+        *slash = '\0';
+        mkdir(path, 0777);
+        *slash = '/';
+    }
+}
+
+
+/************************************************************************
+ * # Converting Files
+ ************************************************************************/
+
+/** Write rendered HTML to a file. */
+static void write_file(const uint8_t *data, const size_t length,
+                       void *userdata)
+{
+    fwrite(data, 1, length, userdata);
+}
+
+
+/**
+ * Read all of a file into memory.
+ *
+ * - returns: The contents, to be free'd, or `NULL` if the file could
+ *   not be read.
+ */
+static uint8_t *read_file(const char *path, size_t *length)
+{
+    uint8_t *data = NULL;
+    struct stat st;
+    ssize_t n = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    *length = 0;
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) < 0 || !(data = malloc(st.st_size + 1))) {
+        close(fd);
+        return NULL;
+    }
+    while (*length < (size_t)st.st_size &&
+           (n = read(fd, data + *length, st.st_size - *length)) > 0) {
+        *length += n;
+    }
+    close(fd);
+    if (n < 0) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+
+/** Append rendered output to a file's output in memory. */
+static void append_output(const uint8_t *data, const size_t length,
+                          void *userdata)
+{
+    Output *o = userdata;
+
+    if (!o->nomem && !try_append_span(o->str, data, length)) o->nomem = true;
+}
+
+
+/** Report why a file could not be converted, and mark it as failed. */
+static void fail_file(BuildFile *f, const char *src, const PdError error)
+{
+    fprintf(stderr, "ERROR: %s: %s.\n", src, pd_strerror(error));
+    f->state = FILE_FAILED;
+}
+
+
+/**
+ * Get the paths of a file of a build: its source, its output, and the
+ * temporary file written before the output.
+ *
+ * - throws fatal_memory_error: Memory could not be allocated.
+ */
+static void file_paths(const Build *b, const BuildFile *f, char **src,
+                       char **out, char **temp)
+{
+    *src  = malloc(strlen(b->src) + strlen(f->path) + 2);
+    *out  = output_path(b->out, f->path, b->ext);
+    *temp = malloc(strlen(*out) + 5);
+
+    if (!*src || !*temp) throw_fatal_memory_error();
+    sprintf(*src, "%s/%s", b->src, f->path);
+    sprintf(*temp, "%s.tmp", *out);
+}
+
+
+/**
+ * Check if the contents of a file that was read changed, and keep their
+ * hash if they did.
+ *
+ * - returns: `false` if the file's output is still up to date, which
+ *   marks it as touched.
+ */
+static bool has_changed(BuildFile *f, const char *out, const uint8_t *data,
+                        const size_t length)
+{
+    uint64_t hash[2];
+
+    hash_bytes(data, length, 0, hash);
+    if (f->known && hash[0] == f->hash[0] && hash[1] == f->hash[1] &&
+        access(out, F_OK) == 0) {
+        f->state = FILE_TOUCHED;
+        return false;
+    }
+    f->hash[0] = hash[0];
+    f->hash[1] = hash[1];
+    return true;
+}
+
+
+/**
+ * Convert a file that was read, writing its output to a sink.
+ *
+ * The links of a file are found without keeping its blocks, and
+ * written once the whole file is parsed, as its HTML is rendered.
+ *
+ * - returns: `false` if the file could not be converted, which marks it
+ *   as failed. Some of its links may have been written.
+ */
+static bool convert_file(const Build *b, BuildFile *f, const char *src,
+                         const uint8_t *data, const size_t length,
+                         const PdSink *sink)
+{
+    PdError error = PD_OK;
+    PdDoc *doc = NULL;
+
+    if (b->links) error = pd_extract_links(data, length, &b->opts, sink);
+    else {
+        doc = pd_parse(data, length, &b->opts);
+        if (!(error = pd_error(doc))) pd_render_html(doc, sink);
+        pd_free(doc);
+    }
+    if (error) {
+        fail_file(f, src, error);
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Convert a file whose stat changed, if its contents changed too.
+ *
+ * The output is written to a temporary file that is renamed over the
+ * old one, so the output is always either the old one or the new.
+ */
+static void check_file(Build *b, BuildFile *f)
+{
+    char *src  = NULL;
+    char *out  = NULL;
+    char *temp = NULL;
+    uint8_t *data = NULL;
+    size_t length = 0;
+    PdSink sink = { write_file, NULL };
+    FILE *fp = NULL;
+    bool ok = false;
+
+    file_paths(b, f, &src, &out, &temp);
+    if (!(data = read_file(src, &length))) {
+        fprintf(stderr, "ERROR: file could not be read: '%s'\n", src);
+        f->state = FILE_FAILED;
+        goto done;
+    }
+    if (!has_changed(f, out, data, length)) goto done;
+
+    make_parents(out, strlen(b->out));
+    if (!(fp = fopen(temp, "w"))) {
+        fprintf(stderr, "ERROR: file could not be opened: '%s'\n", temp);
+        f->state = FILE_FAILED;
+        goto done;
+    }
+    sink.userdata = fp;
+    if (!convert_file(b, f, src, data, length, &sink)) {
+        fclose(fp);
+        unlink(temp);
+        goto done;
+    }
+
+    ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(temp, out) < 0) {
+        fprintf(stderr, "ERROR: file could not be written: '%s'\n", out);
+        unlink(temp);
+        f->state = FILE_FAILED;
+    }
+    else f->state = FILE_CONVERTED;
+
+done:
+    free(data);
+    free(temp);
+    free(out);
+    free(src);
+}
+
+
+/** Check if two paths are in the same directory. */
+static bool same_dir(const char *a, const char *b)
+{
+    const char *slash = strrchr(a, '/');
+    size_t length = slash ? (size_t)(slash - a) : 0;
+
+    return !strncmp(a, b, length) && strrchr(b, '/') == b + length;
+}
+
+
+/**
+ * Convert a batch of files whose stat changed, if their contents
+ * changed too.
+ *
+ * Every file is read at once, each is converted into memory, and every
+ * output is then written at once -- as a temporary file renamed over
+ * the output. A file that the batch could not read, or whose size
+ * changed since the tree was walked, is checked on its own instead,
+ * which also reports why it failed.
+ */
+static void check_batch(Build *b, BatchIo *io, BuildFile **files,
+                        const size_t count)
+{
+    char *src[BUILD_BATCH];
+    char *out[BUILD_BATCH];
+    char *temp[BUILD_BATCH];
+    String *conv[BUILD_BATCH];  /* The contents of each output. */
+    size_t which[BUILD_BATCH];  /* The file of each output. */
+    IoFile in[BUILD_BATCH];
+    IoFile put[BUILD_BATCH];
+    Output output = { NULL, false };
+    PdSink sink = { append_output, &output };
+    const char *made = NULL;    /* The last output given its parents. */
+    size_t length = 0;
+    size_t n = 0;               /* Outputs to write. */
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        file_paths(b, files[i], &src[i], &out[i], &temp[i]);
+        in[i].path   = src[i];
+        in[i].temp   = NULL;
+        in[i].length = (size_t)files[i]->size;
+    }
+    read_batch(io, in, count);
+
+    for (i = 0; i < count; i++) {
+        if (in[i].error) {
+            check_file(b, files[i]);
+            continue;
+        }
+        length = in[i].length;
+        if (!has_changed(files[i], out[i], in[i].data, length)) continue;
+
+        /* Most HTML is a little longer than its Markdown; links are few. */
+        conv[n] = try_init_string(b->links ? 256 : length + length / 4 + 64);
+        if (!conv[n]) {
+            fail_file(files[i], src[i], PD_ERR_NOMEM);
+            continue;
+        }
+        output.str   = conv[n];
+        output.nomem = false;
+        if (!convert_file(b, files[i], src[i], in[i].data, length, &sink)) {
+            free_string(conv[n]);
+            continue;
+        }
+        if (output.nomem) {
+            fail_file(files[i], src[i], PD_ERR_NOMEM);
+            free_string(conv[n]);
+            continue;
+        }
+
+        if (!made || !same_dir(made, out[i])) {
+            make_parents(out[i], strlen(b->out));
+            made = out[i];
+        }
+        put[n].path   = out[i];
+        put[n].temp   = temp[i];
+        put[n].data   = conv[n]->data;
+        put[n].length = conv[n]->length;
+        which[n++] = i;
+    }
+    write_batch(io, put, n);
+
+    for (i = 0; i < n; i++) {
+        if (put[i].error) {
+            fprintf(stderr, "ERROR: file could not be written: '%s'\n",
+                    put[i].path);
+            files[which[i]]->state = FILE_FAILED;
+        }
+        else files[which[i]]->state = FILE_CONVERTED;
+        free_string(conv[i]);
+    }
+    for (i = 0; i < count; i++) {
+        free(in[i].data);
+        free(src[i]);
+        free(out[i]);
+        free(temp[i]);
+    }
+}
+
+
+/** Check files until every one has been taken. */
+static void *run_builder(void *arg)
+{
+    Build *b = arg;
+    BatchIo *io = NULL;
+    BuildFile *files[BUILD_BATCH];  /* The files of a batch. */
+    size_t take = b->batch ? b->batch : 1;
+    size_t next = 0;
+    size_t count = 0;
+    size_t i = 0;
+
+    if (b->batch) io = init_batch_io(b->batch, b->uring);
+    while (true) {
+        pthread_mutex_lock(&b->lock);
+        next = b->next;
+        b->next += (next < b->ntodo) ? take : 0;
+        pthread_mutex_unlock(&b->lock);
+
+        if (next >= b->ntodo) break;
+        if (!io) {
+            check_file(b, &b->list->files[b->todo[next]]);
+            continue;
+        }
+        count = (b->ntodo - next < take) ? b->ntodo - next : take;
+        for (i = 0; i < count; i++) {
+            files[i] = &b->list->files[b->todo[next + i]];
+        }
+        check_batch(b, io, files, count);
+    }
+    free_batch_io(io);
+    return NULL;
+}
@@ -0,0 +1,65 @@
+/**
+ * build.h -- incremental conversion of a directory tree
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef BUILD_DOT_H
+#define BUILD_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/************************************************************************
+ * # Directory Builds
+ ************************************************************************/
+
+/** The name of the manifest kept in the output directory. */
+#define BUILD_MANIFEST ".patdown-manifest"
+
+/** The ways a build can read and write its files. */
+typedef enum
+{
+    BUILD_IO_URING,     /* Default: batches, through io_uring if it can. */
+    BUILD_IO_PREAD,     /* Batches, with `pread()` and `pwrite()`. */
+    BUILD_IO_SINGLE     /* Each file on its own, as it is converted. */
+} buildio_t;
+
+/**
+ * A type to hold the options of a build.
+ *
+ * - member workers: Threads that convert files, or zero for one for
+ *   each online CPU.
+ * - member raw: Skip UTF-8 validation of the input.
+ * - member io: How files are read and written.
+ * - member excerpt_blocks: Convert only the leading blocks of each file,
+ *   or zero for every block -- see `PdOptions`.
+ * - member excerpt_bytes: Convert only the leading blocks that hold this
+ *   many bytes of text, or zero for every block.
+ * - member excerpt_refs: Keep the link reference definitions after an
+ *   excerpt.
+ * - member only: The kinds of block converted, as `PdOnly` bits, or
+ *   zero for every kind.
+ * - member links: Write the links of each file as lines of JSON, to a
+ *   `.jsonl` output, instead of its HTML -- see `pd_extract_links()`.
+ */
+typedef struct BuildOptions
+{
+    size_t workers;         /* Threads that convert files. */
+    bool raw;               /* Skip UTF-8 validation of the input. */
+    buildio_t io;           /* How files are read and written. */
+    size_t excerpt_blocks;  /* Blocks of text of each file. */
+    size_t excerpt_bytes;   /* Bytes of text of each file. */
+    bool excerpt_refs;      /* Keep the link definitions after them. */
+    unsigned only;          /* Kinds of block converted, or zero for all. */
+    bool links;             /* Write links as JSON lines, not HTML. */
+} BuildOptions;
+
+/** Convert every Markdown file of a tree that changed since last time. */
+int build_tree(const char *src, const char *out, const BuildOptions *opts);
+
+#endif
@@ -0,0 +1,393 @@
+/**
+ * cache.c -- a bounded, thread-safe cache of rendered documents
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "libpatdown.h"
+
+
+/************************************************************************
+ * # Render Caches
+ *
+ *  Templates, READMEs and boilerplate are rendered over and over from
+ *  the same bytes. A cache keeps their HTML, keyed by a 128-bit hash of
+ *  the input and the options it was parsed with, so a repeat costs a
+ *  hash and a copy instead of a parse.
+ *
+ *  The hash only picks where a document is kept. Each entry holds a
+ *  copy of its input, which a lookup compares byte for byte, so two
+ *  documents that hash the same -- by chance, or because a client of
+ *  the daemon crafted them to -- are never answered with each other's
+ *  HTML.
+ *
+ *  The cache is split into shards, each with its own lock, hash table
+ *  and least-recently-used list, and a document's shard is picked by
+ *  its hash. Threads rendering different documents then rarely wait on
+ *  one another. Each shard holds at most an equal part of the cache's
+ *  bytes, and evicts its least recently used documents to stay under.
+ *
+ *  An entry that is evicted while a reader still holds it is only
+ *  free'd when the reader releases it, so HTML can be written out of a
+ *  hit without holding any lock.
+ *
+ ************************************************************************/
+
+/** The number of shards; a power of two, picked by the top hash bits. */
+#define CACHE_SHARDS 16
+
+/** The number of buckets a shard's table starts with. */
+#define MIN_BUCKETS 64
+
+/** A lock and the entries it guards. */
+typedef struct Shard
+{
+    pthread_mutex_t lock;   /* Guards every other member. */
+    CacheEntry **buckets;   /* Chains of entries by hash. */
+    size_t nbuckets;        /* Number of buckets, a power of two. */
+    size_t entries;         /* Number of entries. */
+    CacheEntry *newest;     /* Entry used most recently. */
+    CacheEntry *oldest;     /* Entry used least recently. */
+    size_t bytes;           /* Bytes held by entries. */
+    size_t limit;           /* The cap on `bytes`. */
+    size_t hits;            /* Lookups that found a render. */
+    size_t misses;          /* Lookups that found nothing. */
+    size_t evictions;       /* Entries evicted to make room. */
+    char pad[64];           /* Keeps shards off each other's lines. */
+} Shard;
+
+/** A bounded cache of rendered documents, shared between threads. */
+struct PdCache
+{
+    Shard shards[CACHE_SHARDS];
+};
+
+
+/**
+ * Allocate an empty cache.
+ *
+ * A document is only cached if its HTML and its input fit in a single
+ * shard -- a sixteenth of the cache.
+ *
+ * - parameter max_bytes: The cap on the memory held by cached renders.
+ *
+ * - returns: A pointer to the new cache, to be free'd with
+ *   `pd_cache_free()`, or `NULL` if memory could not be allocated.
+ */
+PdCache *pd_cache_init(const size_t max_bytes)
+{
+    PdCache *cache = calloc(1, sizeof(PdCache));
+    size_t i = 0;
+
+    if (!cache) return NULL;
+    for (i = 0; i < CACHE_SHARDS; i++) {
+        pthread_mutex_init(&cache->shards[i].lock, NULL);
+        cache->shards[i].limit = max_bytes / CACHE_SHARDS;
+    }
+    return cache;
+}
+
+
+/**
+ * Free a cache and every render it holds, if it exists.
+ *
+ * No other thread may be using the cache.
+ *
+ * - parameter cache: The cache to be free'd.
+ */
+void pd_cache_free(PdCache *cache)
+{
+    CacheEntry *e = NULL;
+    size_t i = 0;
+
+    if (!cache) return;
+    for (i = 0; i < CACHE_SHARDS; i++) {
+        Shard *s = &cache->shards[i];
+        while ((e = s->oldest)) {
+            s->oldest = e->newer;
+            free(e);
+        }
+        free(s->buckets);
+        pthread_mutex_destroy(&s->lock);
+    }
+    free(cache);
+}
+
+
+/**
+ * Get the counters of a cache.
+ *
+ * - parameter cache: The cache.
+ * - parameter stats: Receives the counters, summed over every shard.
+ */
+void pd_cache_stats(PdCache *cache, PdCacheStats *stats)
+{
+    size_t i = 0;
+
+    memset(stats, 0, sizeof(PdCacheStats));
+    for (i = 0; i < CACHE_SHARDS; i++) {
+        Shard *s = &cache->shards[i];
+        pthread_mutex_lock(&s->lock);
+        stats->hits      += s->hits;
+        stats->misses    += s->misses;
+        stats->evictions += s->evictions;
+        stats->entries   += s->entries;
+        stats->bytes     += s->bytes;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+
+/**
+ * Identify a document by its input bytes and options.
+ *
+ * Only the options that can change the output are kept: `max_input`
+ * is checked against the length before the cache is used, and a
+ * `max_depth` of zero is the default depth.
+ *
+ * - parameter key: Receives the key, which points to the input until it
+ *   is stored with a render.
+ * - parameter data: The first byte of the input.
+ * - parameter length: The number of bytes of input.
+ * - parameter opts: The options of the parse, or `NULL` for defaults.
+ */
+void make_cache_key(CacheKey *key, const uint8_t *data, const size_t length,
+                    const PdOptions *opts)
+{
+    memset(key, 0, sizeof(CacheKey));
+    hash_bytes(data, length, 0, key->hash);
+    key->data   = data;
+    key->length = length;
+
+    if (opts) key->opts = *opts;
+    key->opts.max_input = 0;
+    if (key->opts.max_depth == 0) key->opts.max_depth = PD_DEFAULT_MAX_DEPTH;
+}
+
+
+/**
+ * Compare two keys -- member by member, since options have padding,
+ * and then by their input bytes.
+ */
+static bool same_key(const CacheKey *a, const CacheKey *b)
+{
+    return a->hash[0] == b->hash[0] && a->hash[1] == b->hash[1] &&
+           a->length == b->length &&
+           a->opts.raw == b->opts.raw &&
+           a->opts.max_blocks == b->opts.max_blocks &&
+           a->opts.max_depth == b->opts.max_depth &&
+           a->opts.max_arena == b->opts.max_arena &&
+           a->opts.excerpt_blocks == b->opts.excerpt_blocks &&
+           a->opts.excerpt_bytes == b->opts.excerpt_bytes &&
+           a->opts.excerpt_refs == b->opts.excerpt_refs &&
+           a->opts.only == b->opts.only &&
+           (a->length == 0 || !memcmp(a->data, b->data, a->length));
+}
+
+
+/** Get the bytes an entry holds: its output and its input. */
+static size_t entry_size(const CacheEntry *e)
+{
+    return sizeof(CacheEntry) + e->length + e->key.length;
+}
+
+
+/** Get the shard a key belongs to. */
+static Shard *shard_of(PdCache *cache, const CacheKey *key)
+{
+    return &cache->shards[key->hash[1] >> 60];
+}
+
+
+/** Get the bucket of a key in a shard's table of entries. */
+static CacheEntry **bucket_of(Shard *s, const CacheKey *key)
+{
+    return &s->buckets[key->hash[0] & (s->nbuckets - 1)];
+}
+
+
+/** Find the entry of a key in a shard, or return `NULL`. */
+static CacheEntry *find_entry(Shard *s, const CacheKey *key)
+{
+    CacheEntry *e = NULL;
+
+    if (s->nbuckets == 0) return NULL;
+    for (e = *bucket_of(s, key); e; e = e->chain) {
+        if (same_key(&e->key, key)) break;
+    }
+    return e;
+}
+
+
+/** Remove an entry from a shard's least-recently-used list. */
+static void unlink_entry(Shard *s, CacheEntry *e)
+{
+    if (e->newer) e->newer->older = e->older;
+    else s->newest = e->older;
+    if (e->older) e->older->newer = e->newer;
+    else s->oldest = e->newer;
+}
+
+
+/** Add an entry as the most recently used of a shard. */
+static void push_entry(Shard *s, CacheEntry *e)
+{
+    e->newer = NULL;
+    e->older = s->newest;
+    if (s->newest) s->newest->newer = e;
+    else s->oldest = e;
+    s->newest = e;
+}
+
+
+/**
+ * Find and hold a rendered document.
+ *
+ * A hit becomes the most recently used entry of its shard.
+ *
+ * - parameter cache: The cache to look in.
+ * - parameter key: The document.
+ *
+ * - returns: The rendered document, which stays valid until it is
+ *   passed to `release_render()` -- or `NULL` if it is not cached.
+ */
+const CacheEntry *find_render(PdCache *cache, const CacheKey *key)
+{
+    Shard *s = shard_of(cache, key);
+    CacheEntry *e = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    if ((e = find_entry(s, key))) {
+        e->refs++;
+        s->hits++;
+        unlink_entry(s, e);
+        push_entry(s, e);
+    }
+    else s->misses++;
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+
+/**
+ * Stop holding a rendered document returned by `find_render()`.
+ *
+ * - parameter cache: The cache it was found in.
+ * - parameter entry: The rendered document.
+ */
+void release_render(PdCache *cache, const CacheEntry *entry)
+{
+    CacheEntry *e = (CacheEntry *)entry;
+    Shard *s = shard_of(cache, &e->key);
+    bool last = false;      /* The entry was evicted and this is the end. */
+
+    pthread_mutex_lock(&s->lock);
+    last = (--e->refs == 0);
+    pthread_mutex_unlock(&s->lock);
+    if (last) free(e);
+}
+
+
+/** Evict the least recently used entry of a shard. */
+static void evict_oldest(Shard *s)
+{
+    CacheEntry *e = s->oldest;
+    CacheEntry **at = bucket_of(s, &e->key);
+
+    while (*at != e) at = &(*at)->chain;
+    *at = e->chain;
+    unlink_entry(s, e);
+
+    s->bytes -= entry_size(e);
+    s->entries--;
+    s->evictions++;
+    if (--e->refs == 0) free(e);
+}
+
+
+/**
+ * Double the buckets of a shard's table, or make its first ones.
+ *
+ * - returns: `false` if memory could not be allocated. The table is
+ *   then unchanged, and still usable if it has any buckets.
+ */
+static bool grow_buckets(Shard *s)
+{
+    size_t count = s->nbuckets ? s->nbuckets * 2 : MIN_BUCKETS;
+    CacheEntry **buckets = calloc(count, sizeof(CacheEntry *));
+    CacheEntry *e = NULL;
+
+    if (!buckets) return false;
+
+    /* Every entry is on the list, so rebuild the chains from it. */
+    for (e = s->oldest; e; e = e->newer) {
+        CacheEntry **at = &buckets[e->key.hash[0] & (count - 1)];
+        e->chain = *at;
+        *at = e;
+    }
+    free(s->buckets);
+    s->buckets  = buckets;
+    s->nbuckets = count;
+    return true;
+}
+
+
+/**
+ * Store a copy of a rendered document, and of its input.
+ *
+ * Caching is best-effort: a document larger than a shard, or one that
+ * memory cannot be found for, is simply not stored.
+ *
+ * - parameter cache: The cache to store it in.
+ * - parameter key: The document, still pointing to its input.
+ * - parameter html: The rendered output.
+ * - parameter length: The number of bytes in `html`.
+ */
+void store_render(PdCache *cache, const CacheKey *key, const uint8_t *html,
+                  const size_t length)
+{
+    Shard *s = shard_of(cache, key);
+    size_t size = sizeof(CacheEntry) + length + key->length;
+    CacheEntry *e = NULL;
+    CacheEntry **at = NULL;
+
+    if (size > s->limit || !(e = malloc(size))) return;
+    e->key    = *key;
+    e->refs   = 1;
+    e->length = length;
+    memcpy(e->html, html, length);
+    if (key->length) memcpy(e->html + length, key->data, key->length);
+    e->key.data = e->html + length;
+
+    pthread_mutex_lock(&s->lock);
+
+    /* Another thread may have rendered the same document meanwhile. */
+    if (find_entry(s, key) ||
+        (s->entries >= s->nbuckets && !grow_buckets(s) && !s->nbuckets)) {
+        pthread_mutex_unlock(&s->lock);
+        free(e);
+        return;
+    }
+
+    at = bucket_of(s, key);
+    e->chain = *at;
+    *at = e;
+    push_entry(s, e);
+    s->bytes += size;
+    s->entries++;
+
+    while (s->bytes > s->limit) evict_oldest(s);
+    pthread_mutex_unlock(&s->lock);
+}
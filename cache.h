@@ -0,0 +1,72 @@
+/**
+ * cache.h -- a bounded, thread-safe cache of rendered documents
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef CACHE_DOT_H
+#define CACHE_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libpatdown.h"
+
+/************************************************************************
+ * # Render Caches
+ ************************************************************************/
+
+/**
+ * A type to identify a rendered document.
+ *
+ * - member hash: The 128-bit hash of the input bytes.
+ * - member data: The input bytes, compared byte for byte on a lookup.
+ * - member length: The number of input bytes.
+ * - member opts: The options the document was parsed with.
+ */
+typedef struct CacheKey
+{
+    uint64_t hash[2];       /* Hash of the input bytes. */
+    const uint8_t *data;    /* The input bytes. */
+    size_t length;          /* Number of input bytes. */
+    PdOptions opts;         /* Options the document was parsed with. */
+} CacheKey;
+
+/**
+ * A type to hold a rendered document in a cache.
+ *
+ * - member html: The rendered output, followed by the copy of the input
+ *   that `key` points to.
+ * - member length: The number of bytes of output in `html`.
+ */
+typedef struct CacheEntry
+{
+    struct CacheEntry *chain;   /* Next entry of the same bucket. */
+    struct CacheEntry *newer;   /* Entry used more recently. */
+    struct CacheEntry *older;   /* Entry used less recently. */
+    CacheKey key;               /* The document that was rendered. */
+    size_t refs;                /* Readers of `html`, plus the cache. */
+    size_t length;              /* Bytes of output in `html`. */
+    uint8_t html[];             /* The rendered output, then the input. */
+} CacheEntry;
+
+/** Identify a document by its input bytes and options. */
+void make_cache_key(CacheKey *key, const uint8_t *data, const size_t length,
+                    const PdOptions *opts);
+
+/** Find and hold a rendered document, or return `NULL` on a miss. */
+const CacheEntry *find_render(PdCache *cache, const CacheKey *key);
+
+/** Stop holding a rendered document returned by `find_render()`. */
+void release_render(PdCache *cache, const CacheEntry *entry);
+
+/** Store a copy of a rendered document, evicting others to make room. */
+void store_render(PdCache *cache, const CacheKey *key, const uint8_t *html,
+                  const size_t length);
+
+#endif
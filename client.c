@@ -0,0 +1,430 @@
+/**
+ * client.c -- a client and load generator for `patdown --serve`
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#define _GNU_SOURCE     /* Sockets and clock_gettime(). */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libpatdown.h"
+#include "serve.h"
+
+static const char *_program = "pdclient";
+
+/** Print the help dialog. */
+static void print_help()
+{
+    printf("%s -- a client for `patdown --serve`\n", _program);
+    printf("\n");
+    printf("  USAGE: %s [options <arg>] <socket> [<inputfile>]\n", _program);
+    printf("\n");
+    printf("  OPTIONS:\n");
+    printf("  -c <count>       Connections, each on a thread [default: 1]\n");
+    printf("  -h, --help       Show help\n");
+    printf("  -n <count>       Requests to send [default: 1]\n");
+    printf("  -p <depth>       Requests in flight per connection "
+           "[default: 1]\n");
+    printf("  -q               Don't print the responses\n");
+    printf("  -s               Print the server's stats\n");
+    printf("\n");
+    printf("  A single request prints its response. Any more print a\n");
+    printf("  summary of the throughput and latency that was measured.\n");
+    printf("\n");
+}
+
+
+/************************************************************************
+ * # Sockets
+ ************************************************************************/
+
+/**
+ * Connect to the socket of a server.
+ *
+ * - returns: The connected socket, or -1 with a message printed.
+ */
+static int connect_socket(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "ERROR: could not connect to '%s': %s\n",
+                path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/** Write every byte of a buffer, or return `false`. */
+static bool write_all(const int fd, const uint8_t *data, size_t length)
+{
+    ssize_t n = 0;
+
+    while (length > 0) {
+        if ((n = write(fd, data, length)) < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data   += n;
+        length -= n;
+    }
+    return true;
+}
+
+
+/** Read exactly length bytes, or return `false` at the end of input. */
+static bool read_all(const int fd, uint8_t *data, size_t length)
+{
+    ssize_t n = 0;
+
+    while (length > 0) {
+        if ((n = read(fd, data, length)) <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return false;
+        }
+        data   += n;
+        length -= n;
+    }
+    return true;
+}
+
+
+/** Send a request of some kind with a body. */
+static bool send_request(const int fd, const request_t kind,
+                         const uint8_t *body, const size_t length)
+{
+    uint8_t header[SERVE_HEADER];
+
+    pack_header(header, (uint8_t)kind, (uint32_t)length);
+    return write_all(fd, header, sizeof(header)) &&
+           write_all(fd, body, length);
+}
+
+
+/**
+ * Read the next response into a buffer, growing it as needed.
+ *
+ * - returns: `false` if the connection ended or memory ran out.
+ */
+static bool read_response(const int fd, uint8_t *status, uint8_t **body,
+                          size_t *length, size_t *allocd)
+{
+    uint8_t header[SERVE_HEADER];
+    uint8_t *grown = NULL;
+
+    if (!read_all(fd, header, sizeof(header))) return false;
+    *status = header[0];
+    *length = unpack_length(header);
+
+    if (*length > *allocd) {
+        if (!(grown = realloc(*body, *length))) return false;
+        *body   = grown;
+        *allocd = *length;
+    }
+    return read_all(fd, *body, *length);
+}
+
+
+/************************************************************************
+ * # Load Generation
+ ************************************************************************/
+
+/** The work and the measurements of a single connection. */
+typedef struct Load
+{
+    pthread_t thread;       /* The thread driving the connection. */
+    const char *path;       /* The socket of the server. */
+    const uint8_t *doc;     /* The document sent with every request. */
+    size_t length;          /* Bytes in `doc`. */
+    size_t requests;        /* Requests to send. */
+    size_t depth;           /* Requests in flight at once. */
+    size_t errors;          /* Responses with an error status. */
+    size_t bytes;           /* Bytes of responses received. */
+    bool failed;            /* The connection broke. */
+    Histogram latency;      /* Time from sending to receiving. */
+} Load;
+
+
+/** Get the microseconds between two times. */
+static uint64_t elapsed_usec(const struct timespec *from,
+                             const struct timespec *to)
+{
+    return (uint64_t)(to->tv_sec - from->tv_sec) * 1000000 +
+           (to->tv_nsec - from->tv_nsec) / 1000;
+}
+
+
+/**
+ * Send a connection's requests, keeping up to `depth` in flight, and
+ * time each one until its response arrives.
+ */
+static void *run_load(void *arg)
+{
+    Load *ld = arg;
+    struct timespec *sent_at = calloc(ld->depth, sizeof(struct timespec));
+    struct timespec now;
+    uint8_t *body = NULL;
+    size_t allocd = 0;
+    size_t length = 0;
+    size_t sent = 0;
+    size_t received = 0;
+    uint8_t status = 0;
+    int fd = connect_socket(ld->path);
+
+    if (fd < 0 || !sent_at) {
+        ld->failed = true;
+        free(sent_at);
+        return NULL;
+    }
+
+    while (received < ld->requests) {
+        while (sent < ld->requests && sent - received < ld->depth) {
+            clock_gettime(CLOCK_MONOTONIC, &sent_at[sent % ld->depth]);
+            if (!send_request(fd, REQUEST_RENDER, ld->doc, ld->length)) {
+                ld->failed = true;
+                goto done;
+            }
+            sent++;
+        }
+        if (!read_response(fd, &status, &body, &length, &allocd)) {
+            ld->failed = true;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        record_latency(&ld->latency,
+                       elapsed_usec(&sent_at[received % ld->depth], &now));
+        if (status != PD_OK) ld->errors++;
+        ld->bytes += SERVE_HEADER + length;
+        received++;
+    }
+
+done:
+    close(fd);
+    free(sent_at);
+    free(body);
+    return NULL;
+}
+
+
+/**
+ * Drive a server with the same document from a number of connections,
+ * and print what was measured.
+ *
+ * - returns: `EXIT_SUCCESS` if every request got a response.
+ */
+static int generate_load(const char *path, const uint8_t *doc,
+                         const size_t length, const size_t requests,
+                         const size_t conns, const size_t depth)
+{
+    Load *loads = calloc(conns, sizeof(Load));
+    Histogram total;
+    struct timespec start, end;
+    size_t errors = 0;
+    size_t bytes  = 0;
+    size_t i = 0;
+    bool failed = false;
+    double secs = 0;
+
+    if (!loads) {
+        fprintf(stderr, "FATAL: memory could not be allocated\n");
+        return EXIT_FAILURE;
+    }
+    memset(&total, 0, sizeof(total));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < conns; i++) {
+        loads[i].path     = path;
+        loads[i].doc      = doc;
+        loads[i].length   = length;
+        loads[i].requests = requests / conns + (i < requests % conns);
+        loads[i].depth    = depth;
+        pthread_create(&loads[i].thread, NULL, run_load, &loads[i]);
+    }
+    for (i = 0; i < conns; i++) {
+        pthread_join(loads[i].thread, NULL);
+        merge_histogram(&total, &loads[i].latency);
+        errors += loads[i].errors;
+        bytes  += loads[i].bytes;
+        failed |= loads[i].failed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = elapsed_usec(&start, &end) / 1e6;
+
+    printf("requests     %zu\n", total.count);
+    printf("errors       %zu\n", errors);
+    printf("connections  %zu\n", conns);
+    printf("depth        %zu\n", depth);
+    printf("seconds      %.3f\n", secs);
+    printf("req/s        %.0f\n", total.count / secs);
+    printf("MB/s in      %.1f\n", total.count * (double)length / secs / 1e6);
+    printf("MB/s out     %.1f\n", bytes / secs / 1e6);
+    printf("p50_us       %llu\n",
+           (unsigned long long)latency_percentile(&total, 50));
+    printf("p90_us       %llu\n",
+           (unsigned long long)latency_percentile(&total, 90));
+    printf("p99_us       %llu\n",
+           (unsigned long long)latency_percentile(&total, 99));
+    printf("max_us       %llu\n", (unsigned long long)total.max);
+
+    free(loads);
+    if (failed) fprintf(stderr, "ERROR: a connection was broken\n");
+    return (failed || errors) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+/************************************************************************
+ * # Reading Input From Files
+ ************************************************************************/
+
+/** Read all of a file into memory, or return `NULL`. */
+static uint8_t *read_file(FILE *fp, size_t *length)
+{
+    uint8_t *data = NULL;
+    uint8_t *grown = NULL;
+    size_t allocd = 0;
+    size_t n = 0;
+
+    *length = 0;
+    do {
+        if (*length == allocd) {
+            allocd = allocd ? allocd * 2 : 65536;
+            if (!(grown = realloc(data, allocd))) {
+                free(data);
+                return NULL;
+            }
+            data = grown;
+        }
+        n = fread(data + *length, 1, allocd - *length, fp);
+        *length += n;
+    } while (n > 0);
+    return data;
+}
+
+
+/************************************************************************
+ * # Main Function
+ ************************************************************************/
+
+int main(int argc, char **argv)
+{
+    char *sockName  = NULL;         /* Socket of the server. */
+    char *iFileName = NULL;         /* Input file name. */
+    FILE *ifp       = stdin;        /* Input file stream. */
+    uint8_t *doc    = NULL;         /* The document to send. */
+    size_t length   = 0;            /* Bytes in `doc`. */
+    size_t requests = 1;            /* Requests to send. */
+    size_t conns    = 1;            /* Connections to send them on. */
+    size_t depth    = 1;            /* Requests in flight on each. */
+    int helpFlag    = 0;            /* Flag for help dialog. */
+    int quietFlag   = 0;            /* Flag to not print responses. */
+    int statsFlag   = 0;            /* Flag to request stats. */
+    uint8_t *body   = NULL;
+    size_t allocd   = 0;
+    uint8_t status  = 0;
+    int fd = -1;
+    int ret = EXIT_SUCCESS;
+
+    while (true) {
+        int optindex = 0;
+        const struct option long_opts[] = {
+          {"help",      no_argument,    &helpFlag,      1},
+          {0,           0,              0,              0},
+        };
+
+        int c = getopt_long(argc, argv, "c:hn:p:qs", long_opts, &optindex);
+        if (c == -1) break;
+
+        switch (c) {
+            case 'c': conns = strtoul(optarg, NULL, 10);    break;
+            case 'h': helpFlag = 1;                         break;
+            case 'n': requests = strtoul(optarg, NULL, 10); break;
+            case 'p': depth = strtoul(optarg, NULL, 10);    break;
+            case 'q': quietFlag = 1;                        break;
+            case 's': statsFlag = 1;                        break;
+            default: break;
+        }
+    }
+    if (optind < argc) sockName = argv[optind++];
+    if (optind < argc) iFileName = argv[optind++];
+
+    if (helpFlag || !sockName) {
+        print_help();
+        return helpFlag ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (conns == 0) conns = 1;
+    if (depth == 0) depth = 1;
+
+    if (statsFlag) {
+        if ((fd = connect_socket(sockName)) < 0) return EXIT_FAILURE;
+        if (!send_request(fd, REQUEST_STATS, NULL, 0) ||
+            !read_response(fd, &status, &body, &length, &allocd)) {
+            fprintf(stderr, "ERROR: the server closed the connection\n");
+            ret = EXIT_FAILURE;
+        }
+        else fwrite(body, 1, length, stdout);
+        close(fd);
+        free(body);
+        return ret;
+    }
+
+    if (iFileName && !(ifp = fopen(iFileName, "rb"))) {
+        fprintf(stderr, "FATAL: file could not be opened: '%s'\n",
+                iFileName);
+        return EXIT_FAILURE;
+    }
+    doc = read_file(ifp, &length);
+    if (iFileName) fclose(ifp);
+    if (!doc) {
+        fprintf(stderr, "FATAL: memory could not be allocated\n");
+        return EXIT_FAILURE;
+    }
+
+    if (requests > 1) {
+        ret = generate_load(sockName, doc, length, requests, conns, depth);
+        free(doc);
+        return ret;
+    }
+
+    if ((fd = connect_socket(sockName)) < 0) {
+        free(doc);
+        return EXIT_FAILURE;
+    }
+    if (!send_request(fd, REQUEST_RENDER, doc, length) ||
+        !read_response(fd, &status, &body, &length, &allocd)) {
+        fprintf(stderr, "ERROR: the server closed the connection\n");
+        ret = EXIT_FAILURE;
+    }
+    else if (status != PD_OK) {
+        fprintf(stderr, "ERROR: %s.\n", pd_strerror((PdError)status));
+        ret = EXIT_FAILURE;
+    }
+    else if (!quietFlag) fwrite(body, 1, length, stdout);
+
+    close(fd);
+    free(doc);
+    free(body);
+    return ret;
+}
@@ -0,0 +1,370 @@
+/**
+ * entities.c -- decoding of HTML5 character references
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "entities.h"
+
+
+/************************************************************************
+ * # Character References
+ *
+ *  A reference is either named, like `&copy;`, or numeric, like `&#169;`
+ *  or `&#xA9;`. HTML5 names 2,125 references, so the names are looked
+ *  up in a perfect hash that tools/mkentities.c generates from
+ *  entities.txt at build time: a name is hashed once, the seed of its
+ *  bucket is mixed in to pick its slot, and the name in that slot is
+ *  the only one it is compared with.
+ *
+ *  Most `&` in text start no reference at all, so they are rejected
+ *  before any hashing: a name must be letters and digits closed by a
+ *  `;`, and have one of the lengths that names have.
+ *
+ *  Numeric references to U+0000, to a surrogate, or past U+10FFFF stand
+ *  for U+FFFD, as CommonMark asks.
+ *
+ ************************************************************************/
+
+/** A named reference, and the UTF-8 it stands for. */
+typedef struct Entity
+{
+    uint16_t name;      /* Offset of the name in `entity_names`. */
+    uint8_t length;     /* Bytes of the name. */
+    uint8_t size;       /* Bytes of the UTF-8. */
+    uint8_t utf8[ENTITY_MAX_UTF8];  /* The UTF-8 it stands for. */
+} Entity;
+
+#include "entities.inc"
+
+#if ENTITY_LONGEST + 2 > ENTITY_MAX_LENGTH
+#error "entities.txt has a name longer than ENTITY_MAX_LENGTH allows"
+#endif
+
+/** The UTF-8 encoding of U+FFFD REPLACEMENT CHARACTER. */
+static const uint8_t replacement[] = { 0xEF, 0xBF, 0xBD };
+
+
+/** Check if a byte is an ASCII letter or digit. */
+static bool is_alnum(const uint8_t c)
+{
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+
+/** Get the value of a hex digit, or -1 if it is not one. */
+static int hex_value(const uint8_t c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') return (c | 0x20) - 'a' + 10;
+    return -1;
+}
+
+
+/** Hash a name -- 32-bit FNV-1a, as in tools/mkentities.c. */
+static uint32_t hash_name(const uint8_t *name, const size_t length)
+{
+    uint32_t h = UINT32_C(2166136261);
+    size_t i = 0;
+
+    for (i = 0; i < length; i++) h = (h ^ name[i]) * UINT32_C(16777619);
+    return h;
+}
+
+
+/** Mix the seed of a bucket into the hash of a name to pick its slot. */
+static uint32_t mix_slot(uint32_t h, const uint32_t seed)
+{
+    h ^= seed * UINT32_C(0x9e3779b9);
+    h ^= h >> 16;
+    h *= UINT32_C(0x85ebca6b);
+    h ^= h >> 13;
+    h *= UINT32_C(0xc2b2ae35);
+    h ^= h >> 16;
+    return h & (ENTITY_SLOTS - 1);
+}
+
+
+/**
+ * Look up a name.
+ *
+ * - returns: The reference of that name, or `NULL` if there is none.
+ */
+static const Entity *find_entity(const uint8_t *name, const size_t length)
+{
+    const Entity *e = NULL;
+    uint32_t h = 0;
+    uint16_t slot = 0;
+
+    if (length > ENTITY_LONGEST || !(ENTITY_LENGTHS >> length & 1)) {
+        return NULL;
+    }
+    h = hash_name(name, length);
+    slot = entity_slots[mix_slot(h, entity_seeds[h & (ENTITY_BUCKETS - 1)])];
+    if (!slot) return NULL;
+
+    e = &entity_list[slot - 1];
+    if (e->length != length || memcmp(entity_names + e->name, name, length)) {
+        return NULL;
+    }
+    return e;
+}
+
+
+/** Encode a code point as UTF-8, returning the bytes written. */
+static size_t encode_utf8(const uint32_t c, uint8_t *utf8)
+{
+    if (c < 0x80) {
+        utf8[0] = c;
+        return 1;
+    }
+    if (c < 0x800) {
+        utf8[0] = 0xC0 | (c >> 6);
+        utf8[1] = 0x80 | (c & 0x3F);
+        return 2;
+    }
+    if (c < 0x10000) {
+        utf8[0] = 0xE0 | (c >> 12);
+        utf8[1] = 0x80 | ((c >> 6) & 0x3F);
+        utf8[2] = 0x80 | (c & 0x3F);
+        return 3;
+    }
+    utf8[0] = 0xF0 | (c >> 18);
+    utf8[1] = 0x80 | ((c >> 12) & 0x3F);
+    utf8[2] = 0x80 | ((c >> 6) & 0x3F);
+    utf8[3] = 0x80 | (c & 0x3F);
+    return 4;
+}
+
+
+/**
+ * Decode a numeric reference: `&#` and up to seven decimal digits, or
+ * `&#x` and up to six hex digits, then `;`.
+ *
+ * - returns: The bytes of the reference, or zero if it is not one.
+ */
+static size_t decode_numeric(const uint8_t *data, const size_t length,
+                             uint8_t *utf8, size_t *size)
+{
+    bool hex = length > 2 && (data[2] | 0x20) == 'x';
+    size_t most  = hex ? 6 : 7;     /* Most digits. */
+    size_t first = hex ? 3 : 2;     /* Index of the first digit. */
+    size_t i = first;
+    uint32_t c = 0;
+    int digit = 0;
+
+    for (; i < length && i - first < most; i++) {
+        if (hex) digit = hex_value(data[i]);
+        else digit = (data[i] >= '0' && data[i] <= '9') ? data[i] - '0' : -1;
+        if (digit < 0) break;
+        c = c * (hex ? 16 : 10) + digit;
+    }
+    if (i == first || i == length || data[i] != ';') return 0;
+
+    if (c == 0 || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+        memcpy(utf8, replacement, sizeof(replacement));
+        *size = sizeof(replacement);
+    }
+    else *size = encode_utf8(c, utf8);
+    return i + 1;
+}
+
+
+/**
+ * Decode the character reference at the start of a span, if it is one.
+ *
+ * - parameter data: The span, starting with `&`.
+ * - parameter length: The bytes of the span.
+ * - parameter utf8: Receives the UTF-8 the reference stands for; room
+ *   for `ENTITY_MAX_UTF8` bytes.
+ * - parameter size: Receives the bytes written to `utf8`.
+ *
+ * - returns: The bytes of the reference, from `&` to `;`, or zero if
+ *   the span does not start with one.
+ */
+size_t decode_entity(const uint8_t *data, const size_t length,
+                     uint8_t *utf8, size_t *size)
+{
+    const Entity *e = NULL;
+    size_t i = 1;
+
+    if (length < 3 || data[0] != '&') return 0;
+    if (data[1] == '#') return decode_numeric(data, length, utf8, size);
+
+    /* Most text that follows a `&` is not a name closed by a `;`. */
+    while (i < length && i < ENTITY_MAX_LENGTH && is_alnum(data[i])) i++;
+    if (i == length || data[i] != ';') return 0;
+    if (!(e = find_entity(data + 1, i - 1))) return 0;
+
+    memcpy(utf8, e->utf8, e->size);
+    *size = e->size;
+    return i + 1;
+}
+
+
+/**
+ * Get the bytes at the end of a span that could start a reference, if
+ * the span were longer -- so the rest of a reference split between two
+ * spans can be decoded once the next one arrives.
+ *
+ * - parameter data: The span.
+ * - parameter length: The bytes of the span.
+ *
+ * - returns: The bytes of the unfinished reference at the end of the
+ *   span, from its `&`, or zero if there is none.
+ */
+size_t entity_prefix(const uint8_t *data, const size_t length)
+{
+    size_t from = (length > ENTITY_MAX_LENGTH) ? length - ENTITY_MAX_LENGTH
+                                               : 0;
+    size_t amp = length;        /* Index of the last `&`. */
+    size_t i = 0;
+
+    for (i = length; i > from; i--) {
+        if (data[i - 1] == '&') {
+            amp = i - 1;
+            break;
+        }
+    }
+    if (amp == length) return 0;
+
+    i = amp + 1;
+    if (i < length && data[i] == '#') {
+        i++;
+        if (i < length && (data[i] | 0x20) == 'x') i++;
+        while (i < length && hex_value(data[i]) >= 0) i++;
+    }
+    else while (i < length && is_alnum(data[i])) i++;
+    return (i == length) ? length - amp : 0;
+}
+
+
+/************************************************************************
+ * # Decoding Spans of Text
+ *
+ *  The parser reports the text of a block a span at a time, so a
+ *  reference may be split between two spans. A decoder holds the start
+ *  of a reference at the end of a span, and decodes it once the rest of
+ *  it arrives. Renderers differ only in how they write decoded text, so
+ *  each gives its decoder a sink that escapes the text as it needs.
+ *
+ ************************************************************************/
+
+/**
+ * Set up a decoder of text.
+ *
+ * - parameter d: The decoder.
+ * - parameter out: Where the decoded text is written.
+ */
+void init_decoder(Decoder *d, const PdSink *out)
+{
+    d->out  = *out;
+    d->held = 0;
+}
+
+
+/**
+ * Finish a character reference held from the last span of text with
+ * the start of the next.
+ *
+ * - parameter d: The decoder, holding the start of a reference.
+ * - parameter data: The next span of text.
+ * - parameter length: The bytes of the span.
+ * - parameter more: More text of the block may follow the span.
+ *
+ * - returns: The bytes of the span used to finish the reference. If it
+ *   is still unfinished, the whole span is held with it.
+ */
+size_t finish_reference(Decoder *d, const uint8_t *data, const size_t length,
+                        const bool more)
+{
+    uint8_t join[2 * ENTITY_MAX_LENGTH];    /* The held bytes, and more. */
+    uint8_t utf8[ENTITY_MAX_UTF8];
+    size_t take = (length < ENTITY_MAX_LENGTH) ? length : ENTITY_MAX_LENGTH;
+    size_t total = d->held + take;
+    size_t size = 0;
+    size_t n = 0;
+
+    if (d->held == 0) return 0;
+    memcpy(join, d->hold, d->held);
+    memcpy(join + d->held, data, take);
+
+    if ((n = decode_entity(join, total, utf8, &size))) {
+        d->out.write(utf8, size, d->out.userdata);
+        n -= d->held;
+        d->held = 0;
+        return n;
+    }
+    if (more && take == length && total <= ENTITY_MAX_LENGTH &&
+        entity_prefix(join, total) == total) {
+        memcpy(d->hold + d->held, data, length);
+        d->held = total;
+        return length;
+    }
+    flush_decoder(d);
+    return 0;
+}
+
+
+/**
+ * Write a span of text, decoding its character references.
+ *
+ * - parameter d: The decoder.
+ * - parameter data: The span of text.
+ * - parameter length: The bytes of the span.
+ * - parameter more: More text of the block may follow, so a reference
+ *   at the end of the span may be unfinished. It is held until the
+ *   next span, or until the decoder is flushed.
+ */
+void write_decoded(Decoder *d, const uint8_t *data, size_t length,
+                   const bool more)
+{
+    const uint8_t *end = NULL;
+    const uint8_t *amp = NULL;      /* The next `&`. */
+    uint8_t utf8[ENTITY_MAX_UTF8];
+    size_t size = 0;
+    size_t n = 0;
+
+    if (d->held) {
+        n = finish_reference(d, data, length, more);
+        if (d->held) return;
+        data   += n;
+        length -= n;
+    }
+    end = data + length;
+
+    while ((amp = memchr(data, '&', end - data))) {
+        if (amp > data) d->out.write(data, amp - data, d->out.userdata);
+        if ((n = decode_entity(amp, end - amp, utf8, &size))) {
+            d->out.write(utf8, size, d->out.userdata);
+            data = amp + n;
+            continue;
+        }
+        if (more && entity_prefix(amp, end - amp) == (size_t)(end - amp)) {
+            memcpy(d->hold, amp, end - amp);
+            d->held = end - amp;
+            return;
+        }
+        d->out.write(amp, 1, d->out.userdata);
+        data = amp + 1;
+    }
+    if (end > data) d->out.write(data, end - data, d->out.userdata);
+}
+
+
+/** Write the start of a reference that was never finished, as text. */
+void flush_decoder(Decoder *d)
+{
+    if (d->held == 0) return;
+    d->out.write(d->hold, d->held, d->out.userdata);
+    d->held = 0;
+}
@@ -0,0 +1,68 @@
+/**
+ * entities.h -- decoding of HTML5 character references
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef ENTITIES_DOT_H
+#define ENTITIES_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libpatdown.h"
+
+/************************************************************************
+ * # Character References
+ ************************************************************************/
+
+/** The most bytes of a reference: `&CounterClockwiseContourIntegral;`. */
+#define ENTITY_MAX_LENGTH 33
+
+/** The most bytes of UTF-8 a reference decodes to. */
+#define ENTITY_MAX_UTF8 8
+
+/** Decode the character reference at the start of a span, if it is one. */
+size_t decode_entity(const uint8_t *data, const size_t length,
+                     uint8_t *utf8, size_t *size);
+
+/** Get the bytes of a span that could start an unfinished reference. */
+size_t entity_prefix(const uint8_t *data, const size_t length);
+
+/**
+ * A type to decode the character references of text reported a span
+ * at a time, when a reference may be split between two spans.
+ *
+ * - member out: Where the decoded text is written, escaped as the
+ *   renderer needs it.
+ * - member hold: The start of a character reference at the end of the
+ *   last span of text, decoded once the rest of it arrives.
+ * - member held: The bytes of `hold`, or zero.
+ */
+typedef struct Decoder
+{
+    PdSink out;         /* Where the decoded text is written. */
+    uint8_t hold[ENTITY_MAX_LENGTH];    /* An unfinished reference. */
+    size_t held;        /* Bytes of `hold`. */
+} Decoder;
+
+/** Set up a decoder of text. */
+void init_decoder(Decoder *d, const PdSink *out);
+
+/** Finish a reference held from the last span with the start of the next. */
+size_t finish_reference(Decoder *d, const uint8_t *data, const size_t length,
+                        const bool more);
+
+/** Write a span of text, decoding its character references. */
+void write_decoded(Decoder *d, const uint8_t *data, size_t length,
+                   const bool more);
+
+/** Write the start of a reference that was never finished, as text. */
+void flush_decoder(Decoder *d);
+
+#endif
@@ -19,3 +19,26 @@ void throw_fatal_memory_error(void)
     fprintf(stderr, "FATAL: memory could not be allocated.\n");
     exit(EXIT_FAILURE);
 }
+
+
+/**
+ * Get a description of an error that stopped a parse.
+ *
+ * - parameter error: The error.
+ *
+ * - returns: A NULL-terminated description, which must not be modified.
+ */
+const char *pd_strerror(const PdError error)
+{
+    switch (error) {
+        case PD_OK:              return "no error";
+        case PD_ERR_NOMEM:       return "memory could not be allocated";
+        case PD_ERR_INPUT_LIMIT: return "input exceeds the maximum size";
+        case PD_ERR_BLOCK_LIMIT: return "too many blocks in the document";
+        case PD_ERR_DEPTH_LIMIT: return "blocks are nested too deeply";
+        case PD_ERR_ARENA_LIMIT: return "document exceeds its memory limit";
+        case PD_ERR_FORMAT:      return "not a saved document";
+        case PD_ERR_OPTIONS:     return "options of an unknown size";
+    }
+    return "unknown error";
+}
@@ -11,6 +11,9 @@
 #ifndef ERRORS_DOT_H
 #define ERRORS_DOT_H
 
+/* Errors that stop a parse are the library's `PdError`. */
+#include "libpatdown.h"
+
 /** Memory could not be allocated. */
 void throw_fatal_memory_error(void);
 
@@ -0,0 +1,637 @@
+/**
+ * extract.c -- extraction of the links of parsed blocks
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "autolink.h"
+#include "extract.h"
+#include "libpatdown.h"
+#include "patdown.h"
+#include "spans.h"
+#include "strings.h"
+#include "utf8.h"
+
+
+/************************************************************************
+ * # Link Extraction
+ *
+ *  The writer is a consumer of the parser's events, like the HTML
+ *  renderer, but it writes only the links of a document, each as a line
+ *  of JSON: its destination, the offset in the document it starts at,
+ *  and its kind.
+ *
+ *      {"dest":"https://a.b/c","offset":120,"kind":"link"}
+ *
+ *  A link reference definition (`ref`) is reported with its block, at
+ *  the offset the block starts at, which may be its indent. An
+ *  inline link (`link`), an image (`image`) or an autolink (`autolink`)
+ *  can only be found in the text of a paragraph or a header, which can
+ *  run over several lines -- so each span of their text is kept, as a
+ *  pointer into the parser's input, until the block ends. A block none
+ *  of whose spans holds a byte that can start a link is never searched,
+ *  and the spans of a block are only copied when there are several to
+ *  be joined. Code and raw HTML are never searched, and neither are code
+ *  spans or escapes: the spans of inline syntax are those the HTML
+ *  renderer finds, so it links what is reported here and nothing else.
+ *
+ *  A reference to a definition -- `[text][label]`, `[label][]` or
+ *  `[label]` -- is a link (`link` or `image`) only if some definition
+ *  has its label, which may come after it in the document. So every
+ *  link is kept, with a copy of its destination, until the document
+ *  ends; each reference is then given the destination of the first
+ *  definition of its label, and the links are written in the order
+ *  they were found. A reference to no definition is text, which may
+ *  hold an autolink of its own; a reference or an inline link whose
+ *  text holds another link is text around it. Labels are matched with
+ *  their whitespace collapsed and their ASCII letters folded to lower
+ *  case.
+ *
+ *  Each link is placed in the document by the Parser itself, which
+ *  knows where the content of a blockquote came from.
+ *
+ ************************************************************************/
+
+/** The metacharacters that can start a link, or give an autolink away. */
+#define LINK_META (META_BRACKET | META_ANGLE | META_COLON | META_AT | \
+                   META_WWW)
+
+/** The most bytes of a label, as a definition holds it. */
+#define MOST_LABEL 999
+
+static void scan_links(LinkWriter *w, const uint8_t *text, size_t at,
+                       const size_t to, const bool autolinks);
+static size_t place_link(LinkWriter *w, const size_t at);
+static void keep_link(LinkWriter *w, const char *kind, const char *prefix,
+                      const uint8_t *dest, const size_t length,
+                      const size_t offset, const bool label);
+static void keep_def(LinkWriter *w, const char *label);
+static void write_link(const LinkWriter *w, const char *kind,
+                       const char *prefix, const uint8_t *dest,
+                       const size_t length, const size_t offset);
+
+
+/** Check if a block's text is searched for links. */
+static bool is_prose(const mdblock_t type)
+{
+    return type == PARAGRAPH || type == SETEXT_HEADER_1 ||
+           type == SETEXT_HEADER_2 ||
+           (type >= ATX_HEADER_1 && type <= ATX_HEADER_6);
+}
+
+
+/** Start a block, keeping the destination of a link definition. */
+static PdError link_enter_block(const mdblock_t type, const void *info,
+                                const size_t start, void *userdata)
+{
+    LinkWriter *w = userdata;
+    const LinkRef *ref = info;
+
+    w->block  = type;
+    w->start  = start;
+    w->scan   = false;
+    w->count  = 0;
+    w->length = 0;
+    w->cursor = 0;
+    if (type == LINK_REFERENCE_DEF && ref) {
+        keep_link(w, "ref", "", (const uint8_t *)ref->dest,
+                  strlen(ref->dest), start, false);
+        keep_def(w, ref->label);
+    }
+    return w->error;
+}
+
+
+/** Keep each span of text of a block that may hold a link. */
+static PdError link_text(const uint8_t *data, const size_t length,
+                         void *userdata)
+{
+    LinkWriter *w = userdata;
+    size_t allocd = w->allocd ? w->allocd * 2 : 16;
+    TextSpan *spans = NULL;
+
+    if (!is_prose(w->block) || length == 0) return PD_OK;
+    if (w->count == w->allocd) {
+        if (!(spans = realloc(w->spans, allocd * sizeof(TextSpan)))) {
+            return PD_ERR_NOMEM;
+        }
+        w->spans  = spans;
+        w->allocd = allocd;
+    }
+
+    w->spans[w->count].data   = data;
+    w->spans[w->count].length = length;
+    w->spans[w->count].at     = w->length;
+    w->count++;
+    w->length += length;
+    if (!w->scan) w->scan = (scan_inlines(data, length) & LINK_META) != 0;
+    return PD_OK;
+}
+
+
+/** Search the text of a block for links once it has all been reported. */
+static PdError link_exit_block(const mdblock_t type, const size_t end,
+                               void *userdata)
+{
+    LinkWriter *w = userdata;
+    const uint8_t *text = NULL;
+    size_t i = 0;
+
+    (void)end;
+    if (!is_prose(type) || !w->scan) return PD_OK;
+    if (w->count == 1) text = w->spans[0].data;
+    else {
+        if (!w->joined && !(w->joined = try_init_string(w->length))) {
+            return PD_ERR_NOMEM;
+        }
+        w->joined->length = 0;
+        for (i = 0; i < w->count; i++) {
+            if (!try_append_span(w->joined, w->spans[i].data,
+                                 w->spans[i].length)) {
+                return PD_ERR_NOMEM;
+            }
+        }
+        text = w->joined->data;
+    }
+    scan_links(w, text, 0, w->length, true);
+    return w->error;
+}
+
+
+/**
+ * Get the callbacks that find each link of a document, to be written as
+ * a line of JSON by `finish_link_writer()` once the parse is done.
+ *
+ * The writer's `parser` must be set to the Parser the callbacks are
+ * given to before the parse starts.
+ *
+ * - parameter w: The writer state, initialized here.
+ * - parameter sink: Where the links are written.
+ *
+ * - returns: The callbacks.
+ */
+Callbacks link_callbacks(LinkWriter *w, const PdSink *sink)
+{
+    Callbacks cb = {
+        link_enter_block, link_text, link_exit_block, NULL, NULL
+    };
+
+    memset(w, 0, sizeof(LinkWriter));
+    w->sink  = *sink;
+    w->block = UNKNOWN;
+
+    cb.userdata = w;
+    return cb;
+}
+
+
+/** Free the memory held by a writer of links, but not the writer. */
+void free_link_writer(LinkWriter *w)
+{
+    free(w->spans);
+    free_string(w->joined);
+    free(w->links);
+    free(w->defs);
+    free_string(w->pool);
+}
+
+
+/************************************************************************
+ * ## Finding Links
+ ************************************************************************/
+
+/**
+ * Keep the links in a range of a block's text, in order, each followed
+ * by the links inside its text.
+ *
+ * - parameter text: The text of the block.
+ * - parameter at: The offset of the range.
+ * - parameter to: The offset after the range.
+ * - parameter autolinks: Keep autolinks and references, as well as
+ *   links and images. The text of an inline link holds neither.
+ */
+static void scan_links(LinkWriter *w, const uint8_t *text, size_t at,
+                       const size_t to, const bool autolinks)
+{
+    const size_t inside = w->inside;
+    InlineSpan span;
+    Autolink link;
+    size_t next = 0;        /* The offset of the next span, or `to`. */
+    bool found = false;
+
+    while (at < to) {
+        found = find_span(text, at, to, autolinks, &span);
+        next  = found ? span.start : to;
+
+        if (autolinks && find_autolink(text, next, at, next, &link)) {
+            keep_link(w, "autolink", autolink_prefix(link.type),
+                      text + link.text, link.length,
+                      place_link(w, link.start), false);
+            at = link.end;
+            continue;
+        }
+        if (!found) break;
+
+        switch (span.type) {
+            case SPAN_LINK:
+            case SPAN_IMAGE:
+                keep_link(w, (span.type == SPAN_IMAGE) ? "image" : "link",
+                          "", text + span.dest, span.dest_length,
+                          place_link(w, span.start), false);
+                scan_links(w, text, span.text, span.text + span.length,
+                           false);
+                break;
+            case SPAN_REF_LINK:
+            case SPAN_REF_IMAGE:
+                keep_link(w, (span.type == SPAN_REF_IMAGE) ? "image" : "link",
+                          "", text + span.label, span.label_length,
+                          place_link(w, span.start), true);
+                w->inside = w->link_count;
+                scan_links(w, text, span.text, span.text + span.length,
+                           true);
+                w->inside = inside;
+                break;
+            default:
+                break;
+        }
+        at = span.end;
+    }
+}
+
+
+/************************************************************************
+ * ## Keeping Links
+ ************************************************************************/
+
+/**
+ * Make room for one more item of an array.
+ *
+ * - returns: `false` if the memory could not be allocated.
+ */
+static bool grow_array(void **items, size_t *allocd, const size_t count,
+                       const size_t size)
+{
+    size_t more = *allocd ? *allocd * 2 : 16;
+    void *grown = NULL;
+
+    if (count < *allocd) return true;
+    if (!(grown = realloc(*items, more * size))) return false;
+    *items  = grown;
+    *allocd = more;
+    return true;
+}
+
+
+/**
+ * Normalize a label, so that two labels that match are the same bytes:
+ * each run of whitespace becomes a space, whitespace at either end is
+ * dropped, and ASCII letters are folded to lower case.
+ *
+ * - parameter out: Receives the label, which is never longer.
+ *
+ * - returns: The bytes of the normalized label.
+ */
+static size_t normalize_label(const uint8_t *data, const size_t length,
+                              uint8_t *out)
+{
+    bool space = false;     /* Whitespace since the last byte written. */
+    size_t n = 0;
+    size_t i = 0;
+
+    for (i = 0; i < length; i++) {
+        if (data[i] == ' ' || data[i] == '\t' || data[i] == '\r' ||
+            data[i] == '\n') {
+            space = (n > 0);
+            continue;
+        }
+        if (space) out[n++] = ' ';
+        space = false;
+        out[n++] = (data[i] >= 'A' && data[i] <= 'Z') ? data[i] + 0x20
+                                                      : data[i];
+    }
+    return n;
+}
+
+
+/**
+ * Keep a link found in the document, with a copy of its destination,
+ * until the document ends.
+ *
+ * - parameter kind: The kind of link: `ref`, `link`, `image` or
+ *   `autolink`.
+ * - parameter prefix: Written before the destination, as an autolink's
+ *   `mailto:`.
+ * - parameter dest: The destination, as it is in the text, or the label
+ *   of a reference.
+ * - parameter length: The bytes of the destination or label.
+ * - parameter offset: The offset in the document the link starts at.
+ * - parameter label: The link is a reference, to be resolved.
+ */
+static void keep_link(LinkWriter *w, const char *kind, const char *prefix,
+                      const uint8_t *dest, const size_t length,
+                      const size_t offset, const bool label)
+{
+    uint8_t norm[MOST_LABEL + 1];   /* The normalized label. */
+    FoundLink *l = NULL;
+    size_t n = 0;
+
+    if (w->error) return;
+    if (!grow_array((void **)&w->links, &w->link_allocd, w->link_count,
+                    sizeof(FoundLink)) ||
+        (!w->pool && !(w->pool = try_init_string(1024)))) {
+        w->error = PD_ERR_NOMEM;
+        return;
+    }
+    if (label) {
+        n = normalize_label(dest, (length < sizeof(norm)) ? length
+                                                          : sizeof(norm),
+                            norm);
+        dest = norm;
+    }
+    else n = length;
+
+    l = &w->links[w->link_count];
+    l->kind    = kind;
+    l->prefix  = prefix;
+    l->dest    = w->pool->length;
+    l->length  = n;
+    l->offset  = offset;
+    l->inside  = w->inside;
+    l->label   = label;
+    l->dropped = false;
+    if (!try_append_span(w->pool, dest, n)) {
+        w->error = PD_ERR_NOMEM;
+        return;
+    }
+    w->link_count++;
+}
+
+
+/**
+ * Keep the label of the definition that was just kept as a link, to
+ * resolve the references to it.
+ */
+static void keep_def(LinkWriter *w, const char *label)
+{
+    uint8_t norm[MOST_LABEL + 1];   /* The normalized label. */
+    LinkDef *d = NULL;
+
+    if (w->error) return;
+    if (!grow_array((void **)&w->defs, &w->def_allocd, w->def_count,
+                    sizeof(LinkDef))) {
+        w->error = PD_ERR_NOMEM;
+        return;
+    }
+    d = &w->defs[w->def_count];
+    d->key    = NULL;
+    d->label  = w->pool->length;
+    d->length = normalize_label((const uint8_t *)label,
+                                strlen(label), norm);
+    d->link   = w->link_count - 1;
+    if (!try_append_span(w->pool, norm, d->length)) {
+        w->error = PD_ERR_NOMEM;
+        return;
+    }
+    w->def_count++;
+}
+
+
+/************************************************************************
+ * ## Resolving References
+ ************************************************************************/
+
+/** Compare the labels of two definitions. */
+static int compare_labels(const void *a, const void *b)
+{
+    const LinkDef *x = a;
+    const LinkDef *y = b;
+    size_t n = (x->length < y->length) ? x->length : y->length;
+    int c = n ? memcmp(x->key, y->key, n) : 0;
+
+    if (c) return c;
+    return (x->length > y->length) - (x->length < y->length);
+}
+
+
+/** Compare two definitions by label, and then by their order. */
+static int compare_defs(const void *a, const void *b)
+{
+    const LinkDef *x = a;
+    const LinkDef *y = b;
+    int c = compare_labels(a, b);
+
+    if (c) return c;
+    return (x->link > y->link) - (x->link < y->link);
+}
+
+
+/**
+ * Sort the definitions by label, keeping only the first definition of
+ * each label.
+ */
+static void sort_defs(LinkWriter *w)
+{
+    size_t kept = 0;
+    size_t i = 0;
+
+    for (i = 0; i < w->def_count; i++) {
+        w->defs[i].key = w->pool->data + w->defs[i].label;
+    }
+    if (w->def_count > 1) {
+        qsort(w->defs, w->def_count, sizeof(LinkDef), compare_defs);
+    }
+    for (i = 0; i < w->def_count; i++) {
+        if (kept && !compare_labels(&w->defs[kept - 1], &w->defs[i])) {
+            continue;
+        }
+        w->defs[kept++] = w->defs[i];
+    }
+    w->def_count = kept;
+}
+
+
+/**
+ * Resolve a reference to the destination of its definition, or drop it
+ * if there is none.
+ */
+static void resolve_link(LinkWriter *w, FoundLink *l)
+{
+    LinkDef key = { NULL, 0, 0, 0 };
+    const LinkDef *def = NULL;
+    const FoundLink *ref = NULL;
+
+    key.key    = w->pool->data + l->dest;
+    key.length = l->length;
+    if (w->def_count) {
+        def = bsearch(&key, w->defs, w->def_count, sizeof(LinkDef),
+                      compare_labels);
+    }
+    if (!def) {
+        l->dropped = true;
+        return;
+    }
+    ref = &w->links[def->link];
+    l->dest   = ref->dest;
+    l->length = ref->length;
+    l->label  = false;
+}
+
+
+/** Check if a link is inside the text of a reference that is a link. */
+static bool in_reference(const LinkWriter *w, const FoundLink *l)
+{
+    size_t at = l->inside;
+
+    while (at) {
+        if (!w->links[at - 1].dropped) return true;
+        at = w->links[at - 1].inside;
+    }
+    return false;
+}
+
+
+/**
+ * Resolve the references of a document once it has been parsed, and
+ * write each of its links as a line of JSON, in the order they were
+ * found.
+ *
+ * The references are resolved from the last, so that a reference whose
+ * text holds a link is known before it is itself resolved. A link
+ * holds no link, but an image may, and an autolink inside the text of
+ * either is only text.
+ *
+ * - returns: `PD_OK`, or `PD_ERR_NOMEM` if some link could not be kept.
+ *   The links kept before it are written.
+ */
+PdError finish_link_writer(LinkWriter *w)
+{
+    FoundLink *l = NULL;
+    FoundLink *holder = NULL;   /* The reference whose text holds `l`. */
+    size_t i = 0;
+
+    if (w->link_count == 0) return w->error;
+    sort_defs(w);
+    for (i = w->link_count; i-- > 0;) {
+        l = &w->links[i];
+        if (l->label && !l->dropped) resolve_link(w, l);
+        if (l->dropped || !l->inside) continue;
+
+        holder = &w->links[l->inside - 1];
+        if (!strcmp(l->kind, "link") && !strcmp(holder->kind, "link")) {
+            holder->dropped = true;
+        }
+    }
+    for (i = 0; i < w->link_count; i++) {
+        l = &w->links[i];
+        if (l->dropped ||
+            (!strcmp(l->kind, "autolink") && in_reference(w, l))) {
+            continue;
+        }
+        write_link(w, l->kind, l->prefix, w->pool->data + l->dest,
+                   l->length, l->offset);
+    }
+    return w->error;
+}
+
+
+/************************************************************************
+ * ## Writing Links
+ ************************************************************************/
+
+/**
+ * Get the offset in the document of a byte of a block's text.
+ *
+ * Links are placed in the order they are found, so the search for the
+ * span that holds one starts at the span of the last.
+ *
+ * - parameter at: The offset of the byte in the text of the block.
+ */
+static size_t place_link(LinkWriter *w, const size_t at)
+{
+    const TextSpan *span = NULL;
+
+    if (!w->parser) return w->start;
+    if (w->cursor >= w->count || w->spans[w->cursor].at > at) w->cursor = 0;
+    while (w->cursor + 1 < w->count && w->spans[w->cursor + 1].at <= at) {
+        w->cursor++;
+    }
+    span = &w->spans[w->cursor];
+    return text_offset(w->parser, span->data + (at - span->at));
+}
+
+
+/** Write a NULL-terminated string to the sink. */
+static void write_string(const LinkWriter *w, const char *s)
+{
+    w->sink.write((const uint8_t *)s, strlen(s), w->sink.userdata);
+}
+
+
+/**
+ * Write bytes as the contents of a JSON string: quotes, backslashes and
+ * control characters escaped, and invalid UTF-8 replaced with U+FFFD.
+ */
+static void write_json(const LinkWriter *w, const uint8_t *data,
+                       const size_t length)
+{
+    char escape[8];
+    size_t valid = 0;       /* End of the valid UTF-8 ahead. */
+    size_t run = 0;         /* First byte not yet written. */
+    size_t i = 0;
+
+    while (i < length) {
+        valid = i + validate_utf8(data + i, length - i);
+        for (run = i; i < valid; i++) {
+            if (data[i] >= 0x20 && data[i] != '"' && data[i] != '\\') {
+                continue;
+            }
+            w->sink.write(data + run, i - run, w->sink.userdata);
+            if (data[i] == '"' || data[i] == '\\') {
+                snprintf(escape, sizeof(escape), "\\%c", data[i]);
+            }
+            else snprintf(escape, sizeof(escape), "\\u%04x", data[i]);
+            write_string(w, escape);
+            run = i + 1;
+        }
+        w->sink.write(data + run, i - run, w->sink.userdata);
+        if (i < length) {
+            write_string(w, data[i] ? "\\ufffd" : "\\u0000");
+            i++;
+        }
+    }
+}
+
+
+/**
+ * Write a link as a line of JSON.
+ *
+ * - parameter kind: The kind of link: `ref`, `link`, `image` or
+ *   `autolink`.
+ * - parameter prefix: Written before the destination, as an autolink's
+ *   `mailto:`.
+ * - parameter dest: The destination, as it is in the text.
+ * - parameter length: The bytes of the destination.
+ * - parameter offset: The offset in the document the link starts at.
+ */
+static void write_link(const LinkWriter *w, const char *kind,
+                       const char *prefix, const uint8_t *dest,
+                       const size_t length, const size_t offset)
+{
+    char tail[64];
+
+    write_string(w, "{\"dest\":\"");
+    write_string(w, prefix);
+    write_json(w, dest, length);
+    snprintf(tail, sizeof(tail), "\",\"offset\":%zu,\"kind\":\"%s\"}\n",
+             offset, kind);
+    write_string(w, tail);
+}
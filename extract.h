@@ -0,0 +1,150 @@
+/**
+ * extract.h -- extraction of the links of parsed blocks
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef EXTRACT_DOT_H
+#define EXTRACT_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libpatdown.h"
+#include "patdown.h"
+#include "strings.h"
+
+/************************************************************************
+ * # Link Extraction
+ ************************************************************************/
+
+/**
+ * A type to hold a span of a block's text, as the parser reported it.
+ *
+ * - member data: The bytes of the span, which the parser still holds.
+ * - member length: The bytes of the span.
+ * - member at: The offset of the span in the text of the block.
+ */
+typedef struct TextSpan
+{
+    const uint8_t *data;    /* The bytes, held by the parser. */
+    size_t length;          /* Bytes of the span. */
+    size_t at;              /* Offset of the span in the block's text. */
+} TextSpan;
+
+/**
+ * A type to hold a link found in a document, until every reference in
+ * it can be resolved.
+ *
+ * - member kind: The kind of link: `ref`, `link`, `image` or
+ *   `autolink`.
+ * - member prefix: Written before the destination, as an autolink's
+ *   `mailto:`.
+ * - member dest: The offset of the destination in the writer's `pool`,
+ *   or of the label of a reference not yet resolved.
+ * - member length: The bytes of the destination or label.
+ * - member offset: The offset in the document the link starts at.
+ * - member inside: One more than the index of the reference whose text
+ *   holds the link, or zero.
+ * - member label: The link is a reference not yet resolved.
+ * - member dropped: The link is not written: a reference to no
+ *   definition, or one whose text holds a link.
+ */
+typedef struct FoundLink
+{
+    const char *kind;       /* `ref`, `link`, `image` or `autolink`. */
+    const char *prefix;     /* Written before the destination. */
+    size_t dest;            /* Destination, or label, in `pool`. */
+    size_t length;          /* Bytes of the destination or label. */
+    size_t offset;          /* Offset in the document. */
+    size_t inside;          /* One more than the reference holding it. */
+    bool label;             /* A reference not yet resolved. */
+    bool dropped;           /* Not written. */
+} FoundLink;
+
+/**
+ * A type to hold a link reference definition, by its label.
+ *
+ * - member key: The label, once every definition has been found.
+ * - member label: The offset of the normalized label in `pool`.
+ * - member length: The bytes of the label.
+ * - member link: The index of the definition among the links found.
+ */
+typedef struct LinkDef
+{
+    const uint8_t *key;     /* The label, in `pool`. */
+    size_t label;           /* Offset of the label in `pool`. */
+    size_t length;          /* Bytes of the label. */
+    size_t link;            /* Index of the definition's link. */
+} LinkDef;
+
+/**
+ * A type to hold the state of a writer of links.
+ *
+ * The spans of a block that may hold a link are kept until it ends,
+ * without being copied -- they are joined only when there are several.
+ * The links found are kept until the document ends, when each
+ * reference is resolved against the definitions, and written in order.
+ *
+ * - member sink: Where each link is written, as a line of JSON.
+ * - member parser: The Parser reporting to the writer, which places
+ *   each span of text in the document.
+ * - member block: The block being parsed.
+ * - member start: The offset of the block in the document.
+ * - member scan: The block's text holds a byte that starts a link.
+ * - member spans: The spans of text of the block.
+ * - member count: The number of spans.
+ * - member allocd: The number of spans allocated.
+ * - member length: The bytes of text of the block.
+ * - member joined: The text of a block of several spans, or `NULL`.
+ * - member cursor: The span of the last link placed in the document.
+ * - member links: The links found in the document.
+ * - member link_count: The number of links.
+ * - member link_allocd: The number of links allocated.
+ * - member defs: The link reference definitions found.
+ * - member def_count: The number of definitions.
+ * - member def_allocd: The number of definitions allocated.
+ * - member pool: The destinations and labels of the links found.
+ * - member inside: One more than the index of the reference whose text
+ *   is searched, or zero.
+ * - member error: `PD_ERR_NOMEM` if a link could not be kept.
+ */
+typedef struct LinkWriter
+{
+    PdSink sink;            /* Where each link is written. */
+    const Parser *parser;   /* Places each span in the document. */
+    mdblock_t block;        /* Block being parsed. */
+    size_t start;           /* Offset of the block in the document. */
+    bool scan;              /* Text holds a byte that starts a link. */
+    TextSpan *spans;        /* Spans of text of the block. */
+    size_t count;           /* Number of spans. */
+    size_t allocd;          /* Number of spans allocated. */
+    size_t length;          /* Bytes of text of the block. */
+    String *joined;         /* Text of a block of several spans. */
+    size_t cursor;          /* Span of the last link placed. */
+    FoundLink *links;       /* Links found in the document. */
+    size_t link_count;      /* Number of links. */
+    size_t link_allocd;     /* Number of links allocated. */
+    LinkDef *defs;          /* Definitions found. */
+    size_t def_count;       /* Number of definitions. */
+    size_t def_allocd;      /* Number of definitions allocated. */
+    String *pool;           /* Destinations and labels of the links. */
+    size_t inside;          /* One more than the reference searched. */
+    PdError error;          /* A link could not be kept. */
+} LinkWriter;
+
+/** Get the callbacks that write each link of a document as JSON. */
+Callbacks link_callbacks(LinkWriter *w, const PdSink *sink);
+
+/** Resolve the references of a document, and write each of its links. */
+PdError finish_link_writer(LinkWriter *w);
+
+/** Free the memory held by a writer of links. */
+void free_link_writer(LinkWriter *w);
+
+#endif
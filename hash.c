@@ -0,0 +1,121 @@
+/**
+ * hash.c -- fast non-cryptographic hashing of byte strings
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hash.h"
+
+
+/************************************************************************
+ * # Hashing
+ *
+ *  This is MurmurHash3, in its x64 128-bit variant, by Austin Appleby,
+ *  who placed it in the public domain. It reads 16 bytes per round at
+ *  several bytes per cycle, so hashing a document costs a small part
+ *  of parsing it, and 128 bits make an accidental collision between
+ *  two documents vanishingly unlikely.
+ *
+ *  Blocks are loaded with `memcpy()`, which compilers turn into single
+ *  loads, so the input needs no alignment. The hash of the same bytes
+ *  differs between little- and big-endian machines, which is fine for
+ *  a key that never leaves the process.
+ *
+ ************************************************************************/
+
+/** Rotate a 64-bit word left by r bits. */
+static uint64_t rotl64(const uint64_t x, const int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+
+/** Mix the bits of a word so that every bit of input affects the rest. */
+static uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= UINT64_C(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= UINT64_C(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+    return k;
+}
+
+
+/**
+ * Hash a range of bytes to 128 bits.
+ *
+ * - parameter data: The first byte to hash.
+ * - parameter length: The number of bytes to hash.
+ * - parameter seed: Varies the hash, e.g. with the options a document
+ *   is rendered with.
+ * - parameter hash: Receives the hash, as two 64-bit halves.
+ */
+void hash_bytes(const uint8_t *data, const size_t length,
+                const uint64_t seed, uint64_t hash[2])
+{
+    const uint64_t c1 = UINT64_C(0x87c37b91114253d5);
+    const uint64_t c2 = UINT64_C(0x4cf5ad432745937f);
+    const uint8_t *tail = data + (length & ~(size_t)15);
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    for (; data < tail; data += 16) {
+        memcpy(&k1, data, sizeof(k1));
+        memcpy(&k2, data + 8, sizeof(k2));
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    /* The last 0-15 bytes, little-endian, as the reference does. */
+    k1 = 0;
+    k2 = 0;
+    switch (length & 15) {
+        case 15: k2 ^= (uint64_t)tail[14] << 48; /* fall through */
+        case 14: k2 ^= (uint64_t)tail[13] << 40; /* fall through */
+        case 13: k2 ^= (uint64_t)tail[12] << 32; /* fall through */
+        case 12: k2 ^= (uint64_t)tail[11] << 24; /* fall through */
+        case 11: k2 ^= (uint64_t)tail[10] << 16; /* fall through */
+        case 10: k2 ^= (uint64_t)tail[9] << 8;   /* fall through */
+        case  9: k2 ^= (uint64_t)tail[8];
+                 k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+                 /* fall through */
+        case  8: k1 ^= (uint64_t)tail[7] << 56;  /* fall through */
+        case  7: k1 ^= (uint64_t)tail[6] << 48;  /* fall through */
+        case  6: k1 ^= (uint64_t)tail[5] << 40;  /* fall through */
+        case  5: k1 ^= (uint64_t)tail[4] << 32;  /* fall through */
+        case  4: k1 ^= (uint64_t)tail[3] << 24;  /* fall through */
+        case  3: k1 ^= (uint64_t)tail[2] << 16;  /* fall through */
+        case  2: k1 ^= (uint64_t)tail[1] << 8;   /* fall through */
+        case  1: k1 ^= (uint64_t)tail[0];
+                 k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+                 break;
+        default: break;
+    }
+
+    h1 ^= (uint64_t)length;
+    h2 ^= (uint64_t)length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    hash[0] = h1;
+    hash[1] = h2;
+}
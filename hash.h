@@ -0,0 +1,25 @@
+/**
+ * hash.h -- fast non-cryptographic hashing of byte strings
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef HASH_DOT_H
+#define HASH_DOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/************************************************************************
+ * # Hashing
+ ************************************************************************/
+
+/** Hash a range of bytes to 128 bits, stored in two halves. */
+void hash_bytes(const uint8_t *data, const size_t length,
+                const uint64_t seed, uint64_t hash[2]);
+
+#endif
@@ -0,0 +1,425 @@
+/**
+ * html.c -- rendering of parsed blocks as HTML5
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "autolink.h"
+#include "entities.h"
+#include "html.h"
+#include "libpatdown.h"
+#include "patdown.h"
+#include "spans.h"
+#include "strings.h"
+
+
+/************************************************************************
+ * # HTML Rendering
+ *
+ *  The renderer is a consumer of the parser's events: each block is
+ *  opened with its tag when it is entered, its text is written as it is
+ *  reported, and the tag is closed when the block is exited. Text is only
+ *  buffered from the first byte of a block that may start a span of
+ *  inline syntax, so most blocks are rendered while they are still being
+ *  parsed.
+ *
+ *  Inlines are not parsed yet, so the text of every block is written
+ *  as-is, with the characters that are special to HTML escaped. Raw
+ *  HTML blocks are the only exception. Character references, like
+ *  `&copy;` or `&#169;`, are decoded to the characters they stand for,
+ *  and autolinks -- `<scheme:...>`, `www.`, `https://` and emails --
+ *  are written as links. Neither is done in code, where they are text
+ *  like any other.
+ *
+ *  Nor is an autolink written inside a span of inline syntax: a code
+ *  span, an escape, or a link or image, whose destination is no more a
+ *  link of its own than its text. A span can run over several lines, so
+ *  the spans are found in the whole text of the block, which is kept
+ *  from the first byte that may start one until the block is exited.
+ *
+ ************************************************************************/
+
+/** The metacharacters that can start a span of inline syntax. */
+#define SPAN_META (META_BACKTICK | META_BRACKET | META_BACKSLASH)
+
+static void write_tag(const Html *h, const char *tag);
+static void write_escaped(const Html *h, const uint8_t *data, size_t length);
+static void write_escaped_out(const uint8_t *data, const size_t length,
+                              void *userdata);
+static void write_text(Html *h, const uint8_t *data, size_t length,
+                       const bool more);
+static void keep_text(Html *h, const uint8_t *data, const size_t length);
+static void write_kept(Html *h);
+static int header_level(const mdblock_t type);
+
+
+/** Open the tag of each block that is entered. */
+static PdError html_enter_block(const mdblock_t type, const void *info,
+                                const size_t start, void *userdata)
+{
+    Html *h = userdata;
+    const CodeBlk *blk = info;
+    char tag[8];                /* An opening header tag. */
+
+    (void)start;
+    flush_decoder(&h->decoder);
+    h->block = type;
+    h->text  = false;
+    h->plain = false;
+    h->flat  = false;
+    if (h->kept) h->kept->length = 0;
+
+    switch (type) {
+        case ATX_HEADER_1:
+        case ATX_HEADER_2:
+        case ATX_HEADER_3:
+        case ATX_HEADER_4:
+        case ATX_HEADER_5:
+        case ATX_HEADER_6:
+        case SETEXT_HEADER_1:
+        case SETEXT_HEADER_2:
+            snprintf(tag, sizeof(tag), "<h%d>", header_level(type));
+            write_tag(h, tag);
+            break;
+        case PARAGRAPH:
+            write_tag(h, "<p>");
+            break;
+        case HORIZONTAL_RULE:
+            write_tag(h, "<hr>\n");
+            break;
+        case INDENTED_CODE_BLOCK:
+            write_tag(h, "<pre><code>");
+            break;
+        case FENCED_CODE_BLOCK:
+            if (blk->lang[0] == '\0') {
+                write_tag(h, "<pre><code>");
+                break;
+            }
+            write_tag(h, "<pre><code class=\"language-");
+            write_decoded(&h->decoder, blk->lang,
+                          strlen((const char *)blk->lang), false);
+            write_tag(h, "\">");
+            break;
+        case BLOCKQUOTE_START:
+            write_tag(h, "<blockquote>\n");
+            break;
+        default:
+            break;
+    }
+    return PD_OK;
+}
+
+
+/** Note a block whose text holds no inline metacharacter at all. */
+static PdError html_inlines(const uint16_t mask, void *userdata)
+{
+    Html *h = userdata;
+
+    h->plain = (mask == 0);
+    h->flat  = !(mask & SPAN_META);
+    return PD_OK;
+}
+
+
+/**
+ * Write each span of text: raw HTML as it is, code escaped, and the
+ * rest with its character references decoded -- unless it holds no
+ * metacharacter, when it is only escaped. Text that may hold a span of
+ * inline syntax is kept until the block is exited.
+ */
+static PdError html_text(const uint8_t *data, const size_t length,
+                         void *userdata)
+{
+    Html *h = userdata;
+
+    if (length == 0) return PD_OK;
+    h->text = true;
+
+    switch (h->block) {
+        case HTML_BLOCK:
+        case HTML_COMMENT:
+            h->sink.write(data, length, h->sink.userdata);
+            break;
+        case INDENTED_CODE_BLOCK:
+        case FENCED_CODE_BLOCK:
+            write_escaped(h, data, length);
+            break;
+        default:
+            if (h->plain) write_escaped(h, data, length);
+            else if (h->flat) write_text(h, data, length, true);
+            else keep_text(h, data, length);
+            break;
+    }
+    return PD_OK;
+}
+
+
+/** Close the tag of each block that is exited. */
+static PdError html_exit_block(const mdblock_t type, const size_t end,
+                               void *userdata)
+{
+    Html *h = userdata;
+    char tag[8];                /* A closing header tag. */
+
+    (void)end;
+    flush_decoder(&h->decoder);
+    write_kept(h);
+    switch (type) {
+        case ATX_HEADER_1:
+        case ATX_HEADER_2:
+        case ATX_HEADER_3:
+        case ATX_HEADER_4:
+        case ATX_HEADER_5:
+        case ATX_HEADER_6:
+        case SETEXT_HEADER_1:
+        case SETEXT_HEADER_2:
+            snprintf(tag, sizeof(tag), "</h%d>\n", header_level(type));
+            write_tag(h, tag);
+            break;
+        case PARAGRAPH:
+            write_tag(h, "</p>\n");
+            break;
+        case INDENTED_CODE_BLOCK:
+            /* The last line of an indented block has no newline. */
+            if (h->text) write_tag(h, "\n");
+            write_tag(h, "</code></pre>\n");
+            break;
+        case FENCED_CODE_BLOCK:
+            write_tag(h, "</code></pre>\n");
+            break;
+        case HTML_BLOCK:
+        case HTML_COMMENT:
+            if (h->text) write_tag(h, "\n");
+            break;
+        case BLOCKQUOTE_END:
+            write_tag(h, "</blockquote>\n");
+            break;
+        default:
+            break;
+    }
+    h->block = UNKNOWN;
+    return PD_OK;
+}
+
+
+/**
+ * Get the callbacks that render each block as HTML5.
+ *
+ * - parameter h: The renderer state, initialized here.
+ * - parameter sink: Where the HTML is written.
+ *
+ * - returns: The callbacks.
+ */
+Callbacks html_callbacks(Html *h, const PdSink *sink)
+{
+    Callbacks cb = {
+        html_enter_block, html_text, html_exit_block, html_inlines, NULL
+    };
+    PdSink out = { write_escaped_out, h };
+
+    h->sink  = *sink;
+    h->block = UNKNOWN;
+    h->text  = false;
+    h->plain = false;
+    h->flat  = false;
+    h->kept  = NULL;
+    init_decoder(&h->decoder, &out);
+
+    cb.userdata = h;
+    return cb;
+}
+
+
+/** Free the memory held by an HTML renderer, but not the renderer. */
+void free_html(Html *h)
+{
+    free_string(h->kept);
+    h->kept = NULL;
+}
+
+
+/** Write a NULL-terminated tag to the sink. */
+static void write_tag(const Html *h, const char *tag)
+{
+    h->sink.write((const uint8_t *)tag, strlen(tag), h->sink.userdata);
+}
+
+
+/**
+ * Write a span of text to the sink, escaping `&`, `<`, `>` and `"`.
+ *
+ * The runs of text between the special characters are written as they
+ * are, so most text is written with a single call.
+ */
+static void write_escaped(const Html *h, const uint8_t *data, size_t length)
+{
+    const uint8_t *end = data + length;
+    const uint8_t *run = data;      /* Start of the unescaped run. */
+    const char *entity = NULL;      /* Entity of the current byte. */
+
+    for (; data < end; data++) {
+        switch (*data) {
+            case '&': entity = "&amp;";  break;
+            case '<': entity = "&lt;";   break;
+            case '>': entity = "&gt;";   break;
+            case '"': entity = "&quot;"; break;
+            default: continue;
+        }
+        if (data > run) h->sink.write(run, data - run, h->sink.userdata);
+        write_tag(h, entity);
+        run = data + 1;
+    }
+    if (end > run) h->sink.write(run, end - run, h->sink.userdata);
+}
+
+
+/** Write decoded text to the sink of a renderer, escaped. */
+static void write_escaped_out(const uint8_t *data, const size_t length,
+                              void *userdata)
+{
+    write_escaped(userdata, data, length);
+}
+
+
+/** Check if a byte may be written as it is in the URL of a link. */
+static bool is_href_safe(const uint8_t c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || (c && strchr("-_.!~*'();/?:@=+$,%#", c));
+}
+
+
+/**
+ * Write the URL of a link to the sink: `&` is escaped, and any byte
+ * that may not be in a URL is percent-encoded.
+ */
+static void write_href(const Html *h, const uint8_t *data, size_t length)
+{
+    static const char *hex = "0123456789ABCDEF";
+    const uint8_t *end = data + length;
+    const uint8_t *run = data;      /* Start of the unencoded run. */
+    char code[4] = { '%', 0, 0, 0 };
+
+    for (; data < end; data++) {
+        if (is_href_safe(*data)) continue;
+        if (data > run) h->sink.write(run, data - run, h->sink.userdata);
+        if (*data == '&') write_tag(h, "&amp;");
+        else {
+            code[1] = hex[*data >> 4];
+            code[2] = hex[*data & 0xF];
+            write_tag(h, code);
+        }
+        run = data + 1;
+    }
+    if (end > run) h->sink.write(run, end - run, h->sink.userdata);
+}
+
+
+/** Write an autolink found in a span of text to the sink, as a link. */
+static void write_link(const uint8_t *data, const Autolink *link,
+                       void *userdata)
+{
+    const Html *h = userdata;
+
+    write_tag(h, "<a href=\"");
+    write_tag(h, autolink_prefix(link->type));
+    write_href(h, data + link->text, link->length);
+    write_tag(h, "\">");
+    write_escaped(h, data + link->text, link->length);
+    write_tag(h, "</a>");
+}
+
+
+/**
+ * Write a span of text to the sink: its autolinks as links, and the
+ * text between them decoded and escaped.
+ *
+ * - parameter h: The renderer.
+ * - parameter data: The span of text.
+ * - parameter length: The bytes of the span.
+ * - parameter more: More text of the block may follow the span.
+ */
+static void write_text(Html *h, const uint8_t *data, size_t length,
+                       const bool more)
+{
+    write_autolinked(&h->decoder, data, length, more, write_link);
+}
+
+
+/**
+ * Write the text of a block up to the first byte that may start a span
+ * of inline syntax, and keep the rest of it, from there on, until the
+ * block is exited. Text that cannot be kept is written as it comes,
+ * with what was kept before it.
+ */
+static void keep_text(Html *h, const uint8_t *data, const size_t length)
+{
+    size_t at = 0;
+
+    if (!h->kept || h->kept->length == 0) {
+        while (at < length && !starts_span(data[at])) at++;
+        if (at == length) {
+            write_text(h, data, length, true);
+            return;
+        }
+        /* No reference runs into the byte that starts a span. */
+        write_text(h, data, at, false);
+    }
+    if (!h->kept && !(h->kept = try_init_string(length - at))) {
+        write_text(h, data + at, length - at, true);
+        return;
+    }
+    if (!try_append_span(h->kept, data + at, length - at)) {
+        write_kept(h);
+        write_text(h, data + at, length - at, true);
+    }
+}
+
+
+/**
+ * Write the text kept from a block's first span of inline syntax: the
+ * text between the spans with its autolinks as links, code spans and
+ * escapes only escaped, and links and images decoded, but with no
+ * autolink.
+ */
+static void write_kept(Html *h)
+{
+    const uint8_t *data = NULL;
+    size_t length = 0;
+    size_t at = 0;          /* Offset of the text not yet written. */
+    size_t n = 0;           /* Bytes of a span. */
+    InlineSpan span;
+
+    if (!h->kept || h->kept->length == 0) return;
+    data   = h->kept->data;
+    length = h->kept->length;
+
+    while (find_span(data, at, length, false, &span)) {
+        write_text(h, data + at, span.start - at, false);
+        n = span.end - span.start;
+        if (span.type == SPAN_CODE || span.type == SPAN_ESCAPE) {
+            write_escaped(h, data + span.start, n);
+        }
+        else write_decoded(&h->decoder, data + span.start, n, false);
+        at = span.end;
+    }
+    write_text(h, data + at, length - at, false);
+    h->kept->length = 0;
+}
+
+
+/** Get the level (1-6) of a header block. */
+static int header_level(const mdblock_t type)
+{
+    if (type == SETEXT_HEADER_1) return 1;
+    if (type == SETEXT_HEADER_2) return 2;
+    return type - ATX_HEADER_1 + 1;
+}
@@ -0,0 +1,59 @@
+/**
+ * html.h -- rendering of parsed blocks as HTML5
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef HTML_DOT_H
+#define HTML_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "entities.h"
+#include "libpatdown.h"
+#include "patdown.h"
+#include "strings.h"
+
+/************************************************************************
+ * # HTML Rendering
+ ************************************************************************/
+
+/**
+ * A type to hold the state of an HTML renderer.
+ *
+ * - member sink: Where the HTML is written.
+ * - member block: The block being rendered.
+ * - member text: The block has written some text.
+ * - member plain: The block's text holds no inline metacharacter, so
+ *   it is only escaped.
+ * - member flat: The block's text holds no byte that starts a span of
+ *   inline syntax, so it is written as it is reported.
+ * - member kept: The text of the block from its first span of inline
+ *   syntax, written once the block is exited, or `NULL`.
+ * - member decoder: Decodes the character references of the text, and
+ *   writes it escaped.
+ */
+typedef struct Html
+{
+    PdSink sink;        /* Where the HTML is written. */
+    mdblock_t block;    /* Block being rendered. */
+    bool text;          /* Block has written some text. */
+    bool plain;         /* Block's text holds no metacharacter. */
+    bool flat;          /* Block's text starts no inline span. */
+    String *kept;       /* Text of the block from its first span. */
+    Decoder decoder;    /* Decodes the text and escapes it. */
+} Html;
+
+/** Get the callbacks that render each block as HTML5. */
+Callbacks html_callbacks(Html *h, const PdSink *sink);
+
+/** Free the memory held by an HTML renderer. */
+void free_html(Html *h);
+
+#endif
@@ -0,0 +1,1397 @@
+/**
+ * libpatdown.c -- public interface of the patdown library
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* sysconf(). */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "errors.h"
+#include "extract.h"
+#include "html.h"
+#include "libpatdown.h"
+#include "patdown.h"
+#include "strings.h"
+#include "table.h"
+#include "text.h"
+#include "utf8.h"
+
+
+/************************************************************************
+ * # Documents
+ *
+ *  A document owns the queue of blocks parsed from it. The text of each
+ *  block is copied into the queue, so the input can be released as soon
+ *  as `pd_parse()` returns.
+ *
+ *  A document also keeps a span for each top-level block: where its
+ *  input started, and the last node of the queue once it was parsed.
+ *  The spans are what allow an edited document to be re-parsed in
+ *  part -- see `pd_reparse()`.
+ *
+ *  Once a document will not be edited again, `pd_compact()` replaces
+ *  its queue and spans with a table of its blocks -- see table.c.
+ *
+ *  A parse that fails keeps only its error: the queue is free'd at
+ *  once, along with everything the parse had allocated. If even the
+ *  document cannot be allocated, a shared, read-only document holding
+ *  `PD_ERR_NOMEM` is returned instead, so `pd_parse()` never returns
+ *  `NULL`.
+ *
+ ************************************************************************/
+
+/**
+ * A type to hold the position of a top-level block of a document.
+ *
+ * - member start: The offset of the first byte of the block's input.
+ * - member before: The last block reported before it.
+ * - member tail: The last node of the queue once it was parsed, or
+ *   `NULL` if the queue was still empty.
+ * - member nodes: The number of nodes in the queue once it was parsed.
+ * - member blocks: The number of blocks entered once it was parsed --
+ *   only counted when `max_blocks` is set.
+ * - member reach: The offset of the first byte that no link reference
+ *   definition up to and including this block read.
+ */
+typedef struct Span
+{
+    size_t start;           /* Offset of the block's first byte. */
+    mdblock_t before;       /* Last block reported before it. */
+    struct Markdown *tail;  /* Last node of the queue once parsed. */
+    size_t nodes;           /* Nodes in the queue once parsed. */
+    size_t blocks;          /* Blocks entered once parsed. */
+    size_t reach;           /* End of the bytes link definitions read. */
+} Span;
+
+/** A growable list of the spans of a document. */
+typedef struct Spans
+{
+    Span *items;            /* Spans in the order of the input. */
+    size_t length;          /* Number of spans. */
+    size_t allocd;          /* Number of spans allocated. */
+} Spans;
+
+/** The smallest number of spans allocated. */
+#define MIN_SPANS 64
+
+/** The bytes of the first `PdOptions` with a size, the least one can be. */
+#define MIN_OPTIONS (offsetof(PdOptions, only) + sizeof(unsigned))
+
+/** The offset of the first byte of each line of a document. */
+typedef struct Lines
+{
+    size_t *starts;         /* Offset of each line, in order. */
+    size_t length;          /* Number of lines, or zero until indexed. */
+} Lines;
+
+/** A parsed Markdown document. */
+struct PdDoc
+{
+    Queue *blocks;      /* Every block of the document, or `NULL`. */
+    PdError error;      /* Why the document could not be parsed. */
+    PdOptions opts;     /* Options the document was parsed with. */
+    size_t length;      /* Bytes of input parsed. */
+    bool repaired;      /* Invalid UTF-8 in the input was replaced. */
+    Spans spans;        /* Every top-level block of the document. */
+    size_t compact;     /* Arena size that forces a whole parse. */
+    Lines lines;        /* Where each line starts, once located. */
+    Table *table;       /* Every block, once compacted, or `NULL`. */
+    const uint8_t *source;  /* Source of a loaded document, or `NULL`. */
+};
+
+/** The document returned when no memory is left for a document. */
+static const PdDoc nomem_doc = {
+    NULL, PD_ERR_NOMEM, PD_OPTIONS_INIT, 0, false, { NULL, 0, 0 }, 0,
+    { NULL, 0 }, NULL, NULL
+};
+
+static PdError read_options(const PdOptions *opts, PdOptions *out);
+static void load_doc(PdDoc *doc, const uint8_t *buf, const size_t len);
+static void forget_lines(PdDoc *doc);
+static PdError parse_doc(PdDoc *doc, const uint8_t *buf, const size_t len);
+static size_t parse_spans(PdDoc *doc, Parser *p, const uint8_t *buf,
+                          const size_t len, size_t at, const Spans *old,
+                          const PdEdit *edit);
+
+
+/**
+ * Parse a document from a range of bytes.
+ *
+ * - parameter buf: The first byte of the document. It does not need to
+ *   be NULL-terminated, and it is never modified.
+ * - parameter len: The number of bytes in the document.
+ * - parameter opts: The options of the parse, or `NULL` for defaults.
+ *
+ * - returns: A new document, to be free'd with `pd_free()`. If it could
+ *   not be parsed, it is empty and `pd_error()` reports why.
+ */
+PdDoc *pd_parse(const uint8_t *buf, const size_t len, const PdOptions *opts)
+{
+    PdDoc *doc = calloc(1, sizeof(PdDoc));
+
+    if (!doc) return (PdDoc *)&nomem_doc;
+
+    if (!(doc->error = read_options(opts, &doc->opts))) {
+        load_doc(doc, buf, len);
+    }
+    return doc;
+}
+
+
+/**
+ * Read the options of a caller, which may have been built with fewer
+ * options than the library, or more.
+ *
+ * - parameter opts: The options, or `NULL` for defaults.
+ * - parameter out: Receives the options, with those the caller did not
+ *   know of zero.
+ *
+ * - returns: `PD_ERR_OPTIONS` if the options are too small to be any
+ *   the library knows, or set an option past those it knows.
+ */
+static PdError read_options(const PdOptions *opts, PdOptions *out)
+{
+    const uint8_t *bytes = (const uint8_t *)opts;
+    size_t known = sizeof(PdOptions);   /* Bytes of the options read. */
+    size_t i = 0;
+
+    memset(out, 0, sizeof(PdOptions));
+    out->size = sizeof(PdOptions);
+    if (!opts) return PD_OK;
+    if (opts->size < MIN_OPTIONS) return PD_ERR_OPTIONS;
+
+    if (opts->size < known) known = opts->size;
+    for (i = known; i < opts->size; i++) {
+        if (bytes[i]) return PD_ERR_OPTIONS;
+    }
+    memcpy(out, opts, known);
+    out->size = sizeof(PdOptions);
+    return PD_OK;
+}
+
+
+/**
+ * Replace the blocks of a document with a parse of a range of bytes.
+ *
+ * The document keeps its error, and is left empty, if the parse fails.
+ */
+static void load_doc(PdDoc *doc, const uint8_t *buf, const size_t len)
+{
+    free_queue(doc->blocks);
+    free_table(doc->table);
+    forget_lines(doc);
+    doc->table        = NULL;
+    doc->source       = NULL;
+    doc->blocks       = NULL;
+    doc->spans.length = 0;
+    doc->length       = len;
+    doc->repaired     = false;
+
+    if (doc->opts.max_input && len > doc->opts.max_input) {
+        doc->error = PD_ERR_INPUT_LIMIT;
+    }
+    else doc->error = parse_doc(doc, buf, len);
+
+    if (doc->error) {
+        free_queue(doc->blocks);
+        doc->blocks = NULL;
+    }
+    else doc->compact = 2 * doc->blocks->arena->allocd;
+}
+
+
+/** Allocate a Parser with the options of a parse, reporting to callbacks. */
+static Parser *opts_parser(const PdOptions *opts, const Callbacks *cb)
+{
+    Parser *p = init_parser(cb);
+
+    if (!p) return NULL;
+    p->max_blocks = opts->max_blocks;
+    if (opts->max_depth) p->max_depth = opts->max_depth;
+    p->excerpt.blocks = opts->excerpt_blocks;
+    p->excerpt.bytes  = opts->excerpt_bytes;
+    p->excerpt.refs   = opts->excerpt_refs;
+    p->only           = opts->only;
+    return p;
+}
+
+
+/** Allocate a Parser that adds each block to a document's queue. */
+static Parser *doc_parser(PdDoc *doc)
+{
+    Callbacks cb = queue_callbacks(doc->blocks);
+
+    return opts_parser(&doc->opts, &cb);
+}
+
+
+/**
+ * Parse the blocks of a document into its queue.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse.
+ */
+static PdError parse_doc(PdDoc *doc, const uint8_t *buf, const size_t len)
+{
+    String *fix  = NULL;    /* The input with its invalid UTF-8 repaired. */
+    size_t valid = len;     /* Length of the valid UTF-8 prefix. */
+    Parser *p    = NULL;
+    PdError error = PD_OK;
+
+    if (!doc->opts.raw && len > 0) valid = validate_utf8(buf, len);
+    if (valid < len) {
+        if (!(fix = repair_utf8(buf, len, valid))) return PD_ERR_NOMEM;
+        buf = fix->data;
+        doc->repaired = true;
+    }
+
+    if (!(doc->blocks = init_queue(doc->opts.max_arena))) {
+        free_string(fix);
+        return PD_ERR_NOMEM;
+    }
+    if (!(p = doc_parser(doc))) {
+        free_string(fix);
+        return PD_ERR_NOMEM;
+    }
+
+    parse_spans(doc, p, buf, fix ? fix->length : len, 0, NULL, NULL);
+    error = p->error;
+    free_parser(p);
+    free_string(fix);
+    return error;
+}
+
+
+/** Add a span to the end of a list, or return `false`. */
+static bool push_span(Spans *s, const Span *span)
+{
+    size_t allocd = s->allocd ? s->allocd * 2 : MIN_SPANS;
+    Span *items = NULL;
+
+    if (s->length == s->allocd) {
+        if (!(items = realloc(s->items, allocd * sizeof(Span)))) {
+            return false;
+        }
+        s->items  = items;
+        s->allocd = allocd;
+    }
+    s->items[s->length++] = *span;
+    return true;
+}
+
+
+/**
+ * Parse top-level blocks into a document, adding a span for each.
+ *
+ * When a previous parse and an edit are given, the parse stops at the
+ * first block boundary past the edit where the previous parse had a
+ * block in the same state: every block from there on is the same.
+ *
+ * The offsets of each node are made relative to the start of its span,
+ * so that spans kept past an edit are moved without touching a node.
+ *
+ * - parameter doc: The document to add the blocks and spans to.
+ * - parameter p: The Parser adding blocks to the document's queue.
+ * - parameter buf: The first byte of the document.
+ * - parameter len: The number of bytes in the document.
+ * - parameter at: The offset of the first block to parse.
+ * - parameter old: The spans of the previous parse, or `NULL`.
+ * - parameter edit: The edit since the previous parse, or `NULL`.
+ *
+ * - returns: The index of the old span the parse stopped at, or the
+ *   number of old spans if it parsed to the end of the document.
+ */
+static size_t parse_spans(PdDoc *doc, Parser *p, const uint8_t *buf,
+                          const size_t len, size_t at, const Spans *old,
+                          const PdEdit *edit)
+{
+    size_t j = 0;           /* Next old span that could match. */
+    size_t n = 0;           /* Length of the block. */
+    size_t reach = 0;       /* End of the bytes link definitions read. */
+    struct Markdown *last = NULL;   /* Tail of the queue before a block. */
+    Span span;
+
+    if (doc->spans.length) {
+        reach = doc->spans.items[doc->spans.length - 1].reach;
+    }
+
+    while (true) {
+        /* An old span at the same place, shifted by the edit? */
+        if (old) {
+            while (j < old->length &&
+                   old->items[j].start + edit->inserted < at + edit->removed) {
+                j++;
+            }
+            if (j < old->length && at >= edit->offset + edit->inserted &&
+                old->items[j].start + edit->inserted == at + edit->removed &&
+                old->items[j].before == p->last) {
+                return j;
+            }
+        }
+
+        span.start  = at;
+        span.before = p->last;
+        last = doc->blocks->tail;
+        if ((n = parse_next_block(p, buf, at, len)) == 0) break;
+
+        rebase_nodes(last ? next_node(last) : doc->blocks->head, at);
+        span.tail   = doc->blocks->tail;
+        span.nodes  = doc->blocks->length;
+        span.blocks = p->blocks;
+        if (p->reach && (size_t)(p->reach - buf) >= reach) {
+            reach = p->reach - buf + 1;
+        }
+        span.reach = reach;
+        if (!push_span(&doc->spans, &span)) {
+            p->error = PD_ERR_NOMEM;
+            break;
+        }
+        at += n;
+    }
+    return old ? old->length : 0;
+}
+
+
+/**
+ * Get the kinds of block named in a list, for the `only` option.
+ *
+ * The names are `atx`, `setext`, `paragraph`, `indented`, `fenced`,
+ * `html`, `hr`, `quote` and `refs`, separated by commas.
+ *
+ * - parameter names: The NULL-terminated list of names.
+ * - parameter only: Receives the kinds named, as `PdOnly` bits.
+ *
+ * - returns: `false` if a name is not one of the kinds, or the list
+ *   names none.
+ */
+bool pd_only_names(const char *names, unsigned *only)
+{
+    static const struct { const char *name; unsigned kind; } kinds[] = {
+        { "atx",       PD_ONLY_ATX },
+        { "setext",    PD_ONLY_SETEXT },
+        { "paragraph", PD_ONLY_PARAGRAPH },
+        { "indented",  PD_ONLY_INDENTED },
+        { "fenced",    PD_ONLY_FENCED },
+        { "html",      PD_ONLY_HTML },
+        { "hr",        PD_ONLY_RULE },
+        { "quote",     PD_ONLY_QUOTE },
+        { "refs",      PD_ONLY_REFS }
+    };
+    const char *comma = NULL;
+    size_t length = 0;
+    size_t i = 0;
+
+    *only = 0;
+    while (true) {
+        comma  = strchr(names, ',');
+        length = comma ? (size_t)(comma - names) : strlen(names);
+        for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+            if (strlen(kinds[i].name) == length &&
+                !strncmp(kinds[i].name, names, length)) break;
+        }
+        if (i == sizeof(kinds) / sizeof(kinds[0])) return false;
+        *only |= kinds[i].kind;
+        if (!comma) return true;
+        names = comma + 1;
+    }
+}
+
+
+/**
+ * Get the reason a document could not be parsed.
+ *
+ * - parameter doc: The document.
+ *
+ * - returns: `PD_OK` if the document was parsed.
+ */
+PdError pd_error(const PdDoc *doc)
+{
+    return doc->error;
+}
+
+
+/**
+ * Render a parsed document as HTML5.
+ *
+ *  The document is only read, so it can be rendered any number of
+ *  times, from any number of threads at once. A document that could
+ *  not be parsed renders nothing.
+ *
+ * - parameter doc: The document to render.
+ * - parameter sink: Where the HTML is written.
+ */
+void pd_render_html(const PdDoc *doc, const PdSink *sink)
+{
+    Html h;
+    Callbacks cb = html_callbacks(&h, sink);
+
+    if (doc->table) replay_table(doc->table, &cb);
+    else if (doc->blocks) replay_queue(doc->blocks, &cb);
+    free_html(&h);
+}
+
+
+/**
+ * Write every link of a document as a line of JSON, without keeping or
+ * rendering its blocks.
+ *
+ * Each line holds the link's destination, the offset of its first byte
+ * in the document and its kind -- `ref` for a link reference definition,
+ * `link`, `image` or `autolink`:
+ *
+ *     {"dest":"https://a.b/c","offset":120,"kind":"link"}
+ *
+ * A reference to a definition -- `[text][label]`, `[label][]` or
+ * `[label]` -- is a `link` or an `image` with the destination of the
+ * first definition of its label, wherever that is. So the links are
+ * kept, not written, until the whole document has been parsed.
+ *
+ * The document is parsed as it is, so that each offset is one of its
+ * own: any invalid UTF-8 of a destination is written as U+FFFD, and the
+ * `raw` option does not matter.
+ *
+ * - parameter buf: The first byte of the document. It does not need to
+ *   be NULL-terminated, and it is never modified.
+ * - parameter len: The number of bytes in the document.
+ * - parameter opts: The options of the parse, or `NULL` for defaults.
+ * - parameter sink: Where the links are written.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse. The links
+ *   found before it stopped have been written.
+ */
+PdError pd_extract_links(const uint8_t *buf, const size_t len,
+                         const PdOptions *opts, const PdSink *sink)
+{
+    PdOptions o;
+    LinkWriter w;
+    Callbacks cb = link_callbacks(&w, sink);
+    Parser *p = NULL;
+    PdError error = PD_OK;
+    PdError written = PD_OK;    /* The error of writing the links. */
+
+    if ((error = read_options(opts, &o))) return error;
+    if (o.max_input && len > o.max_input) return PD_ERR_INPUT_LIMIT;
+    if (!(p = opts_parser(&o, &cb))) return PD_ERR_NOMEM;
+
+    w.parser = p;
+    error = parse_markdown(p, buf, len);
+    free_parser(p);
+    written = finish_link_writer(&w);
+    free_link_writer(&w);
+    return error ? error : written;
+}
+
+
+/**
+ * Render the visible text of a parsed document, without any markup.
+ *
+ *  Each block is written on lines of its own, set off by a blank line,
+ *  and each header is written after a form feed, so that the text
+ *  splits into sections at each one -- see text.c. Like HTML, the text
+ *  can be rendered any number of times, from any number of threads.
+ *
+ * - parameter doc: The document to render.
+ * - parameter code: Write the text of code blocks too.
+ * - parameter sink: Where the text is written.
+ */
+void pd_render_text(const PdDoc *doc, const bool code, const PdSink *sink)
+{
+    TextOut t;
+    Callbacks cb = text_callbacks(&t, sink, code);
+
+    if (doc->table) replay_table(doc->table, &cb);
+    else if (doc->blocks) replay_queue(doc->blocks, &cb);
+    free_text_out(&t);
+}
+
+
+/**
+ * Report the blocks of a range of the spans of a document, with their
+ * offsets.
+ *
+ * The nodes of each top-level block hold offsets relative to its span,
+ * so the queue is replayed a span at a time.
+ *
+ * - parameter doc: The document.
+ * - parameter first: The first span to report.
+ * - parameter last: The span after the last to report.
+ * - parameter cb: The callbacks to report each block to.
+ */
+static void replay_spans(const PdDoc *doc, const size_t first,
+                         const size_t last, const Callbacks *cb)
+{
+    const Span *span = doc->spans.items + first;
+    const struct Markdown *tail = first ? span[-1].tail : NULL;
+    size_t i = 0;
+
+    /* A span that added no nodes has the tail of the span before it. */
+    for (i = first; i < last; i++, span++) {
+        if (span->tail == tail) continue;
+        replay_nodes(tail ? next_node(tail) : doc->blocks->head, span->tail,
+                     span->start, cb);
+        tail = span->tail;
+    }
+}
+
+
+/** Report every block of a parsed document, with its offsets. */
+static void replay_doc(const void *blocks, const Callbacks *cb)
+{
+    const PdDoc *doc = blocks;
+    replay_spans(doc, 0, doc->spans.length, cb);
+}
+
+
+/**
+ * Replace the blocks of a document with a compact table of them.
+ *
+ *  A table holds every block in a few arrays -- about 13 bytes for each
+ *  block, plus its text -- instead of a node, text and extension for
+ *  each, linked into a queue. Rendering it or listing its blocks then
+ *  reads memory in order instead of following pointers.
+ *
+ *  A compacted document renders the same HTML, and reports the same
+ *  blocks, as it did before. It no longer keeps what it needs to
+ *  re-parse only part of itself, so `pd_reparse()` parses it again from
+ *  scratch -- as a document that is not compacted.
+ *
+ * - parameter doc: The document.
+ *
+ * - returns: `PD_OK`, or the reason the document could not be
+ *   compacted: memory could not be allocated, or the document is 4 GiB
+ *   or larger. The document is then unchanged. A document that could
+ *   not be parsed has nothing to compact, and returns its error.
+ */
+PdError pd_compact(PdDoc *doc)
+{
+    PdError error = PD_OK;
+    Table *t = NULL;
+
+    if (doc->error || doc->table) return doc->error;
+    if (!(t = build_table(replay_doc, doc, &error))) return error;
+
+    free_queue(doc->blocks);
+    free(doc->spans.items);
+    doc->blocks = NULL;
+    doc->table  = t;
+    doc->spans.items  = NULL;
+    doc->spans.length = doc->spans.allocd = 0;
+    return PD_OK;
+}
+
+
+/**
+ * Free a parsed document, if it exists.
+ *
+ * - parameter doc: The document to be free'd.
+ */
+void pd_free(PdDoc *doc)
+{
+    if (doc && doc != &nomem_doc) {
+        free_queue(doc->blocks);
+        free_table(doc->table);
+        free(doc->spans.items);
+        free(doc->lines.starts);
+        free(doc);
+    }
+}
+
+
+/************************************************************************
+ * # Incremental Parsing
+ *
+ *  An editor re-renders its preview on every keystroke, and parsing the
+ *  whole document each time is too slow for a large one. After an edit
+ *  only the blocks near it are parsed again:
+ *
+ *  1. The blocks before the edit are kept, except for those whose parse
+ *     may have looked at the edited bytes -- see `block_ends_before()`.
+ *
+ *  2. Blocks are parsed from the end of the last block kept. The queue
+ *     is cut there, and the new blocks are added to its tail.
+ *
+ *  3. Past the edit, the parse stops at the first block boundary that
+ *     is also a boundary of the old parse, shifted by the edit, and
+ *     where the last block reported is the same. The parse of a block
+ *     only depends on that last block and on the bytes from its start
+ *     on, which are unchanged, so every old block from there on is
+ *     kept: its nodes are spliced back onto the queue, and its span is
+ *     shifted by the length of the edit.
+ *
+ *  The result is always the same as parsing the new document from
+ *  scratch, which is what happens when part of a parse cannot be kept:
+ *  the document was repaired or could not be parsed, the new bytes are
+ *  not valid UTF-8, the edit does not match the lengths of the two
+ *  documents, or a cap was reached on the way.
+ *
+ *  The nodes of replaced blocks stay in the document's arena until the
+ *  next whole parse, which happens once the arena has doubled in size.
+ *
+ ************************************************************************/
+
+/**
+ * Check if the bytes an edit inserted are valid UTF-8.
+ *
+ * The rest of the document was valid before the edit, so only the
+ * inserted bytes need to be checked -- along with any sequence they
+ * join at either side of the edit.
+ */
+static bool edit_is_valid_utf8(const uint8_t *buf, const size_t len,
+                               const PdEdit *edit)
+{
+    size_t from = edit->offset;
+    size_t to   = edit->offset + edit->inserted;
+    size_t k    = 0;
+
+    /* Widen the range to the sequences on either side. */
+    for (k = 0; k < 3 && from > 0 && (buf[from - 1] & 0xC0) == 0x80; k++) {
+        from--;
+    }
+    if (from > 0 && buf[from - 1] >= 0x80) from--;
+    for (k = 0; k < 3 && to < len && (buf[to] & 0xC0) == 0x80; k++) to++;
+
+    return validate_utf8(buf + from, to - from) == to - from;
+}
+
+
+/** Check if an edit matches the lengths of a document before and after. */
+static bool edit_matches(const PdDoc *doc, const size_t len,
+                         const PdEdit *edit)
+{
+    return edit->offset <= doc->length && edit->offset <= len &&
+           edit->removed <= doc->length - edit->offset &&
+           edit->inserted <= len - edit->offset &&
+           doc->length - edit->removed == len - edit->inserted;
+}
+
+
+/**
+ * Find the number of leading blocks that an edit cannot change.
+ *
+ * - parameter old: The spans of the document before the edit.
+ * - parameter buf: The document after the edit. Every byte before the
+ *   offset of the edit is the same as before.
+ * - parameter offset: The offset of the edit.
+ */
+static size_t kept_spans(const Spans *old, const uint8_t *buf,
+                         const size_t offset)
+{
+    size_t lo = 0;
+    size_t hi = old->length;
+    size_t mid = 0;
+
+    /* Find the first block that starts after the edit. */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (old->items[mid].start <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    /* The block with the edit and any that looked at it are parsed. */
+    if (lo > 0) lo--;
+    while (lo > 0 && (old->items[lo - 1].reach > offset ||
+                      !block_ends_before(buf + old->items[lo].start,
+                                         buf + offset))) {
+        lo--;
+    }
+    return lo;
+}
+
+
+/**
+ * Re-parse the blocks of a document that an edit may have changed.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse -- in which
+ *   case the document must be parsed again from scratch.
+ */
+static PdError parse_edit(PdDoc *doc, const uint8_t *buf, const size_t len,
+                          const PdEdit *edit)
+{
+    Spans old = doc->spans;     /* Spans of the old parse. */
+    Queue *q  = doc->blocks;
+    struct Markdown *tail = q->tail;    /* Last node of the old parse. */
+    struct Markdown *rest = NULL;       /* First node parsed again. */
+    struct Markdown *first = NULL;      /* First node kept past the edit. */
+    size_t nodes  = q->length;  /* Nodes of the old parse. */
+    size_t kept   = 0;          /* Nodes kept before the edit. */
+    size_t before = 0;          /* Old nodes before the first kept span. */
+    size_t k = kept_spans(&old, buf, edit->offset);
+    size_t j = 0;               /* First old span kept past the edit. */
+    size_t done   = 0;          /* Nodes in the queue once parsed. */
+    size_t blocks = 0;          /* Old blocks before the first kept span. */
+    size_t reach  = 0;          /* End of the bytes link definitions read. */
+    Parser *p = NULL;
+    PdError error = PD_OK;
+    Span span;
+
+    if (!(p = doc_parser(doc))) return PD_ERR_NOMEM;
+    doc->spans.allocd = old.allocd ? old.allocd : MIN_SPANS;
+    if (!(doc->spans.items = malloc(doc->spans.allocd * sizeof(Span)))) {
+        doc->spans = old;
+        free_parser(p);
+        return PD_ERR_NOMEM;
+    }
+    memcpy(doc->spans.items, old.items, k * sizeof(Span));
+    doc->spans.length = k;
+
+    if (k > 0) {
+        kept      = old.items[k - 1].nodes;
+        p->blocks = old.items[k - 1].blocks;
+    }
+    if (k < old.length) p->last = old.items[k].before;
+    rest = cut_queue(q, k ? old.items[k - 1].tail : NULL, kept);
+
+    j = parse_spans(doc, p, buf, len, k < old.length ? old.items[k].start : 0,
+                    &old, edit);
+
+    /* Splice the old blocks past the edit back onto the queue. */
+    if (!p->error && j < old.length) {
+        before = j ? old.items[j - 1].nodes : 0;
+        first  = (before == kept) ? rest : next_node(old.items[j - 1].tail);
+        done   = q->length;
+        blocks = j ? old.items[j - 1].blocks : 0;
+        reach  = doc->spans.length ?
+                 doc->spans.items[doc->spans.length - 1].reach : 0;
+        splice_queue(q, first, tail, nodes - before);
+
+        for (; j < old.length && !p->error; j++) {
+            span = old.items[j];
+            span.start  = span.start - edit->removed + edit->inserted;
+            span.nodes  = span.nodes - before + done;
+            span.blocks = span.blocks - blocks + p->blocks;
+            if (span.reach + edit->inserted > edit->removed + reach) {
+                span.reach = span.reach + edit->inserted - edit->removed;
+            }
+            else span.reach = reach;
+            if (!push_span(&doc->spans, &span)) p->error = PD_ERR_NOMEM;
+        }
+        if (p->max_blocks && span.blocks > p->max_blocks) {
+            p->error = PD_ERR_BLOCK_LIMIT;
+        }
+    }
+
+    error = p->error;
+    free(old.items);
+    free_parser(p);
+    return error;
+}
+
+
+/**
+ * Update a parsed document after an edit, parsing only what changed.
+ *
+ *  The blocks that the edit cannot have changed are kept as they were
+ *  parsed, and the rest are parsed again. The document is then the
+ *  same as `pd_parse()` would return for the new bytes, with the same
+ *  options -- it can be rendered at once, and updated again after the
+ *  next edit.
+ *
+ *  An edit that does not match the lengths of the old and new bytes is
+ *  not an error: the document is parsed again from scratch.
+ *
+ * - parameter doc: The document parsed before the edit.
+ * - parameter buf: The first byte of the whole document after the edit.
+ * - parameter len: The number of bytes in the document after the edit.
+ * - parameter edit: The bytes that were replaced.
+ *
+ * - returns: `PD_OK`, or the reason the new document could not be
+ *   parsed. The document is then empty, just as if it had been parsed
+ *   with `pd_parse()`.
+ */
+PdError pd_reparse(PdDoc *doc, const uint8_t *buf, const size_t len,
+                   const PdEdit *edit)
+{
+    if (doc == &nomem_doc) return PD_ERR_NOMEM;
+
+    /* An excerpt ends wherever its text does, and the blocks kept of
+     * only some kinds need not line up with the spans, so either is
+     * parsed anew. */
+    if (doc->blocks && !doc->repaired && edit_matches(doc, len, edit) &&
+        !doc->opts.excerpt_blocks && !doc->opts.excerpt_bytes &&
+        !doc->opts.only &&
+        doc->blocks->arena->allocd < doc->compact &&
+        !(doc->opts.max_input && len > doc->opts.max_input) &&
+        (doc->opts.raw || edit_is_valid_utf8(buf, len, edit)) &&
+        parse_edit(doc, buf, len, edit) == PD_OK) {
+        doc->length = len;
+        forget_lines(doc);
+        return PD_OK;
+    }
+
+    load_doc(doc, buf, len);
+    return doc->error;
+}
+
+
+/************************************************************************
+ * # Saved Documents
+ *
+ *  A document can be saved as the table of its blocks followed by the
+ *  source it was parsed from -- see table.c for the layout. A saved
+ *  document is loaded by pointing a table at the saved bytes, so a file
+ *  mapped into memory is rendered or queried without being parsed,
+ *  copied or decoded, by any number of processes at once.
+ *
+ ************************************************************************/
+
+/**
+ * Write a document, its blocks and its source in a binary format.
+ *
+ *  The format is versioned, and only loaded by the same version of the
+ *  library on a machine of the same byte order. The blocks are saved
+ *  as a table, built for the occasion unless the document was already
+ *  compacted.
+ *
+ * - parameter doc: The document.
+ * - parameter buf: The bytes the document was parsed from. A loaded
+ *   document saves its own source, and `buf` is ignored.
+ * - parameter len: The number of bytes in `buf`.
+ * - parameter sink: Where the saved bytes are written.
+ *
+ * - returns: `PD_OK`, or the reason the document could not be saved --
+ *   its own error if it could not be parsed.
+ */
+PdError pd_save(const PdDoc *doc, const uint8_t *buf, const size_t len,
+                const PdSink *sink)
+{
+    const Table *t = doc->table;
+    Table *built = NULL;    /* The table, if it was built to be saved. */
+    String *fix  = NULL;    /* The source with its invalid UTF-8 repaired. */
+    PdError error = PD_OK;
+
+    if (doc->error) return doc->error;
+    if (!t && !(t = built = build_table(replay_doc, doc, &error))) {
+        return error;
+    }
+
+    /* The offsets of a repaired document are those of the repair. */
+    if (doc->source) {
+        buf = doc->source;
+    }
+    else if (doc->repaired) {
+        if (!(fix = repair_utf8(buf, len, validate_utf8(buf, len)))) {
+            free_table(built);
+            return PD_ERR_NOMEM;
+        }
+        buf = fix->data;
+    }
+
+    save_table(t, buf, fix ? fix->length : doc->length, sink);
+    free_string(fix);
+    free_table(built);
+    return PD_OK;
+}
+
+
+/**
+ * Use the bytes of a saved document in place, without parsing.
+ *
+ *  The document reads its blocks and its source from the saved bytes,
+ *  which must stay valid and unchanged until it is free'd. It renders,
+ *  lists its blocks and locates offsets like the document that was
+ *  saved -- and like any document, it can be re-parsed from new bytes.
+ *
+ *  Every offset in the saved bytes is checked as they are loaded, so a
+ *  damaged or hostile file is rejected rather than read out of bounds.
+ *
+ * - parameter data: The saved bytes, aligned to eight bytes -- as a
+ *   mapping of a file, or any allocation, is.
+ * - parameter size: The number of saved bytes.
+ *
+ * - returns: A new document, to be free'd with `pd_free()`. If the
+ *   bytes are not a saved document, it is empty and `pd_error()`
+ *   reports `PD_ERR_FORMAT`.
+ */
+PdDoc *pd_load(const uint8_t *data, const size_t size)
+{
+    PdDoc *doc = calloc(1, sizeof(PdDoc));
+    Table *t = NULL;
+
+    if (!doc) return (PdDoc *)&nomem_doc;
+    if (!(t = malloc(sizeof(Table)))) {
+        doc->error = PD_ERR_NOMEM;
+        return doc;
+    }
+    if (!map_table(t, data, size, &doc->source, &doc->length)) {
+        free(t);
+        doc->error = PD_ERR_FORMAT;
+        return doc;
+    }
+    doc->table = t;
+    return doc;
+}
+
+
+/**
+ * Get the source of a loaded document.
+ *
+ * - parameter doc: The document.
+ * - parameter len: Receives the number of bytes of source.
+ *
+ * - returns: The first byte of the source saved with the document, or
+ *   `NULL` if it was parsed rather than loaded.
+ */
+const uint8_t *pd_source(const PdDoc *doc, size_t *len)
+{
+    *len = doc->source ? doc->length : 0;
+    return doc->source;
+}
+
+
+/************************************************************************
+ * # Source Positions
+ *
+ *  Every block knows the range of bytes it was parsed from, kept in its
+ *  node. Line and column numbers are only needed to report a position
+ *  to a person, so they are found from an index of where each line
+ *  starts, which is built the first time a position is located.
+ *
+ *  The offsets of a document whose invalid UTF-8 was repaired are those
+ *  of the repaired input, in which each invalid sequence became the
+ *  three bytes of U+FFFD.
+ *
+ ************************************************************************/
+
+/**
+ * Get the range of bytes each block of a document was parsed from.
+ *
+ *  The blocks are listed in the order they start: a blockquote before
+ *  every block inside of it. Blank lines are not blocks.
+ *
+ *  The blocks of a compacted document are read from its table, and
+ *  otherwise from its queue, a top-level block at a time.
+ *
+ * - parameter doc: The document.
+ * - parameter spans: Receives the range of each block, or `NULL`.
+ * - parameter max: The number of ranges `spans` has room for.
+ *
+ * - returns: The number of blocks in the document, which may be more
+ *   than `max`. A document that could not be parsed has none.
+ */
+size_t pd_block_spans(const PdDoc *doc, PdSpan *spans, const size_t max)
+{
+    const struct Markdown *node = doc->blocks ? doc->blocks->head : NULL;
+    const Span *span = doc->spans.items;    /* Top-level block of `node`. */
+    size_t nodes = 0;       /* Nodes before `node`. */
+    size_t count = 0;       /* Blocks found. */
+    size_t start = 0;       /* Offset of a block in its span. */
+    size_t end   = 0;       /* Offset of its end in its span. */
+    mdblock_t type = UNKNOWN;
+    const Table *t = doc->table;
+    size_t i = 0;
+
+    for (i = 0; t && i < t->length; i++) {
+        if (t->types[i] == BLANK_LINE || t->types[i] == BLOCKQUOTE_END) {
+            continue;
+        }
+        if (count < max) {
+            spans[count].start = t->starts[i];
+            spans[count].end   = t->starts[i] + t->sizes[i];
+        }
+        count++;
+    }
+
+    for (; node; node = next_node(node), nodes++) {
+        while (span->nodes <= nodes) span++;
+
+        type = get_node_span(node, &start, &end);
+        if (type == BLANK_LINE || type == BLOCKQUOTE_END) continue;
+        if (count < max) {
+            spans[count].start = span->start + start;
+            spans[count].end   = span->start + end;
+        }
+        count++;
+    }
+    return count;
+}
+
+
+/** Check if a line ends with the byte at an offset. */
+static bool ends_line(const uint8_t *buf, const size_t len, const size_t i)
+{
+    if (buf[i] == '\n') return true;
+    return buf[i] == '\r' && (i + 1 == len || buf[i + 1] != '\n');
+}
+
+
+/** Forget where the lines of a document start, once it has changed. */
+static void forget_lines(PdDoc *doc)
+{
+    free(doc->lines.starts);
+    doc->lines.starts = NULL;
+    doc->lines.length = 0;
+}
+
+
+/**
+ * Index where each line of a document starts.
+ *
+ * A line ends at a `\n`, a `\r\n`, or a lone `\r`, just as it does
+ * for the parser.
+ *
+ * - returns: `false` if memory could not be allocated.
+ */
+static bool index_lines(PdDoc *doc, const uint8_t *buf)
+{
+    size_t count = 1;       /* Lines of the document. */
+    size_t i = 0;
+
+    for (i = 0; i < doc->length; i++) count += ends_line(buf, doc->length, i);
+    if (!(doc->lines.starts = malloc(count * sizeof(size_t)))) return false;
+
+    doc->lines.starts[0] = 0;
+    doc->lines.length    = 1;
+    for (i = 0; i < doc->length; i++) {
+        if (ends_line(buf, doc->length, i)) {
+            doc->lines.starts[doc->lines.length++] = i + 1;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Get the line and column of an offset into a document.
+ *
+ *  The first call indexes the lines of the document, which is kept
+ *  until the document is parsed again. A document being located must
+ *  not be used from any other thread at the same time.
+ *
+ * - parameter doc: The document.
+ * - parameter buf: The bytes the document was last parsed from. A
+ *   loaded document locates offsets in its own source, and `buf` is
+ *   ignored.
+ * - parameter offset: The offset to locate. An offset past the end of
+ *   the document is located at its end.
+ * - parameter loc: Receives the line and column, both counted from one.
+ *   Columns count bytes, not characters.
+ *
+ * - returns: `PD_OK`, or `PD_ERR_NOMEM` if the lines could not be
+ *   indexed.
+ */
+PdError pd_locate(PdDoc *doc, const uint8_t *buf, size_t offset,
+                  PdLocation *loc)
+{
+    size_t lo = 0;
+    size_t hi = 0;
+    size_t mid = 0;
+
+    if (doc == &nomem_doc) return PD_ERR_NOMEM;
+    if (doc->source) buf = doc->source;
+    if (!doc->lines.length && !index_lines(doc, buf)) return PD_ERR_NOMEM;
+    if (offset > doc->length) offset = doc->length;
+
+    /* Find the last line that starts at or before the offset. */
+    hi = doc->lines.length;
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (doc->lines.starts[mid] <= offset) lo = mid;
+        else hi = mid;
+    }
+    loc->line   = lo + 1;
+    loc->column = offset - doc->lines.starts[lo] + 1;
+    return PD_OK;
+}
+
+
+/************************************************************************
+ * # Cached Rendering
+ ************************************************************************/
+
+/** The HTML of a render being captured for a cache. */
+typedef struct Capture
+{
+    String *html;       /* The HTML written so far. */
+    bool nomem;         /* `html` could not be grown. */
+} Capture;
+
+
+/** Append each span of HTML to a capture. */
+static void capture_html(const uint8_t *data, const size_t length,
+                         void *userdata)
+{
+    Capture *cap = userdata;
+    if (!try_append_span(cap->html, data, length)) cap->nomem = true;
+}
+
+
+/**
+ * Render a range of bytes as HTML5, from a cache when it can be.
+ *
+ *  A document that was rendered before, from the same bytes and with
+ *  the same options, is written straight from the cache without being
+ *  parsed. Any other document is parsed, rendered into the cache, and
+ *  then written. A document that could not be parsed writes nothing
+ *  and is never cached.
+ *
+ *  The HTML of a cached document is always written with a single call
+ *  to the sink.
+ *
+ * - parameter cache: The cache to use, or `NULL` to always parse.
+ * - parameter buf: The first byte of the document.
+ * - parameter len: The number of bytes in the document.
+ * - parameter opts: The options of the parse, or `NULL` for defaults.
+ * - parameter sink: Where the HTML is written.
+ *
+ * - returns: `PD_OK`, or the reason the document could not be parsed.
+ */
+PdError pd_render_html_cached(PdCache *cache, const uint8_t *buf,
+                              const size_t len, const PdOptions *opts,
+                              const PdSink *sink)
+{
+    const CacheEntry *hit = NULL;
+    Capture cap = { NULL, false };
+    PdSink capture = { capture_html, &cap };
+    PdDoc *doc = NULL;
+    PdError error = PD_OK;
+    PdOptions o;
+    CacheKey key;
+
+    if ((error = read_options(opts, &o))) return error;
+    if (cache && !(o.max_input && len > o.max_input)) {
+        make_cache_key(&key, buf, len, &o);
+        if ((hit = find_render(cache, &key))) {
+            sink->write(hit->html, hit->length, sink->userdata);
+            release_render(cache, hit);
+            return PD_OK;
+        }
+    }
+
+    doc = pd_parse(buf, len, &o);
+    if ((error = pd_error(doc))) {
+        pd_free(doc);
+        return error;
+    }
+
+    /* Most HTML is a little longer than its Markdown. */
+    if (cache && (cap.html = try_init_string(len + len / 4 + 64))) {
+        pd_render_html(doc, &capture);
+    }
+    if (cap.html && !cap.nomem) {
+        store_render(cache, &key, cap.html->data, cap.html->length);
+        sink->write(cap.html->data, cap.html->length, sink->userdata);
+    }
+    else pd_render_html(doc, sink);
+
+    free_string(cap.html);
+    pd_free(doc);
+    return PD_OK;
+}
+
+
+/************************************************************************
+ * # Parallel Rendering
+ *
+ *  Each block renders on its own: it is opened, written and closed
+ *  without looking at the blocks around it. A large document is split
+ *  into chunks of about the same number of bytes -- between top-level
+ *  blocks, or between the rows of a compacted document -- and the
+ *  chunks are rendered into buffers of their own by several threads at
+ *  once. The buffers are then written in order.
+ *
+ *  There are a few chunks for each thread, taken in turn, so a thread
+ *  that finishes early takes more of them.
+ *
+ ************************************************************************/
+
+/** The fewest bytes of input worth a thread of their own. */
+#define MIN_CHUNK (64 << 10)
+
+/** The number of chunks split for each thread. */
+#define CHUNKS_PER_WORKER 4
+
+/**
+ * A type to hold a range of a document, rendered by one thread.
+ *
+ * - member first: The first span, or row, of the chunk.
+ * - member last: The span, or row, after the last.
+ * - member ext: The extensions of the rows before `first`.
+ * - member html: The rendered HTML, or `NULL` if it could not be
+ *   buffered.
+ */
+typedef struct Chunk
+{
+    size_t first;       /* First span or row of the chunk. */
+    size_t last;        /* Span or row after the last. */
+    size_t ext;         /* Extensions of the rows before `first`. */
+    String *html;       /* Rendered HTML, or `NULL`. */
+} Chunk;
+
+/** The chunks of a document being rendered by several threads. */
+typedef struct Render
+{
+    const PdDoc *doc;       /* The document. */
+    Chunk *chunks;          /* Every chunk, in order. */
+    size_t count;           /* Number of chunks. */
+    size_t next;            /* Next chunk to take. */
+    pthread_mutex_t lock;   /* Guards `next`. */
+} Render;
+
+/** Get the number of spans, or rows, a document can be split between. */
+static size_t count_units(const PdDoc *doc)
+{
+    return doc->table ? doc->table->length : doc->spans.length;
+}
+
+
+/**
+ * Get the offset of the bytes of a span, or row, of a document.
+ *
+ * The bytes of a row are its text in the table. The span, or row,
+ * after the last starts at the end of the bytes -- which, for a
+ * repaired document, may be before the start of its last span.
+ */
+static size_t unit_start(const PdDoc *doc, const size_t i)
+{
+    if (doc->table) return i ? doc->table->ends[i - 1] : 0;
+    if (i == doc->spans.length) return doc->length;
+    return doc->spans.items[i].start;
+}
+
+
+/** Get the first span, or row, from `lo` on that starts at `at` or later. */
+static size_t find_unit(const PdDoc *doc, size_t lo, const size_t at)
+{
+    size_t hi  = count_units(doc);
+    size_t mid = 0;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (unit_start(doc, mid) < at) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+
+/** Report each block of a chunk to a set of callbacks. */
+static void replay_chunk(const PdDoc *doc, const Chunk *c, const Callbacks *cb)
+{
+    if (doc->table) replay_rows(doc->table, c->first, c->last, c->ext, cb);
+    else replay_spans(doc, c->first, c->last, cb);
+}
+
+
+/** Render chunks into their buffers until every one has been taken. */
+static void *run_renderer(void *arg)
+{
+    Render *r = arg;
+    const PdDoc *doc = r->doc;
+    const Chunk *c = NULL;
+    size_t next  = 0;
+    size_t bytes = 0;           /* Bytes of the chunk. */
+    Capture cap  = { NULL, false };
+    PdSink sink  = { capture_html, &cap };
+    Html h;
+    Callbacks cb = html_callbacks(&h, &sink);
+
+    while (true) {
+        pthread_mutex_lock(&r->lock);
+        next = r->next++;
+        pthread_mutex_unlock(&r->lock);
+
+        if (next >= r->count) break;
+        c = &r->chunks[next];
+        bytes = unit_start(doc, c->last);
+        bytes = (bytes > unit_start(doc, c->first)) ?
+                bytes - unit_start(doc, c->first) : 0;
+
+        /* Most HTML is a little longer than its Markdown. */
+        if (!(cap.html = try_init_string(bytes + bytes / 4 + 64))) continue;
+        cap.nomem = false;
+        replay_chunk(doc, c, &cb);
+        if (cap.nomem) free_string(cap.html);
+        else r->chunks[next].html = cap.html;
+    }
+    free_html(&h);
+    return NULL;
+}
+
+
+/**
+ * Render a parsed document as HTML5, using several threads.
+ *
+ *  The HTML written is the same as that of `pd_render_html()`, and is
+ *  written from the calling thread, in order, once every chunk has been
+ *  rendered. A document too small to be worth splitting, or a render
+ *  that cannot allocate its threads, is rendered on the calling thread
+ *  alone. A chunk whose buffer could not be allocated is rendered
+ *  straight to the sink in its turn, so the HTML is always complete.
+ *
+ * - parameter doc: The document to render.
+ * - parameter workers: The most threads to render with, counting the
+ *   calling thread, or zero for one for each online processor.
+ * - parameter sink: Where the HTML is written.
+ */
+void pd_render_html_parallel(const PdDoc *doc, size_t workers,
+                             const PdSink *sink)
+{
+    size_t units = count_units(doc);
+    size_t bytes = unit_start(doc, units);
+    size_t count = 0;       /* Chunks to split the document into. */
+    size_t first = 0;       /* First span or row of the next chunk. */
+    size_t last  = 0;       /* Span or row after the last of the chunk. */
+    size_t ext   = 0;       /* Extensions of the rows before `first`. */
+    size_t started = 0;     /* Threads started. */
+    size_t i = 0;
+    long cpus = 0;
+    pthread_t *threads = NULL;
+    Render r = { doc, NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+    Html h;
+    Callbacks cb = html_callbacks(&h, sink);
+
+    if (workers == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    if (workers > bytes / MIN_CHUNK) workers = bytes / MIN_CHUNK;
+    count = workers * CHUNKS_PER_WORKER;
+    if (doc->error || workers < 2 ||
+        !(r.chunks = calloc(count, sizeof(Chunk))) ||
+        !(threads = calloc(workers - 1, sizeof(pthread_t)))) {
+        free(r.chunks);
+        pd_render_html(doc, sink);
+        return;
+    }
+
+    /* Split the bytes evenly, each chunk ending before a span or row. */
+    for (i = 1; i <= count; i++, first = last) {
+        last = (i == count) ? units : find_unit(doc, first, bytes / count * i);
+        if (last == first) continue;
+        r.chunks[r.count].first = first;
+        r.chunks[r.count].last  = last;
+        r.chunks[r.count].ext   = ext;
+        r.count++;
+        if (doc->table) ext += count_exts(doc->table, first, last);
+    }
+
+    for (started = 0; started < workers - 1; started++) {
+        if (pthread_create(&threads[started], NULL, run_renderer, &r)) break;
+    }
+    run_renderer(&r);
+    for (i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&r.lock);
+
+    for (i = 0; i < r.count; i++) {
+        if (r.chunks[i].html) {
+            sink->write(r.chunks[i].html->data, r.chunks[i].html->length,
+                        sink->userdata);
+            free_string(r.chunks[i].html);
+        }
+        else replay_chunk(doc, &r.chunks[i], &cb);
+    }
+    free_html(&h);
+    free(threads);
+    free(r.chunks);
+}
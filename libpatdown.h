@@ -0,0 +1,300 @@
+/**
+ * libpatdown.h -- public interface of the patdown library
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *  This is the only header a program embedding patdown needs. Every
+ *  document is parsed into its own `PdDoc`, and the library holds no
+ *  state of its own, so any number of documents can be parsed and
+ *  rendered at once -- from any number of threads, as long as a single
+ *  document is not freed while it is being rendered.
+ *
+ *  The library never exits the process. A document that could not be
+ *  parsed is still returned, empty, and `pd_error()` reports why.
+ *
+ ************************************************************************/
+
+#ifndef LIBPATDOWN_DOT_H
+#define LIBPATDOWN_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Mark a function as part of the shared library's interface. */
+#if defined(__GNUC__)
+#define PD_EXPORT __attribute__((visibility("default")))
+#else
+#define PD_EXPORT
+#endif
+
+/************************************************************************
+ * # Library Types
+ ************************************************************************/
+
+/** A parsed Markdown document. */
+typedef struct PdDoc PdDoc;
+
+
+/** Reasons a document could not be parsed. */
+typedef enum
+{
+    PD_OK,                  /* The document was parsed. */
+    PD_ERR_NOMEM,           /* Memory could not be allocated. */
+    PD_ERR_INPUT_LIMIT,     /* The input is larger than `max_input`. */
+    PD_ERR_BLOCK_LIMIT,     /* There are more blocks than `max_blocks`. */
+    PD_ERR_DEPTH_LIMIT,     /* Blocks are nested deeper than `max_depth`. */
+    PD_ERR_ARENA_LIMIT,     /* The document needs more than `max_arena`. */
+    PD_ERR_FORMAT,          /* The bytes are not a saved document. */
+    PD_ERR_OPTIONS          /* The options are not ones the library knows. */
+} PdError;
+
+
+/** The nesting depth of containers allowed when `max_depth` is zero. */
+#define PD_DEFAULT_MAX_DEPTH 64
+
+/**
+ * Kinds of block a parse can be limited to, as bits of a mask.
+ *
+ * Every block is still parsed, since each kind can only be told apart
+ * from the blocks around it, but only the kinds in the mask are kept.
+ * Nothing of the rest -- not even its text -- is copied.
+ */
+typedef enum
+{
+    PD_ONLY_ATX       = 1 << 0,     /* ATX headers. */
+    PD_ONLY_SETEXT    = 1 << 1,     /* Setext headers. */
+    PD_ONLY_PARAGRAPH = 1 << 2,     /* Paragraphs. */
+    PD_ONLY_INDENTED  = 1 << 3,     /* Indented code blocks. */
+    PD_ONLY_FENCED    = 1 << 4,     /* Fenced code blocks. */
+    PD_ONLY_HTML      = 1 << 5,     /* HTML blocks. */
+    PD_ONLY_RULE      = 1 << 6,     /* Horizontal rules. */
+    PD_ONLY_QUOTE     = 1 << 7,     /* The starts and ends of blockquotes. */
+    PD_ONLY_REFS      = 1 << 8      /* Link reference definitions. */
+} PdOnly;
+
+/**
+ * A type to hold the options of a parse.
+ *
+ * A `NULL` pointer to options is the same as options of all zeroes.
+ * Each cap limits a single document: exceeding it stops the parse of
+ * that document, which is then empty and reports the error.
+ *
+ * Options are passed by pointer and start with their size, so that new
+ * options can be added at the end without breaking callers built with
+ * an older header: the options they do not know of are zero. Options
+ * should start as `PD_OPTIONS_INIT`, which sets `size` and zeroes the
+ * rest.
+ *
+ * - member size: `sizeof(PdOptions)`, as the caller was built with it.
+ *   A parse with a `size` the library cannot read -- smaller than its
+ *   first options, or larger with any of the extra options set --
+ *   fails with `PD_ERR_OPTIONS`.
+ * - member raw: Skip UTF-8 validation of the input. By default any
+ *   NULL-bytes and invalid UTF-8 are replaced with U+FFFD.
+ * - member max_input: Bytes of input, or zero for no cap.
+ * - member max_blocks: Blocks in the document, or zero for no cap.
+ * - member max_depth: Containers nested inside one another, or zero for
+ *   `PD_DEFAULT_MAX_DEPTH`. Nesting is never unbounded, since each
+ *   level is parsed with a recursive call.
+ * - member max_arena: Bytes of memory held by the parsed document, or
+ *   zero for no cap.
+ * - member excerpt_blocks: Parse only the leading blocks of text of the
+ *   document -- not counting blank lines, link reference definitions or
+ *   blockquotes -- or zero for the whole document.
+ * - member excerpt_bytes: Parse only the leading blocks that hold this
+ *   many bytes of text, or zero for the whole document. The block that
+ *   reaches it is kept whole, and any blockquote around it is closed.
+ * - member excerpt_refs: Also keep the link reference definitions of
+ *   the rest of the document, so references in an excerpt resolve. The
+ *   rest is then parsed, though none of its other blocks are kept.
+ *
+ * - member only: The kinds of block kept, as `PdOnly` bits, or zero for
+ *   every kind. An excerpt counts only the blocks that are kept.
+ *
+ * Unlike a cap, an excerpt is not an error: the document holds the
+ * blocks up to where the parse stopped.
+ */
+typedef struct PdOptions
+{
+    size_t size;            /* `sizeof(PdOptions)`, as the caller knows it. */
+    bool raw;               /* Skip UTF-8 validation of the input. */
+    size_t max_input;       /* Bytes of input. */
+    size_t max_blocks;      /* Blocks in the document. */
+    size_t max_depth;       /* Containers nested inside one another. */
+    size_t max_arena;       /* Bytes of memory held by the document. */
+    size_t excerpt_blocks;  /* Blocks of text parsed, or zero for all. */
+    size_t excerpt_bytes;   /* Bytes of text parsed, or zero for all. */
+    bool excerpt_refs;      /* Keep the link definitions after them. */
+    unsigned only;          /* Kinds of block kept, or zero for all. */
+} PdOptions;
+
+/** Options of all zeroes, of the size this header gives them. */
+#define PD_OPTIONS_INIT { .size = sizeof(PdOptions) }
+
+
+/**
+ * A type to receive rendered output.
+ *
+ * - member write: Called with each span of output, in order.
+ * - member userdata: Passed as the last argument of `write`.
+ */
+typedef struct PdSink
+{
+    void (*write)(const uint8_t *data, const size_t length, void *userdata);
+    void *userdata;
+} PdSink;
+
+
+/**
+ * A type to describe an edit of a parsed document.
+ *
+ * The bytes of the old document in `[offset, offset + removed)` were
+ * replaced by the bytes of the new document in `[offset, offset +
+ * inserted)`. Every other byte is unchanged.
+ *
+ * - member offset: The first byte that changed.
+ * - member removed: The number of bytes of the old document replaced.
+ * - member inserted: The number of bytes of the new document that
+ *   replaced them.
+ */
+typedef struct PdEdit
+{
+    size_t offset;      /* First byte that changed. */
+    size_t removed;     /* Bytes of the old document replaced. */
+    size_t inserted;    /* Bytes of the new document replacing them. */
+} PdEdit;
+
+
+/**
+ * A type to hold the range of bytes a block was parsed from.
+ *
+ * A block includes its indentation and its last line ending. A block
+ * inside of a blockquote is parsed without the markers of each line,
+ * but its range is still that of the document, markers and all.
+ *
+ * - member start: The offset of the block's first byte.
+ * - member end: The offset of the byte after the block.
+ */
+typedef struct PdSpan
+{
+    size_t start;       /* Offset of the block's first byte. */
+    size_t end;         /* Offset of the byte after the block. */
+} PdSpan;
+
+
+/**
+ * A type to hold a position in a document, as a person would count it.
+ *
+ * - member line: The line, counted from one.
+ * - member column: The byte of the line, counted from one.
+ */
+typedef struct PdLocation
+{
+    size_t line;        /* Line, counted from one. */
+    size_t column;      /* Byte of the line, counted from one. */
+} PdLocation;
+
+
+/** A bounded cache of rendered documents, shared between threads. */
+typedef struct PdCache PdCache;
+
+/**
+ * A type to hold the counters of a cache.
+ *
+ * - member hits: Renders answered from the cache.
+ * - member misses: Renders that had to parse the document.
+ * - member evictions: Documents dropped to make room for others.
+ * - member entries: Documents in the cache.
+ * - member bytes: Memory held by the documents in the cache.
+ */
+typedef struct PdCacheStats
+{
+    size_t hits;        /* Renders answered from the cache. */
+    size_t misses;      /* Renders that had to parse the document. */
+    size_t evictions;   /* Documents dropped to make room for others. */
+    size_t entries;     /* Documents in the cache. */
+    size_t bytes;       /* Memory held by the documents in the cache. */
+} PdCacheStats;
+
+
+/************************************************************************
+ * # Library Methods
+ ************************************************************************/
+
+/** Parse a document from a range of bytes, which need not be terminated. */
+PD_EXPORT PdDoc *pd_parse(const uint8_t *buf, const size_t len,
+                          const PdOptions *opts);
+
+/** Get the reason a document could not be parsed, or `PD_OK`. */
+PD_EXPORT PdError pd_error(const PdDoc *doc);
+
+/** Get a description of an error. */
+PD_EXPORT const char *pd_strerror(const PdError error);
+
+/** Get the kinds of block named in a comma-separated list. */
+PD_EXPORT bool pd_only_names(const char *names, unsigned *only);
+
+/** Render a parsed document as HTML5, writing it to a sink. */
+PD_EXPORT void pd_render_html(const PdDoc *doc, const PdSink *sink);
+
+/** Render a parsed document as HTML5, using several threads. */
+PD_EXPORT void pd_render_html_parallel(const PdDoc *doc, size_t workers,
+                                       const PdSink *sink);
+
+/** Write every link of a document as a line of JSON, without rendering. */
+PD_EXPORT PdError pd_extract_links(const uint8_t *buf, const size_t len,
+                                   const PdOptions *opts,
+                                   const PdSink *sink);
+
+/** Render the visible text of a parsed document, split by section. */
+PD_EXPORT void pd_render_text(const PdDoc *doc, const bool code,
+                              const PdSink *sink);
+
+/** Update a parsed document after an edit, parsing only what changed. */
+PD_EXPORT PdError pd_reparse(PdDoc *doc, const uint8_t *buf,
+                             const size_t len, const PdEdit *edit);
+
+/** Replace the blocks of a document with a compact table of them. */
+PD_EXPORT PdError pd_compact(PdDoc *doc);
+
+/** Write a document, its blocks and its source in a binary format. */
+PD_EXPORT PdError pd_save(const PdDoc *doc, const uint8_t *buf,
+                          const size_t len, const PdSink *sink);
+
+/** Use the bytes of a saved document in place, without parsing. */
+PD_EXPORT PdDoc *pd_load(const uint8_t *data, const size_t size);
+
+/** Get the source of a loaded document, or `NULL`. */
+PD_EXPORT const uint8_t *pd_source(const PdDoc *doc, size_t *len);
+
+/** Get the range of bytes each block was parsed from, in order. */
+PD_EXPORT size_t pd_block_spans(const PdDoc *doc, PdSpan *spans,
+                                const size_t max);
+
+/** Get the line and column of an offset into a document. */
+PD_EXPORT PdError pd_locate(PdDoc *doc, const uint8_t *buf, size_t offset,
+                            PdLocation *loc);
+
+/** Free a parsed document, if it exists. */
+PD_EXPORT void pd_free(PdDoc *doc);
+
+/** Allocate a cache holding at most max_bytes of rendered documents. */
+PD_EXPORT PdCache *pd_cache_init(const size_t max_bytes);
+
+/** Free a cache and every document it holds, if it exists. */
+PD_EXPORT void pd_cache_free(PdCache *cache);
+
+/** Get the counters of a cache. */
+PD_EXPORT void pd_cache_stats(PdCache *cache, PdCacheStats *stats);
+
+/** Render a range of bytes as HTML5, from a cache when it can be. */
+PD_EXPORT PdError pd_render_html_cached(PdCache *cache, const uint8_t *buf,
+                                        const size_t len,
+                                        const PdOptions *opts,
+                                        const PdSink *sink);
+
+#endif
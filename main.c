@@ -8,14 +8,23 @@
  * 
  ************************************************************************/
 
+#include <errno.h>
 #include <getopt.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "build.h"
 #include "errors.h"
+#include "html.h"
 #include "patdown.h"
+#include "pipeline.h"
+#include "serve.h"
+#include "stream.h"
 #include "strings.h"
+#include "text.h"
 
 static const char *_program = "patdown";
 static const char *_version = "0.0.1";
@@ -41,9 +50,36 @@ static void print_help()
     printf("\n");
     printf("  OPTIONS:\n");
     printf("  -5               Output HTML5 [default]\n");
+    printf("  -a, --save       Output the parsed document in a binary\n");
+    printf("                   format that loads without parsing\n");
+    printf("  --build <src>    Convert the changed files of src to the\n");
+    printf("                   output directory named by <inputfile>\n");
+    printf("  --cache <MiB>    Cache rendered documents for --serve\n");
+    printf("  --no-code        Leave code blocks out of --text\n");
     printf("  -d               Output parsing information\n");
+    printf("  --excerpt-blocks <count>\n");
+    printf("                   Stop after count blocks of text\n");
+    printf("  --excerpt-bytes <count>\n");
+    printf("                   Stop after the block that brings the\n");
+    printf("                   text to count bytes\n");
+    printf("  --excerpt-refs   Keep the link definitions after an\n");
+    printf("                   excerpt\n");
     printf("  -h, --help       Show help\n");
+    printf("  --io <mode>      Set how --build reads and writes files:\n");
+    printf("                   uring [default], pread or single\n");
+    printf("  -j <count>       Set threads for --build and --serve\n");
+    printf("  -l, --links      Output every link as a line of JSON,\n");
+    printf("                   and --build to .jsonl files\n");
     printf("  -o <file>        Set output file [default: stdout]\n");
+    printf("  --only <kinds>   Keep only the kinds of block listed, as\n");
+    printf("                   atx,setext,paragraph,indented,fenced,\n");
+    printf("                   html,hr,quote,refs\n");
+    printf("  -p, --pipe       Read, parse and print the input on\n");
+    printf("                   separate threads\n");
+    printf("  -r, --raw        Skip UTF-8 validation of the input\n");
+    printf("  --serve <socket> Render documents sent to a Unix socket\n");
+    printf("  -t, --text       Output the visible text, with a form\n");
+    printf("                   feed before each header\n");
     printf("  -v, --version    Show version\n");
     printf("\n");
     printf("\n");
@@ -73,44 +109,179 @@ static FILE *open_file(const char *fileName, const char *mode)
 }
 
 
+/**
+ * Read the number given to an option, or exit if it is not one.
+ *
+ * - parameter option: The name of the option, for the message.
+ * - parameter arg: The argument of the option.
+ *
+ * - returns: The number, if `arg` is all decimal digits and fits in a
+ *   `size_t`.
+ */
+static size_t read_count(const char *option, const char *arg)
+{
+    unsigned long long value = 0;
+    char *end = NULL;
+
+    errno = 0;
+    if (arg[0] >= '0' && arg[0] <= '9') value = strtoull(arg, &end, 10);
+    if (!end || *end || errno || value > SIZE_MAX) {
+        fprintf(stderr, "FATAL: invalid number for %s: '%s'\n", option,
+                arg);
+        exit(EXIT_FAILURE);
+    }
+    return (size_t)value;
+}
+
+
 /************************************************************************
  * # Reading Input From Files
  ************************************************************************/
 
+/** The number of bytes requested from each call to `fread()`. */
+#define READ_BUF 5120
+
+/** Write each span of output to the file stream in `userdata`. */
+static void write_file(const uint8_t *data, const size_t length,
+                       void *userdata)
+{
+    fwrite(data, 1, length, userdata);
+}
+
+
 /**
- * Read all bytes from a supplied input file stream.
+ * Parse all bytes from a supplied input file stream as they are read.
  *
- * Bytes are read into a `String` buffer that is reallocated by an order
- * of 5120 bytes in order to make room for the entire file.
+ * Each chunk read from the file is fed to a `Stream`, which reports the
+ * blocks as soon as they are closed. Only the blocks that are still
+ * open are kept in memory, so a pipe of any length can be parsed.
  *
  * - parameter ifp: Input file stream (must be opened for reading).
+ * - parameter cb: The callbacks that print each block.
+ * - parameter repair: Replace NULL-bytes and invalid UTF-8 with U+FFFD.
+ * - parameter pipe: Read and print on threads of their own, so that the
+ *   input is read, parsed and printed at the same time.
+ * - parameter excerpt: Where the parse stops. Nothing more is read once
+ *   it has.
+ * - parameter only: The kinds of block printed, or zero for all.
  *
- * - returns: A `String` node initialized with the bytes read from file, 
- *   the memory allocated for this node (in bytes), and the number of bytes 
- *   actually read from the input file stream.
+ * - returns: `PD_OK`, or the error that stopped the parse.
  */
-static String *read_all_input_bytes(FILE *ifp)
+static PdError stream_input_bytes(FILE *ifp, const Callbacks *cb,
+                                  const bool repair, const bool pipe,
+                                  const Excerpt *excerpt,
+                                  const unsigned only)
 {
-    int ret    = 0;         /* The return value from fread(). */
-    size_t lim = 5120;      /* Max number of bytes to allocate for. */
-    size_t order  = 1;      /* Multiplier for lim if we realloc() memory. */
-    String *bytes = init_string(lim);
+    uint8_t chunk[READ_BUF];    /* The bytes from each call to fread(). */
+    size_t ret = 0;             /* The return value from fread(). */
+    Stream *s  = NULL;
+    PdError error = PD_OK;
     
-    if (!ifp) return NULL;
+    if (!ifp) return PD_OK;
+    if (pipe) return pipe_stream(ifp, cb, repair, excerpt, only);
+    if (!(s = init_stream(cb, repair))) return PD_ERR_NOMEM;
+    s->parser->excerpt = *excerpt;
+    s->parser->only    = only;
     
-    while (true) {
-        ret = fread(bytes->data + bytes->length, 1, 
-                    bytes->allocd - bytes->length - 1, ifp);
-        bytes->length += ret;
-        
-        if (feof(ifp)) break;
-        else {
-            lim += lim * ++order;
-            realloc_string(bytes, lim);
-        }
+    while (!error && !excerpt_ended(s->parser) &&
+           (ret = fread(chunk, 1, sizeof(chunk), ifp)) > 0) {
+        error = feed_stream(s, chunk, ret);
+    }
+    if (!error) error = finish_stream(s);
+    free_stream(s);
+    return error;
+}
+
+
+/**
+ * Read all bytes from a supplied input file stream.
+ *
+ * - returns: The whole input, to be free'd, or `NULL` if memory could
+ *   not be allocated.
+ */
+static String *read_input_bytes(FILE *ifp)
+{
+    String *input = try_init_string(READ_BUF);  /* The whole input. */
+    size_t ret = 0;             /* The return value from fread(). */
+    bool room  = true;          /* Whether the input had room to grow. */
+
+    if (!input) return NULL;
+    while ((room = try_reserve_string(input, READ_BUF)) &&
+           (ret = fread(input->data + input->length, 1, READ_BUF, ifp)) > 0) {
+        input->length += ret;
+    }
+    if (!room) {
+        free_string(input);
+        return NULL;
     }
-    bytes->data[bytes->length] = '\0';
-    return bytes;
+    return input;
+}
+
+
+/**
+ * Parse all bytes from a supplied input file stream, and save them.
+ *
+ * The whole input is read before it is parsed, and the document is
+ * written in the binary format of `pd_save()`.
+ *
+ * - parameter ifp: Input file stream (must be opened for reading).
+ * - parameter ofp: Output file stream (must be opened for writing).
+ * - parameter raw: Skip UTF-8 validation of the input.
+ * - parameter excerpt: Where the parse stops.
+ * - parameter only: The kinds of block kept, or zero for all.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse.
+ */
+static PdError save_input_bytes(FILE *ifp, FILE *ofp, const bool raw,
+                                const Excerpt *excerpt, const unsigned only)
+{
+    String *input = read_input_bytes(ifp);      /* The whole input. */
+    PdOptions opts = PD_OPTIONS_INIT;
+    PdSink sink = { write_file, ofp };
+    PdDoc *doc  = NULL;
+    PdError error = PD_OK;
+
+    if (!input) return PD_ERR_NOMEM;
+    opts.raw            = raw;
+    opts.excerpt_blocks = excerpt->blocks;
+    opts.excerpt_bytes  = excerpt->bytes;
+    opts.excerpt_refs   = excerpt->refs;
+    opts.only           = only;
+    doc   = pd_parse(input->data, input->length, &opts);
+    error = pd_save(doc, input->data, input->length, &sink);
+    pd_free(doc);
+    free_string(input);
+    return error;
+}
+
+
+/**
+ * Parse all bytes from a supplied input file stream, and write each of
+ * their links as a line of JSON -- see `pd_extract_links()`.
+ *
+ * - parameter ifp: Input file stream (must be opened for reading).
+ * - parameter ofp: Output file stream (must be opened for writing).
+ * - parameter excerpt: Where the parse stops.
+ * - parameter only: The kinds of block searched, or zero for all.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse.
+ */
+static PdError link_input_bytes(FILE *ifp, FILE *ofp, const Excerpt *excerpt,
+                                const unsigned only)
+{
+    String *input = read_input_bytes(ifp);      /* The whole input. */
+    PdOptions opts = PD_OPTIONS_INIT;
+    PdSink sink = { write_file, ofp };
+    PdError error = PD_OK;
+
+    if (!input) return PD_ERR_NOMEM;
+    opts.excerpt_blocks = excerpt->blocks;
+    opts.excerpt_bytes  = excerpt->bytes;
+    opts.excerpt_refs   = excerpt->refs;
+    opts.only           = only;
+    error = pd_extract_links(input->data, input->length, &opts, &sink);
+    free_string(input);
+    return error;
 }
 
 
@@ -123,30 +294,91 @@ int main(int argc, char **argv)
     char *iFileName  = NULL;        /* Input file name. */
     FILE *ifp        = stdin;       /* Input file stream. */
     char *oFileName  = NULL;        /* Output file name. */
+    char *sockName   = NULL;        /* Socket to serve renders on. */
+    char *buildDir   = NULL;        /* Source tree to build. */
+    size_t workers   = 0;           /* Threads to build or serve with. */
+    size_t cacheMiB  = 0;           /* Render cache size when serving. */
+    buildio_t buildIo = BUILD_IO_URING; /* How builds read and write. */
     FILE *ofp        = stdout;      /* Output file stream. */
     output_t outType = OUT_HTML5;   /* Output type. */
     int helpFlag     = 0;           /* Flag for help dialog. */
     int versionFlag  = 0;           /* Flag for version dialog. */
-    String *rawBytes = NULL;        /* Raw bytes read from inputfile. */
+    int rawFlag      = 0;           /* Flag to skip UTF-8 validation. */
+    int pipeFlag     = 0;           /* Flag to pipeline the stream. */
+    int refsFlag     = 0;           /* Flag to keep later link refs. */
+    int noCodeFlag   = 0;           /* Flag to leave code out of text. */
+    Excerpt excerpt  = { 0, 0, false }; /* Where parsing stops. */
+    unsigned only    = 0;           /* Kinds of block kept, or all. */
+    PdError error    = PD_OK;       /* Error that stopped the parse. */
+    Callbacks cb;                   /* Callbacks that print each block. */
+    PdSink sink;                    /* Where the output is written. */
+    Html html;                      /* Renderer of the HTML. */
+    TextOut text;                   /* Renderer of the visible text. */
     
     while (true) {
         int optindex = 0;
         const struct option long_opts[] = {
           {"help",      no_argument,    &helpFlag,      1},
           {"version",   no_argument,    &versionFlag,   1},
+          {"raw",       no_argument,    &rawFlag,       1},
+          {"pipe",      no_argument,    &pipeFlag,      1},
+          {"excerpt-refs", no_argument, &refsFlag,      1},
+          {"no-code",   no_argument,    &noCodeFlag,    1},
+          {"save",      no_argument,        NULL,       'a'},
+          {"links",     no_argument,        NULL,       'l'},
+          {"text",      no_argument,        NULL,       't'},
+          {"serve",     required_argument,  NULL,       'S'},
+          {"cache",     required_argument,  NULL,       'C'},
+          {"build",     required_argument,  NULL,       'B'},
+          {"io",        required_argument,  NULL,       'I'},
+          {"excerpt-blocks", required_argument, NULL,   'E'},
+          {"excerpt-bytes",  required_argument, NULL,   'Y'},
+          {"only",      required_argument,  NULL,       'O'},
           {0,           0,              0,              0},
         };
         
         /* Get character code or EOF for current argument. */
-        int c = getopt_long(argc, argv, "5dho:v", long_opts, &optindex);
+        int c = getopt_long(argc, argv, "5adhj:lo:prtv", long_opts, &optindex);
         if (c == -1) break;
         
         switch (c) {
             case '5': outType = OUT_HTML5;  break;
+            case 'a': outType = OUT_SAVED;  break;
+            case 'B': buildDir = optarg;    break;
+            case 'C': cacheMiB = read_count("--cache", optarg); break;
             case 'd': outType = OUT_PARSED; break;
+            case 'E':
+                excerpt.blocks = read_count("--excerpt-blocks", optarg);
+                break;
             case 'h': helpFlag = 1;         break;
+            case 'I':
+                if (!strcmp(optarg, "uring")) buildIo = BUILD_IO_URING;
+                else if (!strcmp(optarg, "pread")) buildIo = BUILD_IO_PREAD;
+                else if (!strcmp(optarg, "single")) buildIo = BUILD_IO_SINGLE;
+                else {
+                    fprintf(stderr, "FATAL: unknown --io mode: '%s'\n",
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j': workers = read_count("-j", optarg); break;
+            case 'l': outType = OUT_LINKS;  break;
             case 'o': oFileName = optarg;   break;
+            case 'O':
+                if (!pd_only_names(optarg, &only)) {
+                    fprintf(stderr, "FATAL: unknown --only kinds: '%s'\n",
+                            optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'p': pipeFlag = 1;         break;
+            case 'r': rawFlag = 1;          break;
+            case 'S': sockName = optarg;    break;
+            case 't': outType = OUT_TEXT;   break;
             case 'v': versionFlag = 1;      break;
+            case 'Y':
+                excerpt.bytes = read_count("--excerpt-bytes", optarg);
+                break;
             default: break;
         }
     }
@@ -166,20 +398,57 @@ int main(int argc, char **argv)
     if (helpFlag) print_help();
     else if (versionFlag) print_version();
 
+    excerpt.refs = refsFlag;
+    if (buildDir) {
+        BuildOptions opts = { workers, rawFlag, buildIo, excerpt.blocks,
+                              excerpt.bytes, excerpt.refs, only,
+                              outType == OUT_LINKS };
+        if (!iFileName) {
+            fprintf(stderr, "FATAL: --build needs an output directory\n");
+            return EXIT_FAILURE;
+        }
+        return build_tree(buildDir, iFileName, &opts);
+    }
+
+    if (sockName) {
+        ServeOptions opts = { workers, cacheMiB << 20, PD_OPTIONS_INIT };
+        opts.doc.raw            = rawFlag;
+        opts.doc.excerpt_blocks = excerpt.blocks;
+        opts.doc.excerpt_bytes  = excerpt.bytes;
+        opts.doc.excerpt_refs   = excerpt.refs;
+        opts.doc.only           = only;
+        return serve_socket(sockName, &opts);
+    }
+
     if (iFileName) ifp = open_file(iFileName, "r");
-    if (oFileName) ofp = open_file(oFileName, "w");
+    if (oFileName) ofp = open_file(oFileName, "wb");
     
-    rawBytes = read_all_input_bytes(ifp);
-    
-    markdown(rawBytes);
-    if (rawBytes) free_string(rawBytes);
-    
-    debug_print_queue();
+    if (outType == OUT_SAVED) {
+        error = save_input_bytes(ifp, ofp, rawFlag, &excerpt, only);
+    }
+    else if (outType == OUT_LINKS) {
+        error = link_input_bytes(ifp, ofp, &excerpt, only);
+    }
+    else {
+        sink.write    = write_file;
+        sink.userdata = ofp;
+        if (outType == OUT_HTML5) cb = html_callbacks(&html, &sink);
+        else if (outType == OUT_TEXT) {
+            cb = text_callbacks(&text, &sink, !noCodeFlag);
+        }
+        else cb = debug_callbacks();
+        error = stream_input_bytes(ifp, &cb, !rawFlag, pipeFlag, &excerpt,
+                                   only);
+        if (outType == OUT_HTML5) free_html(&html);
+        else if (outType == OUT_TEXT) free_text_out(&text);
+    }
     
-    if (iFileName && ifp) fclose(ofp);
+    if (iFileName && ifp) fclose(ifp);
     if (oFileName && ofp) fclose(ofp);
 
-    free_markdown();
-    
+    if (error) {
+        fprintf(stderr, "ERROR: %s.\n", pd_strerror(error));
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
@@ -1,17 +1,23 @@
 /**
  * markdown.c -- markdown queue implementation
- * 
+ *
  *  author:     Pat Gaffney <pat@hypepat.com>
  *  created:    2016-06-15
  *  modified:   2016-12-22
  *  project:    patdown
- * 
+ *
  ************************************************************************/
 
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
+#include "arena.h"
 #include "errors.h"
 #include "patdown.h"
 #include "strings.h"
@@ -20,295 +26,624 @@
 /************************************************************************
  * # Markdown Blocks
  *
- * Markdown nodes are created and inserted into a queue. They are 
- * distinguished by their `mdblock_t` and their position in the queue. 
+ * Markdown nodes are created and inserted into a queue. They are
+ * distinguished by their `mdblock_t` and their position in the queue.
  * The queue forms a linear structure of nodes parsed from the file.
  *
+ * Every node, its text, and its extension are allocated from the arena
+ * of the queue, so the whole queue is free'd at once.
+ *
  ************************************************************************/
 
 /** A container node for a parsed Markdown block. */
 typedef struct Markdown
 {
-    String *string;         /* String value of parsed block. */
+    uint8_t *data;          /* Text of parsed block, if it has any. */
+    size_t length;          /* Number of bytes of text. */
+    size_t allocd;          /* Number of bytes allocated for text. */
     mdblock_t type;         /* Type (element) of parsed block. */
     void *addtinfo;         /* (Optional) additional block data. */
     struct Markdown *next;  /* Pointer to next node in the queue. */
+    size_t start;           /* Offset of the block's first byte. */
+    size_t end;             /* Offset of the byte after the block. */
+    uint16_t inlines;       /* Inline metacharacters of its text. */
 } Markdown;
 
 
-/** Markdown Queue Pointers */
-static Markdown *head = NULL;   /* Head of the queue. */
-static Markdown *tail = NULL;   /* Tail of the queue. */
-
-/** Allow the parser to set the current block before inserting it. */
-static mdblock_t currentblk = UNKNOWN;
+/** The smallest number of bytes allocated for the text of a block. */
+#define MIN_TEXT 64
+
+/** Names of each `mdblock_t`, for debug-printing. */
+static const char *blocknames[25] = {
+    "UNKNOWN",
+    "BLANK_LINE",
+    "ATX_HEADER_1",
+    "ATX_HEADER_2",
+    "ATX_HEADER_3",
+    "ATX_HEADER_4",
+    "ATX_HEADER_5",
+    "ATX_HEADER_6",
+    "HORIZONTAL_RULE",
+    "PARAGRAPH",
+    "SETEXT_HEADER_1",
+    "SETEXT_HEADER_2",
+    "INDENTED_CODE_BLOCK",
+    "FENCED_CODE_BLOCK",
+    "HTML_BLOCK",
+    "HTML_COMMENT",
+    "LINK_REFERENCE_DEF",
+    "BLOCKQUOTE_START",
+    "BLOCKQUOTE_END",
+    "UNORDERED_LIST_START",
+    "UNORDERED_LIST_ITEM",
+    "UNORDERED_LIST_END",
+    "ORDERED_LIST_START",
+    "ORDERED_LIST_ITEM",
+    "ORDERED_LIST_END"
+};
 
 /** Private Markdown queue functions. **/
-static Markdown *md_alloc_node(void);
-static bool md_insert_queue(Markdown **, Markdown **, Markdown *);
-static void free_markdown_node(Markdown *);
+static Markdown *add_node(Queue *q, const mdblock_t type);
+static bool block_has_text(const mdblock_t);
+
+
+/**
+ * Initialize an empty Markdown queue.
+ *
+ *  Each queue holds the blocks of a single document, so any number of
+ *  documents can be parsed at once.
+ *
+ * - parameter limit: The cap on the bytes of memory the queue may hold,
+ *   or zero for no cap.
+ *
+ * - returns: A pointer to the new queue, or `NULL` if memory could not
+ *   be allocated.
+ */
+Queue *init_queue(const size_t limit)
+{
+    Arena *a = init_arena(limit);
+    Queue *q = NULL;
+
+    if (!a) return NULL;
+    if (!(q = arena_alloc(a, sizeof(Queue)))) {
+        free_arena(a);
+        return NULL;
+    }
 
-/** Private Markdown extension functions. **/
-static CodeBlk *alloc_code_blk(void);
+    q->arena  = a;
+    q->head   = NULL;
+    q->tail   = NULL;
+    q->length = 0;
+    q->open   = NULL;
+    return q;
+}
 
 
 /**
- * Allocate memory for a new Markdown block.
+ * Free a Markdown queue and all the nodes in it, if it exists.
  *
- * - throws fatal_memory_error: Memory could not be allocated.
+ *  This is the external interface for freeing a Markdown queue
+ *  created by parsing a document.
  *
- * - returns: A pointer to the new Markdown node.
+ * - parameter q: The queue to be free'd.
  */
-static Markdown *md_alloc_node(void)
+void free_queue(Queue *q)
 {
-    Markdown *node = NULL;
-    node = malloc(sizeof(Markdown));
-    if (!node) throw_fatal_memory_error();
-    return node;
+    if (q) free_arena(q->arena);
 }
 
 
 /**
- * Add a Markdown node to the queue with a given set of data.
+ * Add an empty Markdown node to the tail of the queue.
  *
- * - parameter s: The actual string of parsed markdown.
+ * - parameter q: The queue to add the node to.
  * - parameter type: The block type, or, HTML element.
- * - parameter addtinfo: Any additional information -- optional.
  *
- * - returns: `true` if node is inserted, `false` if node is `NULL`.
+ * - returns: The new node, or `NULL` if it could not be allocated.
  */
-bool add_markdown(String *s, const mdblock_t type, void *addtinfo)
+static Markdown *add_node(Queue *q, const mdblock_t type)
 {
-    Markdown *node = md_alloc_node();
-    
-    /* Create an empty String node if *s was NULL. */
-    if (!s) node->string = init_string(0);
-    else    node->string = s;
-    
+    Markdown *node = arena_alloc(q->arena, sizeof(Markdown));
+    if (!node) return NULL;
+
+    node->data     = NULL;
+    node->length   = 0;
+    node->allocd   = 0;
     node->type     = type;
-    node->addtinfo = addtinfo;
+    node->addtinfo = NULL;
     node->next     = NULL;
-    
-    currentblk = UNKNOWN;
-    
-    if (md_insert_queue(&head, &tail, node)) return true;
-    else return false;
+    node->start    = 0;
+    node->end      = 0;
+    node->inlines  = 0;
+
+    if (!q->head) q->head = node;
+    else q->tail->next = node;
+
+    q->tail = node;
+    q->length++;
+    return node;
 }
 
 
 /**
- * Insert a Markdown block into the queue at the tail.
+ * Get the number of parsed Markdown blocks.
  *
- * - parameter head: The first node in the queue.
- * - parameter tail: The last node in the queue.
- * - parameter node: The node to be inserted at the tail.
- * 
- * - returns: `true` if node is inserted, `false` if node is `NULL`.
+ * - parameter q: The queue of blocks.
+ *
+ * - returns: The number of nodes in the queue.
  */
-static bool md_insert_queue(Markdown **head, Markdown **tail, Markdown *node)
+size_t get_queue_length(const Queue *q)
 {
-    if (node) {
-        if (!*head) *head = node;
-        else (*tail)->next = node;
-        
-        *tail = node;
-        return true;
-    }
-    return false;
+    return q->length;
 }
 
 
 /**
- * Get the number of parsed Markdown blocks.
+ * Detach every node after a node from a queue.
  *
- * - returns: The number of nodes in the queue.
+ *  The detached nodes keep their links to one another, and their memory
+ *  stays in the arena of the queue, so a run of them can be added back
+ *  with `splice_queue()`.
+ *
+ * - parameter q: The queue to cut.
+ * - parameter after: The node that becomes the tail, or `NULL` to
+ *   detach every node.
+ * - parameter length: The number of nodes up to and including `after`.
+ *
+ * - returns: The first node detached, or `NULL` if there was none.
  */
-size_t get_queue_length(void)
+Markdown *cut_queue(Queue *q, Markdown *after, const size_t length)
 {
-    size_t len = 0;
-    Markdown *node = head;
-    
-    if (!node) return 0;
-    
-    while (node) {
-        len++;
-        node = node->next;
-    }
-    return len;
+    Markdown *rest = after ? after->next : q->head;
+
+    if (after) after->next = NULL;
+    else q->head = NULL;
+
+    q->tail   = after;
+    q->length = length;
+    return rest;
 }
 
 
 /**
- * Set the current block being parsed.
+ * Get the node after a node in a queue.
  *
- * This is useful when parsing multi-line blocks (i.e. paragraphs).
- * This value will be returned from `get_last_block()` instead of
- * `tail->type` when available. The value of `currentblk` is reset to
- * `UNKNOWN` everytime `add_markdown()` is called.
+ * - parameter node: The node.
  *
- * - parameter blk: The new value of `currentblk`.
+ * - returns: The next node, or `NULL` if `node` is the tail.
  */
-void set_current_block(const mdblock_t blk)
+Markdown *next_node(const Markdown *node)
 {
-    currentblk = blk;
+    return node->next;
 }
 
 
 /**
- * Get the type of the last block added to the queue.
+ * Add a run of detached nodes back to the tail of a queue.
  *
- * - returns: The `mdblock_t` of tail, or `currentblk`, if it isn't `UNKNOWN`.
+ * - parameter q: The queue to add the nodes to.
+ * - parameter first: The first node of the run, or `NULL` for none.
+ * - parameter last: The last node of the run.
+ * - parameter length: The number of nodes in the run.
  */
-mdblock_t get_last_block(void)
+void splice_queue(Queue *q, Markdown *first, Markdown *last,
+                  const size_t length)
 {
-    if (currentblk != UNKNOWN) {
-        return currentblk;
-    }
-    else if (tail) {
-        return tail->type;
-    }
-    return UNKNOWN;
+    if (!first) return;
+
+    if (!q->head) q->head = first;
+    else q->tail->next = first;
+
+    q->tail    = last;
+    q->length += length;
 }
 
 
 /**
- * Dequeue the last block added to the queue.
+ * Make the offsets of a node and every node after it relative to base.
  *
- * - returns: The `String` of that tail node, or `NULL` if no tail.
+ * - parameter first: The first node to change, or `NULL` for none.
+ * - parameter base: The offset subtracted from every offset, no larger
+ *   than any of them.
  */
-String *dequeue_last_block(void)
+void rebase_nodes(Markdown *first, const size_t base)
 {
-    String *lastBlock = NULL;   /* String to return. */
-    Markdown *tmp = head;       /* Temp node to traverse queue. */
-    
-    if (!tail) return NULL;    
-    lastBlock = tail->string;
-    
-    /* Find the new tail. */
-    while (tmp->next != tail) {
-        tmp = tmp->next;
+    for (; first; first = first->next) {
+        first->start -= base;
+        first->end   -= base;
     }
-    
-    /* Free the current tail. */
-    if (tail->addtinfo) free(tail->addtinfo);
-    free(tail);
-    tail = tmp;
-    
-    return lastBlock;
 }
 
 
 /**
- * Debug-print the entire Markdown queue.
+ * Get the type of a node, and the offsets of the block it was parsed from.
  *
- *  This function is used for debugging purposes only.
+ * A blockquote has two nodes, for its start and its end, and both have
+ * the offsets of the whole blockquote.
+ *
+ * - parameter node: The node.
+ * - parameter start: Receives the offset of the block's first byte.
+ * - parameter end: Receives the offset of the byte after the block.
+ *
+ * - returns: The type of the block.
  */
-void debug_print_queue(void)
+mdblock_t get_node_span(const Markdown *node, size_t *start, size_t *end)
 {
-    Markdown *tmp = head;
-    static char *blocknames[25] = {
-        "UNKNOWN",
-        "BLANK_LINE",
-        "ATX_HEADER_1",
-        "ATX_HEADER_2",
-        "ATX_HEADER_3",
-        "ATX_HEADER_4",
-        "ATX_HEADER_5",
-        "ATX_HEADER_6",
-        "HORIZONTAL_RULE",
-        "PARAGRAPH",
-        "SETEXT_HEADER_1",
-        "SETEXT_HEADER_2",
-        "INDENTED_CODE_BLOCK",
-        "FENCED_CODE_BLOCK",
-        "HTML_BLOCK",
-        "HTML_COMMENT",
-        "LINK_REFERENCE_DEF",
-        "BLOCKQUOTE_START",
-        "BLOCKQUOTE_END",
-        "UNORDERED_LIST_START",
-        "UNORDERED_LIST_ITEM",
-        "UNORDERED_LIST_END",
-        "ORDERED_LIST_START",
-        "ORDERED_LIST_ITEM",
-        "ORDERED_LIST_END"
-    };
-    
-    while (tmp) {
-        if (tmp->type == LINK_REFERENCE_DEF) {
-            printf("%s: [%s]: %s \'%s\'\n", 
-                   blocknames[tmp->type],
-                   ((LinkRef *)tmp->addtinfo)->label,
-                   ((LinkRef *)tmp->addtinfo)->dest,
-                   ((LinkRef *)tmp->addtinfo)->title);
-        }
-        else {
-            printf("%s: \'%s\'\n", 
-                   blocknames[tmp->type], 
-                   tmp->string->data);
+    *start = node->start;
+    *end   = node->end;
+    return node->type;
+}
+
+
+/**
+ * Check if a type of block holds any text.
+ *
+ * - parameter type: The type of the block.
+ *
+ * - returns: `false` for blocks that are only markers, `true` otherwise.
+ */
+static bool block_has_text(const mdblock_t type)
+{
+    switch (type) {
+        case BLANK_LINE:
+        case HORIZONTAL_RULE:
+        case LINK_REFERENCE_DEF:
+        case BLOCKQUOTE_START:
+        case BLOCKQUOTE_END:
+            return false;
+        default:
+            return true;
+    }
+}
+
+
+/************************************************************************
+ * ## Inline Metacharacters
+ *
+ *  Each node keeps a mask of the inline metacharacters in its text --
+ *  see `mdmeta_t` -- so that a block with none of them, which is most
+ *  paragraphs of prose, is written as it is rather than searched for
+ *  inline spans byte by byte. The mask is found as each span is copied
+ *  into the node, while its bytes are still in cache.
+ *
+ ************************************************************************/
+
+/** The metacharacter bit of each byte, or zero. `ww` is found apart. */
+static const uint16_t meta_bits[256] = {
+    ['*']  = META_STAR,
+    ['_']  = META_UNDERSCORE,
+    ['`']  = META_BACKTICK,
+    ['[']  = META_BRACKET,
+    ['<']  = META_ANGLE,
+    ['&']  = META_AMPERSAND,
+    ['\\'] = META_BACKSLASH,
+    ['!']  = META_BANG,
+    [':']  = META_COLON,
+    ['@']  = META_AT
+};
+
+
+/** Get the mask of the metacharacters in a span, one byte at a time. */
+static uint16_t scan_bytes(const uint8_t *data, const size_t length)
+{
+    uint16_t mask = 0;
+    size_t i = 0;
+
+    for (i = 0; i < length; i++) {
+        mask |= meta_bits[data[i]];
+        if (data[i] == 'w' && i + 1 < length && data[i + 1] == 'w') {
+            mask |= META_WWW;
         }
-        tmp = tmp->next;
     }
+    return mask;
+}
+
+
+#if defined(__SSE2__)
+/** Mark the bytes of a vector equal to a byte. */
+static __m128i match_byte(const __m128i v, const char c)
+{
+    return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
 }
 
 
-/** 
- * Free all the Markdown nodes in the queue. 
+/**
+ * Check if a block of sixteen bytes holds any metacharacter.
  *
- *  This is the external interface for freeing the internal
- *  Markdown queue created by parsing the input file.
+ * - parameter data: The block, and the byte after it.
  */
-void free_markdown(void)
+static bool block_has_meta(const uint8_t *data)
 {
-    free_markdown_node(head);
+    const __m128i v = _mm_loadu_si128((const __m128i *)data);
+    const __m128i n = _mm_loadu_si128((const __m128i *)(data + 1));
+    __m128i hit = _mm_and_si128(match_byte(v, 'w'), match_byte(n, 'w'));
+
+    hit = _mm_or_si128(hit, _mm_or_si128(match_byte(v, '*'),
+                                         match_byte(v, '_')));
+    hit = _mm_or_si128(hit, _mm_or_si128(match_byte(v, '`'),
+                                         match_byte(v, '[')));
+    hit = _mm_or_si128(hit, _mm_or_si128(match_byte(v, '<'),
+                                         match_byte(v, '&')));
+    hit = _mm_or_si128(hit, _mm_or_si128(match_byte(v, '\\'),
+                                         match_byte(v, '!')));
+    hit = _mm_or_si128(hit, _mm_or_si128(match_byte(v, ':'),
+                                         match_byte(v, '@')));
+    return _mm_movemask_epi8(hit) != 0;
 }
+#endif
 
 
-/** 
- * Free the memory allocated for a Markdown node.
+/**
+ * Get the mask of the inline metacharacters in a span of text.
+ *
+ * With SSE2 sixteen bytes are checked at once for any metacharacter,
+ * and only a block that holds one is checked a byte at a time to find
+ * which. Otherwise every byte is looked up in a table.
  *
- *  This is the internal interface for freeing a particular
- *  Markdown node. All nodes below the node pointer to by the
- *  argument will also be free'd.
+ * - parameter data: The span of text.
+ * - parameter length: The bytes of the span.
  *
- * - parameter node: The node at which to begin freeing.
+ * - returns: The `mdmeta_t` bits of every metacharacter in the span.
  */
-static void free_markdown_node(Markdown *node)
+uint16_t scan_inlines(const uint8_t *data, const size_t length)
 {
-    if (node) {
-        if (node->addtinfo) free(node->addtinfo);
-        free_string(node->string);
-        free_markdown_node(node->next);
-        free(node);
+    uint16_t mask = 0;
+    size_t at = 0;
+
+#if defined(__SSE2__)
+    /* The byte after each block is read too, for a `ww` across two. */
+    for (; length - at >= 17; at += 16) {
+        if (block_has_meta(data + at)) mask |= scan_bytes(data + at, 17);
     }
+#endif
+    return mask | scan_bytes(data + at, length - at);
 }
 
 
 /************************************************************************
- * ## Markdown Block Extensions
+ * ## Building the Queue
+ *
+ *  The queue is one consumer of the parser's events. A node is added
+ *  when a block is entered, and each span of text is appended to the
+ *  text of that node. The `info` of a block is only valid during the
+ *  event, so it is copied into the node's extension. The queue being
+ *  built is passed to each callback as its `userdata`.
+ *
+ *  Only the node at the tail ever grows, and its text is the last
+ *  allocation of the arena, so it usually grows in place.
+ *
+ *  A blockquote only ends after every block inside of it, so each one
+ *  that has started is kept on a stack until it does. The stack is
+ *  linked through the unused extension of each blockquote's node.
+ *
  ************************************************************************/
 
+/** Add a node for each block that is entered. */
+static PdError queue_enter_block(const mdblock_t type, const void *info,
+                                 const size_t start, void *userdata)
+{
+    Queue *q = userdata;
+    Markdown *node = NULL;
+    size_t size = 0;        /* Size of the block's extension. */
+
+    if (type == FENCED_CODE_BLOCK) size = sizeof(CodeBlk);
+    else if (type == LINK_REFERENCE_DEF) size = sizeof(LinkRef);
+
+    if (!(node = add_node(q, type))) return q->arena->error;
+    node->start = start;
+    if (size > 0) {
+        if (!(node->addtinfo = arena_alloc(q->arena, size))) {
+            return q->arena->error;
+        }
+        memcpy(node->addtinfo, info, size);
+    }
+    if (type == BLOCKQUOTE_START) {
+        node->addtinfo = q->open;
+        q->open = node;
+    }
+    return PD_OK;
+}
+
+
+/** Append each span of text to the block at the tail. */
+static PdError queue_text(const uint8_t *data, const size_t length,
+                          void *userdata)
+{
+    Queue *q = userdata;
+    Markdown *node = q->tail;
+    size_t cap = node->allocd;
+    size_t back = 0;        /* Bytes scanned again, before the span. */
+    uint8_t *text = NULL;
+
+    if (length == 0) return PD_OK;
+    if (node->length + length > cap) {
+        if (cap < MIN_TEXT) cap = MIN_TEXT;
+        while (cap < node->length + length) cap *= 2;
+
+        text = arena_extend(q->arena, node->data, node->allocd, cap);
+        if (!text) return q->arena->error;
+        node->data   = text;
+        node->allocd = cap;
+    }
+    memcpy(node->data + node->length, data, length);
+
+    /* From the last byte already copied, for a `ww` across two spans. */
+    back = (node->length > 0);
+    node->inlines |= scan_inlines(node->data + node->length - back,
+                                  length + back);
+    node->length  += length;
+    return PD_OK;
+}
+
+
+/** Note where each block ends, adding a node at the end of a blockquote. */
+static PdError queue_exit_block(const mdblock_t type, const size_t end,
+                                void *userdata)
+{
+    Queue *q = userdata;
+    Markdown *open = q->open;   /* The blockquote that ends. */
+    Markdown *node = NULL;
+
+    if (type != BLOCKQUOTE_END) {
+        q->tail->end = end;
+        return PD_OK;
+    }
+
+    if (!(node = add_node(q, type))) return q->arena->error;
+    q->open        = open->addtinfo;
+    open->addtinfo = NULL;
+    open->end      = end;
+    node->start    = open->start;
+    node->end      = end;
+    return PD_OK;
+}
+
+
 /**
- * Allocate memory for a CodeBlk structure.
+ * Get the callbacks that add each block to a Markdown queue.
  *
- * - throws fatal_memory_error: Memory could not be allocated.
+ * - parameter q: The queue to add the blocks to.
  *
- * - returns: A pointer to the new structure.
+ * - returns: The callbacks.
  */
-static CodeBlk *alloc_code_blk(void)
+Callbacks queue_callbacks(Queue *q)
 {
-    CodeBlk *cb = malloc(sizeof(CodeBlk));
-    if (!cb) throw_fatal_memory_error();
+    Callbacks cb = {
+        queue_enter_block, queue_text, queue_exit_block, NULL, NULL
+    };
+
+    cb.userdata = q;
     return cb;
 }
 
 
+/************************************************************************
+ * ## Debug-Printing
+ *
+ *  Each block is printed on its own line as its name followed by its
+ *  quoted text. Blocks that hold no text print `(null)` instead. The
+ *  printer is a consumer of the parser's events, so blocks can be
+ *  printed as they are parsed -- printing the queue replays its nodes
+ *  as events.
+ *
+ ************************************************************************/
+
+/** Print the name of each block that is entered. */
+static PdError debug_enter_block(const mdblock_t type, const void *info,
+                                 const size_t start, void *userdata)
+{
+    const LinkRef *lr = info;
+
+    (void)start;
+    (void)userdata;
+
+    if (type == LINK_REFERENCE_DEF) {
+        printf("%s: [%s]: %s \'%s\'\n",
+               blocknames[type], lr->label, lr->dest, lr->title);
+    }
+    else if (type == BLOCKQUOTE_START) {
+        printf("%s: \'(null)\'\n", blocknames[type]);
+    }
+    else printf("%s: \'", blocknames[type]);
+    return PD_OK;
+}
+
+
+/** Print each span of text. Blocks may contain NULL-bytes. */
+static PdError debug_text(const uint8_t *data, const size_t length,
+                          void *userdata)
+{
+    (void)userdata;
+    fwrite(data, 1, length, stdout);
+    return PD_OK;
+}
+
+
+/** Close the quoted text of each block. */
+static PdError debug_exit_block(const mdblock_t type, const size_t end,
+                                void *userdata)
+{
+    (void)end;
+    (void)userdata;
+
+    if (type == BLOCKQUOTE_END) {
+        printf("%s: \'(null)\'\n", blocknames[type]);
+    }
+    else if (type != LINK_REFERENCE_DEF) {
+        if (!block_has_text(type)) printf("(null)");
+        printf("\'\n");
+    }
+    return PD_OK;
+}
+
+
+/**
+ * Get the callbacks that debug-print each block as it is parsed.
+ *
+ * - returns: The callbacks.
+ */
+Callbacks debug_callbacks(void)
+{
+    const Callbacks cb = {
+        debug_enter_block, debug_text, debug_exit_block, NULL, NULL
+    };
+    return cb;
+}
+
+
+/**
+ * Report each block in a Markdown queue, as if it was being parsed.
+ *
+ * - parameter q: The queue of blocks.
+ * - parameter cb: The callbacks to report each block to.
+ */
+void replay_queue(const Queue *q, const Callbacks *cb)
+{
+    replay_nodes(q->head, NULL, 0, cb);
+}
+
+
 /**
- * Initialize a CodeBlk structure.
+ * Report a run of nodes, as if they were being parsed.
+ *
+ * - parameter first: The first node to report, or `NULL` for none.
+ * - parameter last: The last node to report, or `NULL` to report every
+ *   node to the end of the queue.
+ * - parameter base: The offset added to the offsets of each node.
+ * - parameter cb: The callbacks to report each block to.
+ */
+void replay_nodes(const Markdown *first, const Markdown *last,
+                  const size_t base, const Callbacks *cb)
+{
+    const Markdown *tmp = first;
+
+    for (; tmp; tmp = (tmp == last) ? NULL : tmp->next) {
+        if (tmp->type != BLOCKQUOTE_END && cb->enter_block) {
+            cb->enter_block(tmp->type, tmp->addtinfo, base + tmp->start,
+                            cb->userdata);
+        }
+        if (tmp->length > 0 && cb->inlines) {
+            cb->inlines(tmp->inlines, cb->userdata);
+        }
+        if (tmp->length > 0 && cb->text) {
+            cb->text(tmp->data, tmp->length, cb->userdata);
+        }
+        if (tmp->type != BLOCKQUOTE_START && cb->exit_block) {
+            cb->exit_block(tmp->type, base + tmp->end, cb->userdata);
+        }
+    }
+}
+
+
+/**
+ * Debug-print the entire Markdown queue.
+ *
+ *  This function is used for debugging purposes only.
  *
- * - returns: A pointer to the new structure.
+ * - parameter q: The queue of blocks.
  */
-CodeBlk *init_code_blk(void)
+void debug_print_queue(const Queue *q)
 {
-    return alloc_code_blk();
+    const Callbacks cb = debug_callbacks();
+    replay_queue(q, &cb);
 }
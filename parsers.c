@@ -8,13 +8,17 @@
  *
  ************************************************************************/
 
+#define _POSIX_C_SOURCE 200809L    /* ssize_t. */
+
 #include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/types.h>
 
 #include <stdio.h>
 
+#include "errors.h"
 #include "patdown.h"
 #include "strings.h"
 
@@ -23,6 +27,7 @@
 
 /** Named constants for particular byte-lengths. */
 #define NEWLINE 1
+#define CRLF 2
 #define NULL_CHAR 1
 
 /** Named constants for the boolean parameter of parsing functions. */
@@ -32,31 +37,565 @@
 /** The number of characters to compare when parsing html tag names. */
 #define TAG_LEN 25
 
-/* Block parsing prototypes. */
-static bool    block_parser(String *);
-static ssize_t is_blank_line(uint8_t *, bool);
-static bool    is_still_paragraph(uint8_t *);
-static ssize_t parse_paragraph(uint8_t *);
-static ssize_t is_atx_header(uint8_t *, bool);
-static ssize_t parse_atx_header(uint8_t *, size_t, size_t);
-static ssize_t is_horizontal_rule(uint8_t *, bool);
-static ssize_t is_setext_header(uint8_t *);
-static ssize_t parse_indented_code_block(uint8_t *);
-static ssize_t is_opening_code_fence(uint8_t *, bool);
-static ssize_t is_closing_code_fence(uint8_t *, CodeBlk *);
-static size_t  parse_fenced_code_block(uint8_t *, CodeBlk *, size_t);
-static ssize_t is_html_block(uint8_t *, bool);
-static ssize_t is_link_definition(uint8_t *, bool);
-static ssize_t is_blockquote(uint8_t *data, bool parse);
-static ssize_t is_bullet_list(uint8_t *data, bool parse);
-
-/** Call upon the parsers and generate the Markdown queue. */
-bool markdown(String *bytes)
+/** The newline reported between the lines of a block. */
+static const uint8_t lf = '\n';
+
+/* Block parsing prototypes. Every function parses the bytes in the
+ * range [data, end) -- the byte at `end` is never read. */
+static bool    block_parser(Parser *, const uint8_t *, const uint8_t *);
+static ssize_t parse_block(Parser *, const uint8_t *, const uint8_t *);
+static ssize_t parse_any_block(Parser *, const uint8_t *, const uint8_t *);
+static ssize_t is_blank_line(Parser *, const uint8_t *, const uint8_t *,
+                             bool);
+static bool    is_still_paragraph(Parser *, const uint8_t *,
+                                  const uint8_t *);
+static ssize_t parse_paragraph(Parser *, const uint8_t *, const uint8_t *);
+static ssize_t is_atx_header(Parser *, const uint8_t *, const uint8_t *,
+                             bool);
+static ssize_t parse_atx_header(Parser *, const uint8_t *, const uint8_t *,
+                                size_t, size_t);
+static ssize_t is_horizontal_rule(Parser *, const uint8_t *,
+                                  const uint8_t *, bool);
+static ssize_t is_setext_header(Parser *, const uint8_t *, const uint8_t *);
+static ssize_t parse_indented_code_block(Parser *, const uint8_t *,
+                                         const uint8_t *);
+static ssize_t is_opening_code_fence(Parser *, const uint8_t *,
+                                     const uint8_t *, bool);
+static ssize_t is_closing_code_fence(const uint8_t *, const uint8_t *,
+                                     CodeBlk *);
+static size_t  parse_fenced_code_block(Parser *, const uint8_t *,
+                                       const uint8_t *, CodeBlk *, size_t);
+static ssize_t is_html_block(Parser *, const uint8_t *, const uint8_t *,
+                             bool);
+static ssize_t is_link_definition(Parser *, const uint8_t *,
+                                  const uint8_t *, bool);
+static ssize_t is_blockquote(Parser *p, const uint8_t *data,
+                             const uint8_t *end, bool parse);
+static ssize_t is_bullet_list(Parser *p, const uint8_t *data,
+                              const uint8_t *end, bool parse);
+
+/**
+ * Get the number of bytes before the next line ending (or EOF).
+ *
+ * A line ends at a `\n`, a `\r\n`, or a lone `\r`. The newline is found
+ * first so that the search for a carriage return never leaves the line.
+ */
+static size_t line_length(const uint8_t *data, const uint8_t *end)
 {
-    if (!bytes->data || bytes->length == 0) return false;
+    const uint8_t *eol = memchr(data, '\n', end - data);
+    const uint8_t *cr  = NULL;
 
-    if (!block_parser(bytes)) return false;
-    return true;
+    if (!eol) eol = end;
+    cr = memchr(data, '\r', eol - data);
+    return (cr ? cr : eol) - data;
+}
+
+
+/**
+ * Get the length of the line ending at the current byte.
+ *
+ * - returns: 2 for `\r\n`, 1 for `\n` or `\r`, and 0 when the current
+ *   byte is not a line ending (or is EOF).
+ */
+static size_t newline_length(const uint8_t *data, const uint8_t *end)
+{
+    if (data >= end) return 0;
+    if (*data == '\n') return NEWLINE;
+    if (*data != '\r') return 0;
+    return (data + 1 < end && *(data + 1) == '\n') ? CRLF : NEWLINE;
+}
+
+
+/************************************************************************
+ * # Parsers
+ ************************************************************************/
+
+/**
+ * Allocate a Parser that reports each block to a set of callbacks.
+ *
+ * The Parser has no cap on the number of blocks, containers can be
+ * nested `PD_DEFAULT_MAX_DEPTH` deep, it has no excerpt, and it reports
+ * every kind of block. Any of them can be changed before the parse
+ * starts.
+ *
+ * - parameter cb: The callbacks to invoke. Any of the callbacks can be
+ *   `NULL`, and the events it would receive are skipped.
+ *
+ * - returns: A pointer to the new Parser, or `NULL` if memory could not
+ *   be allocated.
+ */
+Parser *init_parser(const Callbacks *cb)
+{
+    Parser *p = malloc(sizeof(Parser));
+    if (!p) return NULL;
+
+    p->cb         = *cb;
+    p->max_blocks = 0;
+    p->max_depth  = PD_DEFAULT_MAX_DEPTH;
+    memset(&p->excerpt, 0, sizeof(Excerpt));
+    p->only       = 0;
+    reset_parser(p);
+    return p;
+}
+
+
+/**
+ * Prepare a Parser to parse a new document.
+ *
+ * The callbacks, caps, excerpt and kinds of block reported are kept, so
+ * a Parser can be reused for any number of documents, one at a time.
+ *
+ * - parameter p: The Parser to reset.
+ */
+void reset_parser(Parser *p)
+{
+    p->current    = UNKNOWN;
+    p->last       = UNKNOWN;
+    p->blocks     = 0;
+    p->depth      = 0;
+    p->reach      = NULL;
+    p->input      = NULL;
+    p->offset     = 0;
+    p->origin     = NULL;
+    p->start      = NULL;
+    p->exited     = UNKNOWN;
+    p->shown      = 0;
+    p->written    = 0;
+    p->defs_only  = false;
+    p->defs_depth = 0;
+    p->error      = PD_OK;
+}
+
+
+/**
+ * Free the memory allocated for a Parser, if it exists.
+ *
+ * - parameter p: The Parser to be free'd.
+ */
+void free_parser(Parser *p)
+{
+    if (p) free(p);
+}
+
+
+/**
+ * Parse a range of bytes, reporting each block to the Parser's callbacks.
+ *
+ * The bytes are only read, never copied or modified, and they do not
+ * need to be NULL-terminated: a NULL-byte is parsed like any other
+ * character. This allows parsing a read-only mapping of a file or a
+ * slice of a larger buffer in place.
+ *
+ * The offsets reported for each block continue from the end of the
+ * input of any `parse_markdown_partial()` before.
+ *
+ * - parameter p: The Parser to report each block to.
+ * - parameter bytes: The first byte of the document.
+ * - parameter length: The number of bytes in the document.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse.
+ */
+PdError parse_markdown(Parser *p, const uint8_t *bytes, const size_t length)
+{
+    p->input = bytes;
+    if (bytes && length > 0) block_parser(p, bytes, bytes + length);
+    return p->error;
+}
+
+
+/**
+ * Parse the leading blocks of an incomplete document.
+ *
+ * Only the last block that is not a blank line can still grow when
+ * more input arrives -- a paragraph may gain another line, a code block
+ * may find its closing fence, and so on. Every block before it is
+ * closed: parsing the whole document would report the same events.
+ *
+ * The range is first parsed without reporting anything to find that
+ * last block, then parsed again, reporting each block before it. The
+ * last block and any blank lines after it are left for the next call.
+ *
+ * The range should end with a line ending, so that no block is decided
+ * by a line that has only partially arrived.
+ *
+ * The offsets of the blocks are reported as if every range parsed was
+ * part of one document: the next call continues from the offset of the
+ * last block left for it.
+ *
+ * - parameter p: The Parser to report each closed block to.
+ * - parameter bytes: The first byte of the buffered input.
+ * - parameter length: The number of bytes buffered.
+ *
+ * - returns: The number of bytes holding the closed blocks. Parsing
+ *   resumes from this offset once more input is buffered.
+ */
+size_t parse_markdown_partial(Parser *p, const uint8_t *bytes,
+                              const size_t length)
+{
+    const uint8_t *doc  = bytes;        /* Document pointer. */
+    const uint8_t *end  = bytes + length;
+    const uint8_t *open = NULL;         /* Start of the last open block. */
+    const Callbacks cb  = p->cb;        /* Callbacks to restore. */
+    const mdblock_t last = p->last;     /* Last block to restore. */
+    const size_t blocks = p->blocks;    /* Block count to restore. */
+    ssize_t len = 0;                    /* Length of the current block. */
+
+    /* Past the end of an excerpt, the rest of the input is dropped. */
+    if (excerpt_ended(p)) return length;
+
+    /* Find the last block that is not a blank line. */
+    p->input = bytes;
+    memset(&p->cb, 0, sizeof(p->cb));
+    while (doc < end && !p->error && (len = parse_block(p, doc, end)) > 0) {
+        if (p->last != BLANK_LINE) open = doc;
+        doc += len;
+    }
+    p->cb     = cb;
+    p->last   = last;
+    p->blocks = blocks;
+
+    /* Only blank lines were parsed: all of them are closed. */
+    if (!open) open = doc;
+
+    for (doc = bytes; doc < open && !p->error && !excerpt_ended(p);
+         doc += len) {
+        len = parse_block(p, doc, end);
+    }
+    p->offset += open - bytes;
+    return open - bytes;
+}
+
+
+/**
+ * Parse and report the next top-level block of a document.
+ *
+ * Parsing a document block by block reports the same events as
+ * `parse_markdown()`. Between two top-level blocks, the parse of the
+ * rest of the document depends only on the bytes that are left and on
+ * `p->last` -- which is what allows a document to be re-parsed from
+ * any block boundary.
+ *
+ * - parameter p: The Parser to report the block to.
+ * - parameter bytes: The first byte of the document.
+ * - parameter at: The offset of the block.
+ * - parameter length: The number of bytes in the document.
+ *
+ * - returns: The number of bytes in the block, or zero at the end of
+ *   the document, at the end of an excerpt, or once the parse has been
+ *   stopped by an error.
+ */
+size_t parse_next_block(Parser *p, const uint8_t *bytes, const size_t at,
+                        const size_t length)
+{
+    ssize_t len = 0;        /* Length of the block. */
+
+    if (at >= length || p->error || excerpt_ended(p)) return 0;
+    p->input  = bytes;
+    p->offset = 0;
+    len = parse_block(p, bytes + at, bytes + length);
+    return (len > 0 && !p->error) ? len : 0;
+}
+
+
+/**
+ * Check if a block was parsed without looking at a range of bytes.
+ *
+ * A block is parsed from its first byte forwards, and the parsers look
+ * past its last byte for at most the blank lines after it and the next
+ * line with any text -- to see if a paragraph continues, if a code
+ * block has more code, and so on. One more byte is read at the end of
+ * that line, to tell a `\r\n` from a lone `\r`.
+ *
+ * A link reference definition can be scanned much further, so how far
+ * its scan read is noted in `p->reach` instead.
+ *
+ * - parameter data: The first byte after the block.
+ * - parameter end: The first byte of the range.
+ *
+ * - returns: `true` if the parse of the block never read the byte at
+ *   `end` or any after it, so changing them cannot change the block.
+ */
+bool block_ends_before(const uint8_t *data, const uint8_t *end)
+{
+    ssize_t bl = 0;         /* Length of a blank line. */
+
+    while ((bl = is_blank_line(NULL, data, end, CHK_SYNTX)) > 0) data += bl;
+    if (data >= end) return false;
+
+    data += line_length(data, end);
+    data += newline_length(data, end);
+    return data < end;
+}
+
+
+/************************************************************************
+ * # Parser Events
+ *
+ *  Every block is reported with a call to `enter_block()`, any number
+ *  of calls to `add_text()`, and a call to `exit_block()`. The last
+ *  block reported is tracked here, since some blocks are parsed
+ *  differently depending on the block before them.
+ *
+ *  Once the parse is stopped by an error, nothing more is reported.
+ *  The parsers still return the length of each block, but the loops
+ *  over blocks check `p->error` and end early.
+ *
+ *  The loops over blocks end early at the end of an excerpt as well,
+ *  so each blockquote still open is ended as usual. When the link
+ *  definitions after the excerpt are wanted the loops go on instead,
+ *  and every other block is left unreported -- but for the ends of
+ *  the blockquotes that were open, which were reported as entered.
+ *
+ *  A parse limited to some kinds of block, as `p->only` asks, parses
+ *  every block all the same, but reports nothing of the others: the
+ *  text of a paragraph is never even split into lines.
+ *
+ *  Each block is reported with its offsets in the document. A block
+ *  starts at the first byte `parse_block()` was called with, and the
+ *  length it returns is only known once the block has been parsed, so
+ *  the call to `exit_block()` only marks the block -- its end is
+ *  reported by `parse_block()` as it returns.
+ *
+ ************************************************************************/
+
+/** A line of the content of a blockquote, and its place in the document. */
+typedef struct Line
+{
+    size_t from;        /* Offset of the line in the content. */
+    size_t length;      /* Number of bytes of the line. */
+    size_t start;       /* Offset of its first byte in the document. */
+    size_t next;        /* Offset of the line after it in the document. */
+} Line;
+
+/** The content of a blockquote, as a map back to the document. */
+struct Origin
+{
+    const uint8_t *base;    /* First byte of the content. */
+    Line *lines;            /* Each line of the content, in order. */
+    size_t count;           /* Number of lines. */
+    size_t allocd;          /* Number of lines allocated. */
+};
+
+
+/**
+ * Find the line of a blockquote's content that holds an offset.
+ *
+ * The lines are joined by a single newline, which belongs to the line
+ * before it. An offset at the start of a line is in that line, unless
+ * it is the end of a block -- which is then in the line before.
+ */
+static const Line *find_line(const struct Origin *o, const size_t at,
+                             const bool end)
+{
+    size_t lo = 0;          /* First line left to search. */
+    size_t hi = o->count;   /* Line after the last left to search. */
+    size_t mid = 0;
+
+    while (hi - lo > 1) {
+        mid = lo + (hi - lo) / 2;
+        if (o->lines[mid].from < at || (!end && o->lines[mid].from == at)) {
+            lo = mid;
+        }
+        else hi = mid;
+    }
+    return &o->lines[lo];
+}
+
+
+/**
+ * Get the offset in the document of a byte being parsed.
+ *
+ * - parameter at: A byte of the input, or of a blockquote's content.
+ * - parameter end: Whether `at` is the end of a block. An end past the
+ *   text of a line is the start of the next line in the document,
+ *   after any line ending the content does not have.
+ */
+static size_t source_offset(const Parser *p, const uint8_t *at,
+                            const bool end)
+{
+    const Line *line = NULL;    /* Line of the content holding `at`. */
+    size_t x = 0;               /* Offset of `at` in the content. */
+
+    if (!p->origin) return p->offset + (at - p->input);
+
+    x    = at - p->origin->base;
+    line = find_line(p->origin, x, end);
+    if (end && x - line->from >= line->length) return line->next;
+    return line->start + (x - line->from);
+}
+
+
+/**
+ * Get the offset in the document of a byte of text being reported.
+ *
+ * - parameter at: A byte of a span passed to the `text` callback. The
+ *   span must be of the block being parsed, whose exit may be being
+ *   reported, and must not be a newline that joins two lines.
+ *
+ * - returns: The offset -- of the line's byte in the document, even for
+ *   the content of a blockquote.
+ */
+size_t text_offset(const Parser *p, const uint8_t *at)
+{
+    return source_offset(p, at, false);
+}
+
+
+/**
+ * Check if a parse has reported the whole of its excerpt.
+ *
+ * A parse that only looks ahead, reporting nothing, counts nothing and
+ * never ends its excerpt.
+ *
+ * - parameter p: The Parser, which goes on to report only the link
+ *   reference definitions once the excerpt ends, if it asks for them.
+ *
+ * - returns: `true` if the parse has nothing more to report.
+ */
+bool excerpt_ended(Parser *p)
+{
+    const Excerpt *e = &p->excerpt;
+
+    if (p->defs_only) return false;
+    if (!p->cb.enter_block && !p->cb.text && !p->cb.exit_block) return false;
+    if (!(e->blocks && p->shown >= e->blocks) &&
+        !(e->bytes && p->written >= e->bytes)) return false;
+    if (!e->refs) return true;
+
+    p->defs_only  = true;
+    p->defs_depth = p->depth;
+    return false;
+}
+
+
+/** Check if a block is left unreported, past the end of an excerpt. */
+static bool is_hidden(Parser *p, const mdblock_t type)
+{
+    if (!p->defs_only || type == LINK_REFERENCE_DEF) return false;
+
+    /* A blockquote open at the end of the excerpt is still ended. */
+    if (type != BLOCKQUOTE_END || p->depth >= p->defs_depth) return true;
+    p->defs_depth = p->depth;
+    return false;
+}
+
+
+/** Check if a block counts toward an excerpt. */
+static bool is_shown(const mdblock_t type)
+{
+    return type != BLANK_LINE && type != LINK_REFERENCE_DEF &&
+           type != BLOCKQUOTE_START;
+}
+
+
+/** The kind of block each type is, as a `PdOnly` bit, or zero for none. */
+static const unsigned block_kinds[] = {
+    [ATX_HEADER_1]        = PD_ONLY_ATX,
+    [ATX_HEADER_2]        = PD_ONLY_ATX,
+    [ATX_HEADER_3]        = PD_ONLY_ATX,
+    [ATX_HEADER_4]        = PD_ONLY_ATX,
+    [ATX_HEADER_5]        = PD_ONLY_ATX,
+    [ATX_HEADER_6]        = PD_ONLY_ATX,
+    [HORIZONTAL_RULE]     = PD_ONLY_RULE,
+    [PARAGRAPH]           = PD_ONLY_PARAGRAPH,
+    [SETEXT_HEADER_1]     = PD_ONLY_SETEXT,
+    [SETEXT_HEADER_2]     = PD_ONLY_SETEXT,
+    [INDENTED_CODE_BLOCK] = PD_ONLY_INDENTED,
+    [FENCED_CODE_BLOCK]   = PD_ONLY_FENCED,
+    [HTML_BLOCK]          = PD_ONLY_HTML,
+    [HTML_COMMENT]        = PD_ONLY_HTML,
+    [LINK_REFERENCE_DEF]  = PD_ONLY_REFS,
+    [BLOCKQUOTE_START]    = PD_ONLY_QUOTE,
+    [BLOCKQUOTE_END]      = PD_ONLY_QUOTE,
+    [LIST_ITEM_END]       = 0       /* The last type, to size the table. */
+};
+
+
+/** Check if a kind of block is reported, when only some kinds are. */
+static bool is_wanted(const Parser *p, const mdblock_t type)
+{
+    return !p->only || (p->only & block_kinds[type]);
+}
+
+
+/**
+ * Report the end of the block marked by `exit_block()`, if any.
+ *
+ * - parameter at: The byte after the block.
+ * - parameter end: Whether `at` is the end of the block being parsed,
+ *   or the start of another block after it.
+ */
+static void report_exit(Parser *p, const uint8_t *at, const bool end)
+{
+    const mdblock_t type = p->exited;
+
+    p->exited = UNKNOWN;
+    if (type != UNKNOWN && !p->error && !is_hidden(p, type) &&
+        is_wanted(p, type) && p->cb.exit_block) {
+        p->error = p->cb.exit_block(type, source_offset(p, at, end),
+                                    p->cb.userdata);
+    }
+}
+
+
+/** Report the start of a block. */
+static void enter_block(Parser *p, const mdblock_t type, const void *info)
+{
+    /* A block entered after another in the same call ends the first. */
+    if (p->exited != UNKNOWN) report_exit(p, p->start, false);
+
+    p->current = UNKNOWN;
+    p->last    = type;
+    if (p->error || (p->defs_only && type != LINK_REFERENCE_DEF)) return;
+
+    if (p->max_blocks && ++p->blocks > p->max_blocks) {
+        p->error = PD_ERR_BLOCK_LIMIT;
+    }
+    else if (p->cb.enter_block && is_wanted(p, type)) {
+        p->shown += is_shown(type);
+        p->error = p->cb.enter_block(type, info,
+                                     source_offset(p, p->start, false),
+                                     p->cb.userdata);
+    }
+}
+
+
+/** Report a span of text inside the current block. */
+static void add_text(Parser *p, const uint8_t *data, const size_t length)
+{
+    if (!p->error && !p->defs_only && p->cb.text && is_wanted(p, p->last)) {
+        p->written += length;
+        p->error = p->cb.text(data, length, p->cb.userdata);
+    }
+}
+
+
+/** Mark the end of a block, to be reported by `parse_block()`. */
+static void exit_block(Parser *p, const mdblock_t type)
+{
+    p->last   = type;
+    p->exited = type;
+}
+
+
+/** Report a block that holds no text. */
+static void add_empty_block(Parser *p, const mdblock_t type,
+                            const void *info)
+{
+    enter_block(p, type, info);
+    exit_block(p, type);
+}
+
+
+/**
+ * Get the type of the last block reported.
+ *
+ * - returns: The block being parsed, if it has been set in
+ *   `p->current`, otherwise the last block entered or exited.
+ */
+static mdblock_t get_last_block(Parser *p)
+{
+    return (p->current != UNKNOWN) ? p->current : p->last;
 }
 
 
@@ -72,84 +611,102 @@ bool markdown(String *bytes)
  *
  */
 
-/** Parse a String of input bytes into a Markdown queue. */
-static bool block_parser(String *bytes)
+/** Parse a range of input bytes, reporting each block. */
+static bool block_parser(Parser *p, const uint8_t *data, const uint8_t *end)
 {
-    uint8_t *doc = bytes->data;     /* Document pointer. */
-    ssize_t len  = 0;               /* Length of last block. */
-    size_t total = 0;               /* Total bytes parsed. */
+    const uint8_t *doc = data;      /* Document pointer. */
+    ssize_t len = 0;                /* Length of last block. */
 
-    while (true) {
-        if (total >= bytes->length) break;
-        size_t ws = count_indentation(doc);
-
-        /* Check for blank line, returns 0 for EOF. */
-        if (((len = is_blank_line(doc, PARSE_BLK))) > 0) {
-            doc += len;
-            total += len;
-            continue;
-        }
+    while (doc < end && !p->error && !excerpt_ended(p) &&
+           (len = parse_block(p, doc, end)) > 0) {
+        doc += len;
+    }
 
-        /* Zero is returned when EOF is found. */
-        else if (len == 0) break;
+    /* Return true only if we reported at least one block. */
+    return (doc != data);
+}
 
-        /* Check for indented code block. */
-        else if (ws > 3) {
-            len = parse_indented_code_block(doc);
-            doc += len;
-            total += len;
-            continue;
-        }
 
-        /* Switch on first non-WS character of the line. */
-        switch(*(doc + ws)) {
-            case '-': len = is_horizontal_rule(doc, PARSE_BLK);
-                      len = is_bullet_list(doc, PARSE_BLK);         break;
-            case '_': len = is_horizontal_rule(doc, PARSE_BLK);     break;
-            case '*': len = is_horizontal_rule(doc, PARSE_BLK);
-                      len = is_bullet_list(doc, PARSE_BLK);         break;
-            case '#': len = is_atx_header(doc, PARSE_BLK);          break;
-            case '`': len = is_opening_code_fence(doc, PARSE_BLK);  break;
-            case '~': len = is_opening_code_fence(doc, PARSE_BLK);  break;
-            case '<': len = is_html_block(doc, PARSE_BLK);          break;
-            case '[': len = is_link_definition(doc, PARSE_BLK);     break;
-            case '>': len = is_blockquote(doc, PARSE_BLK);          break;
-            case '+': len = is_bullet_list(doc, PARSE_BLK);         break;
-            default:  len = -1;
-        }
+/**
+ * Parse the next block in a range of input bytes.
+ *
+ * A container block -- a blockquote -- is parsed along with every
+ * block nested inside of it.
+ *
+ * - returns: The number of bytes in the block, or zero at EOF.
+ */
+static ssize_t parse_block(Parser *p, const uint8_t *doc,
+                           const uint8_t *end)
+{
+    ssize_t len = 0;                /* Length of the block. */
 
-        /* Default to paragraph if no nodes were added. */
-        if (len == -1) len = parse_paragraph(doc + ws) + ws;
-        doc += len;
-        total += len;
+    p->start = doc;
+    len = parse_any_block(p, doc, end);
+    report_exit(p, doc + len, true);
+    return len;
+}
+
+
+/** Parse the next block of any type, marking its end. */
+static ssize_t parse_any_block(Parser *p, const uint8_t *doc,
+                               const uint8_t *end)
+{
+    size_t ws = count_indentation(doc, end);
+    ssize_t len = 0;                /* Length of the block. */
+
+    /* Check for blank line, returns 0 for EOF. */
+    if (((len = is_blank_line(p, doc, end, PARSE_BLK))) >= 0) return len;
+
+    /* Check for indented code block. */
+    if (ws > 3) return parse_indented_code_block(p, doc, end);
+
+    /* Switch on first non-WS character of the line. A line of WS
+     * without a newline at EOF falls through to a paragraph. */
+    switch((doc + ws < end) ? *(doc + ws) : '\0') {
+        case '-': len = is_horizontal_rule(p, doc, end, PARSE_BLK);
+                  if (len == -1) len = is_bullet_list(p, doc, end, PARSE_BLK);
+                  break;
+        case '_': len = is_horizontal_rule(p, doc, end, PARSE_BLK);    break;
+        case '*': len = is_horizontal_rule(p, doc, end, PARSE_BLK);
+                  if (len == -1) len = is_bullet_list(p, doc, end, PARSE_BLK);
+                  break;
+        case '#': len = is_atx_header(p, doc, end, PARSE_BLK);         break;
+        case '`': len = is_opening_code_fence(p, doc, end, PARSE_BLK); break;
+        case '~': len = is_opening_code_fence(p, doc, end, PARSE_BLK); break;
+        case '<': len = is_html_block(p, doc, end, PARSE_BLK);         break;
+        case '[': len = is_link_definition(p, doc, end, PARSE_BLK);    break;
+        case '>': len = is_blockquote(p, doc, end, PARSE_BLK);         break;
+        case '+': len = is_bullet_list(p, doc, end, PARSE_BLK);        break;
+        default:  len = -1;
     }
 
-    /* Return true only if we added at least one block to the queue. */
-    return (doc != bytes->data);
+    /* Default to paragraph if no block was reported. */
+    if (len == -1) len = parse_paragraph(p, doc + ws, end) + ws;
+    return len;
 }
 
 
 /** =========================== Blank Lines ============================
  *
  * Blank lines contain only WS characters: spaces, tabs, and a newline.
- * Blank lines produce no output, but they are inserted into the Markdown
- * queue in order to keep block precedence as the parsing continues.
+ * Blank lines produce no output, but they are reported like any other
+ * block in order to keep block precedence as the parsing continues.
  *
  */
 
 /** Check the next line for a blank line. */
-static ssize_t is_blank_line(uint8_t *data, bool parse)
+static ssize_t is_blank_line(Parser *p, const uint8_t *data,
+                             const uint8_t *end, bool parse)
 {
-    size_t i = 0;   /* Byte-index to increment and return. */
+    size_t i  = 0;  /* Byte-index to increment and return. */
+    size_t nl = 0;  /* Length of the line ending. */
 
-    if (!(*data)) return 0;
-    while (isblank(*data)) data++, i++;
+    if (data >= end) return 0;
+    while (data < end && isblank(*data)) data++, i++;
 
-    if (*data == '\n') {
-        if (parse) add_markdown(NULL, BLANK_LINE, NULL);
-
-        /* Don't append a newline byte if we reached EOF. */
-        return !(*data) ? i : i + NEWLINE;
+    if ((nl = newline_length(data, end)) > 0) {
+        if (parse) add_empty_block(p, BLANK_LINE, NULL);
+        return i + nl;
     }
     return -1;
 }
@@ -168,62 +725,79 @@ static ssize_t is_blank_line(uint8_t *data, bool parse)
  *
  ** TODO: Add a check for lists.
  */
-static bool is_still_paragraph(uint8_t *data)
+static bool is_still_paragraph(Parser *p, const uint8_t *data,
+                               const uint8_t *end)
 {
-    return ((is_blank_line(data, CHK_SYNTX) < 0) &&
-            (is_atx_header(data, CHK_SYNTX) < 0) &&
-            (is_horizontal_rule(data, CHK_SYNTX) < 0) &&
-            (is_opening_code_fence(data, CHK_SYNTX) < 0) &&
-            (is_html_block(data, CHK_SYNTX) < 0) &&
-            (is_blockquote(data, CHK_SYNTX) < 0));
+    return ((is_blank_line(p, data, end, CHK_SYNTX) < 0) &&
+            (is_atx_header(p, data, end, CHK_SYNTX) < 0) &&
+            (is_horizontal_rule(p, data, end, CHK_SYNTX) < 0) &&
+            (is_opening_code_fence(p, data, end, CHK_SYNTX) < 0) &&
+            (is_html_block(p, data, end, CHK_SYNTX) < 0) &&
+            (is_blockquote(p, data, end, CHK_SYNTX) < 0));
 }
 
 
-/** Parse a paragraph block and add it to the queue. */
-static ssize_t parse_paragraph(uint8_t *data)
+/**
+ * Parse a paragraph block and report it.
+ *
+ * The lines are scanned first, since the type of the block is not known
+ * until the line that may make it a setext header. The same lines are
+ * then reported, with their leading WS removed.
+ */
+static ssize_t parse_paragraph(Parser *p, const uint8_t *data,
+                               const uint8_t *end)
 {
-    String *p = init_string(BLK_BUF);
+    const uint8_t *start = data;    /* First byte of the paragraph. */
+    const uint8_t *last  = data;    /* End of the last line of text. */
+    const uint8_t *line  = data;    /* Line being reported. */
     mdblock_t type = PARAGRAPH;
-    ssize_t sh = 0;     /* Length of a possible setext header. */
-    size_t  ws = 0;     /* Length of possible leading line WS. */
+    ssize_t sh = 0;         /* Length of a possible setext header. */
+    size_t len = 0;         /* Length of the current line. */
+    size_t nl  = 0;         /* Length of the line ending. */
 
-    set_current_block(PARAGRAPH);
+    p->current = PARAGRAPH;
     while (true) {
         /* Remove all leading WS on the line. */
-        while (isblank(*data)) data++, ws++;
+        while (data < end && isblank(*data)) data++;
 
-        /* Add characters until we reach a newline. */
-        while (*data && *data != '\n') {
-            if (p->length < p->allocd - NULL_CHAR) {
-                *p->data++ = *data++;
-                p->length++;
-            }
-            else realloc_string(p, p->allocd + BLK_BUF);
-        }
+        /* Skip the rest of the line. */
+        data += line_length(data, end);
+        last  = data;
 
-        /* Is this next line the same paragraph? Setext header? */
-        if (!(*data) || !is_still_paragraph(++data)) break;
+        /* Is this next line the same paragraph? Setext header? A
+         * newline just before EOF is left for the block parser. */
+        nl = newline_length(data, end);
+        if (data + nl >= end) break;
+        if (!is_still_paragraph(p, data += nl, end)) break;
 
-        if (((sh = is_setext_header(data))) > 0) {
-            if (*(data + count_indentation(data)) == '=') {
+        if (((sh = is_setext_header(p, data, end))) > 0) {
+            if (*(data + count_indentation(data, end)) == '=') {
                 type = SETEXT_HEADER_1;
             }
             else type = SETEXT_HEADER_2;
+            data += sh;
             break;
         }
-        sh = 0;
-
-        /* Add a newline and continue parsing. */
-        *p->data++ = '\n';
-        p->length++;
     }
 
-    *p->data = '\0';
-    p->data -= p->length;
-    add_markdown(p, type, NULL);
+    /* Report each line without its leading WS, separated by newlines --
+     * if this kind of block is reported at all. */
+    enter_block(p, type, NULL);
+    while (is_wanted(p, type)) {
+        while (line < last && isblank(*line)) line++;
 
-    /* <p> + [optional] setext + WS + newline [or 0 if EOF] */
-    return p->length + sh + ws + (!(*data) ? 0 : NEWLINE);
+        len = line_length(line, last);
+        add_text(p, line, len);
+        line += len;
+
+        if (line >= last) break;
+        add_text(p, &lf, NEWLINE);
+        line += newline_length(line, last);
+    }
+    exit_block(p, type);
+
+    /* <p> + [optional] setext + newline [or 0 if EOF] */
+    return data - start;
 }
 
 
@@ -239,67 +813,58 @@ static ssize_t parse_paragraph(uint8_t *data)
  */
 
 /** Check the current line for an ATX header. */
-static ssize_t is_atx_header(uint8_t *data, bool parse)
+static ssize_t is_atx_header(Parser *p, const uint8_t *data, const uint8_t *end,
+                             bool parse)
 {
-    size_t ws = count_indentation(data);
+    size_t ws = count_indentation(data, end);
     size_t hashes = 0;  /* Number of leading hashes. */
     size_t i = ws;      /* Byte-index to increment and return. */
 
     if (ws > 3) return -1;
     data += ws;
 
-    while (*data == '#') hashes++, i++, data++;
+    while (data < end && *data == '#') hashes++, i++, data++;
 
     /* Required space after initial hashes and beginning of heading. */
-    if (hashes < 1 || hashes > 6 || (*data != 0x20 && *data != '\t')) {
+    if (hashes < 1 || hashes > 6 || data >= end ||
+        (*data != 0x20 && *data != '\t')) {
         return -1;
     }
 
     /* Parse blanks until we reach a non-blank byte. */
-    while (isblank(*data)) i++, data++;
+    while (data < end && isblank(*data)) i++, data++;
 
-    if (parse) return parse_atx_header(data, hashes, i);
+    if (parse) return parse_atx_header(p, data, end, hashes, i);
     return i;
 }
 
 
-/** Parse an ATX header and add it to the queue. */
-static ssize_t parse_atx_header(uint8_t *data, size_t hashes, size_t i)
+/** Parse an ATX header and report it. */
+static ssize_t parse_atx_header(Parser *p, const uint8_t *data,
+                                const uint8_t *end, size_t hashes, size_t i)
 {
-    String *h = init_string(BLK_BUF);
-
-    /* Add characters until we reach a newline. */
-    while (*data && *data != '\n') {
-        if (h->length < h->allocd) {
-            *h->data++ = *data++;
-            h->length++;
-        }
-        else realloc_string(h, h->allocd + BLK_BUF);
-    }
-    i += h->length;
+    size_t len = line_length(data, end);    /* Length of the whole line. */
+    size_t eoh = len;                       /* Length of the header text. */
+    size_t k   = 0;                         /* Start of trailing hashes. */
 
     /* Remove any trailing spaces/hashes before the newline. */
-    h->data--;
-    if (*h->data == 0x20 || *h->data == '#') {
-        while (*h->data == 0x20) h->data--, h->length--;
-        while (*h->data == '#') h->data--, h->length--;
-
-        /* Required space before trailing sequence of hashes. */
-        if (*h->data == 0x20) {
-            while (*h->data == 0x20) h->data--, h->length--;
-        }
-        /* If the space was missing, keep the trailing hashes. */
-        else {
-            h->data++;
-            while (*h->data == '#') h->data++, h->length++;
-            h->data--;
-        }
+    while (eoh > 0 && data[eoh - 1] == 0x20) eoh--;
+    k = eoh;
+    while (k > 0 && data[k - 1] == '#') k--;
+
+    /* Required space before trailing sequence of hashes. If the space
+     * was missing, keep the trailing hashes. */
+    if (k == 0) eoh = 0;
+    else if (k < eoh && data[k - 1] == 0x20) {
+        eoh = k;
+        while (eoh > 0 && data[eoh - 1] == 0x20) eoh--;
     }
-    h->data++;
-    *h->data = '\0';
-    h->data -= h->length;
-    add_markdown(h, (ATX_HEADER_1 - 1) + hashes, NULL);
-    return !(*data) ? i : i + NEWLINE;
+
+    enter_block(p, (ATX_HEADER_1 - 1) + hashes, NULL);
+    add_text(p, data, eoh);
+    exit_block(p, (ATX_HEADER_1 - 1) + hashes);
+
+    return i + len + newline_length(data + len, end);
 }
 
 
@@ -312,30 +877,34 @@ static ssize_t parse_atx_header(uint8_t *data, size_t hashes, size_t i)
  */
 
 /** Check the current line for a horizontal rule. */
-static ssize_t is_horizontal_rule(uint8_t *data, bool parse)
+static ssize_t is_horizontal_rule(Parser *p, const uint8_t *data,
+                                  const uint8_t *end, bool parse)
 {
-    size_t ws = count_indentation(data);
+    size_t ws = count_indentation(data, end);
     size_t i  = ws;     /* Byte-index to increment and return. */
     size_t rc = 0;      /* Number of rule characters. */
     int8_t hr = -1;     /* Specific rule character used in this <hr>. */
 
+    if (ws > 3) return -1;
     data += ws;
-    hr = (*data == '*' || *data == '_' || *data == '-') ? *data : -1;
+    if (data < end && (*data == '*' || *data == '_' || *data == '-')) {
+        hr = *data;
+    }
 
     /* Ensure this is not a setext header. */
-    if (get_last_block() == PARAGRAPH && hr == '-') return -1;
-    if (ws > 3 || hr == -1) return -1;
+    if (get_last_block(p) == PARAGRAPH && hr == '-') return -1;
+    if (hr == -1) return -1;
 
     /* Parse *n* number of spaces and *n* number of rule characters. */
-    while (*data == 0x20 || *data == hr) {
+    while (data < end && (*data == 0x20 || *data == hr)) {
         if (*data++ == hr) rc++;
         i++;
     }
 
     /* No other characters may occur inline. */
-    if ((*data == '\n' || !(*data)) && rc > 2) {
-        if (parse) add_markdown(NULL, HORIZONTAL_RULE, NULL);
-        return !(*data) ? i : (i + NEWLINE);
+    if ((data >= end || newline_length(data, end) > 0) && rc > 2) {
+        if (parse) add_empty_block(p, HORIZONTAL_RULE, NULL);
+        return i + newline_length(data, end);
     }
     return -1;
 }
@@ -352,29 +921,30 @@ static ssize_t is_horizontal_rule(uint8_t *data, bool parse)
  */
 
 /** Check the current line for a setext header. */
-static ssize_t is_setext_header(uint8_t *data)
+static ssize_t is_setext_header(Parser *p, const uint8_t *data,
+                                const uint8_t *end)
 {
-    size_t ws = count_indentation(data);
+    size_t ws = count_indentation(data, end);
     size_t i  = ws;     /* Byte-index to increment and return. */
     int8_t sc = -1;     /* Setext character used in this header. */
 
     if (ws > 3) return -1;
 
     data += ws;
-    sc = (*data == '-' || *data == '=') ? *data : -1;
+    if (data < end && (*data == '-' || *data == '=')) sc = *data;
 
     /* The last (or current) block must be a paragraph. */
-    if (get_last_block() != PARAGRAPH || sc == -1) return -1;
+    if (get_last_block(p) != PARAGRAPH || sc == -1) return -1;
 
     /* Parse *n* number of consecutive setext characters. */
-    while (*data == sc) data++, i++;
+    while (data < end && *data == sc) data++, i++;
 
     /* Parse *n* number of spaces. */
-    while (*data == 0x20) data++, i++;
+    while (data < end && *data == 0x20) data++, i++;
 
     /* No other characters may occur inline. */
-    if (*data == '\n' || !(*data)) {
-       return !(*data) ? i : (i + NEWLINE);
+    if (data >= end || newline_length(data, end) > 0) {
+       return i + newline_length(data, end);
     }
     return -1;
 }
@@ -391,69 +961,57 @@ static ssize_t is_setext_header(uint8_t *data)
  *
  */
 
-/** Parse an indented code block and add it to the queue. */
-static ssize_t parse_indented_code_block(uint8_t *data)
+/** Parse an indented code block and report it. */
+static ssize_t parse_indented_code_block(Parser *p, const uint8_t *data,
+                                         const uint8_t *end)
 {
-    size_t i  = 0;      /* Byte-index to increment and return. */
-    size_t ws = 0;      /* White space index. */
-    String *c = init_string(BLK_BUF);
+    const uint8_t *start = data;    /* First byte of the code block. */
+    const uint8_t *last  = data;    /* End of the last line of code. */
+    size_t nl  = 0;         /* Newlines waiting to be added. */
+    size_t len = 0;         /* Length of the current line. */
+    size_t k   = 0;         /* Number of indentation spaces skipped. */
+    ssize_t bl = 0;         /* Length of a nested blank line. */
 
-    if ((ws = count_indentation(data)) < 4) return -1;
+    if (count_indentation(data, end) < 4) return -1;
+    enter_block(p, INDENTED_CODE_BLOCK, NULL);
 
-    do {
-        /* Skip the indentation: one tab or four spaces. */
-        if (ws > 3) {
-            if (*data == '\t') data++, i++;
-            else data += 4, i += 4;
-        }
-        else {
-            /* Get first non-WS byte. */
-            while (isblank(*data)) data++, i++;
-
-            /* If we found a non-WS byte before the newline, break out. */
-            if (*data != '\n') break;
-
-            /* Otherwise add a newline and continue parsing. */
-            else {
-                if (c->length < c->allocd - NEWLINE - NEWLINE) {
-                    *c->data++ = *data++;
-                    c->length++;
-                }
-                else realloc_string(c, c->allocd + BLK_BUF);
-
-                ws = count_indentation(data);
+    while (true) {
+        if (count_indentation(data, end) > 3) {
+            /* Skip the indentation: one tab or four spaces. */
+            for (k = 0; k < 4 && *data == 0x20; k++) data++;
+            if (k < 4 && *data == '\t') data++;
+
+            /* A line holding only the indentation is a blank line. */
+            if ((len = line_length(data, end)) == 0) {
+                if (data < end) data += newline_length(data, end);
+                else last = data;
+                nl++;
                 continue;
             }
-        }
 
-        /* Add characters until we reach a newline. */
-        while (*data && *data != '\n') {
-            if (c->length < c->allocd - NEWLINE - NEWLINE) {
-                *c->data++ = *data++;
-                c->length++;
-            }
-            else realloc_string(c, c->allocd + BLK_BUF);
-        }
+            /* Keep all newlines found nested in the code block. */
+            while (nl > 0) add_text(p, &lf, NEWLINE), nl--;
 
-        /* Continue parsing based on indentation -- also, be sure to
-         * keep all newlines found nested in the code block. */
-        if (((ws = count_indentation(++data))) > 3 ||
-            is_blank_line(data, CHK_SYNTX) > 0) {
-                *c->data++ = '\n';
-                c->length++;
-                continue;
-        }
-        break;
+            /* Add the rest of the line. */
+            add_text(p, data, len);
+            data += len;
+            data += newline_length(data, end);
 
-    } while (true);
+            last = data;
+            nl = 1;
+        }
 
-    /* Remove any trailing newlines we added. */
-    while (*(--c->data) == '\n') c->length--;
+        /* Blank lines only continue the block if more code follows --
+         * otherwise they are left for the block parser. */
+        else if ((bl = is_blank_line(p, data, end, CHK_SYNTX)) > 0) {
+            data += bl;
+            nl++;
+        }
+        else break;
+    }
 
-    *(++c->data) = '\0';
-    c->data -= c->length;
-    add_markdown(c, INDENTED_CODE_BLOCK, NULL);
-    return i + c->length + NEWLINE;
+    exit_block(p, INDENTED_CODE_BLOCK);
+    return last - start;
 }
 
 
@@ -473,67 +1031,60 @@ static ssize_t parse_indented_code_block(uint8_t *data)
  */
 
 /** Check the current line for an opening code fence. */
-static ssize_t is_opening_code_fence(uint8_t *data, bool parse)
+static ssize_t is_opening_code_fence(Parser *p, const uint8_t *data,
+                                     const uint8_t *end, bool parse)
 {
-    size_t ws = count_indentation(data);
+    size_t ws = count_indentation(data, end);
     size_t i  = ws;         /* Byte-index to increment and return. */
     int8_t fc = -1;         /* Character used in for the fence (~|`). */
     size_t fl = 0;          /* The length of this fence. */
     size_t k  = 0;          /* Index for the code fence info string. */
-    CodeBlk *blk = NULL;    /* The data for this code block. */
+    CodeBlk blk;            /* The data for this code block. */
 
     if (ws > 3) return -1;
 
     data += ws;
-    fc = (*data == '`' || *data == '~') ? *data : -1;
+    if (data < end && (*data == '`' || *data == '~')) fc = *data;
     if (fc == -1) return -1;
 
     /* Count the number of fence characters. */
-    while (*data == fc) i++, fl++, data++;
+    while (data < end && *data == fc) i++, fl++, data++;
     if (fl < 3) return -1;
 
     /* Save the code block data if we're parsing, return true (positive
      * integer) to the caller if we were sent here to just check syntax. */
     if (parse) {
-        blk = init_code_blk();
-        blk->ws = ws;
-        blk->fl = fl;
-        blk->fc = fc;
+        blk.ws = ws;
+        blk.fl = fl;
+        blk.fc = fc;
     }
     else return i;
 
     /* Skip an unlimited number of whitespace. */
-    while (*data == 0x20 || *data == '\t') i++, data++;
-
-    /* Enter the fenced code block if there's no info string. */
-    if (*data == '\n') {
-        if (parse) {
-            return parse_fenced_code_block(++data, blk, i + NEWLINE);
-        }
-        return !(*data) ? i : (i + NEWLINE);
-    }
+    while (data < end && (*data == 0x20 || *data == '\t')) i++, data++;
 
     /* Parse the info string. */
-    for (k = 0; (k < INFO_STR_MAX && isalpha(*data)); k++) {
-        blk->lang[k] = *data++;
+    for (k = 0; k < INFO_STR_MAX && data < end && isalpha(*data); k++) {
+        blk.lang[k] = *data++;
         i++;
     }
-    blk->lang[k] = '\0';
+    blk.lang[k] = '\0';
 
-    /* Find the newline. */
-    while (*data && *data != '\n') data++, i++;
+    /* Find the newline, then enter the fenced code block. */
+    k = line_length(data, end);
+    data += k, i += k;
+    k = newline_length(data, end);
+    data += k, i += k;
 
-    if (parse) {
-        return parse_fenced_code_block(++data, blk, i + NEWLINE);
-    }
-    return !(*data) ? i : (i + NEWLINE);
+    return parse_fenced_code_block(p, data, end, &blk, i);
 }
 
 
 /** Check the current line for a closing code fence. */
-static ssize_t is_closing_code_fence(uint8_t *data, CodeBlk *blk)
+static ssize_t is_closing_code_fence(const uint8_t *data, const uint8_t *end,
+                                     CodeBlk *blk)
 {
-    size_t ws = count_indentation(data);
+    size_t ws = count_indentation(data, end);
     size_t i  = ws;         /* Byte-index to increment and return. */
     int8_t fc = -1;         /* Character used for closing fence (~|`). */
     size_t fl = 0;          /* The length of the closing fence. */
@@ -541,74 +1092,68 @@ static ssize_t is_closing_code_fence(uint8_t *data, CodeBlk *blk)
     if (ws > 3) return -1;
 
     data += ws;
-    fc = (*data == '`' || *data == '~') ? *data : -1;
+    if (data < end && (*data == '`' || *data == '~')) fc = *data;
     if (fc == -1 || fc != blk->fc) return -1;
 
     /* Count the number of fence characters. */
-    while (*data == fc) i++, fl++, data++;
+    while (data < end && *data == fc) i++, fl++, data++;
     if (fl < 3 || fl < blk->fl) return -1;
 
     /* Skip an unlimited number of whitespace. */
-    while (*data == 0x20 || *data == '\t') i++, data++;
+    while (data < end && (*data == 0x20 || *data == '\t')) i++, data++;
 
     /* If any non-newline characters, this can't be a closing fence. */
-    if (!(*data)) return i;
-    if (*data == '\n') return i + NEWLINE;
+    if (data >= end) return i;
+    if (newline_length(data, end) > 0) return i + newline_length(data, end);
 
     return -1;
 }
 
 
-/** Parse a fenced code block and add it to the queue. */
-static size_t parse_fenced_code_block(uint8_t *data, CodeBlk *blk, size_t i)
+/** Parse a fenced code block and report it. */
+static size_t parse_fenced_code_block(Parser *p, const uint8_t *data,
+                                      const uint8_t *end, CodeBlk *blk,
+                                      size_t i)
 {
-    String *cb  = init_string(BLK_BUF);
-    ssize_t cfl = 0;    /* Closing-fence line length (in bytes). */
+    const uint8_t *start = data;    /* First byte after the opening fence. */
+    ssize_t cfl = 0;        /* Closing-fence line length (in bytes). */
+    size_t len  = 0;        /* Length of the current line. */
 
     /* Parse every line as part of this code block
      * until we find the closing fence. */
+    enter_block(p, FENCED_CODE_BLOCK, blk);
     while (true) {
 
         /* Check this line for a code fence. */
-        if ((cfl = is_closing_code_fence(data, blk)) > 0) break;
+        if ((cfl = is_closing_code_fence(data, end, blk)) > 0) break;
         cfl = 0;
 
         /* Advance past the WS on the opening code fence. */
         size_t linews = 0;
-        while (blk->ws > 0 && *data == 0x20 && linews < blk->ws) {
-            data++, i++;
+        while (linews < blk->ws && data < end && *data == 0x20) {
+            data++;
             linews++;
         }
 
-        /* Add characters until we reach a newline. */
-        while (*data && *data != '\n') {
-            if (cb->length < cb->allocd - NEWLINE - NULL_CHAR) {
-                *cb->data++ = *data++;
-                cb->length++;
-                i++;
-            }
-            else realloc_string(cb, cb->allocd + BLK_BUF);
-        }
+        /* Add the rest of the line and the newline. */
+        len = line_length(data, end);
+        add_text(p, data, len);
+        add_text(p, &lf, NEWLINE);
+        data += len;
 
-        /* Add the newline. */
-        *cb->data++ = '\n';
-        cb->length++;
-
-        if (!(*data)) break;
-        i++, data++;
+        if (data >= end) break;
+        data += newline_length(data, end);
     }
 
-    *cb->data = '\0';
-    cb->data -= cb->length;
-    add_markdown(cb, FENCED_CODE_BLOCK, blk);
-    return i + cfl;
+    exit_block(p, FENCED_CODE_BLOCK);
+    return i + (data - start) + cfl;
 }
 
 
 /** =========================== HTML Blocks ============================
  * 
  * Because there are 7 different kinds of HTML blocks, all traffic is
- * directed through is_html_block() which will examine the syntax of
+ * directed through is_html_block(p, ) which will examine the syntax of
  * the current line and determine which type -- if any -- can be
  * represented. It will then parse the line by calling the appropriate
  * parsing function if the `parse` parameter is true.
@@ -667,7 +1212,7 @@ static size_t parse_fenced_code_block(uint8_t *data, CodeBlk *blk, size_t i)
  */
 
 /** Match an input string to a valid HTML element name. */
-static bool match_html_element(uint8_t *e, size_t len)
+static bool match_html_element(const uint8_t *e, size_t len)
 {
     if (len > 7) len = 7;
 
@@ -716,107 +1261,90 @@ static bool match_html_element(uint8_t *e, size_t len)
 
 
 /** Search the current line for the substring `endtag`. */
-static bool line_contains_endtag(char *data, const char *endtag)
+static bool line_contains_endtag(const uint8_t *data, const uint8_t *end,
+                                 const char *endtag)
 {
-    size_t index = 0;       /* Index of next newline. */
-    size_t tagi  = 0;       /* Index of the next end tag. */
-    char *tag    = NULL;    /* Pointer to next end tag. */
-    char *newl   = NULL;    /* Pointer to next newline. */
-
-    /* Get index of next newline. */
-    if (!(newl = strchr(data, '\n'))) {
-        return false;
+    const uint8_t *eol = data + line_length(data, end);
+    size_t len = strlen(endtag);    /* Length of the end tag. */
+
+    /* Only compare at the occurrences of the first byte of the tag. */
+    while ((data = memchr(data, endtag[0], eol - data))) {
+        if ((size_t)(eol - data) < len) return false;
+        if (memcmp(data, endtag, len) == 0) return true;
+        data++;
     }
-    index = newl - data;
-
-    /* Find the index of the endtag. */
-    if (!(tag = strstr(data, endtag))) {
-        return false;
-    }
-    tagi = tag - data;
-
-    return tagi < index;
+    return false;
 }
 
 
 /** Parse all input as HTML block until a blank line is encountered. */
-static ssize_t parse_html_until_blankline(uint8_t *data)
+static ssize_t parse_html_until_blankline(Parser *p, const uint8_t *data,
+                                          const uint8_t *end)
 {
-    String *hb  = init_string(BLK_BUF);
-    size_t i    = 0;    /* Byte-index to increment and return. */
-    ssize_t bl  = 0;    /* Index returned from is_blank_line(). */
+    const uint8_t *start = data;    /* First byte of the HTML block. */
+    size_t len  = 0;        /* Length of the current line. */
 
+    enter_block(p, HTML_BLOCK, NULL);
     while (true) {
 
-        /* Add characters until we reach a newline. */
-        while (*data && *data != '\n') {
-            if (hb->length < hb->allocd - NEWLINE - NULL_CHAR) {
-                *hb->data++ = *data++;
-                hb->length++;
-                i++;
-            }
-            else realloc_string(hb, hb->allocd + BLK_BUF);
-        }
+        /* Add the rest of the line. */
+        len = line_length(data, end);
+        add_text(p, data, len);
+        data += len;
 
-        /* Check the next line for a blank line. */
-        if ((bl = is_blank_line(++data, CHK_SYNTX)) >= 0) break;
-        else {
-            *hb->data++ = '\n';
-            hb->length++;
-            i++;
-            bl = 0;
-        }
+        /* Check the next line for a blank line (or EOF). */
+        if (data >= end) break;
+        data += newline_length(data, end);
+        if (is_blank_line(p, data, end, CHK_SYNTX) >= 0) break;
+        add_text(p, &lf, NEWLINE);
     }
 
-    *hb->data = '\0';
-    hb->data -= hb->length;
-    add_markdown(hb, HTML_BLOCK, NULL);
-    return i + bl;
+    exit_block(p, HTML_BLOCK);
+    return data - start;
 }
 
 
 /** Parse all input as an HTML block until a proper end tag is found. */
-static ssize_t parse_html_block(uint8_t *data, const char *endtag)
+static ssize_t parse_html_block(Parser *p, const uint8_t *data,
+                                const uint8_t *end, const char *endtag)
 {
-    String *hb = init_string(BLK_BUF);
+    const uint8_t *start = data;    /* First byte of the HTML block. */
     bool lastline = false;      /* Set to true when block should end. */
+    size_t len = 0;             /* Length of the current line. */
 
+    enter_block(p, HTML_BLOCK, NULL);
     while (true) {
 
         /* Check if the current line contains the end tag. */
-        if (line_contains_endtag((char *)data, endtag)) {
+        if (line_contains_endtag(data, end, endtag)) {
             lastline = true;
         }
 
-        /* Add characters until we reach a newline. */
-        while (*data && *data != '\n') {
-            if (hb->length < hb->allocd - NEWLINE - NULL_CHAR) {
-                *hb->data++ = *data++;
-                hb->length++;
-            }
-            else realloc_string(hb, hb->allocd + BLK_BUF);
-        }
+        /* Add the rest of the line. */
+        len = line_length(data, end);
+        add_text(p, data, len);
+        data += len;
 
         /* Break if that was our last line or EOF. */
-        if (!(*data) || lastline) break;
+        if (data >= end || lastline) break;
 
         /* Add newline if we're still parsing. */
-        *hb->data++ = *data++;
-        hb->length++;
+        add_text(p, &lf, NEWLINE);
+        data += newline_length(data, end);
     }
 
-    *hb->data = '\0';
-    hb->data -= hb->length;
-    add_markdown(hb, HTML_BLOCK, NULL);
-    return hb->length + NEWLINE;
+    exit_block(p, HTML_BLOCK);
+    return (data - start) + newline_length(data, end);
 }
 
 
 /** Check the current line for an HTML block. */
-static ssize_t is_html_block(uint8_t *data, bool parse)
+static ssize_t is_html_block(Parser *p, const uint8_t *data, const uint8_t *end,
+                             bool parse)
 {
-    size_t ws = count_indentation(data);
-    size_t i  = ws;         /* Byte-index to increment and return. */
+    const uint8_t *start = data;    /* First byte of the line. */
+    size_t ws = count_indentation(data, end);
+    ssize_t i = ws;         /* Byte-index to increment and return. */
     size_t k  = 0;          /* Index for the tag buffer. */
     uint8_t tag[TAG_LEN];   /* Buffer to hold the tag while parsing. */
     bool literal = true;    /* Should we parse for type 1: literal content. */
@@ -825,38 +1353,33 @@ static ssize_t is_html_block(uint8_t *data, bool parse)
     data += ws;
 
     /* All html tags must be opened. */
-    if (*data++ != '<') return -1;
+    if (data >= end || *data++ != '<') return -1;
     else i++;
 
     /* HTML comments, HTML declarations, and CDATA instructions. */
-    if (*data == '!') {
+    if (data < end && *data == '!') {
         data++, i++;
 
         /* 2nd type: HTML comment. */
-        if (*data == '-') {
+        if (data < end && *data == '-') {
             data++, i++;
-            if (*data == '-') {
-                return parse ? parse_html_block(data - i, "-->") : i;
+            if (data < end && *data == '-') {
+                return parse ? parse_html_block(p, start, end, "-->") : i;
             }
             else return -1;
         }
 
         /* 4th type: HTML declaration. */
-        else if (isupper(*data)) {
-            return parse ? parse_html_block(data - i, ">") : i;
+        else if (data < end && isupper(*data)) {
+            return parse ? parse_html_block(p, start, end, ">") : i;
         }
 
         /* 5th type: CDATA instructions. */
-        else if (*data == '[') {
+        else if (data < end && *data == '[') {
             data++, i++;
-            if (*data++ == 'C' &&
-                *data++ == 'D' &&
-                *data++ == 'A' &&
-                *data++ == 'T' &&
-                *data++ == 'A' &&
-                *data   == '[') {
-                    i += 5;
-                    return parse ? parse_html_block(data - i, "]]>") : i;
+            if (end - data >= 6 && memcmp(data, "CDATA[", 6) == 0) {
+                i += 5;
+                return parse ? parse_html_block(p, start, end, "]]>") : i;
             }
             else return -1;
         }
@@ -864,18 +1387,18 @@ static ssize_t is_html_block(uint8_t *data, bool parse)
     }
 
     /* 3rd type: PHP instructions. */
-    if (*data == '?') {
-        return parse ? parse_html_block(data - i, "?>") : i;
+    if (data < end && *data == '?') {
+        return parse ? parse_html_block(p, start, end, "?>") : i;
     }
 
     /* Check for optional forward-slash -- rules out literal blocks. */
-    if (*data == '/') {
+    if (data < end && *data == '/') {
         data++, i++;
         literal = false;
     }
 
     /* Extract the tag name -- exit if there's no tag. */
-    for (k = 0; k < TAG_LEN - 1 && isalpha(*data); k++, i++) {
+    for (k = 0; k < TAG_LEN - 1 && data < end && isalpha(*data); k++, i++) {
         tag[k] = tolower(*data++);
     }
     tag[k] = '\0';
@@ -884,34 +1407,36 @@ static ssize_t is_html_block(uint8_t *data, bool parse)
     /* 1st type: Literal content. */
     if (literal) {
         if (strncmp((char *)tag, "script", TAG_LEN) == 0) {
-            return parse ? parse_html_block(data - i, "</script>") : i;
+            return parse ? parse_html_block(p, start, end, "</script>") : i;
         }
         else if (strncmp((char *)tag, "style", TAG_LEN) == 0) {
-            return parse ? parse_html_block(data - i, "</style>") : i;
+            return parse ? parse_html_block(p, start, end, "</style>") : i;
         }
         else if (strncmp((char *)tag, "pre", TAG_LEN) == 0) {
-            return parse ? parse_html_block(data - i, "</pre>") : i;
+            return parse ? parse_html_block(p, start, end, "</pre>") : i;
         }
     }
 
     /* 6th type: HTML5 element. */
     if (match_html_element(tag, k)) {
-        return parse ? parse_html_until_blankline(data - i) : i;
+        return parse ? parse_html_until_blankline(p, start, end) : i;
     }
 
     /* 7th type: Custom element -- cannot interrupt a paragraph. */
-    if (get_last_block() == PARAGRAPH) return -1;
+    if (get_last_block(p) == PARAGRAPH) return -1;
 
     /* Only the opening bracket is allowed on the first line. */
-    while (*data && *data != '>' && *data != '\n') data++, i++;
-    if (*data == '\n') return -1;
+    while (data < end && *data != '>' && newline_length(data, end) == 0) {
+        data++, i++;
+    }
+    if (data >= end || *data != '>') return -1;
     else data++, i++;
 
     /* Find the newline, otherwise this can't be custom element. */
-    while (*data == 0x20) data++, i++;
-    if (*data && *data != '\n') return -1;
+    while (data < end && *data == 0x20) data++, i++;
+    if (data < end && newline_length(data, end) == 0) return -1;
 
-    return parse ? parse_html_until_blankline(data - i) : i;
+    return parse ? parse_html_until_blankline(p, start, end) : i;
 }
 
 
@@ -927,80 +1452,124 @@ static ssize_t is_html_block(uint8_t *data, bool parse)
  * 6. Optional LINK TITLE: sequence of quoted characters
  *
  * Links are stored in a binary search tree internal to the
- * implementation in `links.c`. They are also inserted into the Markdown
- * queue for testing purposes.
+ * implementation in `links.c`. They are also reported as a block, with
+ * the `LinkRef` as its info, for testing purposes.
  *
  */
 
+/**
+ * Note how far the scan of a link reference definition read.
+ *
+ * A definition is the only block that is scanned across lines before
+ * it is known to exist -- its label, destination and title can each
+ * span lines. Only scans of the document itself are noted, not those
+ * of the content of a blockquote.
+ *
+ * - parameter data: The last byte that was read, or the end of the
+ *   input if the scan reached it.
+ * - parameter ret: The value to return.
+ *
+ * - returns: `ret`, unchanged.
+ */
+static ssize_t reach_link(Parser *p, const uint8_t *data, const ssize_t ret)
+{
+    if (p->depth == 0 && (!p->reach || data > p->reach)) p->reach = data;
+    return ret;
+}
+
+
 /**
  * Check the current line for a link reference definition.
  *
  ** TODO: Add this node to the links BST if parsing was successful.
  */
-static ssize_t is_link_definition(uint8_t *data, bool parse)
+static ssize_t is_link_definition(Parser *p, const uint8_t *data,
+                                  const uint8_t *end, bool parse)
 {
-    size_t ws = count_indentation(data);
+    size_t ws = count_indentation(data, end);
     size_t i  = ws;     /* Byte-index to increment and return. */
     size_t k  = 0;      /* Index for the link label, dest, and title. */
-    LinkRef *lr = init_link_ref();
+    size_t n  = 0;      /* Maximum number of bytes in each of them. */
+    size_t nl = 0;      /* Length of an optional line ending. */
+    LinkRef ref;        /* The link, reported when parsed. */
+    LinkRef *lr = &ref;
 
-    if (ws > 3) return -1;
+    /* A link title is optional. */
+    ref.title[0] = '\0';
+    ref.left = ref.right = NULL;
+
+    if (ws > 3) return reach_link(p, data, -1);
     data += ws;
 
     /* Opening bracket for the link label. */
-    if (*data != '[') return -1;
+    if (data >= end || *data != '[') return reach_link(p, data, -1);
     data++, i++;
 
     /* Add characters until we reach the closing bracket. */
-    for (k = 0; k < 1000 && *data && *data != ']'; k++, i++) {
+    n = sizeof(lr->label) - NULL_CHAR;
+    for (k = 0; k < n && data < end && *data != ']'; k++, i++) {
         lr->label[k] = *data++;
     }
     lr->label[k] = '\0';
 
     /* Ensure we found the closing bracket and colon. */
-    if (*data != ']') return -1;
+    if (data >= end || *data != ']') return reach_link(p, data, -1);
     data++, i++;
-    if (*data != ':') return -1;
+    if (data >= end || *data != ':') return reach_link(p, data, -1);
     data++, i++;
 
     /* Skip an unlimited amount of spaces, tabs, and an optional newline. */
-    while (*data == 0x20 || *data == '\t') data++, i++;
-    if (*data == '\n') data++, i++;
-    while (*data == 0x20 || *data == '\t') data++, i++;
+    while (data < end && (*data == 0x20 || *data == '\t')) data++, i++;
+    nl = newline_length(data, end);
+    data += nl, i += nl;
+    while (data < end && (*data == 0x20 || *data == '\t')) data++, i++;
 
     /* Link reference definitions must provide a destination. */
-    if (!(*data) || *data == '\n') return -1;
+    if (data >= end || newline_length(data, end) > 0) {
+        return reach_link(p, data, -1);
+    }
 
     /* Parse destination until a space or control character. */
     if (*data == '<') data++, i++;
-    for (k = 0; k < 1000 && isgraph(*data); k++, i++) {
+    n = sizeof(lr->dest) - NULL_CHAR;
+    for (k = 0; k < n && data < end && isgraph(*data); k++, i++) {
         lr->dest[k] = *data++;
     }
     if (*(data - 1) == '>') lr->dest[--k] = '\0';
     else lr->dest[k] = '\0';
 
     /* Skip an unlimited amount of spaces, tabs, and an optional newline. */
-    while (*data == 0x20 || *data == '\t') data++, i++;
-    if (*data == '\n') data++, i++;
-    while (*data == 0x20 || *data == '\t') data++, i++;
+    while (data < end && (*data == 0x20 || *data == '\t')) data++, i++;
+    nl = newline_length(data, end);
+    data += nl, i += nl;
+    while (data < end && (*data == 0x20 || *data == '\t')) data++, i++;
 
     /* Check for opening to a link title. */
-    if (*data == '\'' || *data == '\"') {
+    if (data < end && (*data == '\'' || *data == '\"')) {
         uint8_t titleEnd = *data++;
+        i++;
 
-        /* Add characters until we reach the end of the title. */
-        for (k = 0; k < 1000 && *data && *data != titleEnd; k++, i++) {
-            lr->title[k] = *data++;
+        /* Add characters until we reach the end of the title. Every line
+         * ending in the title is stored as a newline. */
+        n = sizeof(lr->title) - NULL_CHAR;
+        for (k = 0; k < n && data < end && *data != titleEnd; k++) {
+            if ((nl = newline_length(data, end)) > 0) {
+                lr->title[k] = '\n';
+                data += nl, i += nl;
+            }
+            else lr->title[k] = *data++, i++;
         }
         lr->title[k] = '\0';
-        if (*data == titleEnd) data++, i++;
+        if (data < end && *data == titleEnd) data++, i++;
 
         /* Skip an unlimited amount of spaces and tabs. */
-        while (*data == 0x20 || *data == '\t') data++, i++;
+        while (data < end && (*data == 0x20 || *data == '\t')) data++, i++;
     }
 
-    if (parse) add_markdown(NULL, LINK_REFERENCE_DEF, lr);
-    return i + NEWLINE;
+    if (parse) add_empty_block(p, LINK_REFERENCE_DEF, lr);
+    if (data >= end) return reach_link(p, data, i);
+    nl = newline_length(data, end);
+    return reach_link(p, data + 1, (nl > 0) ? i + nl : i + NEWLINE);
 }
 
 
@@ -1018,95 +1587,204 @@ static ssize_t is_link_definition(uint8_t *data, bool parse)
  *
  */
 
-/** Parse all subsequent lines with a blockquote marker. */
-static size_t parse_blockquote(uint8_t *data)
+/**
+ * Check if the content of a blockquote ends with an open paragraph.
+ *
+ * The content is parsed without reporting anything. Only the last
+ * block that is not a blank line can change as lines are added, so
+ * each check resumes from the start of that block.
+ *
+ * - parameter p: The Parser the blockquote is reported to.
+ * - parameter bq: The content of the blockquote so far.
+ * - parameter from: The offset of the last block found by the previous
+ *   check, which is updated for the next one.
+ * - parameter state: The last block reported before `from`, which is
+ *   also updated for the next check.
+ *
+ * - returns: `true` if the next line can be a lazy continuation.
+ */
+static bool ends_with_paragraph(Parser *p, const String *bq, size_t *from,
+                                mdblock_t *state)
+{
+    const uint8_t *doc = bq->data + *from;  /* Content pointer. */
+    const uint8_t *end = bq->data + bq->length;
+    const Callbacks cb = p->cb;             /* Callbacks to restore. */
+    const mdblock_t last = p->last;         /* Last block to restore. */
+    const size_t blocks = p->blocks;        /* Block count to restore. */
+    ssize_t len = 0;                        /* Length of the block. */
+    bool ret = false;
+
+    memset(&p->cb, 0, sizeof(p->cb));
+    p->last = *state;
+
+    while (doc < end && !p->error) {
+        mdblock_t before = p->last;
+        if ((len = parse_block(p, doc, end)) <= 0) break;
+
+        if (p->last != BLANK_LINE) {
+            *from  = doc - bq->data;
+            *state = before;
+        }
+        doc += len;
+    }
+    ret = (get_last_block(p) == PARAGRAPH);
+
+    p->cb     = cb;
+    p->last   = last;
+    p->blocks = blocks;
+    return ret;
+}
+
+
+/**
+ * Append a span to the content of a blockquote.
+ *
+ * - returns: `false` if memory could not be allocated, which stops the
+ *   parse.
+ */
+static bool add_content(Parser *p, String *bq, const uint8_t *data,
+                        const size_t length)
 {
-    size_t ws  = 0;     /* Whitespace for current line. */
-    size_t i   = 0;     /* Byte-index to increment and return. */
-    bool first = true;  /* Flag to determine if first line of content. */
+    if (try_append_span(bq, data, length)) return true;
+    p->error = PD_ERR_NOMEM;
+    return false;
+}
 
-    /* String to hold contents of blockquote. */
-    String *bq = init_string(BLK_BUF);
-    add_markdown(NULL, BLOCKQUOTE_START, NULL);
 
-    /* Parse blockquote line-by-line. */
-    while (true) {
-        if (!(*data)) {
-            *bq->data = '\0';
-            bq->data -= bq->length;
-            block_parser(bq);
-            break;
+/**
+ * Note where a line of a blockquote's content came from.
+ *
+ * The map is only kept while the blocks are reported to callbacks --
+ * a parse that reports nothing has no use for offsets.
+ *
+ * - parameter p: The Parser the blockquote is reported to.
+ * - parameter o: The map of the content.
+ * - parameter bq: The content, before the line is added.
+ * - parameter data: The first byte of the line's text.
+ * - parameter len: The number of bytes of text.
+ * - parameter next: The first byte of the line after it.
+ *
+ * - returns: `false` if memory could not be allocated, which stops the
+ *   parse.
+ */
+static bool add_line(Parser *p, struct Origin *o, const String *bq,
+                     const uint8_t *data, const size_t len,
+                     const uint8_t *next)
+{
+    size_t allocd = o->allocd ? o->allocd * 2 : 8;
+    Line *lines = NULL;
+    Line *line  = NULL;
+
+    if (!p->cb.enter_block && !p->cb.exit_block) return true;
+    if (o->count == o->allocd) {
+        if (!(lines = realloc(o->lines, allocd * sizeof(Line)))) {
+            p->error = PD_ERR_NOMEM;
+            return false;
         }
+        o->lines  = lines;
+        o->allocd = allocd;
+    }
+
+    /* Every line but the first follows the newline that joins them. */
+    line = &o->lines[o->count];
+    line->from   = bq->length + (o->count > 0);
+    line->length = len;
+    line->start  = source_offset(p, data, false);
+    line->next   = source_offset(p, next, true);
+    o->count++;
+    return true;
+}
+
+
+/**
+ * Parse all subsequent lines with a blockquote marker.
+ *
+ * The markers are removed from each line and the remaining content is
+ * then parsed as a document of its own. A line without a marker is only
+ * added to the content as a lazy continuation of a paragraph.
+ *
+ * The content is parsed with a recursive call, so the nesting depth is
+ * capped. A blockquote nested too deeply stops the parse.
+ */
+static size_t parse_blockquote(Parser *p, const uint8_t *data,
+                               const uint8_t *end)
+{
+    const uint8_t *start = data;    /* First byte of the blockquote. */
+    size_t ws  = 0;         /* Whitespace for current line. */
+    size_t len = 0;         /* Length of the current line. */
+    size_t from = 0;        /* Last block of the content (lazy check). */
+    mdblock_t state = BLOCKQUOTE_START; /* Block before `from`. */
+    bool first = true;      /* Flag to determine if first line of content. */
+    String *bq = NULL;      /* String to hold contents of blockquote. */
+    struct Origin origin = { NULL, NULL, 0, 0 };    /* Map of `bq`. */
+    struct Origin *outer = p->origin;   /* Map of the input, to restore. */
+
+    if (p->max_depth && p->depth >= p->max_depth) {
+        p->error = PD_ERR_DEPTH_LIMIT;
+        return end - data;
+    }
+    if (!(bq = try_init_string(BLK_BUF))) {
+        p->error = PD_ERR_NOMEM;
+        return end - data;
+    }
+    p->depth++;
+    enter_block(p, BLOCKQUOTE_START, NULL);
+
+    /* Parse blockquote line-by-line. */
+    while (data < end && !p->error) {
 
         /* Skip indentation. */
-        ws = count_indentation(data);
-        if (ws > 3 || *data == '\t' || *(data + ws) != '>') {
-
-            /* If the next line isn't a lazy case, we're done getting content. */
-            if (!is_still_paragraph(data)) {
-                *bq->data = '\0';
-                bq->data -= bq->length;
-                block_parser(bq);
-                break;
-            }
+        ws = count_indentation(data, end);
+        if (ws > 3 || *data == '\t' || data + ws >= end ||
+            *(data + ws) != '>') {
 
-            /* Otherwise, parse the content we have, check for paragraph. */
-            *bq->data = '\0';
-            bq->data -= bq->length;
-            block_parser(bq);
-            if (get_last_block() == PARAGRAPH) {
-                i += bq->length;
-                free_string(bq);
-                bq = dequeue_last_block();
-                i -= bq->length;
-                bq->data += bq->length;
-            }
-            else break;
+            /* Without a marker, the line must continue a paragraph. */
+            if (!is_still_paragraph(p, data, end)) break;
+            if (!ends_with_paragraph(p, bq, &from, &state)) break;
         }
-        data += ws, i += ws;
+        while (data < end && isblank(*data)) data++;
 
         /* Required prepending blockquote character. */
-        if (*data == '>') data++, i++;
+        if (data < end && *data == '>') data++;
 
         /* Skip one space -- if it's there. */
-        if (*data == 0x20) data++, i++;
-
-        /* Add newline if we're still parsing. */
-        if (!first) {
-            *bq->data++ = '\n';
-            bq->length++;
-        }
-
-        /* Add characters until we reach a newline. */
-        while (*data && *data != '\n') {
-            if (bq->length < bq->allocd - NEWLINE - NULL_CHAR) {
-                *bq->data++ = *data++;
-                bq->length++;
-            }
-            else realloc_string(bq, bq->allocd + BLK_BUF);
-        }
-        if (*data) data++;
+        if (data < end && *data == 0x20) data++;
+
+        /* Add the rest of the line, after a newline if not the first. */
+        len = line_length(data, end);
+        if (!add_line(p, &origin, bq, data, len,
+                      data + len + newline_length(data + len, end))) break;
+        if (!first && !add_content(p, bq, &lf, NEWLINE)) break;
+        if (!add_content(p, bq, data, len)) break;
+        data += len;
+        data += newline_length(data, end);
         first = false;
     }
-    add_markdown(NULL, BLOCKQUOTE_END, NULL);
-    i += bq->length;
+
+    origin.base = bq->data;
+    if (origin.count) p->origin = &origin;
+    block_parser(p, bq->data, bq->data + bq->length);
+    p->origin = outer;
+    exit_block(p, BLOCKQUOTE_END);
+    free(origin.lines);
     free_string(bq);
-    return i + NEWLINE;
+    p->depth--;
+    return data - start;
 }
 
+
 /** Check the current line for the beginning of a blockquote. */
-static ssize_t is_blockquote(uint8_t *data, bool parse)
+static ssize_t is_blockquote(Parser *p, const uint8_t *data,
+                             const uint8_t *end, bool parse)
 {
-    size_t ws = count_indentation(data);
-    size_t i  = ws;     /* Byte-index to increment and return. */
+    size_t ws = count_indentation(data, end);
 
-    if (ws > 3 || *data == '\t') return -1;
-    data += ws;
+    if (ws > 3 || data >= end || *data == '\t') return -1;
 
     /* Required prepending blockquote character. */
-    if (*data != '>') return -1;
+    if (data + ws >= end || *(data + ws) != '>') return -1;
 
-    return parse ? parse_blockquote(data - i) : ++i;
+    return parse ? parse_blockquote(p, data, end) : ws + 1;
 }
 
 
@@ -1120,44 +1798,17 @@ static ssize_t is_blockquote(uint8_t *data, bool parse)
  */
 
 /**
+ * Check for a bullet list. Lists are not parsed yet, so the line is left
+ * to the other blocks: a rule, or else a paragraph.
  *
- * UNDER CONSTRUCTION
- *
- **/
-
-// static size_t parse_bullet_list(uint8_t *data, int8_t lc)
-// {
-//     size_t i  = 0;          /* Byte-index to increment and return. */
-//     size_t ws = 0;          /* Whitespace on the current line. */
-//     ssize_t rindent = -1;   /* Required list indentation. */
-//     size_t lindent  = 0;    /* List indentation on current line. */
-
-
-//     /* String to hold contents of a list item. */
-//     String *li = init_string(BLK_BUF);
-//     add_markdown(NULL, UNORDERED_LIST_START, NULL);
-//     add_markdown(NULL, LIST_ITEM_START, NULL);
-
-//     while (true) {
-//         ws = count_indentation(data);
-//         if (ws > 3 || *data == '\t') break;
-
-
-//     }
-// }
-
-// static ssize_t is_bullet_list(uint8_t *data, bool parse)
-// {
-//     size_t ws = count_indentation(data);
-//     size_t i  = ws;     /* Byte-index to increment and return. */
-//     int8_t lc = -1;     /* List marker character. */
-
-//     if (ws > 3 || *data == '\t') return -1;
-//     data += ws;
-
-//     /* Required list marker. */
-//     lc = (*data == '-' || *data == '+' || *data == '*') ? *data : -1;
-//     if (lc == -1) return -1;
-
-//     return parse ? parse_bullet_list(data - i, lc) : ++i;
-// }
+ * - returns: -1, as no line starts a list.
+ */
+static ssize_t is_bullet_list(Parser *p, const uint8_t *data,
+                              const uint8_t *end, bool parse)
+{
+    (void)p;
+    (void)data;
+    (void)end;
+    (void)parse;
+    return -1;
+}
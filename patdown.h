@@ -13,6 +13,7 @@
 
 #include <stdbool.h>
 
+#include "errors.h"
 #include "strings.h"
 
 /************************************************************************
@@ -71,30 +72,85 @@ typedef enum
 } mdinline_t;
 
 
+/**
+ * Inline metacharacters a block's text may hold, as bits of a mask.
+ *
+ * The first eight are the characters an inline span can start with. The
+ * rest give away an extended autolink, which starts with none of them.
+ * A block whose mask is zero holds no inline span at all, so its text
+ * can be written as it is.
+ */
+typedef enum
+{
+    META_STAR       = 1 << 0,   /* `*` */
+    META_UNDERSCORE = 1 << 1,   /* `_` */
+    META_BACKTICK   = 1 << 2,   /* A backtick. */
+    META_BRACKET    = 1 << 3,   /* `[` */
+    META_ANGLE      = 1 << 4,   /* `<` */
+    META_AMPERSAND  = 1 << 5,   /* `&` */
+    META_BACKSLASH  = 1 << 6,   /* `\` */
+    META_BANG       = 1 << 7,   /* `!` */
+    META_COLON      = 1 << 8,   /* `:`, as in `https://` */
+    META_AT         = 1 << 9,   /* `@`, as in an email */
+    META_WWW        = 1 << 10   /* `ww`, as in `www.` */
+} mdmeta_t;
+
+
 /************************************************************************
  * # Markdown Methods
  ************************************************************************/
 
-/** Free all Markdown data. */
-void free_markdown(void);
+/**
+ * A queue of the Markdown blocks parsed from a single document.
+ *
+ * - member arena: The memory of the queue and every block in it.
+ * - member head: The first block in the queue.
+ * - member tail: The last block in the queue.
+ * - member length: The number of blocks in the queue.
+ * - member open: The innermost blockquote that has not ended yet.
+ */
+typedef struct Queue
+{
+    struct Arena *arena;    /* Memory of the queue and its blocks. */
+    struct Markdown *head;  /* First block in the queue. */
+    struct Markdown *tail;  /* Last block in the queue. */
+    size_t length;          /* Number of blocks in the queue. */
+    struct Markdown *open;  /* Innermost blockquote not yet ended. */
+} Queue;
+
+
+/** Initialize an empty Markdown queue, holding at most limit bytes. */
+Queue *init_queue(const size_t limit);
 
-/** Debug-print all Markdown data. */
-void debug_print_queue(void);
+/** Free a Markdown queue and all of its data, if it exists. */
+void free_queue(Queue *q);
 
-/** Add a new Markdown block to the data queue. */
-bool add_markdown(String *, const mdblock_t, void *);
+/** Debug-print all Markdown data in a queue. */
+void debug_print_queue(const Queue *q);
 
 /** Get the number of parsed Markdown blocks. */
-size_t get_queue_length(void);
+size_t get_queue_length(const Queue *q);
 
-/** Get the type of the last block added to the queue. */
-mdblock_t get_last_block(void);
+/** Detach every node after a node, returning the first of them. */
+struct Markdown *cut_queue(Queue *q, struct Markdown *after,
+                           const size_t length);
 
-/** Dequeue the last block added to the queue. */
-String *dequeue_last_block(void);
+/** Get the node after a node in a queue, or `NULL`. */
+struct Markdown *next_node(const struct Markdown *node);
 
-/** Set the current block being parsed. */
-void set_current_block(const mdblock_t);
+/** Add a run of detached nodes back to the tail of a queue. */
+void splice_queue(Queue *q, struct Markdown *first, struct Markdown *last,
+                  const size_t length);
+
+/** Make the offsets of a node and every node after it relative to base. */
+void rebase_nodes(struct Markdown *first, const size_t base);
+
+/** Get the type of a node, and the offsets of the block it was parsed from. */
+mdblock_t get_node_span(const struct Markdown *node, size_t *start,
+                        size_t *end);
+
+/** Get the mask of the inline metacharacters in a span of text. */
+uint16_t scan_inlines(const uint8_t *data, const size_t length);
 
 
 /************************************************************************
@@ -103,7 +159,7 @@ void set_current_block(const mdblock_t);
  * A block extension is a set of additional information about a specific
  * block that is saved during parsing. All of the block extensions are
  * static in memory -- in other words, their memory is managed by
- * calling `free_markdown()`.
+ * calling `free_queue()`.
  *
  ************************************************************************/
 
@@ -127,23 +183,199 @@ void set_current_block(const mdblock_t);
  */
 typedef struct CodeBlk
 {
-    uint8_t lang[INFO_STR_MAX]; /* Info string on the opening fence. */
-    size_t ws;                  /* Indentation on the opening fence. */
-    size_t fl;                  /* Length of the opening code fence. */
-    int8_t fc;                  /* Code fence character (`|~). */
+    uint8_t lang[INFO_STR_MAX + 1]; /* Info string on the opening fence. */
+    size_t ws;                      /* Indentation on the opening fence. */
+    size_t fl;                      /* Length of the opening code fence. */
+    int8_t fc;                      /* Code fence character (`|~). */
 } CodeBlk;
 
 
-/** Allocate a CodeBlk structure. **/
-CodeBlk *init_code_blk(void);
+
+/************************************************************************
+ * # Markdown Events
+ *
+ * The parser reports each block as a sequence of events, rather than
+ * building any structure of its own:
+ *
+ *   1. `enter_block(type, info, start)` when the block starts. The
+ *      `info` is the `CodeBlk` of a fenced code block, the `LinkRef` of
+ *      a link reference definition, and `NULL` for every other block.
+ *   2. `text(data, length)` for each span of the block's text, in order.
+ *      Spans point into the input wherever possible -- a newline between
+ *      two lines is reported as a span of its own.
+ *   3. `exit_block(type, end)` when the block ends.
+ *
+ * A consumer that has the whole text of a block at hand -- a replay of
+ * a queue or a table -- also reports `inlines(mask)` between entering
+ * the block and its first span: the `mdmeta_t` bits of every inline
+ * metacharacter in the block's text. A block reported without one may
+ * hold any of them. The parser itself reports its spans as it reads
+ * them, so it never reports a mask.
+ *
+ * The `start` and `end` are offsets into the document: the block was
+ * parsed from the bytes in `[start, end)`, including its indentation
+ * and its last line ending. A block inside of a blockquote is parsed
+ * from a copy of its lines without their markers, but its offsets are
+ * still those of the document.
+ *
+ * Each callback returns `PD_OK` to continue the parse. Any other error
+ * stops it: no more events are reported, and the Parser keeps the error.
+ *
+ * A blockquote is entered as `BLOCKQUOTE_START` and exited as
+ * `BLOCKQUOTE_END`, and the blocks inside of it are reported in between.
+ * The `info` and the spans are only valid during the callback, so a
+ * consumer must copy anything it keeps.
+ *
+ ************************************************************************/
+
+/**
+ * A set of callbacks to receive the events of a parse.
+ *
+ * - member enter_block: Called when a block starts.
+ * - member text: Called for each span of text in the current block.
+ * - member exit_block: Called when a block ends.
+ * - member inlines: Called with the inline metacharacters of a block
+ *   before its text, if they are known, or `NULL`.
+ * - member userdata: Passed as the last argument of each callback.
+ */
+typedef struct Callbacks
+{
+    PdError (*enter_block)(const mdblock_t, const void *, const size_t,
+                           void *);
+    PdError (*text)(const uint8_t *, const size_t, void *);
+    PdError (*exit_block)(const mdblock_t, const size_t, void *);
+    PdError (*inlines)(const uint16_t, void *);
+    void *userdata;
+} Callbacks;
+
+
+/**
+ * A type to hold the extent of an excerpt: the leading blocks of a
+ * document, for a listing or a preview.
+ *
+ * A parse with an excerpt stops at the first block boundary where it
+ * has reported enough -- the blocks of text, not blank lines, link
+ * definitions or the blockquotes around them, or the bytes of text of
+ * those blocks. The blockquotes still open are ended as usual. The
+ * link reference definitions after the excerpt, which a reference in
+ * it may use, are only parsed and reported when asked for.
+ *
+ * - member blocks: Blocks of the excerpt, or zero for no cap.
+ * - member bytes: Bytes of text of the excerpt, or zero for no cap.
+ * - member refs: Go on to report the link reference definitions after
+ *   the excerpt, and nothing else.
+ */
+typedef struct Excerpt
+{
+    size_t blocks;      /* Blocks of the excerpt, or zero for no cap. */
+    size_t bytes;       /* Bytes of text of the excerpt. */
+    bool refs;          /* Report the link definitions after it. */
+} Excerpt;
+
+
+/**
+ * A type to hold the state of a parse.
+ *
+ * - member cb: The callbacks each block is reported to.
+ * - member current: The block being parsed but not yet reported.
+ * - member last: The last block that was entered or exited.
+ * - member blocks: The number of blocks entered.
+ * - member depth: The number of containers the parse is inside of.
+ * - member max_blocks: The cap on `blocks`, or zero for no cap.
+ * - member max_depth: The cap on `depth`, or zero for no cap.
+ * - member reach: The furthest byte of the input read by the scan of a
+ *   link reference definition, or `NULL`.
+ * - member input: The first byte of the input being parsed.
+ * - member offset: The offset of `input` in the document -- non-zero
+ *   when the document is parsed in pieces, as a stream.
+ * - member origin: The content of the blockquote being parsed, or
+ *   `NULL` when the input itself is.
+ * - member start: The first byte of the block being parsed.
+ * - member exited: A block whose exit is reported once its length is
+ *   known, or `UNKNOWN`.
+ * - member excerpt: Where the parse stops, if it stops early.
+ * - member shown: The blocks counted toward the excerpt.
+ * - member written: The bytes of text counted toward the excerpt.
+ * - member defs_only: The excerpt has ended, and only the link
+ *   reference definitions after it are reported.
+ * - member defs_depth: The depth of the blockquotes still open when
+ *   the excerpt ended, whose ends are reported all the same.
+ * - member only: The kinds of block reported, as `PdOnly` bits, or zero
+ *   for every kind. The others are parsed, but not reported.
+ * - member error: Why the parse was stopped, or `PD_OK`.
+ */
+typedef struct Parser
+{
+    Callbacks cb;           /* The callbacks each block is reported to. */
+    mdblock_t current;      /* Block being parsed but not yet reported. */
+    mdblock_t last;         /* Last block that was entered or exited. */
+    size_t blocks;          /* Number of blocks entered. */
+    size_t depth;           /* Number of containers the parse is inside. */
+    size_t max_blocks;      /* Cap on `blocks`, or zero for no cap. */
+    size_t max_depth;       /* Cap on `depth`, or zero for no cap. */
+    const uint8_t *reach;   /* Furthest byte read by a link definition. */
+    const uint8_t *input;   /* First byte of the input being parsed. */
+    size_t offset;          /* Offset of `input` in the document. */
+    struct Origin *origin;  /* Blockquote content being parsed. */
+    const uint8_t *start;   /* First byte of the block being parsed. */
+    mdblock_t exited;       /* Block whose exit is not yet reported. */
+    Excerpt excerpt;        /* Where the parse stops, if early. */
+    size_t shown;           /* Blocks counted toward the excerpt. */
+    size_t written;         /* Bytes of text counted toward it. */
+    bool defs_only;         /* Only link definitions are reported. */
+    size_t defs_depth;      /* Depth of blockquotes open at its end. */
+    unsigned only;          /* Kinds of block reported, or zero for all. */
+    PdError error;          /* Why the parse was stopped, or `PD_OK`. */
+} Parser;
+
+
+/** Get the callbacks that add each block to a Markdown queue. */
+Callbacks queue_callbacks(Queue *q);
+
+/** Get the callbacks that debug-print each block as it is parsed. */
+Callbacks debug_callbacks(void);
+
+/** Report each block in a Markdown queue to a set of callbacks. */
+void replay_queue(const Queue *q, const Callbacks *cb);
+
+/** Report a run of nodes, with their offsets moved by base, to callbacks. */
+void replay_nodes(const struct Markdown *first, const struct Markdown *last,
+                  const size_t base, const Callbacks *cb);
 
 
 /************************************************************************
  * # Markdown Parsing Functions
  ************************************************************************/
 
-/** Call upon the parsers and generate the Markdown queue. */
-bool markdown(String *rawBytes);
+/** Allocate a Parser that reports each block to a set of callbacks. */
+Parser *init_parser(const Callbacks *cb);
+
+/** Prepare a Parser, keeping its callbacks and caps, for a new document. */
+void reset_parser(Parser *p);
+
+/** Free the memory allocated for a Parser, if it exists. */
+void free_parser(Parser *p);
+
+/** Parse a range of bytes without copying it, reporting each block. */
+PdError parse_markdown(Parser *p, const uint8_t *bytes,
+                       const size_t length);
+
+/** Parse and report the closed blocks of an incomplete document. */
+size_t parse_markdown_partial(Parser *p, const uint8_t *bytes,
+                              const size_t length);
+
+/** Parse and report the top-level block at an offset of a document. */
+size_t parse_next_block(Parser *p, const uint8_t *bytes, const size_t at,
+                        const size_t length);
+
+/** Check if a block was parsed without looking at a range of bytes. */
+bool block_ends_before(const uint8_t *data, const uint8_t *end);
+
+/** Check if a parse has reported the whole of its excerpt. */
+bool excerpt_ended(Parser *p);
+
+/** Get the offset in the document of a byte of text being reported. */
+size_t text_offset(const Parser *p, const uint8_t *at);
 
 
 /************************************************************************
@@ -154,7 +386,10 @@ bool markdown(String *rawBytes);
 typedef enum 
 {
     OUT_HTML5,      /* Default: HTML5 element syntax. */ 
-    OUT_PARSED      /* Internal parsing information (for debugging). */
+    OUT_PARSED,     /* Internal parsing information (for debugging). */
+    OUT_SAVED,      /* The document, saved to be loaded by `pd_load()`. */
+    OUT_LINKS,      /* Every link of the document, as lines of JSON. */
+    OUT_TEXT        /* The visible text, with each section marked. */
 } output_t;
 
 
@@ -0,0 +1,538 @@
+/**
+ * pipeline.c -- reading, parsing and reporting input on separate threads
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* nanosleep() and sched_yield(). */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "errors.h"
+#include "libpatdown.h"
+#include "patdown.h"
+#include "pipeline.h"
+#include "stream.h"
+
+/************************************************************************
+ * # Pipelined Streams
+ *
+ *  A pipelined stream is parsed by three threads at once: one reads the
+ *  input in chunks, the calling thread parses each chunk as it arrives,
+ *  and one reports the events of the blocks it closes to the callbacks.
+ *  A large input then takes about as long as its slowest stage, rather
+ *  than as long as all three.
+ *
+ *  Each stage hands its work to the next through a ring of a few fixed
+ *  buffers, filled by one thread and emptied by the other. A ring needs
+ *  no lock: each of its indices is only written by one of the threads,
+ *  with release ordering, and read by the other with acquire ordering.
+ *  A stage that finds its ring full, or empty, yields its processor a
+ *  few times, and then naps until the other stage catches up.
+ *
+ *  The events of a parse are only valid during each callback, so they
+ *  are copied into the ring: a header, followed by the text of the
+ *  block or by its extension. A span of text too long for one buffer
+ *  is reported in pieces.
+ *
+ ************************************************************************/
+
+/** The number of bytes of each buffer of a ring. */
+#define PIPE_BUF (64 << 10)
+
+/** The number of buffers of each ring. */
+#define PIPE_SLOTS 8
+
+/** The waits for a ring that yield the processor before napping. */
+#define PIPE_SPINS 64
+
+/** The fewest bytes of text worth starting a new event for. */
+#define PIPE_MIN_TEXT 1024
+
+/**
+ * A type to hold one buffer of a ring.
+ *
+ * - member data: The bytes of the buffer.
+ * - member length: The number of bytes filled.
+ * - member last: No buffer follows this one.
+ */
+typedef struct Slot
+{
+    uint8_t *data;      /* The bytes of the buffer. */
+    size_t length;      /* Number of bytes filled. */
+    bool last;          /* No buffer follows this one. */
+} Slot;
+
+/**
+ * A type to hold a ring of buffers, from one thread to another.
+ *
+ * The indices only ever grow, and a slot is found by its index modulo
+ * the number of slots. The ring is full when `tail` is a whole ring
+ * ahead of `head`, and empty when they are equal. The slots keep the
+ * two indices apart, so that they are not on the same cache line.
+ *
+ * - member head: The number of slots emptied, written by the consumer.
+ * - member slots: The buffers.
+ * - member tail: The number of slots filled, written by the producer.
+ */
+typedef struct Ring
+{
+    size_t head;                /* Slots emptied, by the consumer. */
+    Slot slots[PIPE_SLOTS];     /* The buffers. */
+    size_t tail;                /* Slots filled, by the producer. */
+} Ring;
+
+/** The kinds of events copied into a ring. */
+typedef enum
+{
+    EVENT_ENTER,        /* A block starts, followed by its extension. */
+    EVENT_TEXT,         /* A span of text, followed by its bytes. */
+    EVENT_EXIT          /* A block ends. */
+} event_t;
+
+/** The header of each event copied into a ring. */
+typedef struct Event
+{
+    uint8_t kind;       /* The `event_t` of the event. */
+    uint8_t type;       /* The `mdblock_t` of the block. */
+    size_t offset;      /* Offset of the block's start or end. */
+    size_t length;      /* Bytes following the header. */
+} Event;
+
+/**
+ * A type to hold the state of a pipelined stream.
+ *
+ * - member ifp: The input file stream, read by the reader.
+ * - member cb: The callbacks each event is reported to, by the
+ *   reporter.
+ * - member input: Chunks of input, from the reader to the parser.
+ * - member events: Events, from the parser to the reporter.
+ * - member batch: The slot of `events` being filled, or `NULL`.
+ * - member stop: The parse stopped, and the reader should too.
+ */
+typedef struct Pipe
+{
+    FILE *ifp;          /* Input file stream. */
+    Callbacks cb;       /* Callbacks each event is reported to. */
+    Ring input;         /* Chunks of input, read to be parsed. */
+    Ring events;        /* Events, parsed to be reported. */
+    Slot *batch;        /* Slot of `events` being filled, or `NULL`. */
+    int stop;           /* The parse stopped. */
+} Pipe;
+
+static void *run_reader(void *arg);
+static void *run_reporter(void *arg);
+static PdError parse_serially(FILE *ifp, const Callbacks *cb,
+                              const bool repair, const Excerpt *excerpt,
+                              const unsigned only);
+
+
+/************************************************************************
+ * ## Rings
+ ************************************************************************/
+
+/** Allocate the buffers of a ring. */
+static void init_ring(Ring *r)
+{
+    size_t i = 0;
+
+    r->head = r->tail = 0;
+    for (i = 0; i < PIPE_SLOTS; i++) {
+        r->slots[i].data   = malloc(PIPE_BUF);
+        r->slots[i].length = 0;
+        r->slots[i].last   = false;
+        if (!r->slots[i].data) throw_fatal_memory_error();
+    }
+}
+
+
+/** Free the buffers of a ring. */
+static void free_ring(Ring *r)
+{
+    size_t i = 0;
+    for (i = 0; i < PIPE_SLOTS; i++) free(r->slots[i].data);
+}
+
+
+/** Wait a little longer for another stage, counting the waits. */
+static void wait_turn(unsigned *waits)
+{
+    const struct timespec nap = { 0, 50000 };
+
+    if ((*waits)++ < PIPE_SPINS) sched_yield();
+    else nanosleep(&nap, NULL);
+}
+
+
+/**
+ * Wait for an empty slot of a ring, to be filled.
+ *
+ * - parameter r: The ring, filled by this thread only.
+ * - parameter stop: Gives up waiting once it is set, or `NULL`.
+ *
+ * - returns: The slot, or `NULL` if `stop` was set.
+ */
+static Slot *claim_slot(Ring *r, const int *stop)
+{
+    unsigned waits = 0;
+
+    while (r->tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) ==
+           PIPE_SLOTS) {
+        if (stop && __atomic_load_n(stop, __ATOMIC_ACQUIRE)) return NULL;
+        wait_turn(&waits);
+    }
+    return &r->slots[r->tail % PIPE_SLOTS];
+}
+
+
+/** Hand the slot that was claimed to the consumer of a ring. */
+static void push_slot(Ring *r)
+{
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Wait for a filled slot of a ring, to be emptied.
+ *
+ * - parameter r: The ring, emptied by this thread only.
+ *
+ * - returns: The slot.
+ */
+static Slot *take_slot(Ring *r)
+{
+    unsigned waits = 0;
+
+    while (__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head) {
+        wait_turn(&waits);
+    }
+    return &r->slots[r->head % PIPE_SLOTS];
+}
+
+
+/** Hand the slot that was taken back to the producer of a ring. */
+static void pop_slot(Ring *r)
+{
+    __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+
+/************************************************************************
+ * ## Copying Events
+ ************************************************************************/
+
+/** Get the number of bytes of the extension of a type of block. */
+static size_t info_size(const mdblock_t type)
+{
+    if (type == FENCED_CODE_BLOCK) return sizeof(CodeBlk);
+    if (type == LINK_REFERENCE_DEF) return sizeof(LinkRef);
+    return 0;
+}
+
+
+/**
+ * Hand the batch of events being filled to the reporter.
+ *
+ * - parameter p: The pipelined stream.
+ * - parameter last: No batch follows this one. A batch is handed over
+ *   even if there is none being filled.
+ */
+static void flush_batch(Pipe *p, const bool last)
+{
+    if (!p->batch && !last) return;
+    if (!p->batch) {
+        p->batch = claim_slot(&p->events, NULL);
+        p->batch->length = 0;
+    }
+    p->batch->last = last;
+    push_slot(&p->events);
+    p->batch = NULL;
+}
+
+
+/**
+ * Get room for an event at the end of the batch being filled.
+ *
+ * - parameter p: The pipelined stream.
+ * - parameter need: The bytes of the event, at most `PIPE_BUF`.
+ *
+ * - returns: The first byte of the room.
+ */
+static uint8_t *reserve_event(Pipe *p, const size_t need)
+{
+    if (p->batch && PIPE_BUF - p->batch->length < need) flush_batch(p, false);
+    if (!p->batch) {
+        p->batch = claim_slot(&p->events, NULL);
+        p->batch->length = 0;
+    }
+    return p->batch->data + p->batch->length;
+}
+
+
+/** Copy an event and the bytes that follow it into the batch. */
+static void put_event(Pipe *p, const event_t kind, const mdblock_t type,
+                      const size_t offset, const void *data,
+                      const size_t length)
+{
+    Event e;
+    uint8_t *at = reserve_event(p, sizeof(Event) + length);
+
+    e.kind   = kind;
+    e.type   = type;
+    e.offset = offset;
+    e.length = length;
+    memcpy(at, &e, sizeof(Event));
+    if (length) memcpy(at + sizeof(Event), data, length);
+    p->batch->length += sizeof(Event) + length;
+}
+
+
+/** Copy each block that is entered, and its extension. */
+static PdError pipe_enter_block(const mdblock_t type, const void *info,
+                                const size_t start, void *userdata)
+{
+    put_event(userdata, EVENT_ENTER, type, start, info,
+              info ? info_size(type) : 0);
+    return PD_OK;
+}
+
+
+/** Copy each span of text, in pieces if it does not fit in a batch. */
+static PdError pipe_text(const uint8_t *data, size_t length, void *userdata)
+{
+    Pipe *p  = userdata;
+    size_t n = 0;       /* Bytes of the next piece. */
+
+    while (length > 0) {
+        n = (length < PIPE_MIN_TEXT) ? length : PIPE_MIN_TEXT;
+        reserve_event(p, sizeof(Event) + n);
+
+        n = PIPE_BUF - p->batch->length - sizeof(Event);
+        if (n > length) n = length;
+        put_event(p, EVENT_TEXT, UNKNOWN, 0, data, n);
+        data   += n;
+        length -= n;
+    }
+    return PD_OK;
+}
+
+
+/** Copy each block that is exited. */
+static PdError pipe_exit_block(const mdblock_t type, const size_t end,
+                               void *userdata)
+{
+    put_event(userdata, EVENT_EXIT, type, end, NULL, 0);
+    return PD_OK;
+}
+
+
+/**
+ * Report each event of a batch to a set of callbacks.
+ *
+ * The extension of a block is copied out of the batch first, as the
+ * events are packed without regard to alignment.
+ */
+static void report_batch(const Callbacks *cb, const Slot *batch)
+{
+    const uint8_t *at  = batch->data;
+    const uint8_t *end = batch->data + batch->length;
+    const void *info   = NULL;
+    Event e;
+    CodeBlk blk;
+    LinkRef lr;
+
+    while (at < end) {
+        memcpy(&e, at, sizeof(Event));
+        at += sizeof(Event);
+
+        switch (e.kind) {
+            case EVENT_ENTER:
+                info = NULL;
+                if (e.length && e.type == FENCED_CODE_BLOCK) {
+                    memcpy(&blk, at, sizeof(CodeBlk));
+                    info = &blk;
+                }
+                else if (e.length && e.type == LINK_REFERENCE_DEF) {
+                    memcpy(&lr, at, sizeof(LinkRef));
+                    info = &lr;
+                }
+                if (cb->enter_block) {
+                    cb->enter_block(e.type, info, e.offset, cb->userdata);
+                }
+                break;
+            case EVENT_TEXT:
+                if (cb->text) cb->text(at, e.length, cb->userdata);
+                break;
+            default:
+                if (cb->exit_block) {
+                    cb->exit_block(e.type, e.offset, cb->userdata);
+                }
+                break;
+        }
+        at += e.length;
+    }
+}
+
+
+/************************************************************************
+ * ## Stages
+ ************************************************************************/
+
+/**
+ * Parse a file stream, reading and reporting it on threads of their own.
+ *
+ * The callbacks receive the same events, in the same order, as they do
+ * from a `Stream` fed the whole input -- but on another thread, and in
+ * pieces when a span of text is long.
+ *
+ * - parameter ifp: Input file stream (must be opened for reading).
+ * - parameter cb: The callbacks each block is reported to.
+ * - parameter repair: Replace NULL-bytes and invalid UTF-8 with U+FFFD.
+ * - parameter excerpt: Where the parse stops, or `NULL` to parse the
+ *   whole stream.
+ * - parameter only: The kinds of block reported, or zero for all.
+ *
+ * - throws fatal_memory_error: Memory could not be allocated.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse. Once it is
+ *   stopped, or its excerpt has ended, the reader stops at the end of
+ *   its chunk.
+ */
+PdError pipe_stream(FILE *ifp, const Callbacks *cb, const bool repair,
+                    const Excerpt *excerpt, const unsigned only)
+{
+    Callbacks events = {
+        pipe_enter_block, pipe_text, pipe_exit_block, NULL, NULL
+    };
+    Pipe *p = NULL;
+    Stream *s = NULL;
+    Slot *chunk = NULL;
+    pthread_t reader;
+    pthread_t reporter;
+    PdError error = PD_OK;
+    bool done  = false;
+    bool ended = false;     /* The rest of the input is not wanted. */
+
+    if (!ifp) return PD_OK;
+    if (!(p = malloc(sizeof(Pipe)))) throw_fatal_memory_error();
+    p->ifp   = ifp;
+    p->cb    = *cb;
+    p->batch = NULL;
+    p->stop  = 0;
+    init_ring(&p->input);
+    init_ring(&p->events);
+
+    events.userdata = p;
+    if (!(s = init_stream(&events, repair))) {
+        free_ring(&p->input);
+        free_ring(&p->events);
+        free(p);
+        return PD_ERR_NOMEM;
+    }
+    if (excerpt) s->parser->excerpt = *excerpt;
+    s->parser->only = only;
+
+    /* Without both threads, the input is parsed on this one alone. */
+    if (pthread_create(&reporter, NULL, run_reporter, p)) {
+        done = true;
+    }
+    else if (pthread_create(&reader, NULL, run_reader, p)) {
+        flush_batch(p, true);
+        pthread_join(reporter, NULL);
+        done = true;
+    }
+    if (done) {
+        free_stream(s);
+        free_ring(&p->input);
+        free_ring(&p->events);
+        free(p);
+        return parse_serially(ifp, cb, repair, excerpt, only);
+    }
+
+    while (!done) {
+        chunk = take_slot(&p->input);
+        if (chunk->length) error = feed_stream(s, chunk->data, chunk->length);
+        ended = !chunk->last && (error || excerpt_ended(s->parser));
+        done  = chunk->last || ended;
+        pop_slot(&p->input);
+        flush_batch(p, false);
+    }
+    if (ended) __atomic_store_n(&p->stop, 1, __ATOMIC_RELEASE);
+    if (!error) error = finish_stream(s);
+    flush_batch(p, true);
+
+    pthread_join(reader, NULL);
+    pthread_join(reporter, NULL);
+    free_stream(s);
+    free_ring(&p->input);
+    free_ring(&p->events);
+    free(p);
+    return error;
+}
+
+
+/** Read chunks of input until it ends, or the parse stops. */
+static void *run_reader(void *arg)
+{
+    Pipe *p = arg;
+    Slot *chunk = NULL;
+    bool last = false;
+
+    while (!last && (chunk = claim_slot(&p->input, &p->stop))) {
+        chunk->length = fread(chunk->data, 1, PIPE_BUF, p->ifp);
+        chunk->last   = last = (chunk->length < PIPE_BUF);
+        push_slot(&p->input);
+    }
+    return NULL;
+}
+
+
+/** Report batches of events until the last one. */
+static void *run_reporter(void *arg)
+{
+    Pipe *p = arg;
+    Slot *batch = NULL;
+    bool last = false;
+
+    while (!last) {
+        batch = take_slot(&p->events);
+        report_batch(&p->cb, batch);
+        last = batch->last;
+        pop_slot(&p->events);
+    }
+    return NULL;
+}
+
+
+/** Parse a file stream on this thread alone. */
+static PdError parse_serially(FILE *ifp, const Callbacks *cb,
+                              const bool repair, const Excerpt *excerpt,
+                              const unsigned only)
+{
+    uint8_t chunk[4096];    /* The bytes from each call to fread(). */
+    size_t ret = 0;         /* The return value of fread(). */
+    Stream *s  = init_stream(cb, repair);
+    PdError error = PD_OK;
+
+    if (!s) return PD_ERR_NOMEM;
+    if (excerpt) s->parser->excerpt = *excerpt;
+    s->parser->only = only;
+    while (!error && !excerpt_ended(s->parser) &&
+           (ret = fread(chunk, 1, sizeof(chunk), ifp)) > 0) {
+        error = feed_stream(s, chunk, ret);
+    }
+    if (!error) error = finish_stream(s);
+    free_stream(s);
+    return error;
+}
@@ -0,0 +1,28 @@
+/**
+ * pipeline.h -- reading, parsing and reporting input on separate threads
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef PIPELINE_DOT_H
+#define PIPELINE_DOT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "libpatdown.h"
+#include "patdown.h"
+
+/************************************************************************
+ * # Pipelined Streams
+ ************************************************************************/
+
+/** Parse a file stream, reading and reporting it on threads of their own. */
+PdError pipe_stream(FILE *ifp, const Callbacks *cb, const bool repair,
+                    const Excerpt *excerpt, const unsigned only);
+
+#endif
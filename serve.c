@@ -0,0 +1,1130 @@
+/**
+ * serve.c -- a resident daemon that renders documents over a socket
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#define _GNU_SOURCE     /* epoll, eventfd, signalfd and accept4(). */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "errors.h"
+#include "html.h"
+#include "patdown.h"
+#include "serve.h"
+#include "strings.h"
+#include "utf8.h"
+
+
+/************************************************************************
+ * # Serving Protocol
+ ************************************************************************/
+
+/**
+ * Write the header of a request or a response.
+ *
+ * - parameter header: The `SERVE_HEADER` bytes to write.
+ * - parameter kind: The kind of a request, or the status of a response.
+ * - parameter length: The number of bytes in the body.
+ */
+void pack_header(uint8_t *header, const uint8_t kind, const uint32_t length)
+{
+    header[0] = kind;
+    header[1] = (uint8_t)(length >> 24);
+    header[2] = (uint8_t)(length >> 16);
+    header[3] = (uint8_t)(length >> 8);
+    header[4] = (uint8_t)length;
+}
+
+
+/**
+ * Read the length of the body from a header.
+ *
+ * - parameter header: The `SERVE_HEADER` bytes of a request or response.
+ *
+ * - returns: The number of bytes in the body.
+ */
+uint32_t unpack_length(const uint8_t *header)
+{
+    return (uint32_t)header[1] << 24 | (uint32_t)header[2] << 16 |
+           (uint32_t)header[3] << 8  | (uint32_t)header[4];
+}
+
+
+/************************************************************************
+ * # Latency Histograms
+ *
+ *  Latencies below `HIST_SUB` microseconds get a bucket each. Above
+ *  that, each power of two is split into `HIST_SUB` equal buckets, so a
+ *  fixed, small table covers every latency with the same relative
+ *  precision, and recording one is a few shifts.
+ *
+ ************************************************************************/
+
+/** Get the bucket of a latency. */
+static size_t latency_bucket(const uint64_t usec)
+{
+    size_t exp = 0;             /* Position of the highest set bit. */
+
+    if (usec < HIST_SUB) return usec;
+    while (usec >> (exp + 1)) exp++;
+
+    /* `HIST_SUB` is 2^4: keep the four bits after the highest. */
+    return (exp - 3) * HIST_SUB + (usec >> (exp - 4)) - HIST_SUB;
+}
+
+
+/** Get the largest latency that falls in a bucket. */
+static uint64_t bucket_limit(const size_t bucket)
+{
+    size_t exp = 0;
+
+    if (bucket < HIST_SUB) return bucket;
+    exp = bucket / HIST_SUB + 3;
+    return ((uint64_t)(bucket % HIST_SUB + HIST_SUB + 1) << (exp - 4)) - 1;
+}
+
+
+/**
+ * Count a latency.
+ *
+ * - parameter h: The histogram to count it in.
+ * - parameter usec: The latency, in microseconds.
+ */
+void record_latency(Histogram *h, const uint64_t usec)
+{
+    h->buckets[latency_bucket(usec)]++;
+    h->count++;
+    if (usec > h->max) h->max = usec;
+}
+
+
+/**
+ * Get the latency that a percentage of those recorded are within.
+ *
+ * - parameter h: The histogram of latencies.
+ * - parameter percent: The percentage, e.g. 50 or 99.
+ *
+ * - returns: The largest latency of the bucket the percentile falls in,
+ *   but never more than the largest recorded -- or zero if the
+ *   histogram is empty.
+ */
+uint64_t latency_percentile(const Histogram *h, const double percent)
+{
+    size_t want = (size_t)(h->count * percent / 100.0 + 0.5);
+    size_t seen = 0;
+    size_t i = 0;
+
+    if (h->count == 0) return 0;
+    if (want == 0) want = 1;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= want) break;
+    }
+    return (bucket_limit(i) < h->max) ? bucket_limit(i) : h->max;
+}
+
+
+/**
+ * Add every latency of one histogram to another.
+ *
+ * - parameter into: The histogram to add to.
+ * - parameter from: The histogram to add.
+ */
+void merge_histogram(Histogram *into, const Histogram *from)
+{
+    size_t i = 0;
+
+    for (i = 0; i < HIST_BUCKETS; i++) into->buckets[i] += from->buckets[i];
+    into->count += from->count;
+    if (from->max > into->max) into->max = from->max;
+}
+
+
+/************************************************************************
+ * # Serving Documents
+ *
+ *  One thread owns every socket: it waits on them with epoll, reads
+ *  requests, and writes responses. Documents are rendered by a pool of
+ *  worker threads, each with a Parser and an HTML renderer made once,
+ *  when the server starts. A worker renders straight from the parser's
+ *  events into the body of the response, so no document is queued.
+ *
+ *  Requests are handed to the workers in a shared queue. A worker puts
+ *  each rendered response in a second queue and wakes the event loop
+ *  with an eventfd. The loop then writes each connection's responses in
+ *  the order of its requests, so a client can pipeline any number of
+ *  requests while the workers render them out of order.
+ *
+ *  With a cache, a worker first looks up the hash of the request, and
+ *  a document rendered before is copied from the cache without being
+ *  parsed. The cache's shards let the workers look up documents at the
+ *  same time.
+ *
+ *  A connection is only read while it has fewer than `MAX_PENDING`
+ *  requests without a response, so a client that never reads cannot
+ *  make the server buffer without bound.
+ *
+ ************************************************************************/
+
+/** The number of bytes requested from each call to `read()`. */
+#define READ_BUF 65536
+
+/** Requests on a connection awaiting a response before reading stops. */
+#define MAX_PENDING 256
+
+/** The number of events taken from each call to `epoll_wait()`. */
+#define MAX_EVENTS 64
+
+/** The number of responses written by each call to `writev()`. */
+#define MAX_WRITES 32
+
+/** A request, and then its response. */
+typedef struct Job
+{
+    struct Conn *conn;      /* Connection the request arrived on. */
+    uint64_t seq;           /* Position of the request on `conn`. */
+    uint8_t *input;         /* Body of the request, until rendered. */
+    size_t length;          /* Bytes in `input`. */
+    uint8_t header[SERVE_HEADER];   /* Header of the response. */
+    String *body;           /* Body of the response, or `NULL`. */
+    struct timespec start;  /* When the request was read. */
+    struct Job *next;       /* Next job of the same list. */
+} Job;
+
+/** A first-in, first-out list of jobs. */
+typedef struct JobList
+{
+    Job *head;
+    Job *tail;
+} JobList;
+
+/** A client connection, owned by the event loop. */
+typedef struct Conn
+{
+    int fd;                 /* The socket, until the connection dies. */
+    String *in;             /* Bytes read but not yet framed. */
+    uint64_t next_seq;      /* Sequence of the next request. */
+    uint64_t write_seq;     /* Sequence of the next response to write. */
+    Job *ready;             /* Rendered responses, in sequence. */
+    size_t sent;            /* Bytes of the first response written. */
+    size_t pending;         /* Requests held by the workers. */
+    uint32_t events;        /* Events the socket is polled for. */
+    bool eof;               /* No more requests will be read. */
+    bool dead;              /* The socket is closed. */
+    bool touched;           /* Responses arrived in this batch. */
+    struct Conn *prev;      /* Previous connection of the same list. */
+    struct Conn *next;      /* Next connection of the same list. */
+    struct Conn *touch;     /* Next connection touched in this batch. */
+} Conn;
+
+/** A thread that renders documents. */
+typedef struct Worker
+{
+    pthread_t thread;       /* The thread. */
+    struct Server *srv;     /* The server the worker belongs to. */
+    Parser *parser;         /* Parser reporting to `html`. */
+    Html html;              /* Renderer writing to `out`. */
+    String *out;            /* Body of the response being rendered. */
+    bool nomem;             /* `out` could not be grown. */
+} Worker;
+
+/** The state of a server. */
+typedef struct Server
+{
+    ServeOptions opts;      /* The options of the server. */
+    size_t max_input;       /* The largest request body accepted. */
+    int epfd;               /* The epoll instance. */
+    int lfd;                /* The listening socket. */
+    int wakefd;             /* Signalled when a job is done. */
+    int sigfd;              /* Signalled by SIGINT and SIGTERM. */
+    pthread_mutex_t todo_lock;  /* Guards `todo` and `stop`. */
+    pthread_cond_t todo_cond;   /* Signalled when a job is queued. */
+    JobList todo;           /* Requests waiting for a worker. */
+    bool stop;              /* The workers should exit. */
+    pthread_mutex_t done_lock;  /* Guards `done`. */
+    JobList done;           /* Responses waiting for the event loop. */
+    Worker *workers;        /* The worker threads. */
+    PdCache *cache;         /* Rendered documents, or `NULL`. */
+    Conn *conns;            /* Open connections. */
+    Conn *graves;           /* Dead connections, free'd after each batch. */
+    size_t requests;        /* Documents rendered. */
+    size_t errors;          /* Documents that could not be rendered. */
+    size_t bytes_in;        /* Bytes read from clients. */
+    size_t bytes_out;       /* Bytes written to clients. */
+    size_t accepted;        /* Connections accepted. */
+    size_t open;            /* Connections open. */
+    Histogram latency;      /* Time from reading to rendering a request. */
+} Server;
+
+static bool open_server(Server *srv, const char *path);
+static void close_server(Server *srv, const char *path);
+static void run_server(Server *srv);
+static void *run_worker(void *arg);
+static void write_body(const uint8_t *data, const size_t length,
+                       void *userdata);
+static void accept_conns(Server *srv);
+static void service_conn(Server *srv, Conn *c, const uint32_t events);
+static void update_conn(Server *srv, Conn *c);
+static void kill_conn(Server *srv, Conn *c);
+static void collect_jobs(Server *srv);
+static void free_job(Job *j);
+
+
+/**
+ * Render the documents sent to a Unix socket until interrupted.
+ *
+ * Any file already at the path is replaced only if it is a socket. The
+ * socket is removed again when SIGINT or SIGTERM stops the server.
+ *
+ * - parameter path: The path of the socket to listen on.
+ * - parameter opts: The options of the server.
+ *
+ * - returns: `EXIT_SUCCESS` once stopped, or `EXIT_FAILURE` if the
+ *   server could not be started.
+ */
+int serve_socket(const char *path, const ServeOptions *opts)
+{
+    Server srv;
+    size_t started = 0;     /* Worker threads that were created. */
+    long cpus = 0;
+
+    memset(&srv, 0, sizeof(srv));
+    srv.opts = *opts;
+    srv.max_input = opts->doc.max_input ? opts->doc.max_input
+                                        : SERVE_MAX_INPUT;
+    if (srv.max_input > UINT32_MAX) srv.max_input = UINT32_MAX;
+
+    if (srv.opts.workers == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        srv.opts.workers = (cpus > 0) ? (size_t)cpus : 1;
+    }
+    if (!open_server(&srv, path)) {
+        close_server(&srv, path);
+        return EXIT_FAILURE;
+    }
+
+    /* Workers are started with SIGINT and SIGTERM already blocked, so
+     * only the event loop ever sees them, through `sigfd`. */
+    for (started = 0; started < srv.opts.workers; started++) {
+        Worker *w = &srv.workers[started];
+        if (pthread_create(&w->thread, NULL, run_worker, w) != 0) break;
+    }
+    if (started == srv.opts.workers) {
+        fprintf(stderr, "patdown: serving on %s with %zu workers\n",
+                path, started);
+        run_server(&srv);
+    }
+    else fprintf(stderr, "FATAL: worker threads could not be started\n");
+
+    pthread_mutex_lock(&srv.todo_lock);
+    srv.stop = true;
+    pthread_cond_broadcast(&srv.todo_cond);
+    pthread_mutex_unlock(&srv.todo_lock);
+    while (started > 0) pthread_join(srv.workers[--started].thread, NULL);
+
+    close_server(&srv, path);
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * Open the listening socket, the epoll instance and the workers' state.
+ *
+ * - returns: `false` if any of them could not be created. A message
+ *   has been printed, and `close_server()` releases what was opened.
+ */
+static bool open_server(Server *srv, const char *path)
+{
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    struct stat st;
+    sigset_t mask;
+    size_t i = 0;
+
+    srv->epfd = srv->lfd = srv->wakefd = srv->sigfd = -1;
+    pthread_mutex_init(&srv->todo_lock, NULL);
+    pthread_cond_init(&srv->todo_cond, NULL);
+    pthread_mutex_init(&srv->done_lock, NULL);
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "FATAL: socket path is too long: '%s'\n", path);
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A client that disconnects early must not kill the server. */
+    signal(SIGPIPE, SIG_IGN);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    srv->lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (srv->lfd < 0 ||
+        bind(srv->lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(srv->lfd, SOMAXCONN) < 0) {
+        fprintf(stderr, "FATAL: socket could not be opened: '%s': %s\n",
+                path, strerror(errno));
+        return false;
+    }
+
+    srv->epfd   = epoll_create1(EPOLL_CLOEXEC);
+    srv->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    srv->sigfd  = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (srv->epfd < 0 || srv->wakefd < 0 || srv->sigfd < 0) {
+        fprintf(stderr, "FATAL: event loop could not be created: %s\n",
+                strerror(errno));
+        return false;
+    }
+
+    /* The server's own descriptors are told apart from connections by
+     * pointing at the descriptor itself. */
+    ev.events = EPOLLIN;
+    ev.data.ptr = &srv->lfd;
+    epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->lfd, &ev);
+    ev.data.ptr = &srv->wakefd;
+    epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->wakefd, &ev);
+    ev.data.ptr = &srv->sigfd;
+    epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->sigfd, &ev);
+
+    if (!(srv->workers = calloc(srv->opts.workers, sizeof(Worker)))) {
+        throw_fatal_memory_error();
+    }
+    if (srv->opts.cache_bytes &&
+        !(srv->cache = pd_cache_init(srv->opts.cache_bytes))) {
+        throw_fatal_memory_error();
+    }
+    for (i = 0; i < srv->opts.workers; i++) {
+        Worker *w = &srv->workers[i];
+        PdSink sink = { write_body, w };
+        Callbacks cb = html_callbacks(&w->html, &sink);
+
+        w->srv = srv;
+        if (!(w->parser = init_parser(&cb))) throw_fatal_memory_error();
+        w->parser->max_blocks = srv->opts.doc.max_blocks;
+        if (srv->opts.doc.max_depth) {
+            w->parser->max_depth = srv->opts.doc.max_depth;
+        }
+        w->parser->excerpt.blocks = srv->opts.doc.excerpt_blocks;
+        w->parser->excerpt.bytes  = srv->opts.doc.excerpt_bytes;
+        w->parser->excerpt.refs   = srv->opts.doc.excerpt_refs;
+        w->parser->only           = srv->opts.doc.only;
+    }
+    return true;
+}
+
+
+/**
+ * Release everything the server holds, and remove its socket.
+ *
+ * The workers must already have exited.
+ */
+static void close_server(Server *srv, const char *path)
+{
+    JobList *lists[2];
+    Job *j = NULL;
+    Conn *c = NULL;
+    size_t i = 0;
+
+    lists[0] = &srv->todo;
+    lists[1] = &srv->done;
+
+    while (srv->conns) kill_conn(srv, srv->conns);
+    for (i = 0; i < 2; i++) {
+        while ((j = lists[i]->head)) {
+            lists[i]->head = j->next;
+            if (--j->conn->pending == 0) {
+                j->conn->next = srv->graves;
+                srv->graves = j->conn;
+            }
+            free_job(j);
+        }
+    }
+    while ((c = srv->graves)) {
+        srv->graves = c->next;
+        free(c);
+    }
+
+    if (srv->workers) {
+        for (i = 0; i < srv->opts.workers; i++) {
+            free_parser(srv->workers[i].parser);
+            free_html(&srv->workers[i].html);
+        }
+        free(srv->workers);
+    }
+    pd_cache_free(srv->cache);
+    if (srv->lfd >= 0) {
+        close(srv->lfd);
+        unlink(path);
+    }
+    if (srv->epfd >= 0) close(srv->epfd);
+    if (srv->wakefd >= 0) close(srv->wakefd);
+    if (srv->sigfd >= 0) close(srv->sigfd);
+
+    pthread_mutex_destroy(&srv->todo_lock);
+    pthread_cond_destroy(&srv->todo_cond);
+    pthread_mutex_destroy(&srv->done_lock);
+}
+
+
+/** Run the event loop until SIGINT or SIGTERM is received. */
+static void run_server(Server *srv)
+{
+    struct epoll_event events[MAX_EVENTS];
+    bool running = true;
+    Conn *c = NULL;
+    int n = 0;
+    int i = 0;
+
+    while (running) {
+        if ((n = epoll_wait(srv->epfd, events, MAX_EVENTS, -1)) < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "ERROR: epoll_wait: %s\n", strerror(errno));
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            void *ptr = events[i].data.ptr;
+
+            if (ptr == &srv->lfd) accept_conns(srv);
+            else if (ptr == &srv->wakefd) collect_jobs(srv);
+            else if (ptr == &srv->sigfd) running = false;
+            else service_conn(srv, ptr, events[i].events);
+        }
+
+        /* A connection can die while events for it are still in the
+         * batch, so it is only free'd once the batch is handled. */
+        while ((c = srv->graves)) {
+            srv->graves = c->next;
+            free(c);
+        }
+    }
+}
+
+
+/************************************************************************
+ * # Workers
+ ************************************************************************/
+
+/** Append the rendered HTML to the body of the response. */
+static void write_body(const uint8_t *data, const size_t length,
+                       void *userdata)
+{
+    Worker *w = userdata;
+    if (!try_append_span(w->out, data, length)) w->nomem = true;
+}
+
+
+/**
+ * Parse a request, rendering it into the body of its response.
+ *
+ * Invalid UTF-8 is repaired first, unless the server was started with
+ * `raw`.
+ *
+ * - returns: `PD_OK`, or the reason it could not be rendered.
+ */
+static PdError parse_job(Worker *w, Job *j)
+{
+    const uint8_t *data = j->input;
+    size_t length = j->length;
+    size_t valid  = length;     /* Length of the valid UTF-8 prefix. */
+    String *fix   = NULL;       /* The input with its UTF-8 repaired. */
+    PdError error = PD_OK;
+
+    if (!w->srv->opts.doc.raw && length > 0) {
+        valid = validate_utf8(data, length);
+    }
+    if (valid < length) {
+        if (!(fix = repair_utf8(data, length, valid))) return PD_ERR_NOMEM;
+        data   = fix->data;
+        length = fix->length;
+    }
+
+    /* Most HTML is a little longer than its Markdown. */
+    if (!(j->body = try_init_string(length + length / 4 + 64))) {
+        free_string(fix);
+        return PD_ERR_NOMEM;
+    }
+    w->out   = j->body;
+    w->nomem = false;
+    reset_parser(w->parser);
+
+    error = parse_markdown(w->parser, data, length);
+    if (!error && w->nomem) error = PD_ERR_NOMEM;
+    if (!error && j->body->length > UINT32_MAX) error = PD_ERR_INPUT_LIMIT;
+
+    free_string(fix);
+    return error;
+}
+
+
+/**
+ * Render a request as the body of its response.
+ *
+ * With a cache, a document rendered before is copied from it, and each
+ * new one is stored in it -- keyed by the bytes as they were sent. A
+ * request that cannot be rendered gets an empty body, and the error as
+ * the status of its response.
+ */
+static void render_job(Worker *w, Job *j)
+{
+    PdCache *cache = w->srv->cache;
+    const CacheEntry *hit = NULL;
+    PdError error = PD_OK;
+    CacheKey key;
+
+    if (cache) {
+        make_cache_key(&key, j->input, j->length, &w->srv->opts.doc);
+        hit = find_render(cache, &key);
+    }
+
+    if (hit) {
+        if ((j->body = try_init_string(hit->length + 1))) {
+            memcpy(j->body->data, hit->html, hit->length);
+            j->body->length = hit->length;
+        }
+        else error = PD_ERR_NOMEM;
+        release_render(cache, hit);
+    }
+    else {
+        error = parse_job(w, j);
+        if (!error && cache) {
+            store_render(cache, &key, j->body->data, j->body->length);
+        }
+    }
+
+    if (error) {
+        free_string(j->body);
+        j->body = NULL;
+    }
+    free(j->input);
+    j->input = NULL;
+    pack_header(j->header, (uint8_t)error,
+                j->body ? (uint32_t)j->body->length : 0);
+}
+
+
+/** Take the next request, or return `NULL` once the server stops. */
+static Job *take_job(Server *srv)
+{
+    Job *j = NULL;
+
+    pthread_mutex_lock(&srv->todo_lock);
+    while (!srv->todo.head && !srv->stop) {
+        pthread_cond_wait(&srv->todo_cond, &srv->todo_lock);
+    }
+    if (!srv->stop && (j = srv->todo.head)) {
+        srv->todo.head = j->next;
+        if (!srv->todo.head) srv->todo.tail = NULL;
+    }
+    pthread_mutex_unlock(&srv->todo_lock);
+    return j;
+}
+
+
+/** Add a job to the tail of a list. */
+static void push_job(JobList *list, Job *j)
+{
+    j->next = NULL;
+    if (list->tail) list->tail->next = j;
+    else list->head = j;
+    list->tail = j;
+}
+
+
+/** Render requests until the server stops. */
+static void *run_worker(void *arg)
+{
+    Worker *w = arg;
+    Server *srv = w->srv;
+    const uint64_t one = 1;
+    Job *j = NULL;
+
+    while ((j = take_job(srv))) {
+        render_job(w, j);
+
+        pthread_mutex_lock(&srv->done_lock);
+        push_job(&srv->done, j);
+        pthread_mutex_unlock(&srv->done_lock);
+
+        /* The eventfd adds up, so one read wakes the loop for many. */
+        if (write(srv->wakefd, &one, sizeof(one)) < 0) continue;
+    }
+    return NULL;
+}
+
+
+/************************************************************************
+ * # Connections
+ ************************************************************************/
+
+/**
+ * Allocate a job for a request on a connection.
+ *
+ * - returns: The job, or `NULL` if memory could not be allocated.
+ */
+static Job *init_job(Conn *c)
+{
+    Job *j = calloc(1, sizeof(Job));
+    if (!j) return NULL;
+
+    j->conn = c;
+    j->seq  = c->next_seq++;
+    clock_gettime(CLOCK_MONOTONIC, &j->start);
+    return j;
+}
+
+
+/** Free a job and its request and response, if they exist. */
+static void free_job(Job *j)
+{
+    free(j->input);
+    free_string(j->body);
+    free(j);
+}
+
+
+/** Add a finished job to a connection's responses, in sequence. */
+static void add_ready(Conn *c, Job *j)
+{
+    Job **at = &c->ready;
+
+    while (*at && (*at)->seq < j->seq) at = &(*at)->next;
+    j->next = *at;
+    *at = j;
+}
+
+
+/**
+ * Get the counters of the server as the body of a response.
+ *
+ * - returns: The body, or `NULL` if memory could not be allocated.
+ */
+static String *stats_body(const Server *srv)
+{
+    String *str = try_init_string(1024);
+    PdCacheStats cs;
+
+    if (!str) return NULL;
+
+    str->length = snprintf((char *)str->data, str->allocd,
+        "requests %zu\n"
+        "errors %zu\n"
+        "bytes_in %zu\n"
+        "bytes_out %zu\n"
+        "connections %zu\n"
+        "accepted %zu\n"
+        "workers %zu\n"
+        "p50_us %llu\n"
+        "p90_us %llu\n"
+        "p99_us %llu\n"
+        "max_us %llu\n",
+        srv->requests, srv->errors, srv->bytes_in, srv->bytes_out,
+        srv->open, srv->accepted, srv->opts.workers,
+        (unsigned long long)latency_percentile(&srv->latency, 50),
+        (unsigned long long)latency_percentile(&srv->latency, 90),
+        (unsigned long long)latency_percentile(&srv->latency, 99),
+        (unsigned long long)srv->latency.max);
+
+    if (srv->cache) {
+        pd_cache_stats(srv->cache, &cs);
+        str->length += snprintf((char *)str->data + str->length,
+            str->allocd - str->length,
+            "cache_hits %zu\n"
+            "cache_misses %zu\n"
+            "cache_evictions %zu\n"
+            "cache_entries %zu\n"
+            "cache_bytes %zu\n",
+            cs.hits, cs.misses, cs.evictions, cs.entries, cs.bytes);
+    }
+    return str;
+}
+
+
+/** Accept every waiting connection. */
+static void accept_conns(Server *srv)
+{
+    struct epoll_event ev;
+    Conn *c = NULL;
+    int fd = 0;
+
+    while ((fd = accept4(srv->lfd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        /* Without memory for it, the connection is closed at once. */
+        if (!(c = calloc(1, sizeof(Conn))) ||
+            !(c->in = try_init_string(READ_BUF))) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+
+        ev.events = c->events;
+        ev.data.ptr = c;
+        if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            free_string(c->in);
+            free(c);
+            continue;
+        }
+
+        c->next = srv->conns;
+        if (srv->conns) srv->conns->prev = c;
+        srv->conns = c;
+        srv->accepted++;
+        srv->open++;
+    }
+}
+
+
+/**
+ * Frame every complete request buffered on a connection.
+ *
+ * Render requests are handed to the workers; stats are answered at
+ * once. A body over the server's cap is answered with
+ * `PD_ERR_INPUT_LIMIT`, and the connection is then closed, since the
+ * rest of its input can no longer be framed. A request whose body or
+ * stats cannot be allocated is answered with `PD_ERR_NOMEM`. A request
+ * of an unknown kind, or one without memory for its job, closes the
+ * connection without a response.
+ *
+ * - returns: `true` if any request was framed.
+ */
+static bool frame_requests(Server *srv, Conn *c)
+{
+    const uint8_t *data = c->in->data;
+    size_t used   = 0;          /* Bytes of the buffer framed. */
+    size_t queued = 0;          /* Requests handed to the workers. */
+    bool framed   = false;
+    bool drop     = false;      /* The connection must be closed. */
+    Job *first = NULL;          /* Requests to hand to the workers. */
+    Job *last  = NULL;
+    Job *j = NULL;
+    uint32_t length = 0;
+
+    while (!c->eof && c->next_seq - c->write_seq < MAX_PENDING &&
+           c->in->length - used >= SERVE_HEADER) {
+        length = unpack_length(data + used);
+
+        if (data[used] != REQUEST_RENDER && data[used] != REQUEST_STATS) {
+            drop = true;
+            break;
+        }
+        if (length > srv->max_input) {
+            if (!(j = init_job(c))) {
+                drop = true;
+                break;
+            }
+            pack_header(j->header, PD_ERR_INPUT_LIMIT, 0);
+            add_ready(c, j);
+            c->eof = true;
+            used = c->in->length;
+            framed = true;
+            break;
+        }
+        if (c->in->length - used - SERVE_HEADER < length) break;
+
+        if (!(j = init_job(c))) {
+            drop = true;
+            break;
+        }
+        if (data[used] == REQUEST_STATS) {
+            if ((j->body = stats_body(srv))) {
+                pack_header(j->header, PD_OK, (uint32_t)j->body->length);
+            }
+            else pack_header(j->header, PD_ERR_NOMEM, 0);
+            add_ready(c, j);
+        }
+        else if (!(j->input = malloc(length ? length : 1))) {
+            pack_header(j->header, PD_ERR_NOMEM, 0);
+            add_ready(c, j);
+        }
+        else {
+            memcpy(j->input, data + used + SERVE_HEADER, length);
+            j->length = length;
+            j->next = NULL;
+            if (last) last->next = j;
+            else first = j;
+            last = j;
+            queued++;
+        }
+        used += SERVE_HEADER + length;
+        framed = true;
+    }
+
+    if (used > 0) {
+        memmove(c->in->data, c->in->data + used, c->in->length - used);
+        c->in->length -= used;
+    }
+    if (first) {
+        c->pending += queued;
+        pthread_mutex_lock(&srv->todo_lock);
+        if (srv->todo.tail) srv->todo.tail->next = first;
+        else srv->todo.head = first;
+        srv->todo.tail = last;
+        if (queued > 1) pthread_cond_broadcast(&srv->todo_cond);
+        else pthread_cond_signal(&srv->todo_cond);
+        pthread_mutex_unlock(&srv->todo_lock);
+    }
+    if (drop) kill_conn(srv, c);
+    return framed;
+}
+
+
+/**
+ * Write as many of a connection's responses, in sequence, as the
+ * socket will take.
+ *
+ * - returns: `true` if any bytes were written.
+ */
+static bool flush_conn(Server *srv, Conn *c)
+{
+    struct iovec iov[MAX_WRITES * 2];
+    bool wrote = false;
+    uint64_t seq = 0;
+    size_t skip = 0;            /* Bytes of a response already written. */
+    ssize_t n = 0;
+    int count = 0;
+    int k = 0;
+    Job *j = NULL;
+
+    while (c->ready && c->ready->seq == c->write_seq) {
+        /* Gather the responses that are next in sequence. */
+        count = 0;
+        skip = c->sent;
+        seq = c->write_seq;
+        for (j = c->ready; j && j->seq == seq && count < MAX_WRITES * 2 - 1;
+             j = j->next, seq++) {
+            iov[count].iov_base = j->header;
+            iov[count].iov_len  = SERVE_HEADER;
+            count++;
+            if (j->body && j->body->length > 0) {
+                iov[count].iov_base = j->body->data;
+                iov[count].iov_len  = j->body->length;
+                count++;
+            }
+        }
+        for (k = 0; skip > 0; k++) {
+            size_t take = (skip < iov[k].iov_len) ? skip : iov[k].iov_len;
+            iov[k].iov_base = (uint8_t *)iov[k].iov_base + take;
+            iov[k].iov_len -= take;
+            skip -= take;
+        }
+
+        if ((n = writev(c->fd, iov, count)) < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) kill_conn(srv, c);
+            return wrote;
+        }
+        srv->bytes_out += n;
+        wrote = true;
+
+        /* Free each response that was written in full. */
+        n += c->sent;
+        while ((j = c->ready) && j->seq == c->write_seq) {
+            size_t size = SERVE_HEADER + (j->body ? j->body->length : 0);
+            if ((size_t)n < size) break;
+            n -= size;
+            c->ready = j->next;
+            c->write_seq++;
+            free_job(j);
+        }
+        c->sent = n;
+        if (c->sent > 0) return wrote;
+    }
+    return wrote;
+}
+
+
+/**
+ * Handle the events of a connection's socket.
+ *
+ * The end of the input only stops reading: the responses to requests
+ * already read are still written before the connection is closed.
+ */
+static void service_conn(Server *srv, Conn *c, const uint32_t events)
+{
+    ssize_t n = 0;
+
+    /* Once the input has ended, a hang-up means nobody can read the
+     * responses that are left. */
+    if (events & EPOLLERR || (events & EPOLLHUP && c->eof)) {
+        kill_conn(srv, c);
+        return;
+    }
+    if (events & (EPOLLIN | EPOLLHUP) && !c->eof) {
+        if (!try_reserve_string(c->in, READ_BUF)) {
+            kill_conn(srv, c);
+            return;
+        }
+        n = read(c->fd, c->in->data + c->in->length, READ_BUF);
+        if (n > 0) {
+            c->in->length += n;
+            srv->bytes_in += n;
+        }
+        else if (n == 0) c->eof = true;
+        else if (errno != EAGAIN && errno != EINTR) {
+            kill_conn(srv, c);
+            return;
+        }
+    }
+    update_conn(srv, c);
+}
+
+
+/**
+ * Frame and write what a connection can, and poll it for what it is
+ * waiting on -- or close it, if it is done.
+ */
+static void update_conn(Server *srv, Conn *c)
+{
+    struct epoll_event ev;
+    uint32_t events = 0;
+    bool progress = true;
+
+    /* Writing a response can leave room to frame another request. */
+    while (progress && !c->dead) {
+        progress  = frame_requests(srv, c);
+        progress |= flush_conn(srv, c);
+    }
+    if (c->dead) return;
+
+    if (c->eof && c->write_seq == c->next_seq) {
+        kill_conn(srv, c);
+        return;
+    }
+
+    if (!c->eof && c->next_seq - c->write_seq < MAX_PENDING) {
+        events |= EPOLLIN;
+    }
+    if (c->ready && c->ready->seq == c->write_seq) events |= EPOLLOUT;
+
+    if (events != c->events) {
+        ev.events = events;
+        ev.data.ptr = c;
+        epoll_ctl(srv->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+
+/**
+ * Close a connection, and drop its unwritten responses.
+ *
+ * The connection itself is only free'd once the workers have returned
+ * every request they hold from it, and the current batch of events is
+ * handled.
+ */
+static void kill_conn(Server *srv, Conn *c)
+{
+    Job *j = NULL;
+
+    if (c->dead) return;
+    c->dead = true;
+    c->eof  = true;
+    close(c->fd);
+    srv->open--;
+
+    while ((j = c->ready)) {
+        c->ready = j->next;
+        free_job(j);
+    }
+    free_string(c->in);
+    c->in = NULL;
+
+    if (c->prev) c->prev->next = c->next;
+    else srv->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+
+    if (c->pending == 0) {
+        c->next = srv->graves;
+        srv->graves = c;
+    }
+}
+
+
+/**
+ * Take every rendered response from the workers, and write each to its
+ * connection.
+ *
+ * Responses to a connection that died are dropped, and the connection
+ * is free'd with its last one.
+ */
+static void collect_jobs(Server *srv)
+{
+    struct timespec now;
+    uint64_t count = 0;
+    uint64_t usec = 0;
+    Conn *touched = NULL;       /* Connections that got responses. */
+    Conn *c = NULL;
+    Job *j = NULL;
+    Job *next = NULL;
+
+    if (read(srv->wakefd, &count, sizeof(count)) < 0) return;
+
+    pthread_mutex_lock(&srv->done_lock);
+    j = srv->done.head;
+    srv->done.head = srv->done.tail = NULL;
+    pthread_mutex_unlock(&srv->done_lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (; j; j = next) {
+        next = j->next;
+        c = j->conn;
+        c->pending--;
+
+        usec = (uint64_t)(now.tv_sec - j->start.tv_sec) * 1000000 +
+               (now.tv_nsec - j->start.tv_nsec) / 1000;
+        record_latency(&srv->latency, usec);
+        srv->requests++;
+        if (j->header[0] != PD_OK) srv->errors++;
+
+        if (c->dead) {
+            free_job(j);
+            if (c->pending == 0) {
+                c->next = srv->graves;
+                srv->graves = c;
+            }
+            continue;
+        }
+        add_ready(c, j);
+        if (!c->touched) {
+            c->touched = true;
+            c->touch = touched;
+            touched = c;
+        }
+    }
+
+    for (; touched; touched = c) {
+        c = touched->touch;
+        touched->touched = false;
+        update_conn(srv, touched);
+    }
+}
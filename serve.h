@@ -0,0 +1,112 @@
+/**
+ * serve.h -- a resident daemon that renders documents over a socket
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef SERVE_DOT_H
+#define SERVE_DOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libpatdown.h"
+
+/************************************************************************
+ * # Serving Protocol
+ *
+ *  Every request and response is a five byte header followed by a body.
+ *  The first byte of a request is its kind, and the first byte of a
+ *  response is its status -- a `PdError`. The next four bytes are the
+ *  length of the body, most significant byte first.
+ *
+ *  A client can send any number of requests without waiting, and the
+ *  responses are always written in the order of the requests.
+ *
+ ************************************************************************/
+
+/** The bytes of every request and response before its body. */
+#define SERVE_HEADER 5
+
+/** The kinds of requests a client can send. */
+typedef enum
+{
+    REQUEST_RENDER = 'R',   /* Render the body as HTML5. */
+    REQUEST_STATS  = 'S'    /* Report the server's counters as text. */
+} request_t;
+
+/** Write the header of a request or a response. */
+void pack_header(uint8_t *header, const uint8_t kind, const uint32_t length);
+
+/** Read the length of the body from a header. */
+uint32_t unpack_length(const uint8_t *header);
+
+
+/************************************************************************
+ * # Latency Histograms
+ ************************************************************************/
+
+/** Buckets for each power of two; a percentile is within 1/16 of it. */
+#define HIST_SUB 16
+
+/** Buckets for every latency that fits in 64 bits. */
+#define HIST_BUCKETS (61 * HIST_SUB)
+
+/**
+ * A type to count latencies, in microseconds, into log-linear buckets.
+ *
+ * - member count: The number of latencies recorded.
+ * - member max: The largest latency recorded.
+ * - member buckets: The number of latencies in each bucket.
+ */
+typedef struct Histogram
+{
+    size_t count;                   /* Number of latencies recorded. */
+    uint64_t max;                   /* Largest latency recorded. */
+    size_t buckets[HIST_BUCKETS];   /* Latencies in each bucket. */
+} Histogram;
+
+/** Count a latency, in microseconds. */
+void record_latency(Histogram *h, const uint64_t usec);
+
+/** Get the latency that a percentage of those recorded are within. */
+uint64_t latency_percentile(const Histogram *h, const double percent);
+
+/** Add every latency of one histogram to another. */
+void merge_histogram(Histogram *into, const Histogram *from);
+
+
+/************************************************************************
+ * # Serving Documents
+ ************************************************************************/
+
+/**
+ * A type to hold the options of a server.
+ *
+ * - member workers: Threads that render documents, or zero for one for
+ *   each online CPU.
+ * - member cache_bytes: The memory for caching rendered documents
+ *   shared by every worker, or zero for no cache.
+ * - member doc: The options every document is parsed with. Documents
+ *   are rendered as they are parsed, so `max_arena` has no effect, and
+ *   `max_input` defaults to `SERVE_MAX_INPUT` instead of no cap, since
+ *   each request is held in memory until it is rendered.
+ */
+typedef struct ServeOptions
+{
+    size_t workers;     /* Threads that render documents. */
+    size_t cache_bytes; /* Memory for caching rendered documents. */
+    PdOptions doc;      /* Options every document is parsed with. */
+} ServeOptions;
+
+/** The largest request body accepted when `max_input` is zero. */
+#define SERVE_MAX_INPUT ((size_t)64 << 20)
+
+/** Render the documents sent to a Unix socket until interrupted. */
+int serve_socket(const char *path, const ServeOptions *opts);
+
+#endif
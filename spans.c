@@ -0,0 +1,459 @@
+/**
+ * spans.c -- detection of the spans of inline syntax in text
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "spans.h"
+
+/************************************************************************
+ * # Inline Spans
+ *
+ *  Inlines are not parsed into a tree, but the text of a block is
+ *  searched for the spans of syntax that change how the text inside
+ *  them is read: backslash escapes, code spans, inline links and
+ *  images. No autolink can start inside one of them, and the text of a
+ *  link or an image is the only part of it a reader sees.
+ *
+ *  Spans are found in order, each after the last. An escape binds
+ *  tightest, then a code span, so a bracket in either opens no link. A
+ *  run of backticks that no run of the same length closes is text, and
+ *  so is a bracket whose text is not followed by a destination.
+ *
+ *  A link holds no other link, so a bracket whose text holds one opens
+ *  no link of its own: `[a [b](c)](d)` is text around the link to `c`.
+ *  An image may hold a link. Brackets nested past `MOST_NESTING` open no
+ *  link, so that no text is searched more than that many times.
+ *
+ *  A bracket that opens no inline link may still open a reference to a
+ *  link defined elsewhere -- `[text][label]`, `[label][]` or `[label]`
+ *  -- when references are asked for. Whether it is one depends on the
+ *  definitions of the whole document, which the caller resolves.
+ *
+ *  A span must lie within the text it is searched for in, so the text
+ *  of a block that runs over several lines is searched whole.
+ *
+ ************************************************************************/
+
+/** The most brackets nested inside one another that open links. */
+#define MOST_NESTING 16
+
+/** The most bytes of the label of a reference. */
+#define MOST_LABEL 999
+
+static bool next_span(const uint8_t *data, const size_t from,
+                      const size_t to, const bool refs, const int depth,
+                      InlineSpan *span);
+
+
+/** Check if a byte is a space or a tab. */
+static bool is_blank(const uint8_t c)
+{
+    return c == ' ' || c == '\t';
+}
+
+
+/** Check if a byte is ASCII punctuation, which a backslash escapes. */
+static bool is_punct(const uint8_t c)
+{
+    return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') ||
+           (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+}
+
+
+/**
+ * Check if a byte may start a span of inline syntax: a backslash, a
+ * backtick, a bracket, or the `!` of an image.
+ */
+bool starts_span(const uint8_t c)
+{
+    return c == '[' || c == '`' || c == '\\' || c == '!';
+}
+
+
+/**
+ * Skip a code span.
+ *
+ * - parameter run: Receives the backticks of the opening run.
+ *
+ * - returns: The offset after the closing run of backticks, or after the
+ *   opening run if there is none -- a run no other run closes is text.
+ */
+static size_t skip_code_span(const uint8_t *data, const size_t to,
+                             const size_t at, size_t *run)
+{
+    size_t i = at;
+    size_t n = 0;
+
+    while (i < to && data[i] == '`') i++;
+    *run = i - at;
+    while (i < to) {
+        if (data[i] != '`') {
+            i++;
+            continue;
+        }
+        for (n = 0; i < to && data[i] == '`'; i++) n++;
+        if (n == *run) return i;
+    }
+    return at + *run;
+}
+
+
+/**
+ * Find the bracket that closes a link's text.
+ *
+ * - returns: The offset of the bracket, or `to` if there is none.
+ */
+static size_t close_bracket(const uint8_t *data, const size_t to,
+                            size_t at)
+{
+    size_t depth = 1;       /* Brackets open. */
+    size_t run = 0;
+
+    for (at++; at < to; at++) {
+        switch (data[at]) {
+            case '\\':
+                at++;
+                break;
+            case '`':
+                at = skip_code_span(data, to, at, &run) - 1;
+                break;
+            case '[':
+                depth++;
+                break;
+            case ']':
+                if (--depth == 0) return at;
+                break;
+        }
+    }
+    return to;
+}
+
+
+/** Skip spaces and tabs, and at most one line ending between them. */
+static size_t skip_blanks(const uint8_t *data, const size_t to, size_t at)
+{
+    while (at < to && is_blank(data[at])) at++;
+    if (at < to && data[at] == '\n') at++;
+    while (at < to && is_blank(data[at])) at++;
+    return at;
+}
+
+
+/**
+ * Match the destination and optional title of an inline link, from
+ * just after its `(` up to and including its `)`.
+ *
+ * - parameter dest: Receives the offset of the destination.
+ * - parameter length: Receives the bytes of the destination.
+ *
+ * - returns: The offset after the `)`, or zero if there is none.
+ */
+static size_t match_destination(const uint8_t *data, const size_t to,
+                                size_t at, size_t *dest, size_t *length)
+{
+    size_t parens = 0;      /* Parentheses open in the destination. */
+    size_t mark = 0;        /* The offset after the destination. */
+    uint8_t close = 0;      /* The byte that closes the title. */
+
+    at = skip_blanks(data, to, at);
+    if (at < to && data[at] == '<') {
+        *dest = ++at;
+        while (at < to && data[at] != '>' && data[at] != '<' &&
+               data[at] != '\n') {
+            at += (data[at] == '\\') ? 2 : 1;
+        }
+        if (at >= to || data[at] != '>') return 0;
+        *length = at++ - *dest;
+    }
+    else {
+        *dest = at;
+        while (at < to && data[at] > 0x20) {
+            if (data[at] == '\\' && at + 1 < to && data[at + 1] > 0x20) {
+                at++;
+            }
+            else if (data[at] == '(') parens++;
+            else if (data[at] == ')') {
+                if (parens == 0) break;
+                parens--;
+            }
+            at++;
+        }
+        if (parens) return 0;
+        *length = at - *dest;
+    }
+
+    /* A title must be set off from the destination. */
+    mark = at;
+    at = skip_blanks(data, to, at);
+    if (at < to && at > mark &&
+        (data[at] == '"' || data[at] == '\'' || data[at] == '(')) {
+        close = (data[at] == '(') ? ')' : data[at];
+        for (at++; at < to && data[at] != close; at++) {
+            if (data[at] == '\\') at++;
+        }
+        if (at >= to) return 0;
+        at = skip_blanks(data, to, at + 1);
+    }
+    return (at < to && data[at] == ')') ? at + 1 : 0;
+}
+
+
+/**
+ * Check if the text of a link holds a link, at any depth -- the text of
+ * an image it holds included.
+ */
+static bool holds_link(const uint8_t *data, size_t at, const size_t to,
+                       const int depth)
+{
+    InlineSpan span;
+
+    while (next_span(data, at, to, false, depth, &span)) {
+        if (span.type == SPAN_LINK) return true;
+        if (span.type == SPAN_IMAGE &&
+            holds_link(data, span.text, span.text + span.length,
+                       depth + 1)) {
+            return true;
+        }
+        at = span.end;
+    }
+    return false;
+}
+
+
+/**
+ * Match an inline link or image whose text opens at a bracket.
+ *
+ * - parameter image: The bracket follows a `!`.
+ * - parameter depth: The brackets the bracket is nested in.
+ *
+ * - returns: `true` if the bracket opens a link, which `span` receives.
+ */
+static bool match_link(const uint8_t *data, const size_t to,
+                       const size_t at, const bool image, const int depth,
+                       InlineSpan *span)
+{
+    size_t close = close_bracket(data, to, at);
+    size_t end = 0;
+
+    if (depth >= MOST_NESTING || close + 1 >= to || data[close + 1] != '(' ||
+        !(end = match_destination(data, to, close + 2, &span->dest,
+                                  &span->dest_length)) ||
+        (!image && holds_link(data, at + 1, close, depth + 1))) {
+        return false;
+    }
+    span->type   = image ? SPAN_IMAGE : SPAN_LINK;
+    span->start  = at;
+    span->end    = end;
+    span->text   = at + 1;
+    span->length = close - at - 1;
+    return true;
+}
+
+
+/**
+ * Find the bracket that closes a label, which holds no other bracket,
+ * at most `MOST_LABEL` bytes, and something other than whitespace.
+ *
+ * - returns: The offset of the bracket, or `to` if there is none.
+ */
+static size_t close_label(const uint8_t *data, const size_t to, size_t at)
+{
+    const size_t open = at;
+    bool blank = true;      /* The label holds only whitespace. */
+
+    for (at++; at < to && at - open <= MOST_LABEL + 1; at++) {
+        switch (data[at]) {
+            case '\\':
+                at++;
+                blank = false;
+                break;
+            case '[':
+                return to;
+            case ']':
+                return blank ? to : at;
+            case ' ':
+            case '\t':
+            case '\n':
+                break;
+            default:
+                blank = false;
+                break;
+        }
+    }
+    return to;
+}
+
+
+/**
+ * Match a reference to a link defined elsewhere, whose text opens at a
+ * bracket: its text followed by a label, by `[]`, or by nothing, when
+ * its text is its label.
+ *
+ * - parameter image: The bracket follows a `!`.
+ *
+ * - returns: `true` if the bracket opens a reference, which `span`
+ *   receives.
+ */
+static bool match_reference(const uint8_t *data, const size_t to,
+                            const size_t at, const bool image,
+                            InlineSpan *span)
+{
+    size_t close = close_bracket(data, to, at);
+    size_t label = to;      /* The bracket that closes a label. */
+
+    if (close >= to) return false;
+    if (close + 1 < to && data[close + 1] == '[') {
+        label = close_label(data, to, close + 1);
+    }
+    if (label < to) {
+        span->label        = close + 2;
+        span->label_length = label - close - 2;
+        span->end          = label + 1;
+    }
+    else {
+        /* The text is the label, and may be followed by `[]`. */
+        if (close_label(data, to, at) != close) return false;
+        span->label        = at + 1;
+        span->label_length = close - at - 1;
+        span->end          = close + 1;
+        if (close + 2 < to && data[close + 1] == '[' &&
+            data[close + 2] == ']') {
+            span->end = close + 3;
+        }
+    }
+    span->type   = image ? SPAN_REF_IMAGE : SPAN_REF_LINK;
+    span->start  = at;
+    span->text   = at + 1;
+    span->length = close - at - 1;
+    return true;
+}
+
+
+/**
+ * Match a code span whose opening run of backticks starts at an offset.
+ * The text of the code loses one space at each end when it has one at
+ * both, so that code can start or end with a backtick.
+ *
+ * - parameter next: Receives the offset to search on from, after the
+ *   span or after a run no other run closes.
+ *
+ * - returns: `true` if the run opens a code span, which `span` receives.
+ */
+static bool match_code(const uint8_t *data, const size_t to,
+                       const size_t at, size_t *next, InlineSpan *span)
+{
+    size_t run = 0;         /* Backticks of the opening run. */
+    size_t end = skip_code_span(data, to, at, &run);
+    size_t i = 0;
+
+    *next = end;
+    if (end == at + run) return false;
+
+    span->type   = SPAN_CODE;
+    span->start  = at;
+    span->end    = end;
+    span->text   = at + run;
+    span->length = end - run - span->text;
+    for (i = span->text; i < span->text + span->length; i++) {
+        if (data[i] != ' ') break;
+    }
+    if (i < span->text + span->length && data[span->text] == ' ' &&
+        data[span->text + span->length - 1] == ' ') {
+        span->text++;
+        span->length -= 2;
+    }
+    return true;
+}
+
+
+/**
+ * Match a link, an image or a reference whose text opens at a bracket.
+ *
+ * - returns: `true` if the bracket opens one, which `span` receives.
+ */
+static bool match_bracket(const uint8_t *data, const size_t to,
+                          const size_t at, const bool image, const bool refs,
+                          const int depth, InlineSpan *span)
+{
+    return match_link(data, to, at, image, depth, span) ||
+           (refs && match_reference(data, to, at, image, span));
+}
+
+
+/**
+ * Find the first span of inline syntax in text, between two offsets,
+ * inside some number of brackets.
+ */
+static bool next_span(const uint8_t *data, const size_t from,
+                      const size_t to, const bool refs, const int depth,
+                      InlineSpan *span)
+{
+    size_t at = from;
+    size_t next = 0;
+
+    while (at < to) {
+        while (at < to && !starts_span(data[at])) at++;
+        if (at == to) break;
+
+        switch (data[at]) {
+            case '\\':
+                if (at + 1 < to && is_punct(data[at + 1])) {
+                    span->type   = SPAN_ESCAPE;
+                    span->start  = at;
+                    span->end    = at + 2;
+                    span->text   = at + 1;
+                    span->length = 1;
+                    return true;
+                }
+                at++;
+                break;
+            case '`':
+                if (match_code(data, to, at, &next, span)) return true;
+                at = next;
+                break;
+            case '!':
+                if (at + 1 < to && data[at + 1] == '[' &&
+                    match_bracket(data, to, at + 1, true, refs, depth,
+                                  span)) {
+                    span->start = at;
+                    return true;
+                }
+                at++;
+                break;
+            default:
+                if (match_bracket(data, to, at, false, refs, depth, span)) {
+                    return true;
+                }
+                at++;
+                break;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Find the first span of inline syntax in text, between two offsets.
+ *
+ * - parameter data: The text, which holds the whole of any span.
+ * - parameter from: The offset the search starts at.
+ * - parameter to: The offset after the text.
+ * - parameter refs: Find references to links defined elsewhere, too.
+ * - parameter span: Receives the span.
+ *
+ * - returns: `true` if a span was found.
+ */
+bool find_span(const uint8_t *data, const size_t from, const size_t to,
+               const bool refs, InlineSpan *span)
+{
+    return next_span(data, from, to, refs, 0, span);
+}
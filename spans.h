@@ -0,0 +1,67 @@
+/**
+ * spans.h -- detection of the spans of inline syntax in text
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef SPANS_DOT_H
+#define SPANS_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/************************************************************************
+ * # Inline Spans
+ ************************************************************************/
+
+/** Kinds of span of inline syntax. */
+typedef enum
+{
+    SPAN_ESCAPE,        /* \ and the punctuation it escapes */
+    SPAN_CODE,          /* `code`, between runs of backticks */
+    SPAN_LINK,          /* [text](dest "title") */
+    SPAN_IMAGE,         /* ![alt](dest "title") */
+    SPAN_REF_LINK,      /* [text][label], [label][] or [label] */
+    SPAN_REF_IMAGE      /* ![alt][label], ![label][] or ![label] */
+} span_t;
+
+/**
+ * A type to hold a span of inline syntax found in a block's text.
+ *
+ * - member start: Offset of the first byte of the span.
+ * - member end: Offset just past the span.
+ * - member text: Offset of the first byte of the span's text: the
+ *   escaped byte, the code, or the text of the link.
+ * - member length: Bytes of the span's text.
+ * - member dest: Offset of the first byte of a link's destination.
+ * - member dest_length: Bytes of a link's destination.
+ * - member label: Offset of the first byte of a reference's label.
+ * - member label_length: Bytes of a reference's label.
+ * - member type: The kind of span.
+ */
+typedef struct InlineSpan
+{
+    size_t start;       /* First byte of the span. */
+    size_t end;         /* Just past the span. */
+    size_t text;        /* First byte of the text of the span. */
+    size_t length;      /* Bytes of the text of the span. */
+    size_t dest;        /* First byte of a link's destination. */
+    size_t dest_length; /* Bytes of a link's destination. */
+    size_t label;       /* First byte of a reference's label. */
+    size_t label_length;    /* Bytes of a reference's label. */
+    span_t type;        /* The kind of span. */
+} InlineSpan;
+
+/** Check if a byte may start a span of inline syntax. */
+bool starts_span(const uint8_t c);
+
+/** Find the first span of inline syntax in text, between two offsets. */
+bool find_span(const uint8_t *data, const size_t from, const size_t to,
+               const bool refs, InlineSpan *span);
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * stream.c -- push-style parsing of input as it arrives
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "patdown.h"
+#include "stream.h"
+#include "strings.h"
+#include "utf8.h"
+
+
+/************************************************************************
+ * # Markdown Streams
+ *
+ *  Input is pushed into a stream one chunk at a time with
+ *  `feed_stream()`. Once the buffer holds some complete lines, they are
+ *  parsed and every block that has been closed is reported to the
+ *  stream's Parser, and the input it was parsed from is dropped.
+ *
+ *  The last block is parsed again when more input arrives, since it may
+ *  still grow. To keep that linear in the size of the block, a parse is
+ *  only attempted once the buffer has doubled since the last attempt.
+ *
+ *  Any trailing partial line is kept for the next chunk, so a UTF-8
+ *  sequence or a `\r\n` pair that is split between chunks is never
+ *  parsed as two halves.
+ *
+ ************************************************************************/
+
+/** The number of bytes initially allocated for a stream's buffer. */
+#define STREAM_BUF 5120
+
+static size_t complete_lines(const String *buffer);
+static bool repair_stream(Stream *s, size_t *ready);
+
+
+/**
+ * Allocate a Stream to parse a new document.
+ *
+ * - parameter cb: The callbacks each closed block is reported to.
+ * - parameter repair: Replace NULL-bytes and invalid UTF-8 in the input
+ *   with U+FFFD before it is parsed.
+ *
+ * - returns: A pointer to the new Stream, or `NULL` if memory could not
+ *   be allocated.
+ */
+Stream *init_stream(const Callbacks *cb, const bool repair)
+{
+    Stream *s = malloc(sizeof(Stream));
+
+    if (!s) return NULL;
+    s->parser    = init_parser(cb);
+    s->buffer    = try_init_string(STREAM_BUF);
+    if (!s->parser || !s->buffer) {
+        free_stream(s);
+        return NULL;
+    }
+    s->checked   = 0;
+    s->threshold = 0;
+    s->repair    = repair;
+    return s;
+}
+
+
+/**
+ * Free a Stream and any input it still holds.
+ *
+ * - parameter s: The Stream to be free'd.
+ */
+void free_stream(Stream *s)
+{
+    if (s) {
+        free_parser(s->parser);
+        free_string(s->buffer);
+        free(s);
+    }
+}
+
+
+/**
+ * Add the next chunk of input, and report every block it closes.
+ *
+ * - parameter s: The Stream of the document.
+ * - parameter data: The first byte of the chunk.
+ * - parameter length: The number of bytes in the chunk.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse -- which is
+ *   `PD_ERR_NOMEM` if the input could not be buffered. Once the parse
+ *   is stopped, or its excerpt has ended, any further input is ignored.
+ */
+PdError feed_stream(Stream *s, const uint8_t *data, const size_t length)
+{
+    String *buf   = s->buffer;
+    size_t ready  = 0;  /* Bytes in the complete lines of the buffer. */
+    size_t used   = 0;  /* Bytes in the closed blocks. */
+
+    if (s->parser->error) return s->parser->error;
+    if (excerpt_ended(s->parser)) return PD_OK;
+
+    if (!try_append_span(buf, data, length)) {
+        s->parser->error = PD_ERR_NOMEM;
+        return s->parser->error;
+    }
+    if (buf->length < s->threshold) return PD_OK;
+
+    if ((ready = complete_lines(buf)) > 0) {
+        if (!repair_stream(s, &ready)) return s->parser->error;
+        buf = s->buffer;
+
+        used = parse_markdown_partial(s->parser, buf->data, ready);
+
+        /* Drop the input of the reported blocks. */
+        memmove(buf->data, buf->data + used, buf->length - used);
+        buf->length -= used;
+        buf->data[buf->length] = '\0';
+        s->checked -= used;
+    }
+    s->threshold = 2 * buf->length;
+    return s->parser->error;
+}
+
+
+/**
+ * Parse and report the rest of the input -- the document has ended.
+ *
+ * - parameter s: The Stream of the document.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse.
+ */
+PdError finish_stream(Stream *s)
+{
+    size_t ready = s->buffer->length;
+
+    if (s->parser->error) return s->parser->error;
+    if (!repair_stream(s, &ready)) return s->parser->error;
+
+    parse_markdown(s->parser, s->buffer->data, s->buffer->length);
+
+    s->buffer->length = 0;
+    s->checked   = 0;
+    s->threshold = 0;
+    return s->parser->error;
+}
+
+
+/**
+ * Get the number of bytes in the complete lines of a buffer.
+ *
+ * A `\r` at the very end of the buffer could be the first half of a
+ * `\r\n`, so the line it ends is not complete yet.
+ *
+ * - parameter buffer: The buffered input.
+ *
+ * - returns: The offset just past the last line ending, or zero.
+ */
+static size_t complete_lines(const String *buffer)
+{
+    const uint8_t *data = buffer->data;
+    size_t i = buffer->length;  /* Offset just past the current byte. */
+
+    if (i > 0 && data[i - 1] == '\r') i--;
+    while (i > 0 && data[i - 1] != '\n' && data[i - 1] != '\r') i--;
+    return i;
+}
+
+
+/**
+ * Validate the unchecked bytes of the buffer before they are parsed.
+ *
+ * The bytes are only copied when there is something to repair, in which
+ * case the buffer is rebuilt around the repaired bytes.
+ *
+ * - parameter s: The Stream of the document.
+ * - parameter ready: The number of bytes about to be parsed, set to the
+ *   number to parse after the repair.
+ *
+ * - returns: `false` if memory could not be allocated, in which case
+ *   the parse is stopped with `PD_ERR_NOMEM`.
+ */
+static bool repair_stream(Stream *s, size_t *ready)
+{
+    String *buf = s->buffer;
+    String *fix = NULL;     /* The repaired bytes. */
+    String *out = NULL;     /* The rebuilt buffer. */
+    size_t valid = 0;       /* Length of the valid prefix. */
+    size_t size  = 0;       /* Number of unchecked bytes. */
+
+    if (!s->repair || s->checked >= *ready) return true;
+    size = *ready - s->checked;
+
+    valid = validate_utf8(buf->data + s->checked, size);
+    if (valid < size) {
+        fix = repair_utf8(buf->data + s->checked, size, valid);
+        if (fix) out = try_init_string(buf->length - size + fix->length + 1);
+        if (!out) {
+            free_string(fix);
+            s->parser->error = PD_ERR_NOMEM;
+            return false;
+        }
+
+        /* The rebuilt buffer was allocated with room for all of it. */
+        append_span(out, buf->data, s->checked);
+        append_span(out, fix->data, fix->length);
+        append_span(out, buf->data + *ready, buf->length - *ready);
+
+        *ready = s->checked + fix->length;
+        free_string(fix);
+        free_string(buf);
+        s->buffer = out;
+    }
+    s->checked = *ready;
+    return true;
+}
@@ -0,0 +1,58 @@
+/**
+ * stream.h -- push-style parsing of input as it arrives
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef STREAM_DOT_H
+#define STREAM_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "patdown.h"
+#include "strings.h"
+
+/************************************************************************
+ * # Markdown Streams
+ ************************************************************************/
+
+/**
+ * A type to hold the state of a document that is parsed as it arrives.
+ *
+ * Only the input of the blocks that are still open is buffered, so the
+ * memory used is bounded by the largest block rather than the document.
+ *
+ * - member parser: The Parser each closed block is reported to.
+ * - member buffer: Input bytes that have not been parsed.
+ * - member checked: Leading bytes of `buffer` known to be valid UTF-8.
+ * - member threshold: Buffer length that triggers the next parse.
+ * - member repair: Replace NULL-bytes and invalid UTF-8 with U+FFFD.
+ */
+typedef struct Stream
+{
+    Parser *parser;     /* Parser each closed block is reported to. */
+    String *buffer;     /* Input bytes that have not been parsed. */
+    size_t checked;     /* Leading bytes known to be valid UTF-8. */
+    size_t threshold;   /* Buffer length that triggers the next parse. */
+    bool repair;        /* Replace invalid UTF-8 with U+FFFD. */
+} Stream;
+
+/** Allocate a Stream to parse a new document. */
+Stream *init_stream(const Callbacks *cb, const bool repair);
+
+/** Free a Stream and any input it still holds. */
+void free_stream(Stream *s);
+
+/** Add the next chunk of input, and report every block it closes. */
+PdError feed_stream(Stream *s, const uint8_t *data, const size_t length);
+
+/** Parse and report the rest of the input -- the document has ended. */
+PdError finish_stream(Stream *s);
+
+#endif
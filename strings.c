@@ -9,8 +9,11 @@
  ************************************************************************/
 
 #include <ctype.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "errors.h"
 #include "strings.h"
@@ -47,14 +50,15 @@ static uint8_t *alloc_data_array(const size_t size)
  * Count the leading white space in a string.
  *
  * - parameter data: An array of byte data (utf8 string).
+ * - parameter end: The byte just past the end of the array.
  *
  * - returns: The number of WS characters encountered before a non-WS
  *   character, where a space is one and a tab is four.
  */
-size_t count_indentation(uint8_t *data)
+size_t count_indentation(const uint8_t *data, const uint8_t *end)
 {
     size_t ws = 0;
-    while (isblank(*data)) {
+    while (data < end && isblank(*data)) {
         if (*data++ == 0x20) ws++;
         else ws += 4;
     }
@@ -101,8 +105,9 @@ String *init_string(const size_t size)
         str->data   = NULL;
     }
     else {
-        str->allocd = size;
-        str->data   = alloc_data_array(size);
+        str->allocd  = size;
+        str->data    = alloc_data_array(size);
+        str->data[0] = '\0';
     }
     str->length = 0;
     return str;
@@ -111,28 +116,22 @@ String *init_string(const size_t size)
 /**
  * Reallocate a String node's data member to contain size elements.
  *
- * Often, this function is called after some parsing has begun, which
- * will inevitably increment the `data` member of `str`. Becuase of this,
- * we subtract `str` by the number of bytes currently stored in the
- * array to ensure we are reallocating on the original pointer -- 
- * which would be `str->data[0]`.
- *
- * The `str->data` array is then incremented by the same amount after
- * the reallocation -- putting it back into the state at which this
- * function was called.
+ * The `data` member must always point to the first byte of the array.
+ * Callers append to a String through the builder functions below, they
+ * never advance `data` itself.
  *
  * - parameter str: The String node whose member should be reallocated.
  * - parameter size: The new size (in bytes) of the requested memory.
+ *
+ * - throws fatal_memory_error: Memory could not be allocated.
  */
 void realloc_string(String *str, const size_t size)
 {
-    if (str->length > 0) str->data -= str->length;
+    uint8_t *data = realloc(str->data, sizeof(uint8_t) * size);
+    if (!data) throw_fatal_memory_error();
     
-    str->data = realloc(str->data, sizeof(uint8_t) * size);
+    str->data   = data;
     str->allocd = size;
-    if (!str->data) throw_fatal_memory_error();
-    
-    if (str->length > 0) str->data += str->length;
 }
 
 
@@ -151,3 +150,150 @@ void free_string(String *str)
         free(str);
     }
 }
+
+
+/************************************************************************
+ * # String Builder
+ *
+ *  A String node can be used as a growable buffer. Every append keeps
+ *  the bytes NULL-terminated, so `data` is always a valid C-string once
+ *  something has been written to it. The capacity grows geometrically,
+ *  which keeps the total cost of building a block linear in its length.
+ *
+ ************************************************************************/
+
+/** The smallest capacity (in bytes) of a growing String node. */
+#define MIN_GROWTH 64
+
+/**
+ * Ensure a String node has room to append size more bytes.
+ *
+ * Room for a trailing NULL-byte is always reserved as well. When the
+ * node must grow, its capacity is at least doubled.
+ *
+ * - parameter str: The String node to grow.
+ * - parameter size: The number of bytes the caller is about to append.
+ *
+ * - throws fatal_memory_error: Memory could not be allocated.
+ */
+void reserve_string(String *str, const size_t size)
+{
+    if (!try_reserve_string(str, size)) throw_fatal_memory_error();
+}
+
+
+/**
+ * Append length bytes of data to the end of a String node.
+ *
+ * - parameter str: The String node to append to.
+ * - parameter data: The first byte to copy.
+ * - parameter length: The number of bytes to copy.
+ *
+ * - throws fatal_memory_error: Memory could not be allocated.
+ */
+void append_span(String *str, const uint8_t *data, const size_t length)
+{
+    if (!try_append_span(str, data, length)) throw_fatal_memory_error();
+}
+
+
+/**
+ * Append a single byte to the end of a String node.
+ *
+ * - parameter str: The String node to append to.
+ * - parameter byte: The byte to append.
+ */
+void append_byte(String *str, const uint8_t byte)
+{
+    reserve_string(str, 1);
+    str->data[str->length++] = byte;
+    str->data[str->length]   = '\0';
+}
+
+
+/************************************************************************
+ * # Fallible String Builder
+ *
+ *  The functions above end the process when memory runs out, which is
+ *  fine for the command line. A library cannot do that, so these
+ *  functions report the failure instead and leave the node unchanged.
+ *
+ ************************************************************************/
+
+/**
+ * Allocate a `String` node to store size bytes, without exiting.
+ *
+ * - parameter size: The number of bytes to allocate for the data member.
+ *
+ * - returns: A pointer to the new `String` node, or `NULL` if memory
+ *   could not be allocated.
+ */
+String *try_init_string(const size_t size)
+{
+    String *str = malloc(sizeof(String));
+    if (!str) return NULL;
+
+    str->allocd = size;
+    str->length = 0;
+    str->data   = NULL;
+
+    if (size > 0) {
+        if (!(str->data = malloc(size))) {
+            free(str);
+            return NULL;
+        }
+        str->data[0] = '\0';
+    }
+    return str;
+}
+
+
+/**
+ * Ensure a String node has room to append size more bytes.
+ *
+ * - parameter str: The String node to grow.
+ * - parameter size: The number of bytes the caller is about to append.
+ *
+ * - returns: `false` if memory could not be allocated, or if the size
+ *   needed does not fit in a `size_t`.
+ */
+bool try_reserve_string(String *str, const size_t size)
+{
+    size_t need = 0;
+    size_t cap  = str->allocd;
+    uint8_t *data = NULL;
+
+    if (size > SIZE_MAX - str->length - 1) return false;
+    need = str->length + size + 1;
+    if (need <= cap) return true;
+
+    if (cap < MIN_GROWTH) cap = MIN_GROWTH;
+    while (cap < need) {
+        if (cap > SIZE_MAX / 2) return false;
+        cap *= 2;
+    }
+
+    if (!(data = realloc(str->data, cap))) return false;
+    str->data   = data;
+    str->allocd = cap;
+    return true;
+}
+
+
+/**
+ * Append length bytes of data to the end of a String node.
+ *
+ * - parameter str: The String node to append to.
+ * - parameter data: The first byte to copy.
+ * - parameter length: The number of bytes to copy.
+ *
+ * - returns: `false` if memory could not be allocated.
+ */
+bool try_append_span(String *str, const uint8_t *data, const size_t length)
+{
+    if (!try_reserve_string(str, length)) return false;
+    if (length > 0) memcpy(str->data + str->length, data, length);
+    str->length += length;
+    str->data[str->length] = '\0';
+    return true;
+}
@@ -11,6 +11,7 @@
 #ifndef STRINGS_DOT_H
 #define STRINGS_DOT_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -18,8 +19,8 @@
  * # Data Array Utilities
  ************************************************************************/
 
-/** Count the WS to the first non-WS character. */
-size_t count_indentation(uint8_t *data);
+/** Count the WS to the first non-WS character before end. */
+size_t count_indentation(const uint8_t *data, const uint8_t *end);
 
 
 /************************************************************************
@@ -48,4 +49,32 @@ void free_string(String *str);
 /** Reallocate a String node's data member to contain size elements. */
 void realloc_string(String *str, const size_t size);
 
+
+/************************************************************************
+ * # String Builder
+ ************************************************************************/
+
+/** Ensure a String node has room to append size more bytes. */
+void reserve_string(String *str, const size_t size);
+
+/** Append length bytes of data to the end of a String node. */
+void append_span(String *str, const uint8_t *data, const size_t length);
+
+/** Append a single byte to the end of a String node. */
+void append_byte(String *str, const uint8_t byte);
+
+
+/************************************************************************
+ * # Fallible String Builder
+ ************************************************************************/
+
+/** Allocate a String node, or return `NULL` if memory runs out. */
+String *try_init_string(const size_t size);
+
+/** Ensure room to append size more bytes, or return `false`. */
+bool try_reserve_string(String *str, const size_t size);
+
+/** Append length bytes to a String node, or return `false`. */
+bool try_append_span(String *str, const uint8_t *data, const size_t length);
+
 #endif
@@ -0,0 +1,588 @@
+/**
+ * table.c -- compact tables of parsed blocks
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libpatdown.h"
+#include "patdown.h"
+#include "table.h"
+
+
+/************************************************************************
+ * # Block Tables
+ *
+ *  A queue is built one node at a time as a document is parsed, so
+ *  each node, its text and its extension are separate allocations, and
+ *  walking the queue follows a pointer to each of them. Once a document
+ *  is parsed it only needs to be read, and a table holds the same
+ *  blocks in a few flat arrays instead:
+ *
+ *      types    1 byte per block
+ *      ends     4 bytes per block, the end of its text
+ *      starts   4 bytes per block, its offset in the document
+ *      sizes    4 bytes per block, the bytes it was parsed from
+ *      ext      20 bytes per code block or link definition
+ *      text     the text of every block, then every string
+ *
+ *  which is 13 bytes per block, plus its text. Blocks are read in
+ *  order, so the start of a block's text is the end of the one before
+ *  it, and the extensions are read in order as well -- neither needs
+ *  an index of its own.
+ *
+ *  A table is built by replaying the blocks twice: once to count them,
+ *  and once to copy them into a single allocation of the right size.
+ *  Offsets are 32 bits, so a document of 4 GiB or more has no table.
+ *
+ ************************************************************************/
+
+/** The alignment of each array in a table's memory. */
+#define TABLE_ALIGN 8
+
+/** The state of a table being built. */
+typedef struct Builder
+{
+    bool fill;              /* Copy the blocks, not just count them. */
+    uint8_t *types;         /* Type of each block. */
+    uint32_t *ends;         /* End of each block's text. */
+    uint32_t *starts;       /* Offset of each block in the document. */
+    uint32_t *sizes;        /* Bytes each block was parsed from. */
+    TableExt *ext;          /* Extension of each block that has one. */
+    uint8_t *text;          /* Text of every block, then every string. */
+    size_t length;          /* Blocks added. */
+    size_t exts;            /* Extensions added. */
+    size_t bytes;           /* Bytes of text added. */
+    size_t strings;         /* Bytes of strings added, after the text. */
+    size_t base;            /* Offset of the first string in `text`. */
+    size_t far;             /* Largest offset in the document. */
+    size_t open;            /* Innermost blockquote not yet ended, + 1. */
+} Builder;
+
+
+/**
+ * Check if a type of block has an extension.
+ *
+ * - parameter type: The type of the block.
+ *
+ * - returns: `true` for fenced code blocks and link definitions.
+ */
+bool block_has_ext(const mdblock_t type)
+{
+    return type == FENCED_CODE_BLOCK || type == LINK_REFERENCE_DEF;
+}
+
+
+/** Round a size up to the alignment of a table's arrays. */
+static size_t align_size(const size_t size)
+{
+    return (size + TABLE_ALIGN - 1) & ~(size_t)(TABLE_ALIGN - 1);
+}
+
+
+/** Add a NULL-terminated string after the text, returning its offset. */
+static uint32_t add_string(Builder *b, const char *str)
+{
+    size_t length = strlen(str) + 1;
+    size_t at = b->base + b->strings;
+
+    if (b->fill) memcpy(b->text + at, str, length);
+    b->strings += length;
+    return at;
+}
+
+
+/** Add a row to the table for each block that is entered. */
+static PdError table_enter_block(const mdblock_t type, const void *info,
+                                 const size_t start, void *userdata)
+{
+    Builder *b = userdata;
+    const CodeBlk *blk = info;
+    const LinkRef *lr  = info;
+    TableExt e;
+    size_t row = b->length++;
+
+    memset(&e, 0, sizeof(TableExt));
+    if (start > b->far) b->far = start;
+
+    if (type == FENCED_CODE_BLOCK) {
+        e.strings[0] = add_string(b, (const char *)blk->lang);
+        e.fl = blk->fl;
+        e.ws = blk->ws;
+        e.fc = blk->fc;
+    }
+    else if (type == LINK_REFERENCE_DEF) {
+        e.strings[0] = add_string(b, lr->label);
+        e.strings[1] = add_string(b, lr->dest);
+        e.strings[2] = add_string(b, lr->title);
+    }
+    if (block_has_ext(type)) {
+        if (b->fill) b->ext[b->exts] = e;
+        b->exts++;
+    }
+    if (!b->fill) return PD_OK;
+
+    b->types[row]  = type;
+    b->ends[row]   = b->bytes;
+    b->starts[row] = start;
+    b->sizes[row]  = 0;
+
+    /* A blockquote keeps the one around it in its size until it ends. */
+    if (type == BLOCKQUOTE_START) {
+        b->sizes[row] = b->open;
+        b->open = row + 1;
+    }
+    return PD_OK;
+}
+
+
+/** Append each span of text to the block in the last row. */
+static PdError table_text(const uint8_t *data, const size_t length,
+                          void *userdata)
+{
+    Builder *b = userdata;
+
+    if (b->fill) {
+        memcpy(b->text + b->bytes, data, length);
+        b->ends[b->length - 1] = b->bytes + length;
+    }
+    b->bytes += length;
+    return PD_OK;
+}
+
+
+/** Note where each block ends, adding a row at the end of a blockquote. */
+static PdError table_exit_block(const mdblock_t type, const size_t end,
+                                void *userdata)
+{
+    Builder *b = userdata;
+    size_t open = b->open - 1;  /* The blockquote that ends. */
+    size_t row  = b->length;
+
+    if (end > b->far) b->far = end;
+    if (type == BLOCKQUOTE_END) b->length++;
+    if (!b->fill) return PD_OK;
+
+    if (type != BLOCKQUOTE_END) {
+        b->sizes[row - 1] = end - b->starts[row - 1];
+        return PD_OK;
+    }
+
+    b->open         = b->sizes[open];
+    b->sizes[open]  = end - b->starts[open];
+    b->types[row]   = type;
+    b->ends[row]    = b->bytes;
+    b->starts[row]  = b->starts[open];
+    b->sizes[row]   = b->sizes[open];
+    return PD_OK;
+}
+
+
+/**
+ * Copy the blocks reported by a replay into a new table.
+ *
+ * - parameter replay: The function that reports the blocks. It is
+ *   called twice, and must report the same blocks both times.
+ * - parameter blocks: The blocks, passed to `replay`.
+ * - parameter error: Receives `PD_ERR_NOMEM` if memory could not be
+ *   allocated, or `PD_ERR_INPUT_LIMIT` if the document or its text is
+ *   too large for 32-bit offsets.
+ *
+ * - returns: A pointer to the new table, to be free'd with
+ *   `free_table()`, or `NULL` on error.
+ */
+Table *build_table(Replay replay, const void *blocks, PdError *error)
+{
+    Builder b;
+    Callbacks cb = {
+        table_enter_block, table_text, table_exit_block, NULL, NULL
+    };
+    Table *t = NULL;
+    size_t size = 0;        /* Bytes of every array. */
+    size_t column = 0;      /* Bytes of each array of offsets. */
+    uint8_t *mem = NULL;
+
+    memset(&b, 0, sizeof(Builder));
+    cb.userdata = &b;
+    replay(blocks, &cb);
+
+    if (b.far > UINT32_MAX || b.bytes + b.strings > UINT32_MAX) {
+        *error = PD_ERR_INPUT_LIMIT;
+        return NULL;
+    }
+
+    column = align_size(b.length * sizeof(uint32_t));
+    size   = align_size(b.length) + 3 * column +
+             align_size(b.exts * sizeof(TableExt)) + b.bytes + b.strings;
+    if (!(t = malloc(sizeof(Table))) || !(mem = malloc(size ? size : 1))) {
+        free(t);
+        *error = PD_ERR_NOMEM;
+        return NULL;
+    }
+
+    b.types  = mem;
+    b.ends   = (uint32_t *)(mem + align_size(b.length));
+    b.starts = (uint32_t *)((uint8_t *)b.ends + column);
+    b.sizes  = (uint32_t *)((uint8_t *)b.starts + column);
+    b.ext    = (TableExt *)((uint8_t *)b.sizes + column);
+    b.text   = (uint8_t *)b.ext + align_size(b.exts * sizeof(TableExt));
+
+    t->length = b.length;
+    t->exts   = b.exts;
+    t->types  = b.types;
+    t->ends   = b.ends;
+    t->starts = b.starts;
+    t->sizes  = b.sizes;
+    t->ext    = b.ext;
+    t->text   = b.text;
+    t->bytes  = b.bytes + b.strings;
+    t->memory = mem;
+
+    /* Copy the blocks, with the strings after every byte of text. */
+    b.base    = b.bytes;
+    b.fill    = true;
+    b.length  = b.exts = b.bytes = b.strings = 0;
+    replay(blocks, &cb);
+    return t;
+}
+
+
+/**
+ * Report each block of a table, as if it was being parsed.
+ *
+ * - parameter t: The table of blocks.
+ * - parameter cb: The callbacks to report each block to.
+ */
+void replay_table(const Table *t, const Callbacks *cb)
+{
+    replay_rows(t, 0, t->length, 0, cb);
+}
+
+
+/**
+ * Count the blocks of a range of a table that have an extension.
+ *
+ * - parameter t: The table of blocks.
+ * - parameter first: The first block to count.
+ * - parameter last: The block after the last to count.
+ *
+ * - returns: The number of extensions of the blocks.
+ */
+size_t count_exts(const Table *t, const size_t first, const size_t last)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    for (i = first; i < last; i++) count += block_has_ext(t->types[i]);
+    return count;
+}
+
+
+/**
+ * Report a range of the blocks of a table, as if it was being parsed.
+ *
+ * - parameter t: The table of blocks.
+ * - parameter first: The first block to report.
+ * - parameter last: The block after the last to report.
+ * - parameter ext: The number of extensions of the blocks before
+ *   `first` -- see `count_exts()`.
+ * - parameter cb: The callbacks to report each block to.
+ */
+void replay_rows(const Table *t, const size_t first, const size_t last,
+                 const size_t ext, const Callbacks *cb)
+{
+    const TableExt *e = t->ext + ext;   /* Extension of the next block. */
+    const void *info = NULL;
+    size_t from = first ? t->ends[first - 1] : 0;  /* Start of the text. */
+    size_t i = 0;
+    mdblock_t type = UNKNOWN;
+    CodeBlk blk;
+    LinkRef lr;
+
+    for (i = first; i < last; from = t->ends[i++]) {
+        type = t->types[i];
+        info = NULL;
+
+        if (type == FENCED_CODE_BLOCK) {
+            strcpy((char *)blk.lang, (const char *)t->text + e->strings[0]);
+            blk.fl = e->fl;
+            blk.ws = e->ws;
+            blk.fc = e->fc;
+            info = &blk;
+            e++;
+        }
+        else if (type == LINK_REFERENCE_DEF) {
+            strcpy(lr.label, (const char *)t->text + e->strings[0]);
+            strcpy(lr.dest, (const char *)t->text + e->strings[1]);
+            strcpy(lr.title, (const char *)t->text + e->strings[2]);
+            lr.left = lr.right = NULL;
+            info = &lr;
+            e++;
+        }
+
+        if (type != BLOCKQUOTE_END && cb->enter_block) {
+            cb->enter_block(type, info, t->starts[i], cb->userdata);
+        }
+        /* A table keeps no masks: text is scanned as it is replayed. */
+        if (t->ends[i] > from && cb->inlines) {
+            cb->inlines(scan_inlines(t->text + from, t->ends[i] - from),
+                        cb->userdata);
+        }
+        if (t->ends[i] > from && cb->text) {
+            cb->text(t->text + from, t->ends[i] - from, cb->userdata);
+        }
+        if (type != BLOCKQUOTE_START && cb->exit_block) {
+            cb->exit_block(type, t->starts[i] + t->sizes[i], cb->userdata);
+        }
+    }
+}
+
+
+/**
+ * Free a table, if it exists.
+ *
+ * - parameter t: The table to be free'd.
+ */
+void free_table(Table *t)
+{
+    if (t) {
+        free(t->memory);
+        free(t);
+    }
+}
+
+
+/************************************************************************
+ * # Table Files
+ *
+ *  A table is saved as a header, each of its arrays, and the source
+ *  the document was parsed from, one after another:
+ *
+ *      header   magic, version, byte order, counts and offsets
+ *      types    1 byte per block
+ *      ends     4 bytes per block
+ *      starts   4 bytes per block
+ *      sizes    4 bytes per block
+ *      ext      20 bytes per extension
+ *      text     the text of every block, then every string
+ *      source   the bytes of the document
+ *
+ *  Each part starts at a multiple of eight bytes, and every number is
+ *  written in the byte order of the machine that saved it. A file that
+ *  is mapped into memory, or read into any aligned buffer, is then used
+ *  as a table just as it is -- nothing is decoded or copied.
+ *
+ *  Saved bytes may come from anywhere, so they are checked before they
+ *  are used: every part must fit in the file, every offset must fit in
+ *  its part, and every string must end within the length its block
+ *  allows. A table that passes can be replayed without reading outside
+ *  of the file or overflowing a block's extension.
+ *
+ ************************************************************************/
+
+/** The first bytes of a saved table -- a line ending catches a text copy. */
+static const uint8_t table_magic[8] = {
+    'P', 'D', 'A', 'S', 'T', '\r', '\n', 0x1A
+};
+
+/** Saved as a number, and read back the same only on the same byte order. */
+#define TABLE_ORDER 0x01020304
+
+/** The header of a saved table. Offsets are from the start of the file. */
+typedef struct TableHeader
+{
+    uint8_t magic[8];       /* Always `table_magic`. */
+    uint32_t version;       /* Always `TABLE_VERSION`. */
+    uint32_t order;         /* Always `TABLE_ORDER`. */
+    uint32_t ext_size;      /* Bytes of each extension. */
+    uint32_t unused;        /* Zero. */
+    uint64_t length;        /* Number of blocks. */
+    uint64_t exts;          /* Number of extensions. */
+    uint64_t bytes;         /* Bytes of text. */
+    uint64_t source;        /* Bytes of source. */
+    uint64_t types_at;      /* Offset of the types. */
+    uint64_t ends_at;       /* Offset of the ends of the text. */
+    uint64_t starts_at;     /* Offset of the starts in the source. */
+    uint64_t sizes_at;      /* Offset of the sizes in the source. */
+    uint64_t ext_at;        /* Offset of the extensions. */
+    uint64_t text_at;       /* Offset of the text. */
+    uint64_t source_at;     /* Offset of the source. */
+    uint64_t size;          /* Bytes of the whole file. */
+} TableHeader;
+
+
+/** Lay out the parts of a saved table, given the counts in its header. */
+static void place_parts(TableHeader *h)
+{
+    h->types_at  = align_size(sizeof(TableHeader));
+    h->ends_at   = h->types_at + align_size(h->length);
+    h->starts_at = h->ends_at + align_size(h->length * sizeof(uint32_t));
+    h->sizes_at  = h->starts_at + align_size(h->length * sizeof(uint32_t));
+    h->ext_at    = h->sizes_at + align_size(h->length * sizeof(uint32_t));
+    h->text_at   = h->ext_at + align_size(h->exts * sizeof(TableExt));
+    h->source_at = h->text_at + align_size(h->bytes);
+    h->size      = h->source_at + h->source;
+}
+
+
+/** Write a part of a saved table, padded to the start of the next one. */
+static void write_part(const PdSink *sink, const void *data,
+                       const size_t length, const bool pad)
+{
+    static const uint8_t zeroes[TABLE_ALIGN] = { 0 };
+
+    if (length) sink->write(data, length, sink->userdata);
+    if (pad && align_size(length) > length) {
+        sink->write(zeroes, align_size(length) - length, sink->userdata);
+    }
+}
+
+
+/**
+ * Write a table and the source it was parsed from in the saved layout.
+ *
+ * - parameter t: The table.
+ * - parameter source: The bytes the table's offsets refer to.
+ * - parameter length: The number of bytes of source.
+ * - parameter sink: Where the saved bytes are written.
+ */
+void save_table(const Table *t, const uint8_t *source, const size_t length,
+                const PdSink *sink)
+{
+    TableHeader h;
+
+    memset(&h, 0, sizeof(TableHeader));
+    memcpy(h.magic, table_magic, sizeof(h.magic));
+    h.version  = TABLE_VERSION;
+    h.order    = TABLE_ORDER;
+    h.ext_size = sizeof(TableExt);
+    h.length   = t->length;
+    h.exts     = t->exts;
+    h.bytes    = t->bytes;
+    h.source   = length;
+    place_parts(&h);
+
+    write_part(sink, &h, sizeof(TableHeader), true);
+    write_part(sink, t->types, t->length, true);
+    write_part(sink, t->ends, t->length * sizeof(uint32_t), true);
+    write_part(sink, t->starts, t->length * sizeof(uint32_t), true);
+    write_part(sink, t->sizes, t->length * sizeof(uint32_t), true);
+    write_part(sink, t->ext, t->exts * sizeof(TableExt), true);
+    write_part(sink, t->text, t->bytes, true);
+    write_part(sink, source, length, false);
+}
+
+
+/** Check that a string of a saved table ends within a length. */
+static bool string_fits(const Table *t, const uint32_t at, const size_t max)
+{
+    size_t left = 0;        /* Bytes of text from `at` on. */
+
+    if (at >= t->bytes) return false;
+    left = t->bytes - at;
+    return memchr(t->text + at, '\0', left < max ? left : max) != NULL;
+}
+
+
+/** Check every offset of a table read from saved bytes. */
+static bool table_is_valid(const Table *t, const size_t source)
+{
+    const TableExt *e = t->ext;     /* Extension of the next block. */
+    size_t from = 0;                /* Start of the block's text. */
+    size_t i = 0;
+
+    for (i = 0; i < t->length; from = t->ends[i++]) {
+        if (t->types[i] == UNKNOWN || t->types[i] > LIST_ITEM_END) {
+            return false;
+        }
+        if (t->ends[i] < from || t->ends[i] > t->bytes) return false;
+        if (t->starts[i] > source || t->sizes[i] > source - t->starts[i]) {
+            return false;
+        }
+        if (!block_has_ext(t->types[i])) continue;
+
+        if (e == t->ext + t->exts) return false;
+        if (t->types[i] == FENCED_CODE_BLOCK &&
+            !string_fits(t, e->strings[0], INFO_STR_MAX + 1)) {
+            return false;
+        }
+        if (t->types[i] == LINK_REFERENCE_DEF &&
+            (!string_fits(t, e->strings[0], sizeof(((LinkRef *)0)->label)) ||
+             !string_fits(t, e->strings[1], sizeof(((LinkRef *)0)->dest)) ||
+             !string_fits(t, e->strings[2], sizeof(((LinkRef *)0)->title)))) {
+            return false;
+        }
+        e++;
+    }
+    return e == t->ext + t->exts;
+}
+
+
+/**
+ * Read a table and its source from saved bytes, in place.
+ *
+ * The table points into the saved bytes, which must stay valid, and
+ * unchanged, for as long as it is used. Its memory is `NULL`, so
+ * `free_table()` only frees the table itself.
+ *
+ * - parameter t: Receives the table.
+ * - parameter data: The saved bytes, aligned to eight bytes -- as a
+ *   mapping of a file or an allocation always is.
+ * - parameter size: The number of saved bytes.
+ * - parameter source: Receives the first byte of the source.
+ * - parameter length: Receives the number of bytes of source.
+ *
+ * - returns: `false` if the bytes are not a valid table saved by this
+ *   version, on a machine of the same byte order.
+ */
+bool map_table(Table *t, const uint8_t *data, const size_t size,
+               const uint8_t **source, size_t *length)
+{
+    TableHeader h;
+    TableHeader want;       /* The layout the counts call for. */
+
+    if (size < sizeof(TableHeader) || (uintptr_t)data % TABLE_ALIGN) {
+        return false;
+    }
+    memcpy(&h, data, sizeof(TableHeader));
+    if (memcmp(h.magic, table_magic, sizeof(h.magic)) ||
+        h.version != TABLE_VERSION || h.order != TABLE_ORDER ||
+        h.ext_size != sizeof(TableExt)) {
+        return false;
+    }
+
+    /* Counts this large could overflow the layout, and cannot fit. */
+    if (h.length > size || h.exts > size / sizeof(TableExt) ||
+        h.bytes > UINT32_MAX || h.source > size) {
+        return false;
+    }
+    want = h;
+    place_parts(&want);
+    if (memcmp(&want, &h, sizeof(TableHeader)) || h.size != size) {
+        return false;
+    }
+
+    t->length = h.length;
+    t->exts   = h.exts;
+    t->types  = data + h.types_at;
+    t->ends   = (const uint32_t *)(data + h.ends_at);
+    t->starts = (const uint32_t *)(data + h.starts_at);
+    t->sizes  = (const uint32_t *)(data + h.sizes_at);
+    t->ext    = (const TableExt *)(data + h.ext_at);
+    t->text   = data + h.text_at;
+    t->bytes  = h.bytes;
+    t->memory = NULL;
+    if (!table_is_valid(t, h.source)) return false;
+
+    *source = data + h.source_at;
+    *length = h.source;
+    return true;
+}
@@ -0,0 +1,117 @@
+/**
+ * table.h -- compact tables of parsed blocks
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef TABLE_DOT_H
+#define TABLE_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libpatdown.h"
+#include "patdown.h"
+
+/************************************************************************
+ * # Block Tables
+ ************************************************************************/
+
+/**
+ * A type to hold the extension of a block in a table.
+ *
+ * Each string is the offset of a NULL-terminated string in the text of
+ * the table. A fenced code block keeps its info string as the first,
+ * and a link reference definition its label, destination and title.
+ *
+ * - member strings: The offsets of the block's strings.
+ * - member fl: Length of the opening code fence.
+ * - member ws: Indentation on the opening code fence.
+ * - member fc: Code fence character.
+ */
+typedef struct TableExt
+{
+    uint32_t strings[3];    /* Offsets of the block's strings. */
+    uint32_t fl;            /* Length of the opening code fence. */
+    uint8_t ws;             /* Indentation on the opening code fence. */
+    int8_t fc;              /* Code fence character (`|~). */
+} TableExt;
+
+/**
+ * A read-only copy of the blocks of a document, laid out in arrays.
+ *
+ * The arrays are indexed by block, in the order the blocks are
+ * reported, and share a single allocation. The text of block `i` ends
+ * at `ends[i]` and starts where the text of the block before it ends.
+ * Only the blocks with an extension have an entry in `ext`, in order.
+ *
+ * - member length: The number of blocks.
+ * - member exts: The number of extensions.
+ * - member types: The type of each block, as an `mdblock_t`.
+ * - member ends: The end of each block's text in `text`.
+ * - member starts: The offset of each block in the document.
+ * - member sizes: The number of bytes each block was parsed from.
+ * - member ext: The extension of each block that has one.
+ * - member text: The text of every block, then every string.
+ * - member bytes: The number of bytes of `text`.
+ * - member memory: The allocation holding every array, or `NULL` if
+ *   the table is read from memory it does not own.
+ */
+typedef struct Table
+{
+    size_t length;          /* Number of blocks. */
+    size_t exts;            /* Number of extensions. */
+    const uint8_t *types;   /* Type of each block. */
+    const uint32_t *ends;   /* End of each block's text. */
+    const uint32_t *starts; /* Offset of each block in the document. */
+    const uint32_t *sizes;  /* Bytes each block was parsed from. */
+    const TableExt *ext;    /* Extension of each block that has one. */
+    const uint8_t *text;    /* Text of every block, then every string. */
+    size_t bytes;           /* Number of bytes of `text`. */
+    void *memory;           /* Allocation holding every array. */
+} Table;
+
+/** A function that reports a set of blocks to callbacks. */
+typedef void (*Replay)(const void *blocks, const Callbacks *cb);
+
+/** Check if a type of block has an extension. */
+bool block_has_ext(const mdblock_t type);
+
+/** Copy the blocks reported by a replay into a new table. */
+Table *build_table(Replay replay, const void *blocks, PdError *error);
+
+/** Report each block of a table to a set of callbacks. */
+void replay_table(const Table *t, const Callbacks *cb);
+
+/** Count the blocks of a range of a table that have an extension. */
+size_t count_exts(const Table *t, const size_t first, const size_t last);
+
+/** Report a range of the blocks of a table to a set of callbacks. */
+void replay_rows(const Table *t, const size_t first, const size_t last,
+                 const size_t ext, const Callbacks *cb);
+
+/** Free a table, if it exists. */
+void free_table(Table *t);
+
+
+/************************************************************************
+ * # Table Files
+ ************************************************************************/
+
+/** The version of the saved layout, changed with any change to it. */
+#define TABLE_VERSION 1
+
+/** Write a table and the source it was parsed from in the saved layout. */
+void save_table(const Table *t, const uint8_t *source, const size_t length,
+                const PdSink *sink);
+
+/** Read a table and its source from saved bytes, in place. */
+bool map_table(Table *t, const uint8_t *data, const size_t size,
+               const uint8_t **source, size_t *length);
+
+#endif
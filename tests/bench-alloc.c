@@ -0,0 +1,186 @@
+/**
+ * bench-alloc.c -- allocations of a parse into a queue and of a stream
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   The inputs are joined, and repeated until the document is at least
+ *   the size asked for. The document is then parsed twice: once by
+ *   `pd_parse()`, which adds each block to the queue of a document, and
+ *   once as a stream fed a chunk at a time, whose blocks are printed by
+ *   the debug printer as they close -- to `/dev/null`. Every call to
+ *   `malloc()`, `calloc()` and `realloc()` is counted on the way, as the
+ *   Makefile links the benchmark with `--wrap` for each of them.
+ *
+ *   USAGE: bench-alloc [-m <mebibytes>] <inputfile>...
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* clock_gettime(), getopt() and dup(). */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../libpatdown.h"
+#include "../patdown.h"
+#include "../stream.h"
+#include "harness.h"
+
+/** The bytes fed to the stream at once, as `patdown` reads them. */
+#define CHUNK 5120
+
+/** Calls to each allocator, counted by the wrappers below. */
+static size_t mallocs  = 0;
+static size_t reallocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+
+/** Count a call to `malloc()`. */
+void *__wrap_malloc(size_t size)
+{
+    mallocs++;
+    return __real_malloc(size);
+}
+
+
+/** Count a call to `calloc()`, as one to `malloc()`. */
+void *__wrap_calloc(size_t count, size_t size)
+{
+    mallocs++;
+    return __real_calloc(count, size);
+}
+
+
+/** Count a call to `realloc()`. */
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    reallocs++;
+    return __real_realloc(ptr, size);
+}
+
+
+/** Get the seconds since some fixed point. */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** Print the allocations and the time of a parse. */
+static void report(const char *name, const double took)
+{
+    printf("%-24s %10zu malloc  %10zu realloc  %8.2f s\n", name, mallocs,
+           reallocs, took);
+}
+
+
+/**
+ * Parse a document as a stream, printing each block to `/dev/null`.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse.
+ */
+static PdError stream_document(const Buffer *doc)
+{
+    const Callbacks cb = debug_callbacks();
+    Stream *s = init_stream(&cb, true);
+    PdError error = PD_OK;
+    size_t at = 0;
+    size_t n  = 0;
+
+    if (!s) return PD_ERR_NOMEM;
+    for (at = 0; !error && at < doc->length; at += n) {
+        n = (doc->length - at < CHUNK) ? doc->length - at : CHUNK;
+        error = feed_stream(s, doc->data + at, n);
+    }
+    if (!error) error = finish_stream(s);
+    free_stream(s);
+    return error;
+}
+
+
+int main(int argc, char **argv)
+{
+    Buffer one = { NULL, 0, 0 };    /* Every input, once. */
+    Buffer doc = { NULL, 0, 0 };    /* The inputs, repeated. */
+    size_t want = (size_t)100 << 20;    /* Bytes of the document. */
+    PdDoc *d = NULL;
+    PdError error = PD_OK;
+    double start = 0;
+    int out = -1;           /* The standard output, while it is hidden. */
+    int null = -1;
+    int opt = 0;
+    int i = 0;
+
+    while ((opt = getopt(argc, argv, "m:")) != -1) {
+        switch (opt) {
+            case 'm': want = strtoul(optarg, NULL, 10) << 20;   break;
+            default:
+                fprintf(stderr, "USAGE: %s [-m <mebibytes>] "
+                        "<inputfile>...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    for (i = optind; i < argc; i++) {
+        if (!read_file(argv[i], &one)) {
+            fprintf(stderr, "FATAL: file could not be read: '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        append(&one, (const uint8_t *)"\n\n", 2);     /* Ends its blocks. */
+    }
+    if (one.length == 0) {
+        fprintf(stderr, "FATAL: no input to benchmark\n");
+        return EXIT_FAILURE;
+    }
+    while (doc.length < want) append(&doc, one.data, one.length);
+    printf("document %zu bytes\n", doc.length);
+
+    mallocs = reallocs = 0;
+    start = now();
+    d = pd_parse(doc.data, doc.length, NULL);
+    error = pd_error(d);
+    pd_free(d);
+    report("queue (pd_parse)", now() - start);
+
+    /* The debug printer writes to the standard output. */
+    fflush(stdout);
+    out  = dup(STDOUT_FILENO);
+    null = open("/dev/null", O_WRONLY);
+    if (out < 0 || null < 0 || dup2(null, STDOUT_FILENO) < 0) {
+        fprintf(stderr, "FATAL: output could not be hidden\n");
+        return EXIT_FAILURE;
+    }
+    mallocs = reallocs = 0;
+    start = now();
+    if (!error) error = stream_document(&doc);
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(null);
+    close(out);
+    report("stream (debug printer)", now() - start);
+
+    free(one.data);
+    free(doc.data);
+    if (error) {
+        fprintf(stderr, "FAILED: %s\n", pd_strerror(error));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
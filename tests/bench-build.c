@@ -0,0 +1,181 @@
+/**
+ * bench-build.c -- time of a directory build, by the way it does I/O
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   A tree of small Markdown files is made in a temporary directory,
+ *   a hundred to a subdirectory. It is then built from scratch with
+ *   `patdown --build`, once for each `--io` mode, and every build must
+ *   write the very same outputs as the first. The tree is 100000 files
+ *   of 2 KiB unless `-n` and `-s` say otherwise.
+ *
+ *   USAGE: bench-build [-j <threads>] [-n <files>] [-s <bytes>]
+ *                      [-r <rounds>] <patdown>
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* clock_gettime() and getopt(). */
+#define _DEFAULT_SOURCE            /* mkdtemp(). */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/** The ways a build can do its I/O, as given to `--io`. */
+static const char *modes[] = { "single", "pread", "uring" };
+
+/** The number of modes. */
+#define MODES (sizeof(modes) / sizeof(modes[0]))
+
+/** Lines that each file is made from, in turn. */
+static const char *lines[] = {
+    "# A header\n\n",
+    "Some *emphasized* text, with `code` and a [link](http://a.b/c).\n\n",
+    "* a list item\n* another list item\n\n",
+    "> a block quote, over\n> two lines\n\n",
+    "    indented code\n    more code\n\n",
+    "A paragraph that wraps\nonto the next line & has <entities>.\n\n",
+    "```\nfenced code\n```\n\n",
+    "Another header\n--------------\n\n"
+};
+
+/** The number of lines. */
+#define LINES (sizeof(lines) / sizeof(lines[0]))
+
+
+/** Get the seconds since some fixed point. */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** Run a shell command, and exit the benchmark if it fails. */
+static void run(const char *command)
+{
+    if (system(command) != 0) {
+        fprintf(stderr, "FATAL: command failed: %s\n", command);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/**
+ * Make a tree of files, each of about a number of bytes.
+ *
+ * - returns: The total bytes of the files.
+ */
+static size_t make_tree(const char *root, const long files, const long size)
+{
+    char path[4096];
+    size_t total = 0;
+    long written = 0;
+    long i = 0;
+    FILE *fp = NULL;
+
+    for (i = 0; i < files; i++) {
+        if (i % 100 == 0) {
+            snprintf(path, sizeof(path), "%s/src/d%ld", root, i / 100);
+            if (mkdir(path, 0777) < 0) return 0;
+        }
+        snprintf(path, sizeof(path), "%s/src/d%ld/f%ld.md", root, i / 100, i);
+        if (!(fp = fopen(path, "w"))) return 0;
+
+        /* Start at a different line, so the files are not all alike. */
+        for (written = 0; written < size; ) {
+            written += fprintf(fp, "%s", lines[(i + written) % LINES]);
+        }
+        total += written;
+        fclose(fp);
+    }
+    return total;
+}
+
+
+int main(int argc, char **argv)
+{
+    char root[] = "/tmp/bench-build-XXXXXX";
+    char command[8192];
+    char path[4096];
+    long files   = 100000;      /* Files of the tree. */
+    long size    = 2048;        /* Bytes of each file. */
+    long threads = 0;           /* Threads of each build, or every CPU. */
+    long rounds  = 3;           /* Times each build is timed. */
+    double best = 0;            /* Seconds of the fastest build. */
+    double took = 0;            /* Seconds of a build. */
+    double start = 0;
+    size_t total = 0;
+    const char *patdown = NULL;
+    size_t m = 0;
+    long i = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "j:n:r:s:")) != -1) {
+        switch (opt) {
+            case 'j': threads = strtol(optarg, NULL, 10);  break;
+            case 'n': files   = strtol(optarg, NULL, 10);  break;
+            case 'r': rounds  = strtol(optarg, NULL, 10);  break;
+            case 's': size    = strtol(optarg, NULL, 10);  break;
+            default:
+                fprintf(stderr, "USAGE: %s [-j <threads>] [-n <files>] "
+                        "[-s <bytes>] [-r <rounds>] <patdown>\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || files < 1 || size < 1 || rounds < 1) {
+        fprintf(stderr, "USAGE: %s [-j <threads>] [-n <files>] "
+                "[-s <bytes>] [-r <rounds>] <patdown>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    patdown = argv[optind];
+
+    if (!mkdtemp(root)) {
+        fprintf(stderr, "FATAL: temporary directory could not be made\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(path, sizeof(path), "%s/src", root);
+    if (mkdir(path, 0777) < 0 || !(total = make_tree(root, files, size))) {
+        fprintf(stderr, "FATAL: tree could not be made in '%s'\n", root);
+        return EXIT_FAILURE;
+    }
+    printf("%ld files, %zu bytes, %ld rounds\n", files, total, rounds);
+
+    for (m = 0; m < MODES; m++) {
+        for (i = 0, best = 0; i < rounds; i++) {
+            snprintf(command, sizeof(command), "rm -rf '%s/%s'", root,
+                     modes[m]);
+            run(command);
+            snprintf(command, sizeof(command), "'%s' -j %ld --io=%s "
+                     "--build '%s/src' '%s/%s'", patdown,
+                     threads, modes[m], root, root, modes[m]);
+
+            start = now();
+            run(command);
+            took = now() - start;
+            if (i == 0 || took < best) best = took;
+        }
+        printf("%-6s  %8.1f ms  %9.0f files/s  %8.1f MiB/s\n", modes[m],
+               best * 1e3, files / best, total / best / (1 << 20));
+
+        /* Every mode must write what the first did. */
+        if (m > 0) {
+            snprintf(command, sizeof(command), "diff -r -x '.patdown-*' "
+                     "'%s/%s' '%s/%s'", root, modes[0], root, modes[m]);
+            run(command);
+        }
+    }
+
+    snprintf(command, sizeof(command), "rm -rf '%s'", root);
+    run(command);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,158 @@
+/**
+ * bench-embed.c -- a render in process against a run of the executable
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   A small document is parsed and rendered over and over with
+ *   `pd_parse()` and `pd_render_html()`, as a program that embeds the
+ *   library would. The same document is then rendered by running the
+ *   executable over and over, with its output sent to `/dev/null`, as a
+ *   program that shells out to it would. The HTML of the library must
+ *   be that of the executable.
+ *
+ *   USAGE: bench-embed [-r <rounds>] [-s <runs>] <patdown> <inputfile>
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* clock_gettime(), getopt() and fork(). */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../libpatdown.h"
+#include "harness.h"
+
+/** Append everything read from a file descriptor to a buffer. */
+static void append_fd(const int fd, Buffer *b)
+{
+    uint8_t chunk[4096];
+    ssize_t n = 0;
+
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) append(b, chunk, n);
+}
+
+
+/** Get the seconds since some fixed point. */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Run the executable on the input once, and wait for it.
+ *
+ * - parameter out: The file descriptor its output is written to.
+ *
+ * - returns: `true` if it ran and exited with success.
+ */
+static bool run_once(const char *prog, const char *path, const int out)
+{
+    pid_t pid = fork();
+    int status = 0;
+
+    if (pid < 0) return false;
+    if (pid == 0) {
+        dup2(out, STDOUT_FILENO);
+        execl(prog, prog, path, (char *)NULL);
+        _exit(127);
+    }
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+           WEXITSTATUS(status) == 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    Buffer input = { NULL, 0, 0 };
+    Buffer lib   = { NULL, 0, 0 };  /* The HTML of the library. */
+    Buffer exe   = { NULL, 0, 0 };  /* The HTML of the executable. */
+    PdSink sink  = { write_buffer, &lib };
+    long rounds  = 100000;  /* Renders in process. */
+    long runs    = 500;     /* Runs of the executable. */
+    double start = 0;
+    double took  = 0;       /* Seconds of a render in process. */
+    double ran   = 0;       /* Seconds of a run of the executable. */
+    PdDoc *doc = NULL;
+    FILE *fp = NULL;
+    int pipefd[2];
+    int null = -1;
+    bool ok  = true;
+    long r = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+        switch (opt) {
+            case 'r': rounds = strtol(optarg, NULL, 10);    break;
+            case 's': runs   = strtol(optarg, NULL, 10);    break;
+            default:
+                fprintf(stderr, "USAGE: %s [-r <rounds>] [-s <runs>] "
+                        "<patdown> <inputfile>\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind != 2 || rounds < 1 || runs < 1) {
+        fprintf(stderr, "USAGE: %s [-r <rounds>] [-s <runs>] "
+                "<patdown> <inputfile>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!(fp = fopen(argv[optind + 1], "rb"))) {
+        fprintf(stderr, "FATAL: file could not be read: '%s'\n",
+                argv[optind + 1]);
+        return EXIT_FAILURE;
+    }
+    append_fd(fileno(fp), &input);
+    fclose(fp);
+
+    start = now();
+    for (r = 0; r < rounds; r++) {
+        lib.length = 0;
+        doc = pd_parse(input.data, input.length, NULL);
+        pd_render_html(doc, &sink);
+        pd_free(doc);
+    }
+    took = (now() - start) / rounds;
+
+    /* The HTML of one run is kept, to be checked against the library's. */
+    if (pipe(pipefd) < 0) return EXIT_FAILURE;
+    ok = run_once(argv[optind], argv[optind + 1], pipefd[1]);
+    close(pipefd[1]);
+    append_fd(pipefd[0], &exe);
+    close(pipefd[0]);
+    ok = ok && exe.length == lib.length &&
+         !memcmp(exe.data, lib.data, lib.length);
+
+    null = open("/dev/null", O_WRONLY);
+    start = now();
+    for (r = 0; r < runs && ok; r++) {
+        ok = run_once(argv[optind], argv[optind + 1], null);
+    }
+    ran = (now() - start) / runs;
+    close(null);
+
+    printf("document %zu bytes\n", input.length);
+    printf("in process  %10.2f us per parse and render\n", took * 1e6);
+    printf("executable  %10.2f us per run\n", ran * 1e6);
+    if (!ok) {
+        fprintf(stderr, "FAILED: the executable did not write the "
+                "library's HTML\n");
+    }
+    free(input.data);
+    free(lib.data);
+    free(exe.data);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
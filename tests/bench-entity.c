@@ -0,0 +1,287 @@
+/**
+ * bench-entity.c -- lookups of HTML5 character references
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   Every name of the list must decode to the code points the list
+ *   gives it -- each compared with the decode of the numeric reference
+ *   to the same code point -- and a few spans that are not references
+ *   must not decode at all.
+ *
+ *   Then spans of named references, of numeric references, and of `&`
+ *   that start no reference are decoded over and over, both with
+ *   `decode_entity()` and with a binary search of the sorted names, as
+ *   the baseline a perfect hash has to beat.
+ *
+ *   USAGE: bench-entity [-r <rounds>] <entities.txt>
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* clock_gettime() and getopt(). */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../entities.h"
+#include "harness.h"
+
+/** The most names in the list. */
+#define MOST_NAMES 4096
+
+/** A named reference of the list. */
+typedef struct Name
+{
+    char name[ENTITY_MAX_LENGTH];   /* The name, without `&` and `;`. */
+    char points[64];                /* Its code points, in hex. */
+} Name;
+
+/** A span of references, each starting with `&`. */
+typedef struct Span
+{
+    char *data;         /* The references, one after another. */
+    size_t length;      /* Bytes of the span. */
+    size_t amps;        /* Number of `&`. */
+} Span;
+
+/** The names of the list, sorted. */
+static Name names[MOST_NAMES];
+
+/** The number of names. */
+static size_t count;
+
+
+/** Get the seconds since some fixed point. */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** Read the list of names, in its order, which is sorted. */
+static bool read_names(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    char *field = NULL;
+
+    if (!fp) return false;
+    while (fgets(line, sizeof(line), fp) && count < MOST_NAMES) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        field = strtok(line, " \n");
+        snprintf(names[count].name, sizeof(names[count].name), "%s", field);
+        field = strtok(NULL, "\n");
+        snprintf(names[count].points, sizeof(names[count].points), "%s",
+                 field ? field : "");
+        count++;
+    }
+    fclose(fp);
+    return count > 0;
+}
+
+
+/**
+ * Check that every name decodes to its code points, and that spans that
+ * are no reference do not decode.
+ *
+ * - returns: The number of failures.
+ */
+static int check_names(void)
+{
+    const char *rejects[] = {
+        "&", "& ", "&;", "&amp", "&nosuch;", "&AMP ;", "&#;", "&#x;",
+        "&#12345678;", "&#x1234567;", "&#xg;", "&copy ;"
+    };
+    char ref[ENTITY_MAX_LENGTH + 2];
+    char num[16];
+    char *point = NULL;
+    uint8_t got[ENTITY_MAX_UTF8];
+    uint8_t want[ENTITY_MAX_UTF8];
+    size_t got_size = 0;
+    size_t want_size = 0;
+    size_t size = 0;
+    size_t n = 0;
+    size_t i = 0;
+    int failed = 0;
+
+    for (i = 0; i < count; i++) {
+        want_size = 0;
+        for (point = strtok(names[i].points, " "); point;
+             point = strtok(NULL, " ")) {
+            n = snprintf(num, sizeof(num), "&#x%s;", point);
+            decode_entity((const uint8_t *)num, n, want + want_size, &size);
+            want_size += size;
+        }
+
+        n = snprintf(ref, sizeof(ref), "&%s;", names[i].name);
+        if (decode_entity((const uint8_t *)ref, n, got, &got_size) != n ||
+            got_size != want_size || memcmp(got, want, want_size)) {
+            fprintf(stderr, "FAILED: '%s' did not decode\n", ref);
+            failed++;
+        }
+    }
+
+    for (i = 0; i < sizeof(rejects) / sizeof(rejects[0]); i++) {
+        n = strlen(rejects[i]);
+        if (decode_entity((const uint8_t *)rejects[i], n, got, &size)) {
+            fprintf(stderr, "FAILED: '%s' decoded\n", rejects[i]);
+            failed++;
+        }
+    }
+    return failed;
+}
+
+
+/** Compare a name with the name of the list it is searched for at. */
+static int compare_name(const void *key, const void *member)
+{
+    return strcmp(key, ((const Name *)member)->name);
+}
+
+
+/**
+ * Look up a reference with a binary search of the names -- only the
+ * lookup, not the decode, so the baseline is if anything too fast.
+ *
+ * - returns: The bytes of the reference, or zero if it is not one.
+ */
+static size_t search_entity(const uint8_t *data, const size_t length)
+{
+    char name[ENTITY_MAX_LENGTH];
+    size_t i = 1;
+
+    while (i < length && i < ENTITY_MAX_LENGTH &&
+           ((data[i] >= '0' && data[i] <= '9') ||
+            ((data[i] | 0x20) >= 'a' && (data[i] | 0x20) <= 'z'))) {
+        name[i - 1] = data[i];
+        i++;
+    }
+    if (i == length || data[i] != ';') return 0;
+    name[i - 1] = '\0';
+    return bsearch(name, names, count, sizeof(Name), compare_name) ? i + 1
+                                                                   : 0;
+}
+
+
+/** Add a reference, or any text with a `&`, to a span. */
+static void add_span(Span *s, const char *text)
+{
+    size_t n = strlen(text);
+    size_t i = 0;
+
+    s->data = check_alloc(realloc(s->data, s->length + n + 1));
+    memcpy(s->data + s->length, text, n + 1);
+    s->length += n;
+    for (i = 0; i < n; i++) s->amps += (text[i] == '&');
+}
+
+
+/**
+ * Time the lookups of every `&` of a span, with the perfect hash and,
+ * for names, with the binary search.
+ */
+static void time_span(const char *label, const Span *s, const bool search,
+                      const long rounds)
+{
+    const uint8_t *data = (const uint8_t *)s->data;
+    const uint8_t *amp = NULL;
+    const uint8_t *end = data + s->length;
+    uint8_t utf8[ENTITY_MAX_UTF8];
+    size_t size = 0;
+    size_t found[2] = { 0, 0 };     /* References found by each. */
+    double took[2] = { 0, 0 };      /* Seconds of each. */
+    double start = 0;
+    size_t n = 0;
+    int way = 0;
+    long r = 0;
+
+    for (way = 0; way < (search ? 2 : 1); way++) {
+        start = now();
+        for (r = 0; r < rounds; r++) {
+            for (amp = data; (amp = memchr(amp, '&', end - amp)); amp++) {
+                n = way ? search_entity(amp, end - amp)
+                        : decode_entity(amp, end - amp, utf8, &size);
+                found[way] += (n > 0);
+            }
+        }
+        took[way] = now() - start;
+    }
+
+    printf("%-8s %6zu refs  hash %6.1f ns", label, s->amps,
+           took[0] * 1e9 / (rounds * s->amps));
+    if (search) {
+        printf("  bsearch %6.1f ns  %5.2fx", took[1] * 1e9 /
+               (rounds * s->amps), took[1] / took[0]);
+    }
+    printf("\n");
+    if (search && found[0] != found[1]) {
+        fprintf(stderr, "FAILED: %s found %zu by hash, %zu by bsearch\n",
+                label, found[0], found[1]);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *rejects[] = {
+        "AT&T ", "& ", "&nbsp ", "&copy", "R&D ", "&c. ", "&#; ", "&&",
+        "&nosuch; ", "&Amp; "
+    };
+    Span named   = { NULL, 0, 0 };
+    Span numeric = { NULL, 0, 0 };
+    Span other   = { NULL, 0, 0 };
+    char ref[ENTITY_MAX_LENGTH + 2];
+    long rounds = 200;          /* Times each span is decoded. */
+    int failed = 0;
+    size_t i = 0;
+    int opt = 0;
+
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r': rounds = strtol(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "USAGE: %s [-r <rounds>] <entities.txt>\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc || rounds < 1 || !read_names(argv[optind])) {
+        fprintf(stderr, "USAGE: %s [-r <rounds>] <entities.txt>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if ((failed = check_names())) {
+        fprintf(stderr, "FAILED: %d of the checks\n", failed);
+        return EXIT_FAILURE;
+    }
+    printf("%zu names decode\n", count);
+
+    /* Every name once, in a scattered order, and as many of the rest. */
+    for (i = 0; i < count; i++) {
+        snprintf(ref, sizeof(ref), "&%s;", names[(i * 613) % count].name);
+        add_span(&named, ref);
+        snprintf(ref, sizeof(ref), (i & 1) ? "&#%zu;" : "&#x%zX;",
+                 (i * 7919) % 0x10FFFF);
+        add_span(&numeric, ref);
+        add_span(&other, rejects[i % (sizeof(rejects) / sizeof(*rejects))]);
+    }
+
+    time_span("named", &named, true, rounds);
+    time_span("numeric", &numeric, false, rounds);
+    time_span("rejected", &other, true, rounds);
+
+    free(named.data);
+    free(numeric.data);
+    free(other.data);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,154 @@
+/**
+ * bench-only.c -- parses keeping every block against only some kinds
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   The inputs are joined, and repeated until the document is at least
+ *   the size asked for. The document is then parsed over and over --
+ *   first keeping every block, then keeping only the headers, only the
+ *   fenced code blocks and only the HTML blocks, as an outline, a test
+ *   of the code or an audit would. The blocks each keeps must be blocks
+ *   of the whole parse.
+ *
+ *   USAGE: bench-only [-m <mebibytes>] [-r <rounds>] <inputfile>...
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* clock_gettime() and getopt(). */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../libpatdown.h"
+#include "harness.h"
+
+/** A set of kinds of block to keep, and its name. */
+typedef struct Kinds
+{
+    const char *name;   /* Its name, as given to `--only`. */
+    unsigned only;      /* The kinds, or zero for every kind. */
+} Kinds;
+
+
+/** Get the seconds since some fixed point. */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/** Check that every block of a document is a block of another, in order. */
+static bool is_part_of(const PdDoc *part, const PdDoc *whole)
+{
+    size_t count = pd_block_spans(whole, NULL, 0);
+    size_t some  = pd_block_spans(part, NULL, 0);
+    PdSpan *sw = check_alloc(malloc((count + 1) * sizeof(PdSpan)));
+    PdSpan *sp = check_alloc(malloc((some + 1) * sizeof(PdSpan)));
+    size_t i = 0;
+    size_t j = 0;
+
+    pd_block_spans(whole, sw, count);
+    pd_block_spans(part, sp, some);
+    for (i = 0; i < count && j < some; i++) {
+        j += (sw[i].start == sp[j].start && sw[i].end == sp[j].end);
+    }
+    free(sw);
+    free(sp);
+    return j == some;
+}
+
+
+int main(int argc, char **argv)
+{
+    const Kinds kinds[] = {
+        { "all",        0 },
+        { "atx,setext", PD_ONLY_ATX | PD_ONLY_SETEXT },
+        { "fenced",     PD_ONLY_FENCED },
+        { "html",       PD_ONLY_HTML }
+    };
+    Buffer one = { NULL, 0, 0 };    /* Every input, once. */
+    Buffer doc = { NULL, 0, 0 };    /* The inputs, repeated. */
+    size_t want = 32 << 20;         /* Bytes of the document. */
+    long rounds = 10;               /* Times each parse is timed. */
+    PdOptions opts = PD_OPTIONS_INIT;
+    PdDoc *whole = NULL;
+    PdDoc *d = NULL;
+    double start = 0;
+    double full = 0;        /* Seconds of a parse keeping every block. */
+    double took = 0;        /* Seconds of a parse. */
+    size_t blocks = 0;
+    bool ok = true;
+    size_t k = 0;
+    long r = 0;
+    int opt = 0;
+    int i = 0;
+
+    while ((opt = getopt(argc, argv, "m:r:")) != -1) {
+        switch (opt) {
+            case 'm': want   = strtoul(optarg, NULL, 10) << 20;    break;
+            case 'r': rounds = strtol(optarg, NULL, 10);           break;
+            default:
+                fprintf(stderr, "USAGE: %s [-m <mebibytes>] [-r <rounds>] "
+                        "<inputfile>...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    for (i = optind; i < argc; i++) {
+        if (!read_file(argv[i], &one)) {
+            fprintf(stderr, "FATAL: file could not be read: '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        append(&one, (const uint8_t *)"\n\n", 2);     /* Ends its blocks. */
+    }
+    if (one.length == 0 || rounds < 1) {
+        fprintf(stderr, "FATAL: no input to benchmark\n");
+        return EXIT_FAILURE;
+    }
+    while (doc.length < want) append(&doc, one.data, one.length);
+
+    whole = pd_parse(doc.data, doc.length, NULL);
+    if (pd_error(whole)) {
+        fprintf(stderr, "FATAL: %s\n", pd_strerror(pd_error(whole)));
+        return EXIT_FAILURE;
+    }
+    printf("document %zu bytes, %ld rounds\n", doc.length, rounds);
+
+    for (k = 0; k < sizeof(kinds) / sizeof(kinds[0]) && ok; k++) {
+        opts.only = kinds[k].only;
+        start = now();
+        for (r = 0; r < rounds; r++) {
+            d = pd_parse(doc.data, doc.length, &opts);
+            blocks = pd_block_spans(d, NULL, 0);
+            if (r < rounds - 1) pd_free(d);
+        }
+        took = (now() - start) / rounds;
+        if (!kinds[k].only) full = took;
+
+        ok = !pd_error(d) && is_part_of(d, whole);
+        pd_free(d);
+        printf("%-10s %8zu blocks  %8.2f ms  %8.1f MiB/s  %5.2fx\n",
+               kinds[k].name, blocks, took * 1e3,
+               doc.length / took / (1 << 20), full / took);
+    }
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s kept blocks the whole parse does not "
+                "have\n", kinds[k - 1].name);
+    }
+
+    pd_free(whole);
+    free(one.data);
+    free(doc.data);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,172 @@
+/**
+ * bench-render.c -- scaling of a document's render over threads
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   The inputs are joined, and repeated until the document is at least
+ *   the size asked for. The document is parsed once, and rendered over
+ *   and over -- first by `pd_render_html()`, then by
+ *   `pd_render_html_parallel()` with one, two, four... threads, up to
+ *   the most asked for. The same is done again once it is compacted.
+ *   Every render must write the very same HTML.
+ *
+ *   USAGE: bench-render [-j <threads>] [-m <mebibytes>] [-r <rounds>]
+ *                       <inputfile>...
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* clock_gettime() and getopt(). */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../libpatdown.h"
+#include "harness.h"
+
+/** Count the bytes of HTML, so the render is not optimized away. */
+static void count_html(const uint8_t *data, const size_t length,
+                       void *userdata)
+{
+    (void)data;
+    *(size_t *)userdata += length;
+}
+
+
+/** Get the seconds since some fixed point. */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Render a document with a number of threads, or with
+ * `pd_render_html()` when there are none.
+ */
+static void render(const PdDoc *doc, const size_t threads, const PdSink *sink)
+{
+    if (threads) pd_render_html_parallel(doc, threads, sink);
+    else pd_render_html(doc, sink);
+}
+
+
+/**
+ * Time the renders of a document with more and more threads.
+ *
+ * - returns: `true` if every render wrote the same HTML.
+ */
+static bool time_doc(const char *name, const PdDoc *doc, const size_t input,
+                     const size_t most, const long rounds)
+{
+    Buffer want = { NULL, 0, 0 };
+    Buffer got  = { NULL, 0, 0 };
+    PdSink want_sink = { write_buffer, &want };
+    PdSink got_sink  = { write_buffer, &got };
+    size_t html = 0;
+    PdSink count_sink = { count_html, &html };
+    double start = 0;
+    double serial = 0;      /* Seconds of a render on one thread. */
+    double took = 0;        /* Seconds of a render. */
+    bool same = true;
+    size_t threads = 0;     /* Threads of the render, or none. */
+    long i = 0;
+
+    pd_render_html(doc, &want_sink);
+    for (threads = 0; threads <= most; threads = threads ? threads * 2 : 1) {
+        got.length = 0;
+        render(doc, threads, &got_sink);
+        same = got.length == want.length &&
+               !memcmp(got.data, want.data, want.length);
+        if (!same) break;
+
+        start = now();
+        for (i = 0; i < rounds; i++) render(doc, threads, &count_sink);
+        took = (now() - start) / rounds;
+        if (!threads) serial = took;
+
+        printf("%-6s %8s %2zu  %8.2f ms  %8.1f MiB/s  %5.2fx\n", name,
+               threads ? "parallel" : "serial", threads ? threads : 1,
+               took * 1e3, input / took / (1 << 20), serial / took);
+    }
+
+    if (!same) {
+        fprintf(stderr, "FAILED: %s with %zu threads wrote %zu bytes of "
+                "HTML that differ from the %zu bytes of one\n", name,
+                threads, got.length, want.length);
+    }
+    free(want.data);
+    free(got.data);
+    return same;
+}
+
+
+int main(int argc, char **argv)
+{
+    Buffer one = { NULL, 0, 0 };    /* Every input, once. */
+    Buffer doc = { NULL, 0, 0 };    /* The inputs, repeated. */
+    size_t want = 32 << 20;         /* Bytes of the document. */
+    long cpus   = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t most = (cpus > 0) ? (size_t)cpus : 1;   /* Most threads. */
+    long rounds = 10;               /* Times each render is timed. */
+    bool ok = true;
+    PdDoc *d = NULL;
+    PdError error = PD_OK;
+    int opt = 0;
+    int i = 0;
+
+    while ((opt = getopt(argc, argv, "j:m:r:")) != -1) {
+        switch (opt) {
+            case 'j': most   = strtoul(optarg, NULL, 10);          break;
+            case 'm': want   = strtoul(optarg, NULL, 10) << 20;    break;
+            case 'r': rounds = strtol(optarg, NULL, 10);           break;
+            default:
+                fprintf(stderr, "USAGE: %s [-j <threads>] [-m <mebibytes>] "
+                        "[-r <rounds>] <inputfile>...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    for (i = optind; i < argc; i++) {
+        if (!read_file(argv[i], &one)) {
+            fprintf(stderr, "FATAL: file could not be read: '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        append(&one, (const uint8_t *)"\n\n", 2);     /* Ends its blocks. */
+    }
+    if (one.length == 0 || rounds < 1) {
+        fprintf(stderr, "FATAL: no input to benchmark\n");
+        return EXIT_FAILURE;
+    }
+    while (doc.length < want) append(&doc, one.data, one.length);
+
+    d = pd_parse(doc.data, doc.length, NULL);
+    if (pd_error(d)) {
+        fprintf(stderr, "FATAL: %s\n", pd_strerror(pd_error(d)));
+        return EXIT_FAILURE;
+    }
+
+    printf("document %zu bytes, %ld rounds, %ld processors\n", doc.length,
+           rounds, cpus);
+    ok = time_doc("queue", d, doc.length, most, rounds);
+    if ((error = pd_compact(d))) {
+        fprintf(stderr, "FATAL: %s\n", pd_strerror(error));
+        return EXIT_FAILURE;
+    }
+    ok = time_doc("table", d, doc.length, most, rounds) && ok;
+
+    pd_free(d);
+    free(one.data);
+    free(doc.data);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+/**
+ * bench-table.c -- traversal of a document's queue against its table
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   The inputs are joined, and repeated until the document is at least
+ *   the size asked for. The document is parsed once, and its blocks
+ *   are listed and rendered over and over -- first from the queue the
+ *   parse built, then from the table `pd_compact()` replaced it with.
+ *
+ *   USAGE: bench-table [-m <mebibytes>] [-r <rounds>] <inputfile>...
+ *
+ ************************************************************************/
+
+#define _POSIX_C_SOURCE 200809L    /* clock_gettime() and getopt(). */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../libpatdown.h"
+#include "harness.h"
+
+/** The sum of offsets listed, kept so that listing is not skipped. */
+static volatile size_t checksum = 0;
+
+/** Count the bytes of HTML, so the render is not optimized away. */
+static void count_html(const uint8_t *data, const size_t length,
+                       void *userdata)
+{
+    (void)data;
+    *(size_t *)userdata += length;
+}
+
+
+/** Get the seconds since some fixed point. */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/**
+ * Time listing and rendering every block of a document.
+ *
+ * - returns: The bytes of HTML of one render.
+ */
+static size_t time_doc(const char *name, const PdDoc *doc, const long rounds)
+{
+    size_t html = 0;
+    size_t count = pd_block_spans(doc, NULL, 0);
+    PdSpan *spans = check_alloc(malloc((count + 1) * sizeof(PdSpan)));
+    PdSink sink = { count_html, &html };
+    double start = 0;
+    double spanned = 0;     /* Seconds listing the blocks. */
+    double rendered = 0;    /* Seconds rendering the blocks. */
+    long i = 0;
+
+    start = now();
+    for (i = 0; i < rounds; i++) {
+        pd_block_spans(doc, spans, count);
+        checksum += spans[count ? count - 1 : 0].end;
+    }
+    spanned = now() - start;
+
+    start = now();
+    for (i = 0; i < rounds; i++) pd_render_html(doc, &sink);
+    rendered = now() - start;
+
+    printf("%-6s %8zu blocks  spans %7.2f ns/block  render %7.2f ns/block\n",
+           name, count, spanned * 1e9 / rounds / (count + 1),
+           rendered * 1e9 / rounds / (count + 1));
+    free(spans);
+    return html / rounds;
+}
+
+
+int main(int argc, char **argv)
+{
+    Buffer one = { NULL, 0, 0 };    /* Every input, once. */
+    Buffer doc = { NULL, 0, 0 };    /* The inputs, repeated. */
+    size_t want = 8 << 20;          /* Bytes of the document. */
+    long rounds = 20;               /* Times each traversal is timed. */
+    size_t queue_html = 0;
+    size_t table_html = 0;
+    PdDoc *d = NULL;
+    PdError error = PD_OK;
+    int opt = 0;
+    int i = 0;
+
+    while ((opt = getopt(argc, argv, "m:r:")) != -1) {
+        switch (opt) {
+            case 'm': want   = strtoul(optarg, NULL, 10) << 20;    break;
+            case 'r': rounds = strtol(optarg, NULL, 10);           break;
+            default:
+                fprintf(stderr, "USAGE: %s [-m <mebibytes>] [-r <rounds>] "
+                        "<inputfile>...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    for (i = optind; i < argc; i++) {
+        if (!read_file(argv[i], &one)) {
+            fprintf(stderr, "FATAL: file could not be read: '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        append(&one, (const uint8_t *)"\n\n", 2);     /* Ends its blocks. */
+    }
+    if (one.length == 0 || rounds < 1) {
+        fprintf(stderr, "FATAL: no input to benchmark\n");
+        return EXIT_FAILURE;
+    }
+    while (doc.length < want) append(&doc, one.data, one.length);
+
+    d = pd_parse(doc.data, doc.length, NULL);
+    if (pd_error(d)) {
+        fprintf(stderr, "FATAL: %s\n", pd_strerror(pd_error(d)));
+        return EXIT_FAILURE;
+    }
+
+    printf("document %zu bytes, %ld rounds\n", doc.length, rounds);
+    queue_html = time_doc("queue", d, rounds);
+    if ((error = pd_compact(d))) {
+        fprintf(stderr, "FATAL: %s\n", pd_strerror(error));
+        return EXIT_FAILURE;
+    }
+    table_html = time_doc("table", d, rounds);
+
+    pd_free(d);
+    free(one.data);
+    free(doc.data);
+    if (queue_html != table_html) {
+        fprintf(stderr, "FAILED: the table rendered %zu bytes, the queue "
+                "%zu\n", table_html, queue_html);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
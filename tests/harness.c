@@ -0,0 +1,93 @@
+/**
+ * harness.c -- buffers and files shared by the tests and benchmarks
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   Every test and benchmark reads its inputs into growable buffers and
+ *   renders into them through a sink. A failed allocation ends the test,
+ *   since nothing it checks could be trusted after it.
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+
+
+/**
+ * Exit the test if memory could not be allocated.
+ *
+ * - parameter ptr: The memory allocated, or `NULL`.
+ *
+ * - returns: `ptr`, which is never `NULL`.
+ */
+void *check_alloc(void *ptr)
+{
+    if (!ptr) {
+        fprintf(stderr, "FATAL: memory could not be allocated\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+
+/**
+ * Make room for more bytes at the end of a buffer, doubling its size
+ * until they fit.
+ *
+ * - parameter b: The buffer.
+ * - parameter more: The bytes to make room for.
+ */
+void reserve(Buffer *b, const size_t more)
+{
+    size_t allocd = b->allocd ? b->allocd : 4096;
+
+    if (b->data && b->length + more <= b->allocd) return;
+    while (allocd < b->length + more) allocd *= 2;
+    b->data   = check_alloc(realloc(b->data, allocd));
+    b->allocd = allocd;
+}
+
+
+/** Append a range of bytes to a buffer. */
+void append(Buffer *b, const uint8_t *data, const size_t length)
+{
+    reserve(b, length);
+    if (length) memcpy(b->data + b->length, data, length);
+    b->length += length;
+}
+
+
+/** Append each span of output to a buffer, as the `write` of a sink. */
+void write_buffer(const uint8_t *data, const size_t length, void *userdata)
+{
+    append(userdata, data, length);
+}
+
+
+/**
+ * Append a whole file to a buffer.
+ *
+ * - parameter path: The path of the file.
+ * - parameter b: The buffer.
+ *
+ * - returns: `false` if the file could not be opened.
+ */
+bool read_file(const char *path, Buffer *b)
+{
+    FILE *fp = fopen(path, "rb");
+    uint8_t chunk[4096];
+    size_t n = 0;
+
+    if (!fp) return false;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) append(b, chunk, n);
+    fclose(fp);
+    return true;
+}
@@ -0,0 +1,45 @@
+/**
+ * harness.h -- buffers and files shared by the tests and benchmarks
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef HARNESS_DOT_H
+#define HARNESS_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/************************************************************************
+ * # Test Harness
+ ************************************************************************/
+
+/** A growable range of bytes. */
+typedef struct Buffer
+{
+    uint8_t *data;      /* The bytes. */
+    size_t length;      /* Number of bytes. */
+    size_t allocd;      /* Number of bytes allocated. */
+} Buffer;
+
+/** Exit the test if memory could not be allocated. */
+void *check_alloc(void *ptr);
+
+/** Make room for more bytes at the end of a buffer. */
+void reserve(Buffer *b, const size_t more);
+
+/** Append a range of bytes to a buffer. */
+void append(Buffer *b, const uint8_t *data, const size_t length);
+
+/** Append each span of output to a buffer, as the `write` of a sink. */
+void write_buffer(const uint8_t *data, const size_t length, void *userdata);
+
+/** Append a whole file to a buffer. */
+bool read_file(const char *path, Buffer *b);
+
+#endif
@@ -0,0 +1,301 @@
+/**
+ * test-cache.c -- cached renders checked against uncached ones
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   Each input file is rendered by `pd_render_html_cached()` twice: the
+ *   first render must miss, unless an input before it had the same
+ *   bytes, and the second must hit. Both must be the HTML of
+ *   `pd_render_html()`. A render with other options must miss again.
+ *   The counters of the cache must add up to exactly those hits and
+ *   misses.
+ *
+ *   The inputs are then rendered through a cache far too small to hold
+ *   them all. It must evict, stay under its cap, and still render each
+ *   input's own HTML.
+ *
+ *   Two inputs of the same length are then given the same hash. Each
+ *   must be found with its own HTML, and never with the other's.
+ *
+ *   Last, options of other sizes must be read as the library knows
+ *   them, or refused.
+ *
+ *   USAGE: test-cache <inputfile>...
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cache.h"
+#include "../libpatdown.h"
+#include "harness.h"
+
+/** The cap on the bytes of the small cache, a sixteenth in each shard. */
+#define SMALL_CACHE (16 * 1024)
+
+/** Render a document without a cache. */
+static void render_plain(const Buffer *in, const PdOptions *opts,
+                         Buffer *out)
+{
+    PdSink sink = { write_buffer, out };
+    PdDoc *doc = pd_parse(in->data, in->length, opts);
+
+    out->length = 0;
+    if (!pd_error(doc)) pd_render_html(doc, &sink);
+    pd_free(doc);
+}
+
+
+/** Check if two buffers hold the same bytes. */
+static bool same_bytes(const Buffer *a, const Buffer *b)
+{
+    return a->length == b->length &&
+           (a->length == 0 || !memcmp(a->data, b->data, a->length));
+}
+
+
+/**
+ * Render a document through a cache, and check its HTML against the
+ * uncached render.
+ */
+static bool check_render(const char *name, PdCache *cache, const Buffer *in,
+                         const PdOptions *opts, const Buffer *want,
+                         Buffer *got)
+{
+    PdSink sink = { write_buffer, got };
+    PdError error = PD_OK;
+
+    got->length = 0;
+    error = pd_render_html_cached(cache, in->data, in->length, opts, &sink);
+    if (!error && !same_bytes(got, want)) {
+        fprintf(stderr, "FAILED: %s: a cached render is not the HTML of "
+                "pd_render_html()\n", name);
+        return false;
+    }
+    return true;
+}
+
+
+/** Check the counters of a cache. */
+static bool check_stats(const char *name, PdCache *cache, const size_t hits,
+                        const size_t misses)
+{
+    PdCacheStats cs;
+
+    pd_cache_stats(cache, &cs);
+    if (cs.hits != hits || cs.misses != misses) {
+        fprintf(stderr, "FAILED: %s: %zu hits and %zu misses, not %zu "
+                "and %zu\n", name, cs.hits, cs.misses, hits, misses);
+        return false;
+    }
+    return true;
+}
+
+
+/** Check if an input has the same bytes as one before it. */
+static bool seen_before(const Buffer *inputs, const int i)
+{
+    int k = 0;
+
+    for (k = 0; k < i; k++) {
+        if (same_bytes(&inputs[k], &inputs[i])) return true;
+    }
+    return false;
+}
+
+
+/**
+ * Render each input twice through a cache big enough for all of them,
+ * and once more with other options. Only the first render of an input
+ * misses -- unless an input before it had the same bytes.
+ */
+static bool check_hits(char **names, const Buffer *inputs, const int count)
+{
+    PdCache *cache = check_alloc(pd_cache_init((size_t)64 << 20));
+    PdOptions other = PD_OPTIONS_INIT;
+    Buffer want = { NULL, 0, 0 };
+    Buffer got  = { NULL, 0, 0 };
+    size_t hits = 0;
+    size_t misses = 0;
+    bool seen = false;
+    bool ok = true;
+    int i = 0;
+
+    other.raw = true;
+    for (i = 0; ok && i < count; i++) {
+        seen = seen_before(inputs, i);
+        hits   += seen;
+        misses += !seen;
+
+        render_plain(&inputs[i], NULL, &want);
+        ok = check_render(names[i], cache, &inputs[i], NULL, &want, &got) &&
+             check_stats(names[i], cache, hits, misses) &&
+             check_render(names[i], cache, &inputs[i], NULL, &want, &got) &&
+             check_stats(names[i], cache, ++hits, misses);
+
+        hits   += seen;
+        misses += !seen;
+        render_plain(&inputs[i], &other, &want);
+        ok = ok &&
+             check_render(names[i], cache, &inputs[i], &other, &want, &got) &&
+             check_stats(names[i], cache, hits, misses);
+    }
+    pd_cache_free(cache);
+    free(want.data);
+    free(got.data);
+    return ok;
+}
+
+
+/**
+ * Render every input through a cache too small to hold them all, and
+ * check that it evicts and stays under its cap.
+ */
+static bool check_evictions(char **names, const Buffer *inputs,
+                            const int count)
+{
+    PdCache *cache = check_alloc(pd_cache_init(SMALL_CACHE));
+    Buffer want = { NULL, 0, 0 };
+    Buffer got  = { NULL, 0, 0 };
+    PdCacheStats cs;
+    bool ok = true;
+    int round = 0;
+    int i = 0;
+
+    for (round = 0; ok && round < 2; round++) {
+        for (i = 0; ok && i < count; i++) {
+            render_plain(&inputs[i], NULL, &want);
+            ok = check_render(names[i], cache, &inputs[i], NULL, &want, &got);
+        }
+    }
+    pd_cache_stats(cache, &cs);
+    if (ok && (cs.evictions == 0 || cs.bytes > SMALL_CACHE)) {
+        fprintf(stderr, "FAILED: a small cache made %zu evictions and "
+                "holds %zu bytes\n", cs.evictions, cs.bytes);
+        ok = false;
+    }
+    pd_cache_free(cache);
+    free(want.data);
+    free(got.data);
+    return ok;
+}
+
+
+/** Check that a render found in a cache is the one expected. */
+static bool check_found(PdCache *cache, const CacheKey *key,
+                        const char *html)
+{
+    const CacheEntry *hit = find_render(cache, key);
+    bool ok = false;
+
+    if (!hit) return html == NULL;
+    ok = html && hit->length == strlen(html) &&
+         !memcmp(hit->html, html, hit->length);
+    release_render(cache, hit);
+    return ok;
+}
+
+
+/**
+ * Give two inputs of the same length the same hash. Each must miss
+ * until it is stored, and then be found with its own HTML.
+ */
+static bool check_collision(void)
+{
+    const char *one = "# one\n";
+    const char *two = "# two\n";
+    PdCache *cache = check_alloc(pd_cache_init((size_t)1 << 20));
+    CacheKey a;
+    CacheKey b;
+    bool ok = true;
+
+    make_cache_key(&a, (const uint8_t *)one, strlen(one), NULL);
+    make_cache_key(&b, (const uint8_t *)two, strlen(two), NULL);
+    b.hash[0] = a.hash[0];
+    b.hash[1] = a.hash[1];
+
+    store_render(cache, &a, (const uint8_t *)"<h1>one</h1>\n", 13);
+    ok = check_found(cache, &a, "<h1>one</h1>\n") &&
+         check_found(cache, &b, NULL);
+
+    store_render(cache, &b, (const uint8_t *)"<h1>two</h1>\n", 13);
+    ok = ok && check_found(cache, &b, "<h1>two</h1>\n") &&
+         check_found(cache, &a, "<h1>one</h1>\n");
+
+    if (!ok) {
+        fprintf(stderr, "FAILED: two inputs with the same hash were "
+                "confused\n");
+    }
+    pd_cache_free(cache);
+    return ok;
+}
+
+
+/**
+ * Render with options of other sizes. Options too small to be any the
+ * library knows, or with an option past those it knows set, must fail;
+ * larger options with every unknown option zero must render.
+ */
+static bool check_sizes(void)
+{
+    const uint8_t *md = (const uint8_t *)"# one\n";
+    struct {
+        PdOptions opts;
+        uint64_t more;      /* An option the library does not know. */
+    } big;
+    PdOptions small = PD_OPTIONS_INIT;
+    Buffer got = { NULL, 0, 0 };
+    PdSink sink = { write_buffer, &got };
+    bool ok = true;
+
+    memset(&big, 0, sizeof(big));
+    big.opts.size = sizeof(big);
+    small.size    = sizeof(size_t);
+
+    ok = pd_render_html_cached(NULL, md, 6, &small, &sink) == PD_ERR_OPTIONS &&
+         pd_render_html_cached(NULL, md, 6, &big.opts, &sink) == PD_OK;
+    big.more = 1;
+    ok = ok &&
+         pd_render_html_cached(NULL, md, 6, &big.opts, &sink) == PD_ERR_OPTIONS;
+
+    if (!ok) {
+        fprintf(stderr, "FAILED: options of another size were misread\n");
+    }
+    free(got.data);
+    return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+    Buffer *inputs = NULL;
+    int count = argc - 1;
+    bool ok = true;
+    int i = 0;
+
+    inputs = check_alloc(calloc(count ? count : 1, sizeof(Buffer)));
+    for (i = 0; i < count; i++) {
+        if (!read_file(argv[i + 1], &inputs[i])) {
+            fprintf(stderr, "FATAL: file could not be read: '%s'\n",
+                    argv[i + 1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    ok = check_hits(argv + 1, inputs, count) &&
+         check_evictions(argv + 1, inputs, count) &&
+         check_collision() &&
+         check_sizes();
+
+    printf("test-cache: %s on %d inputs\n", ok ? "passed" : "FAILED", count);
+    for (i = 0; i < count; i++) free(inputs[i].data);
+    free(inputs);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
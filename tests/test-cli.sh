@@ -0,0 +1,204 @@
+#####
+# test-cli.sh -- run tests against the modes of the executable
+#
+#  author:     Pat Gaffney <pat@hypepat.com>
+#  created:    2026-10-18
+#  modified:   2026-10-18
+#  project:    patdown
+#
+#   Each mode that runs the parser some other way must write what a
+#   plain run writes:
+#
+#   - `--pipe` must print the output of a serial run, as parsing
+#     information, HTML and text, for every test input and for one
+#     input longer than the pipeline's chunks.
+#   - The daemon of `--serve`, with and without `--cache`, must answer
+#     `pdclient` with the HTML of a plain run, and its cache must count
+#     the repeats as hits.
+#   - `--build` must convert a tree into the HTML of a plain run of
+#     each file, with each of `--io uring`, `pread` and `single`. A
+#     second build converts nothing; a touched file is not converted;
+#     a changed file is; a deleted file's output is removed; a
+#     `.markdown` file beside a `.md` file of the same name fails.
+#   - `--cache`, `--excerpt-blocks`, `--excerpt-bytes` and `-j` must
+#     fail on anything but a whole number.
+#
+#   USAGE: test-cli.sh <patdown> <pdclient>
+#
+#########################################################################
+
+#!/usr/bin/env bash
+
+## Constants ##
+BINARY="$1"
+CLIENT="$2"
+TESTDIR="$(cd "$(dirname "$0")" && pwd)"
+WORKDIR="$(mktemp -d)"
+INPUTS="$TESTDIR/parser/*.md $TESTDIR/parser-crlf/*.md"
+
+## Totals ##
+PASSED=0
+FAILED=0
+
+trap 'rm -rf "$WORKDIR"' EXIT
+
+if [ ! -x "$BINARY" ] || [ ! -x "$CLIENT" ]; then
+    echo "USAGE: $0 <patdown> <pdclient>" >&2
+    exit 1
+fi
+
+# Count a check as passed if its command succeeds.
+check() {
+    local name="$1"
+    shift
+    if "$@"; then
+        let PASSED++
+    else
+        echo " --> FAILED: $name"
+        let FAILED++
+    fi
+}
+
+# Check that two runs of the executable write the same bytes.
+same_output() {
+    cmp -s <("$BINARY" $1) <("$BINARY" $2)
+}
+
+# Check that a command fails.
+not() {
+    ! "$@" > /dev/null 2>&1
+}
+
+# Check that a file holds a line.
+has_line() {
+    grep -qx "$2" "$1"
+}
+
+# Run a build, keeping its summary line.
+build() {
+    "$BINARY" "$@" 2> "$WORKDIR/build.err"
+}
+
+# Check that every .html of a build is the HTML of its source.
+same_tree() {
+    local src="$1" out="$2" file html
+    for file in $(cd "$src" && find . -name '*.md'); do
+        html="$out/${file%.md}.html"
+        cmp -s "$html" <("$BINARY" "$src/$file") || return 1
+    done
+}
+
+
+## --pipe ##
+for file in $INPUTS; do
+    for mode in -d -5 -t; do
+        check "--pipe $mode $file" same_output "$mode $file" \
+              "--pipe $mode $file"
+    done
+done
+
+# One input of many chunks, read from the standard input.
+for i in $(seq 40); do cat $INPUTS; done > "$WORKDIR/long.md"
+for mode in -d -5 -t; do
+    check "--pipe $mode of a long input" \
+          cmp -s <("$BINARY" $mode < "$WORKDIR/long.md") \
+                 <("$BINARY" --pipe $mode < "$WORKDIR/long.md")
+done
+
+
+## --serve ##
+for cache in "" "--cache 1"; do
+    SOCKET="$WORKDIR/serve.sock"
+    "$BINARY" --serve "$SOCKET" -j 2 $cache 2> /dev/null &
+    SERVER=$!
+    for i in $(seq 50); do [ -S "$SOCKET" ] && break; sleep 0.1; done
+
+    for file in $TESTDIR/parser/*.md; do
+        check "--serve $cache $file" \
+              cmp -s <("$CLIENT" "$SOCKET" "$file") <("$BINARY" "$file")
+    done
+    "$CLIENT" -q -n 10 "$SOCKET" "$TESTDIR/parser/p_01.md" > /dev/null
+    "$CLIENT" -s "$SOCKET" > "$WORKDIR/stats"
+    check "--serve $cache answered every request" \
+          has_line "$WORKDIR/stats" "errors 0"
+    if [ -n "$cache" ]; then
+        check "--serve $cache counted the repeats as hits" \
+              grep -q "^cache_hits [1-9]" "$WORKDIR/stats"
+    fi
+
+    kill $SERVER
+    wait $SERVER 2> /dev/null
+    rm -f "$SOCKET"
+done
+
+
+## --build ##
+SRC="$WORKDIR/src"
+mkdir -p "$SRC/one/two"
+cp $TESTDIR/parser/p_*.md "$SRC"
+cp $TESTDIR/parser/atx_*.md "$SRC/one"
+cp $TESTDIR/parser-crlf/setext_*.md "$SRC/one/two"
+COUNT=$(find "$SRC" -name '*.md' | wc -l)
+
+for io in uring pread single; do
+    OUT="$WORKDIR/out-$io"
+    build --io $io --build "$SRC" "$OUT"
+    check "--build --io $io converted every file" \
+          has_line "$WORKDIR/build.err" \
+          "patdown: $COUNT converted, 0 unchanged, 0 removed, 0 failed"
+    check "--build --io $io wrote the HTML of each file" \
+          same_tree "$SRC" "$OUT"
+done
+check "--build wrote the same tree with each --io" \
+      diff -r "$WORKDIR/out-uring" "$WORKDIR/out-pread"
+check "--build wrote the same tree with each --io" \
+      diff -r "$WORKDIR/out-uring" "$WORKDIR/out-single"
+
+OUT="$WORKDIR/out-uring"
+build --build "$SRC" "$OUT"
+check "--build converted nothing that was unchanged" \
+      has_line "$WORKDIR/build.err" \
+      "patdown: 0 converted, $COUNT unchanged, 0 removed, 0 failed"
+
+touch -d '+1 hour' "$SRC/p_01.md"
+build --build "$SRC" "$OUT"
+check "--build did not convert a touched file" \
+      has_line "$WORKDIR/build.err" \
+      "patdown: 0 converted, $COUNT unchanged, 0 removed, 0 failed"
+
+printf '# changed\n' >> "$SRC/one/two/setext_01.md"
+build --build "$SRC" "$OUT"
+check "--build converted a changed file" \
+      has_line "$WORKDIR/build.err" \
+      "patdown: 1 converted, $((COUNT - 1)) unchanged, 0 removed, 0 failed"
+
+rm "$SRC/one/atx_01.md"
+build --build "$SRC" "$OUT"
+check "--build removed the output of a deleted file" \
+      has_line "$WORKDIR/build.err" \
+      "patdown: 0 converted, $((COUNT - 1)) unchanged, 1 removed, 0 failed"
+check "--build removed the output of a deleted file" \
+      test ! -e "$OUT/one/atx_01.html"
+check "--build kept the HTML of each file" same_tree "$SRC" "$OUT"
+
+printf '# twin\n' > "$SRC/p_01.markdown"
+build --build "$SRC" "$OUT"
+check "--build failed a .markdown file beside a .md file" \
+      has_line "$WORKDIR/build.err" \
+      "patdown: 0 converted, $((COUNT - 1)) unchanged, 0 removed, 1 failed"
+check "--build kept the HTML of the .md file" same_tree "$SRC" "$OUT"
+
+
+
+## Numbers ##
+for option in --cache --excerpt-blocks --excerpt-bytes -j; do
+    for value in -1 12x "" " 1" 99999999999999999999999; do
+        check "$option '$value' failed" \
+              not "$BINARY" $option "$value" "$TESTDIR/parser/p_01.md"
+    done
+    check "$option 12 was read" \
+          "$BINARY" $option 12 -o /dev/null "$TESTDIR/parser/p_01.md"
+done
+
+echo "test-cli: $PASSED passed, $FAILED failed"
+[ $FAILED -eq 0 ]
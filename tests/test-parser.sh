@@ -11,7 +11,11 @@
 #   `.out` extension. Tests are done to ensure the resulting string have
 #   equality.
 #
-#   patdown generates parser output for these types -- not HTML.
+#   tests/parser-crlf holds the same tests with `\r\n` line endings, and
+#   the same expected output -- line endings never change the parse.
+#
+#   The expected output is patdown's parsing information (`-d`), not
+#   its HTML.
 #
 #########################################################################
 
@@ -19,7 +23,7 @@
 
 ## Constants ##
 PROG=$'patdown'
-DIR="parser"
+DIRS="parser parser-crlf"
 BASEDIR="$(dirname $PWD)"
 TESTDIR="tests"
 BINARY="$BASEDIR/$PROG"
@@ -47,8 +51,8 @@ else
     echo -e "$BOLD Run the parser tests for $BOLD$PROG$RESET:\n"
 fi
 
-# Test every file in $DIR with the .md extension.
-for testfile in "$DIR"/*.md
+# Test every file in $DIRS with the .md extension.
+for testfile in $(for dir in $DIRS; do echo "$dir"/*.md; done)
 do
     if [ -f "$testfile" ]; then
         
@@ -59,7 +63,7 @@ do
             
             # Get the output file contents and the output from patdown.
             answer=$(< $outfile)
-            result=$(eval $BINARY $testfile)
+            result=$(eval $BINARY -d $testfile)
             
             # Test their respective equality.
             if [[ $answer == "$result" ]]; then
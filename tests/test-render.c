@@ -0,0 +1,225 @@
+/**
+ * test-render.c -- rendered HTML and text checked against the expected
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   Each case is a short document and the output it must render as.
+ *
+ *   The HTML of a document has its character references decoded, its
+ *   autolinks written as links -- but never inside code or a span of
+ *   inline syntax -- and the text of a block with no inline
+ *   metacharacter only escaped.
+ *
+ *   The text of a document is what a reader sees of it: links and
+ *   images as their text, code spans as their code, escaped bytes as
+ *   themselves, and neither the runs of `*` and `_` that open or close
+ *   emphasis nor the `<` and `>` of autolinks.
+ *
+ *   Each document is rendered whole, by `pd_render_html()` or
+ *   `pd_render_text()`, and by a `Stream` fed a byte at a time, which
+ *   reports its text in as many spans.
+ *
+ *   USAGE: test-render
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../html.h"
+#include "../libpatdown.h"
+#include "../stream.h"
+#include "../text.h"
+#include "harness.h"
+
+/** A document and the output it renders as. */
+typedef struct Case
+{
+    const char *markdown;   /* The document. */
+    const char *want;       /* Its output. */
+} Case;
+
+/** The documents and their HTML. */
+static const Case html_cases[] = {
+    /* Character references. */
+    { "&copy; &#169; &#xA9; &amp;\n",
+      "<p>\xc2\xa9 \xc2\xa9 \xc2\xa9 &amp;</p>\n" },
+    { "&bogus; & &amp;lt; &#0;\n",
+      "<p>&amp;bogus; &amp; &amp;lt; \xef\xbf\xbd</p>\n" },
+    { "AT&T &copy\n",
+      "<p>AT&amp;T &amp;copy</p>\n" },
+    { "```\n&copy;\n```\n",
+      "<pre><code>&amp;copy;\n</code></pre>\n" },
+    { "```c\n&lt;\n```\n",
+      "<pre><code class=\"language-c\">&amp;lt;\n</code></pre>\n" },
+    { "`&copy;` &copy;\n",
+      "<p>`&amp;copy;` \xc2\xa9</p>\n" },
+    { "\\&copy; &copy;\n",
+      "<p>\\&amp;copy; \xc2\xa9</p>\n" },
+
+    /* Autolinks. */
+    { "<https://a.b/c?d=e&f=g> and <me@a.b>\n",
+      "<p><a href=\"https://a.b/c?d=e&amp;f=g\">https://a.b/c?d=e&amp;f=g"
+      "</a> and <a href=\"mailto:me@a.b\">me@a.b</a></p>\n" },
+    { "See www.a.b, https://c.d/e. or me@f.gh!\n",
+      "<p>See <a href=\"http://www.a.b\">www.a.b</a>, "
+      "<a href=\"https://c.d/e\">https://c.d/e</a>. or "
+      "<a href=\"mailto:me@f.gh\">me@f.gh</a>!</p>\n" },
+    { "[x](http://a.com \"t\")\n",
+      "<p>[x](http://a.com &quot;t&quot;)</p>\n" },
+    { "[see www.a.b](<http://c.d>) ![i](https://e.f/g.png)\n",
+      "<p>[see www.a.b](&lt;http://c.d&gt;) ![i](https://e.f/g.png)</p>\n" },
+    { "[x](\nhttp://a.com) and\nhttp://b.com\n",
+      "<p>[x](\nhttp://a.com) and\n"
+      "<a href=\"http://b.com\">http://b.com</a></p>\n" },
+    { "`http://a.com` and ``www.b.c ` d`` e@f.gh\n",
+      "<p>`http://a.com` and ``www.b.c ` d`` "
+      "<a href=\"mailto:e@f.gh\">e@f.gh</a></p>\n" },
+    { "[no link] http://a.com `open\n",
+      "<p>[no link] <a href=\"http://a.com\">http://a.com</a> `open</p>\n" },
+    { "    http://a.com\n",
+      "<pre><code>http://a.com\n</code></pre>\n" },
+
+    /* Blocks with no inline metacharacter. */
+    { "Nothing but words.\n",
+      "<p>Nothing but words.</p>\n" },
+    { "# A \"quoted\" > header\n",
+      "<h1>A &quot;quoted&quot; &gt; header</h1>\n" },
+};
+
+/** The documents and their text. */
+static const Case text_cases[] = {
+    /* Links, images, code spans and escapes. */
+    { "[a *b*](x) \\* `code` __c__\n",
+      "a b * code c\n" },
+    { "![alt *text*](i.png \"t\") and [x][y]\n",
+      "alt text and [x][y]\n" },
+    { "[a [b](c) d](e)\n",
+      "[a b d](e)\n" },
+    { "`a *b*` \\_c\\_ `` d ` e `` \\a\n",
+      "a *b* _c_ d ` e \\a\n" },
+    { "[see www.a.b](<http://c.d>) <http://e.f> &copy;\n",
+      "see www.a.b http://e.f \xc2\xa9\n" },
+
+    /* Emphasis. */
+    { "*a\nb* and _c_\n",
+      "a\nb and c\n" },
+    { "snake_case_name and 2*3*4\n",
+      "snake_case_name and 234\n" },
+    { "foo_bar_ and *a **b** c*\n",
+      "foo_bar_ and a b c\n" },
+    { "***a*** and **b* and * c *\n",
+      "a and *b and * c *\n" },
+    { "*a [b* c](d)\n",
+      "*a b* c\n" },
+
+    /* Blocks. */
+    { "# *A* header\n\nText.\n",
+      "\fA header\n\nText.\n" },
+    { "```\n*a* `b`\n```\n",
+      "*a* `b`\n" },
+};
+
+/** The number of cases in a table. */
+#define COUNT(cases) (sizeof(cases) / sizeof(cases[0]))
+
+
+/** Render a document with `pd_render_html()` or `pd_render_text()`. */
+static void render_whole(const char *markdown, const bool text, Buffer *out)
+{
+    PdSink sink = { write_buffer, out };
+    PdDoc *doc = pd_parse((const uint8_t *)markdown, strlen(markdown), NULL);
+
+    out->length = 0;
+    if (!pd_error(doc)) {
+        if (text) pd_render_text(doc, true, &sink);
+        else pd_render_html(doc, &sink);
+    }
+    pd_free(doc);
+}
+
+
+/** Render a document through a stream fed a byte at a time. */
+static void render_streamed(const char *markdown, const bool text,
+                            Buffer *out)
+{
+    PdSink sink = { write_buffer, out };
+    Html h;
+    TextOut t;
+    Callbacks cb = text ? text_callbacks(&t, &sink, true)
+                        : html_callbacks(&h, &sink);
+    Stream *s = check_alloc(init_stream(&cb, true));
+    PdError error = PD_OK;
+    size_t i = 0;
+
+    out->length = 0;
+    for (i = 0; !error && markdown[i]; i++) {
+        error = feed_stream(s, (const uint8_t *)markdown + i, 1);
+    }
+    if (!error) finish_stream(s);
+    free_stream(s);
+    if (text) free_text_out(&t);
+    else free_html(&h);
+}
+
+
+/** Check a render against the output expected, or report how it differs. */
+static bool check_render(const Case *c, const char *how, const Buffer *got)
+{
+    if (got->length == strlen(c->want) &&
+        !memcmp(got->data, c->want, got->length)) {
+        return true;
+    }
+    fprintf(stderr, "FAILED: %s of '%s':\n  want '%s'\n  got  '%.*s'\n",
+            how, c->markdown, c->want, (int)got->length,
+            (const char *)got->data);
+    return false;
+}
+
+
+/**
+ * Render each case of a table whole and streamed.
+ *
+ * - parameter cases: The table.
+ * - parameter count: The number of cases.
+ * - parameter text: Render text, not HTML.
+ * - parameter got: A buffer for the output.
+ *
+ * - returns: The number of renders that failed.
+ */
+static int check_cases(const Case *cases, const size_t count, const bool text,
+                       Buffer *got)
+{
+    const char *whole = text ? "pd_render_text()" : "pd_render_html()";
+    int failed = 0;
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        render_whole(cases[i].markdown, text, got);
+        if (!check_render(&cases[i], whole, got)) failed++;
+        render_streamed(cases[i].markdown, text, got);
+        if (!check_render(&cases[i], "a stream", got)) failed++;
+    }
+    return failed;
+}
+
+
+int main(void)
+{
+    Buffer got = { NULL, 0, 0 };
+    int html = check_cases(html_cases, COUNT(html_cases), false, &got);
+    int text = check_cases(text_cases, COUNT(text_cases), true, &got);
+
+    printf("test-render: %d of %d HTML renders and %d of %d text renders "
+           "passed\n", (int)(2 * COUNT(html_cases)) - html,
+           (int)(2 * COUNT(html_cases)), (int)(2 * COUNT(text_cases)) - text,
+           (int)(2 * COUNT(text_cases)));
+    free(got.data);
+    return (html || text) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,486 @@
+/**
+ * test-reparse.c -- randomized edits checked against whole parses
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   Each input file is edited over and over at random: a range of bytes
+ *   is replaced by Markdown syntax, by a slice of another input, or by
+ *   nothing. After every edit, the document updated by `pd_reparse()`
+ *   must render exactly the same HTML and text as a new `pd_parse()` of
+ *   the edited bytes, and report the same range of bytes for each block.
+ *   The new parse is compacted with `pd_compact()` first, so the table
+ *   of its blocks is checked against the queue of the re-parse. It is
+ *   then saved with `pd_save()`, and the document `pd_load()` reads back
+ *   must render the same HTML and report the same blocks.
+ *
+ *   Each input is also parsed as excerpts of its first few blocks, with
+ *   and without the link definitions after them. Every block of an
+ *   excerpt must be a block of the whole parse, in the same order, and
+ *   an excerpt longer than the input must be the whole parse.
+ *
+ *   Each input is parsed keeping only one kind of block at a time as
+ *   well. Those blocks must be blocks of the whole parse, and keeping
+ *   every kind at once must keep just the blocks of each kind.
+ *
+ *   The links of each input are extracted with `pd_extract_links()`.
+ *   Each must be a line of JSON whose offset is in the input, at the
+ *   `[` of a link or the `!` of an image. An input with a `.jsonl` file
+ *   beside it must have exactly the links of that file.
+ *
+ *   USAGE: test-reparse [-n <edits>] [-s <seed>] <inputfile>...
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../libpatdown.h"
+#include "harness.h"
+
+/** Snippets of syntax that change the type or the extent of blocks. */
+static const char *snippets[] = {
+    "\n", "\n\n", "\r\n", "\r", " ", "    ", "\t", "text", "more text\n",
+    "# ", "###### ", " #", "---", "***\n", "___", "===\n", "- - -\n",
+    "```", "```c\n", "~~~\n", "> ", ">", "> > ", "<div>", "</div>\n",
+    "<!--", "-->", "<?", "?>", "<![CDATA[", "]]>", "<!DOCTYPE", ">",
+    "<script>", "</script>", "<custom>\n", "[a]: /url", " \"title\"\n",
+    "[label]:\n  /dest\n  'title'", "\xc3\xa9", "\xe2\x82\xac", "*", "_"
+};
+
+/** The number of snippets. */
+#define SNIPPETS (sizeof(snippets) / sizeof(snippets[0]))
+
+/** Get the next number of a xorshift64* sequence. */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+
+/** Get a random number in `[0, n)`, or zero when `n` is zero. */
+static size_t random_below(uint64_t *state, const size_t n)
+{
+    return n ? next_random(state) % n : 0;
+}
+
+
+/**
+ * Replace a random range of a document with random bytes.
+ *
+ * Most edits are small, like typing, but some remove or paste larger
+ * ranges -- taken from any of the inputs.
+ */
+static void random_edit(Buffer *doc, const Buffer *inputs, const int count,
+                        uint64_t *state, PdEdit *edit)
+{
+    const Buffer *from = &inputs[random_below(state, count)];
+    const uint8_t *text = NULL;
+    size_t big = (random_below(state, 8) == 0);
+
+    edit->offset   = random_below(state, doc->length + 1);
+    edit->removed  = random_below(state, big ? 64 : 3);
+    edit->inserted = 0;
+    if (edit->removed > doc->length - edit->offset) {
+        edit->removed = doc->length - edit->offset;
+    }
+
+    switch (random_below(state, 3)) {
+        case 0:
+            text = (const uint8_t *)snippets[random_below(state, SNIPPETS)];
+            edit->inserted = strlen((const char *)text);
+            break;
+        case 1:
+            edit->inserted = random_below(state, big ? 256 : 8);
+            if (edit->inserted > from->length) edit->inserted = from->length;
+            text = from->data + random_below(state, from->length -
+                                             edit->inserted + 1);
+            break;
+        default:
+            break;
+    }
+
+    reserve(doc, edit->inserted);
+    memmove(doc->data + edit->offset + edit->inserted,
+            doc->data + edit->offset + edit->removed,
+            doc->length - edit->offset - edit->removed);
+    if (edit->inserted) memcpy(doc->data + edit->offset, text, edit->inserted);
+    doc->length = doc->length - edit->removed + edit->inserted;
+}
+
+
+/** Print the document that failed, escaped, for a bug report. */
+static void print_document(const Buffer *doc)
+{
+    size_t i = 0;
+
+    for (i = 0; i < doc->length; i++) {
+        if (doc->data[i] == '\n') fputs("\\n\n", stderr);
+        else if (doc->data[i] == '\r') fputs("\\r", stderr);
+        else fputc(doc->data[i], stderr);
+    }
+    fputc('\n', stderr);
+}
+
+
+/** Check that two documents report the same, ordered range for each block. */
+static bool same_spans(const PdDoc *a, const PdDoc *b)
+{
+    size_t count = pd_block_spans(a, NULL, 0);
+    PdSpan *sa = check_alloc(malloc((count + 1) * sizeof(PdSpan)));
+    PdSpan *sb = check_alloc(malloc((count + 1) * sizeof(PdSpan)));
+    bool ok = (pd_block_spans(b, NULL, 0) == count);
+    size_t i = 0;
+
+    pd_block_spans(a, sa, count);
+    pd_block_spans(b, sb, count);
+    for (i = 0; i < count && ok; i++) {
+        ok = sa[i].start == sb[i].start && sa[i].end == sb[i].end &&
+             sa[i].start <= sa[i].end &&
+             (i == 0 || sa[i - 1].start <= sa[i].start);
+    }
+    free(sa);
+    free(sb);
+    return ok;
+}
+
+
+/**
+ * Check that a document saved and loaded again is unchanged.
+ *
+ * - parameter doc: The document to save.
+ * - parameter source: The bytes the document was parsed from.
+ * - parameter html: The HTML the document renders, then its text.
+ * - returns: `true` if the loaded document renders the same HTML and
+ *   text, reports the same blocks, and saves the very same bytes again.
+ */
+static bool same_saved(const PdDoc *doc, const Buffer *source,
+                       const Buffer *html)
+{
+    Buffer saved = { NULL, 0, 0 };
+    Buffer again = { NULL, 0, 0 };
+    Buffer got = { NULL, 0, 0 };
+    PdSink saved_sink = { write_buffer, &saved };
+    PdSink again_sink = { write_buffer, &again };
+    PdSink got_sink = { write_buffer, &got };
+    size_t length = 0;
+    PdDoc *loaded = NULL;
+    bool ok = false;
+
+    pd_save(doc, source->data, source->length, &saved_sink);
+    loaded = pd_load(saved.data, saved.length);
+    if (!pd_error(loaded) && pd_source(loaded, &length)) {
+        pd_render_html(loaded, &got_sink);
+        pd_render_text(loaded, true, &got_sink);
+        pd_save(loaded, NULL, 0, &again_sink);
+        ok = got.length == html->length &&
+             (!got.length || !memcmp(got.data, html->data, got.length)) &&
+             again.length == saved.length &&
+             !memcmp(again.data, saved.data, saved.length) &&
+             same_spans(loaded, doc);
+    }
+    pd_free(loaded);
+    free(saved.data);
+    free(again.data);
+    free(got.data);
+    return ok;
+}
+
+
+/** Check that every block of a document is a block of another, in order. */
+static bool is_excerpt_of(const PdDoc *part, const PdDoc *whole)
+{
+    size_t count = pd_block_spans(whole, NULL, 0);
+    size_t some  = pd_block_spans(part, NULL, 0);
+    PdSpan *sw = check_alloc(malloc((count + 1) * sizeof(PdSpan)));
+    PdSpan *sp = check_alloc(malloc((some + 1) * sizeof(PdSpan)));
+    size_t i = 0;
+    size_t j = 0;
+
+    pd_block_spans(whole, sw, count);
+    pd_block_spans(part, sp, some);
+    for (i = 0; i < count && j < some; i++) {
+        j += (sw[i].start == sp[j].start && sw[i].end == sp[j].end);
+    }
+    free(sw);
+    free(sp);
+    return j == some;
+}
+
+
+/**
+ * Parse an input as excerpts of a few lengths.
+ *
+ * - returns: `true` if each excerpt holds blocks of the whole parse, and
+ *   an excerpt with more blocks than the input is the whole parse.
+ */
+static bool check_excerpts(const char *name, const Buffer *input)
+{
+    PdOptions opts = PD_OPTIONS_INIT;
+    PdDoc *whole = pd_parse(input->data, input->length, NULL);
+    PdDoc *part  = NULL;
+    size_t blocks = 0;
+    bool ok = true;
+    int refs = 0;
+
+    for (refs = 0; refs < 2 && ok; refs++) {
+        for (blocks = 1; blocks <= 4 && ok; blocks++) {
+            opts.excerpt_blocks = (blocks == 4) ? input->length + 1 : blocks;
+            opts.excerpt_refs   = refs;
+            part = pd_parse(input->data, input->length, &opts);
+            ok = !pd_error(part) && is_excerpt_of(part, whole) &&
+                 (blocks < 4 || same_spans(part, whole));
+            pd_free(part);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s as an excerpt of %zu blocks%s\n", name,
+                blocks - 1, refs > 1 ? " and its link definitions" : "");
+    }
+    pd_free(whole);
+    return ok;
+}
+
+
+/**
+ * Parse an input keeping only one kind of block, for each kind.
+ *
+ * - returns: `true` if the blocks of each kind are blocks of the whole
+ *   parse, and a parse keeping every kind keeps just those blocks.
+ */
+static bool check_only(const char *name, const Buffer *input)
+{
+    PdOptions opts = PD_OPTIONS_INIT;
+    PdDoc *whole = pd_parse(input->data, input->length, NULL);
+    PdDoc *part  = NULL;
+    size_t kept  = 0;       /* Blocks kept of all the kinds. */
+    unsigned kind = 0;
+    bool ok = true;
+
+    for (kind = 1; kind <= PD_ONLY_REFS && ok; kind <<= 1) {
+        opts.only = kind;
+        part = pd_parse(input->data, input->length, &opts);
+        ok = !pd_error(part) && is_excerpt_of(part, whole);
+        kept += pd_block_spans(part, NULL, 0);
+        pd_free(part);
+    }
+    if (ok) {
+        opts.only = (PD_ONLY_REFS << 1) - 1;
+        part = pd_parse(input->data, input->length, &opts);
+        ok = !pd_error(part) && is_excerpt_of(part, whole) &&
+             pd_block_spans(part, NULL, 0) == kept;
+        pd_free(part);
+    }
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s keeping only kinds 0x%x\n", name,
+                opts.only);
+    }
+    pd_free(whole);
+    return ok;
+}
+
+
+/**
+ * Check the offset and kind of a link extracted from an input.
+ *
+ * - parameter line: A line written by `pd_extract_links()`, without its
+ *   newline -- the destination's quotes are escaped, so the last
+ *   `"offset":` of the line is the link's.
+ *
+ * - returns: `true` if the offset is in the input, and at the byte that
+ *   starts a link or an image.
+ */
+static bool is_link_line(const char *line, const Buffer *input)
+{
+    const char *field = NULL;
+    const char *at = line;
+    unsigned long offset = 0;
+    char kind[16];
+    int n = 0;
+
+    if (strncmp(line, "{\"dest\":\"", 9)) return false;
+    while ((at = strstr(at, "\",\"offset\":"))) field = at++;
+    if (!field ||
+        sscanf(field, "\",\"offset\":%lu,\"kind\":\"%15[a-z]\"}%n",
+               &offset, kind, &n) < 2 || field[n] != '\0' ||
+        offset >= input->length) {
+        return false;
+    }
+    if (!strcmp(kind, "link")) return input->data[offset] == '[';
+    if (!strcmp(kind, "image")) return input->data[offset] == '!';
+    return !strcmp(kind, "autolink") || !strcmp(kind, "ref");
+}
+
+
+/**
+ * Check the links extracted from an input against those expected of it,
+ * in a `.jsonl` file beside it, if there is one.
+ */
+static bool same_links(const char *name, const Buffer *out)
+{
+    Buffer want = { NULL, 0, 0 };
+    size_t length = strlen(name);
+    char path[4096];
+    bool ok = true;
+
+    if (length < 3 || strcmp(name + length - 3, ".md") ||
+        length + 3 >= sizeof(path)) {
+        return true;
+    }
+    snprintf(path, sizeof(path), "%.*s.jsonl", (int)(length - 3), name);
+    if (!read_file(path, &want)) return true;
+
+    ok = want.length == out->length &&
+         (want.length == 0 || !memcmp(want.data, out->data, want.length));
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s extracting links: not the links of "
+                "'%s'\n", name, path);
+    }
+    free(want.data);
+    return ok;
+}
+
+
+/**
+ * Extract the links of an input.
+ *
+ * - returns: `true` if every link is a line of JSON at a byte of the
+ *   input that can start it, and the links are any that are expected.
+ */
+static bool check_links(const char *name, const Buffer *input)
+{
+    Buffer out = { NULL, 0, 0 };
+    PdSink sink = { write_buffer, &out };
+    PdError error = pd_extract_links(input->data, input->length, NULL,
+                                     &sink);
+    char *line = NULL;
+    char *end  = NULL;
+    bool same = !error && same_links(name, &out);
+    bool ok = !error;
+
+    write_buffer((const uint8_t *)"", 1, &out);
+    line = (char *)out.data;
+    while (ok && *line && (end = strchr(line, '\n'))) {
+        *end = '\0';
+        if ((ok = is_link_line(line, input))) line = end + 1;
+    }
+    ok = ok && !*line;
+    if (!ok) {
+        fprintf(stderr, "FAILED: %s extracting links: %s\n", name,
+                error ? pd_strerror(error) : line);
+    }
+    free(out.data);
+    return ok && same;
+}
+
+
+/**
+ * Edit one input at random, checking the document after every edit.
+ *
+ * - returns: `true` if every re-parse matched a whole parse.
+ */
+static bool check_edits(const char *name, const Buffer *inputs,
+                        const int count, const int which, const long edits,
+                        uint64_t *state)
+{
+    Buffer doc = { NULL, 0, 0 };
+    Buffer want = { NULL, 0, 0 };
+    Buffer got = { NULL, 0, 0 };
+    PdSink want_sink = { write_buffer, &want };
+    PdSink got_sink = { write_buffer, &got };
+    PdDoc *live = NULL;
+    PdDoc *whole = NULL;
+    PdEdit edit;
+    bool ok = true;
+    long i = 0;
+
+    write_buffer(inputs[which].data, inputs[which].length, &doc);
+    live = pd_parse(doc.data, doc.length, NULL);
+
+    for (i = 0; i < edits && ok; i++) {
+        random_edit(&doc, inputs, count, state, &edit);
+        pd_reparse(live, doc.data, doc.length, &edit);
+        whole = pd_parse(doc.data, doc.length, NULL);
+        pd_compact(whole);
+
+        want.length = got.length = 0;
+        pd_render_html(whole, &want_sink);
+        pd_render_html(live, &got_sink);
+        pd_render_text(whole, true, &want_sink);
+        pd_render_text(live, true, &got_sink);
+
+        if (pd_error(live) != pd_error(whole) || want.length != got.length ||
+            (want.length && memcmp(want.data, got.data, want.length)) ||
+            !same_spans(live, whole) || !same_saved(whole, &doc, &want)) {
+            fprintf(stderr, "FAILED: %s after edit %ld: offset %zu, "
+                    "removed %zu, inserted %zu\n", name, i + 1,
+                    edit.offset, edit.removed, edit.inserted);
+            print_document(&doc);
+            ok = false;
+        }
+        pd_free(whole);
+    }
+
+    pd_free(live);
+    free(doc.data);
+    free(want.data);
+    free(got.data);
+    return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+    Buffer *inputs = NULL;
+    uint64_t seed  = 0x9E3779B97F4A7C15ULL;
+    long edits = 1000;      /* Edits of each input. */
+    int failed = 0;
+    int count  = 0;
+    int opt = 0;
+    int i = 0;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n': edits = strtol(optarg, NULL, 10);             break;
+            case 's': seed  = strtoull(optarg, NULL, 10) | 1;       break;
+            default:
+                fprintf(stderr, "USAGE: %s [-n <edits>] [-s <seed>] "
+                        "<inputfile>...\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    count  = argc - optind;
+    inputs = check_alloc(calloc(count ? count : 1, sizeof(Buffer)));
+    for (i = 0; i < count; i++) {
+        if (!read_file(argv[optind + i], &inputs[i])) {
+            fprintf(stderr, "FATAL: file could not be read: '%s'\n",
+                    argv[optind + i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!check_edits(argv[optind + i], inputs, count, i, edits, &seed) ||
+            !check_excerpts(argv[optind + i], &inputs[i]) ||
+            !check_only(argv[optind + i], &inputs[i]) ||
+            !check_links(argv[optind + i], &inputs[i])) {
+            failed++;
+        }
+    }
+
+    printf("test-reparse: %d of %d inputs passed %ld random edits\n",
+           count - failed, count, edits);
+    for (i = 0; i < count; i++) free(inputs[i].data);
+    free(inputs);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
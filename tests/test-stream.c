@@ -0,0 +1,207 @@
+/**
+ * test-stream.c -- streamed parses checked against whole parses
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   Each input file is parsed whole by `parse_markdown()`, and the
+ *   events reported to its callbacks are logged: each block entered and
+ *   exited, with its type and offset, and the text between them. The
+ *   input is then fed to a `Stream` in two chunks, split at every byte,
+ *   and in chunks of a few bytes at a time. Every streamed parse must
+ *   log exactly the events of the whole parse.
+ *
+ *   A split at every byte splits each `\r\n` of an input between two
+ *   chunks, and each UTF-8 sequence. The splits of `\r\n` are counted,
+ *   so a run over inputs with CRLF line endings shows that they were
+ *   covered.
+ *
+ *   USAGE: test-stream <inputfile>...
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../libpatdown.h"
+#include "../patdown.h"
+#include "../stream.h"
+#include "harness.h"
+
+/** The sizes of the chunks an input is also fed in, a chunk at a time. */
+static const size_t chunk_sizes[] = { 1, 2, 3, 7, 64 };
+
+/** The number of chunk sizes. */
+#define CHUNK_SIZES (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))
+
+/**
+ * Log a block that is entered. Each event starts with a byte that no
+ * input holds, so it cannot be mistaken for text.
+ */
+static PdError log_enter(const mdblock_t type, const void *info,
+                         const size_t start, void *userdata)
+{
+    char line[64];
+    int n = snprintf(line, sizeof(line), "\x01+%d@%zu\n", (int)type, start);
+
+    (void)info;
+    append(userdata, (const uint8_t *)line, n);
+    return PD_OK;
+}
+
+
+/** Log the text of a block, joined to any text logged right before it. */
+static PdError log_text(const uint8_t *data, const size_t length,
+                        void *userdata)
+{
+    append(userdata, data, length);
+    return PD_OK;
+}
+
+
+/** Log a block that is exited. */
+static PdError log_exit(const mdblock_t type, const size_t end,
+                        void *userdata)
+{
+    char line[64];
+    int n = snprintf(line, sizeof(line), "\x01-%d@%zu\n", (int)type, end);
+
+    append(userdata, (const uint8_t *)line, n);
+    return PD_OK;
+}
+
+
+/** Get the callbacks that log every event to a buffer. */
+static Callbacks log_callbacks(Buffer *log)
+{
+    Callbacks cb = { log_enter, log_text, log_exit, NULL, NULL };
+
+    cb.userdata = log;
+    log->length = 0;
+    return cb;
+}
+
+
+/**
+ * Feed an input to a stream in chunks, each split point being the end
+ * of one chunk.
+ *
+ * - parameter splits: The offsets where each chunk ends, ascending.
+ * - parameter count: The number of offsets.
+ *
+ * - returns: `PD_OK`, or the error that stopped the parse.
+ */
+static PdError stream_chunks(const Buffer *in, const size_t *splits,
+                             const size_t count, Buffer *log)
+{
+    const Callbacks cb = log_callbacks(log);
+    Stream *s = check_alloc(init_stream(&cb, false));
+    PdError error = PD_OK;
+    size_t at = 0;
+    size_t i = 0;
+
+    for (i = 0; !error && i <= count; i++) {
+        size_t to = (i < count) ? splits[i] : in->length;
+        error = feed_stream(s, in->data + at, to - at);
+        at = to;
+    }
+    if (!error) error = finish_stream(s);
+    free_stream(s);
+    return error;
+}
+
+
+/** Check if two logs hold the same events, or report where they differ. */
+static bool same_log(const char *name, const char *how, const Buffer *want,
+                     const Buffer *got)
+{
+    size_t i = 0;
+
+    if (got->length == want->length &&
+        (want->length == 0 || !memcmp(got->data, want->data, want->length))) {
+        return true;
+    }
+    while (i < got->length && i < want->length &&
+           got->data[i] == want->data[i]) {
+        i++;
+    }
+    fprintf(stderr, "FAILED: %s: %s: the events differ from byte %zu of "
+            "the log\n", name, how, i);
+    return false;
+}
+
+
+/**
+ * Stream an input split at every byte, and in chunks of each size, and
+ * check each parse against the whole one.
+ *
+ * - parameter crlf: Counts the splits made between a `\r` and a `\n`.
+ */
+static bool check_input(const char *name, const Buffer *in, size_t *crlf)
+{
+    Buffer want = { NULL, 0, 0 };
+    Buffer got  = { NULL, 0, 0 };
+    Callbacks cb = log_callbacks(&want);
+    Parser *p = check_alloc(init_parser(&cb));
+    size_t *splits = check_alloc(malloc((in->length + 1) * sizeof(size_t)));
+    PdError error = PD_OK;     /* The error of the whole parse. */
+    char how[64];
+    size_t count = 0;
+    size_t k = 0;
+    size_t i = 0;
+    bool ok = true;
+
+    error = parse_markdown(p, in->data, in->length);
+    free_parser(p);
+
+    for (k = 0; ok && k <= in->length; k++) {
+        if (k > 0 && k < in->length && in->data[k - 1] == '\r' &&
+            in->data[k] == '\n') {
+            (*crlf)++;
+        }
+        snprintf(how, sizeof(how), "split at %zu", k);
+        ok = stream_chunks(in, &k, 1, &got) == error &&
+             same_log(name, how, &want, &got);
+    }
+    for (i = 0; ok && i < CHUNK_SIZES; i++) {
+        for (count = 0, k = chunk_sizes[i]; k < in->length;
+             k += chunk_sizes[i]) {
+            splits[count++] = k;
+        }
+        snprintf(how, sizeof(how), "chunks of %zu", chunk_sizes[i]);
+        ok = stream_chunks(in, splits, count, &got) == error &&
+             same_log(name, how, &want, &got);
+    }
+    free(splits);
+    free(want.data);
+    free(got.data);
+    return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+    Buffer input = { NULL, 0, 0 };
+    size_t crlf = 0;            /* Splits between a `\r` and a `\n`. */
+    int failed = 0;
+    int i = 0;
+
+    for (i = 1; i < argc; i++) {
+        input.length = 0;
+        if (!read_file(argv[i], &input)) {
+            fprintf(stderr, "FATAL: file could not be read: '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        if (!check_input(argv[i], &input, &crlf)) failed++;
+    }
+
+    printf("test-stream: %d of %d inputs passed, %zu splits of \\r\\n\n",
+           argc - 1 - failed, argc - 1, crlf);
+    free(input.data);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,607 @@
+/**
+ * text.c -- rendering of parsed blocks as plain text
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "autolink.h"
+#include "entities.h"
+#include "libpatdown.h"
+#include "patdown.h"
+#include "spans.h"
+#include "strings.h"
+#include "text.h"
+
+
+/************************************************************************
+ * # Text Rendering
+ *
+ *  The renderer writes the text a reader would see, for a search index
+ *  or the like: the text of each header and paragraph, and of each code
+ *  block unless they are left out. Raw HTML, rules and link reference
+ *  definitions are never seen, so they are never written, and the
+ *  blocks of a blockquote are written like any others.
+ *
+ *  Each block is written on lines of its own, set off from the last by
+ *  a blank line. Each header starts a section, so it is written after a
+ *  form feed: the text splits into its sections at each form feed, and
+ *  a section starts with the text of its header.
+ *
+ *      Text before the first header.
+ *
+ *      \fA Header
+ *
+ *      The text of its section.
+ *
+ *  Inlines are not parsed into a tree, but the text is what a reader
+ *  sees of them: character references are decoded, and autolinks are
+ *  written as the text of the link, without their `<` and `>`. An
+ *  inline link is written as its text and an image as its alt text, a
+ *  code span as its code, and an escaped character as itself. A run of
+ *  `*` or `_` that opens or closes emphasis is left out; a run that does
+ *  neither is text. A reference to a link defined elsewhere is written
+ *  as it is, since its definition may come after it.
+ *
+ *  The spans of inline syntax are found as the HTML renderer finds them,
+ *  in the whole text of the block, so the text is kept from the first
+ *  byte that may start a span or emphasis until the block is exited.
+ *  The text of a block that holds no such byte, nor `&` or `<`, and of
+ *  code, is written straight from the spans the parser reports -- which
+ *  point into the document itself.
+ *
+ ************************************************************************/
+
+/** The metacharacters that can start a span of inline syntax or emphasis. */
+#define SPAN_META (META_STAR | META_UNDERSCORE | META_BACKTICK | \
+                   META_BRACKET | META_BACKSLASH)
+
+/** The metacharacters of text that a reader does not see as it is. */
+#define SEEN_META (SPAN_META | META_AMPERSAND | META_ANGLE)
+
+static void write_span(TextOut *t, const uint8_t *data, const size_t length);
+static void write_span_out(const uint8_t *data, const size_t length,
+                           void *userdata);
+static void write_visible(TextOut *t, const uint8_t *data, size_t length,
+                          const bool more);
+static void write_seen(TextOut *t, const uint8_t *data, const size_t length,
+                       const bool more);
+static void keep_text(TextOut *t, const uint8_t *data, const size_t length);
+static void write_kept(TextOut *t);
+static bool is_header(const mdblock_t type);
+
+
+/** Check if the text of a block is written. */
+static bool is_shown(const TextOut *t, const mdblock_t type)
+{
+    switch (type) {
+        case PARAGRAPH:
+            return true;
+        case INDENTED_CODE_BLOCK:
+        case FENCED_CODE_BLOCK:
+            return t->code;
+        default:
+            return is_header(type);
+    }
+}
+
+
+/**
+ * Start the output of the block being rendered, once: a blank line if
+ * some block came before it, and a form feed if it starts a section.
+ */
+static void open_block(TextOut *t)
+{
+    if (t->open) return;
+    if (t->any) write_span(t, (const uint8_t *)"\n", 1);
+    if (is_header(t->block)) write_span(t, (const uint8_t *)"\f", 1);
+    t->open = true;
+    t->any  = true;
+}
+
+
+/** Note each block that is entered, and if its text is written. */
+static PdError text_enter_block(const mdblock_t type, const void *info,
+                                const size_t start, void *userdata)
+{
+    TextOut *t = userdata;
+
+    (void)info;
+    (void)start;
+    t->block = type;
+    t->shown = is_shown(t, type);
+    t->open  = false;
+    t->plain = false;
+    t->flat  = false;
+    t->last  = '\n';
+    if (t->kept) t->kept->length = 0;
+    return PD_OK;
+}
+
+
+/**
+ * Note a block whose text is seen as it is, or holds no span of inline
+ * syntax or emphasis.
+ */
+static PdError text_inlines(const uint16_t mask, void *userdata)
+{
+    TextOut *t = userdata;
+
+    t->plain = !(mask & SEEN_META);
+    t->flat  = !(mask & SPAN_META);
+    return PD_OK;
+}
+
+
+/** Check if a span of text holds no `&` or `<`, so it is seen as it is. */
+static bool is_plain(const uint8_t *data, const size_t length)
+{
+    return !memchr(data, '&', length) && !memchr(data, '<', length);
+}
+
+
+/**
+ * Write each span of text that is shown: code and plain text as they
+ * are, and the rest with its references and autolinks as a reader sees
+ * them. The parse of a stream does not report the metacharacters of a
+ * block, so each span of its text is checked on its own. Text that may
+ * hold a span of inline syntax or emphasis is kept until the block is
+ * exited.
+ */
+static PdError text_text(const uint8_t *data, const size_t length,
+                         void *userdata)
+{
+    TextOut *t = userdata;
+
+    if (!t->shown || length == 0) return PD_OK;
+    open_block(t);
+
+    switch (t->block) {
+        case INDENTED_CODE_BLOCK:
+        case FENCED_CODE_BLOCK:
+            write_span(t, data, length);
+            break;
+        default:
+            if (t->plain) write_span(t, data, length);
+            else if (t->flat) write_seen(t, data, length, true);
+            else keep_text(t, data, length);
+            break;
+    }
+    return PD_OK;
+}
+
+
+/** End the output of each block that is shown with a newline. */
+static PdError text_exit_block(const mdblock_t type, const size_t end,
+                               void *userdata)
+{
+    TextOut *t = userdata;
+
+    (void)end;
+    if (t->shown) {
+        flush_decoder(&t->decoder);
+        write_kept(t);
+
+        /* A header with no text still starts a section. */
+        if (is_header(type)) open_block(t);
+        if (t->open && !t->newline) write_span(t, (const uint8_t *)"\n", 1);
+    }
+    t->block = UNKNOWN;
+    t->shown = false;
+    return PD_OK;
+}
+
+
+/**
+ * Get the callbacks that render the visible text of each block.
+ *
+ * - parameter t: The renderer state, initialized here.
+ * - parameter sink: Where the text is written.
+ * - parameter code: Write the text of code blocks too.
+ *
+ * - returns: The callbacks.
+ */
+Callbacks text_callbacks(TextOut *t, const PdSink *sink, const bool code)
+{
+    Callbacks cb = {
+        text_enter_block, text_text, text_exit_block, text_inlines, NULL
+    };
+    PdSink out = { write_span_out, t };
+
+    t->sink    = *sink;
+    t->code    = code;
+    t->block   = UNKNOWN;
+    t->shown   = false;
+    t->open    = false;
+    t->plain   = false;
+    t->flat    = false;
+    t->any     = false;
+    t->newline = false;
+    t->last    = '\n';
+    t->kept    = NULL;
+    init_decoder(&t->decoder, &out);
+    t->delims  = NULL;
+    t->delim_count  = 0;
+    t->delim_allocd = 0;
+
+    cb.userdata = t;
+    return cb;
+}
+
+
+/** Free the memory held by a plain text renderer, but not the renderer. */
+void free_text_out(TextOut *t)
+{
+    free_string(t->kept);
+    free(t->delims);
+    t->kept   = NULL;
+    t->delims = NULL;
+    t->delim_allocd = 0;
+}
+
+
+/** Write a span of text to the sink, as it is. */
+static void write_span(TextOut *t, const uint8_t *data, const size_t length)
+{
+    if (length == 0) return;
+    t->sink.write(data, length, t->sink.userdata);
+    t->newline = (data[length - 1] == '\n');
+}
+
+
+/** Write decoded text to the sink of a renderer, as it is. */
+static void write_span_out(const uint8_t *data, const size_t length,
+                           void *userdata)
+{
+    write_span(userdata, data, length);
+}
+
+
+/** Check if a byte is whitespace. */
+static bool is_space(const uint8_t c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+
+/** Write an autolink found in a span of text as the text of the link. */
+static void write_link_text(const uint8_t *data, const Autolink *link,
+                            void *userdata)
+{
+    write_span(userdata, data + link->text, link->length);
+}
+
+
+/**
+ * Write a span of text to the sink as a reader sees it: each autolink
+ * as the text of the link, and the text between them decoded.
+ *
+ * - parameter t: The renderer.
+ * - parameter data: The span of text.
+ * - parameter length: The bytes of the span.
+ * - parameter more: More text of the block may follow the span.
+ */
+static void write_visible(TextOut *t, const uint8_t *data, size_t length,
+                          const bool more)
+{
+    write_autolinked(&t->decoder, data, length, more, write_link_text);
+}
+
+
+/**
+ * Write a span of text to the sink as a reader sees it, straight from
+ * the span if it holds no `&` or `<`.
+ */
+static void write_seen(TextOut *t, const uint8_t *data, const size_t length,
+                       const bool more)
+{
+    if (!t->decoder.held && is_plain(data, length)) {
+        write_span(t, data, length);
+    }
+    else write_visible(t, data, length, more);
+}
+
+
+/************************************************************************
+ * # Inline Spans and Emphasis
+ *
+ *  Text kept from a block's first span of inline syntax or emphasis is
+ *  written once the block is exited. The stretches of text between its
+ *  spans are searched for runs of `*` and `_`, and each run that closes
+ *  emphasis is matched with the nearest run before it that opens it,
+ *  as CommonMark matches them. The bytes of a run that are matched are
+ *  left out. The text of a link or an image is written the same way,
+ *  but its runs are matched only with each other.
+ *
+ ************************************************************************/
+
+/** Check if a byte may start a span of inline syntax or emphasis. */
+static bool starts_inline(const uint8_t c)
+{
+    return starts_span(c) || c == '*' || c == '_';
+}
+
+
+/** Check if a byte is ASCII punctuation. */
+static bool is_punct(const uint8_t c)
+{
+    return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') ||
+           (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+}
+
+
+/**
+ * Write the text of a block up to the first byte that may start a span
+ * of inline syntax or emphasis, and keep the rest of it, from there on,
+ * until the block is exited. Text that cannot be kept is written as it
+ * comes, with what was kept before it.
+ */
+static void keep_text(TextOut *t, const uint8_t *data, const size_t length)
+{
+    size_t at = 0;
+
+    if (!t->kept || t->kept->length == 0) {
+        while (at < length && !starts_inline(data[at])) at++;
+        if (at == length) {
+            write_seen(t, data, length, true);
+            t->last = data[length - 1];
+            return;
+        }
+        /* No reference runs into the byte that starts a span. */
+        write_seen(t, data, at, false);
+        if (at) t->last = data[at - 1];
+    }
+    if (!t->kept && !(t->kept = try_init_string(length - at))) {
+        write_seen(t, data + at, length - at, true);
+        return;
+    }
+    if (!try_append_span(t->kept, data + at, length - at)) {
+        write_kept(t);
+        write_seen(t, data + at, length - at, true);
+    }
+}
+
+
+/**
+ * Note a run of `*` or `_`.
+ *
+ * - returns: `false` if the memory for it could not be allocated.
+ */
+static bool add_delim(TextOut *t, const size_t start, const size_t length,
+                      const bool can_open, const bool can_close)
+{
+    size_t allocd = t->delim_allocd ? t->delim_allocd * 2 : 16;
+    Delim *delims = NULL;
+    Delim *d = NULL;
+
+    if (t->delim_count == t->delim_allocd) {
+        if (!(delims = realloc(t->delims, allocd * sizeof(Delim)))) {
+            return false;
+        }
+        t->delims       = delims;
+        t->delim_allocd = allocd;
+    }
+
+    d = &t->delims[t->delim_count++];
+    d->start     = start;
+    d->length    = length;
+    d->open      = 0;
+    d->close     = 0;
+    d->can_open  = can_open;
+    d->can_close = can_close;
+    return true;
+}
+
+
+/**
+ * Note each run of `*` and `_` in a stretch of text, and if it may open
+ * or close emphasis: a run opens if it is left-flanking, and closes if
+ * it is right-flanking, but a run of `_` does neither inside a word.
+ * Runs that cannot be noted are written as text.
+ *
+ * - parameter t: The renderer.
+ * - parameter data: The kept text.
+ * - parameter length: The bytes of the kept text.
+ * - parameter from: The offset of the stretch.
+ * - parameter to: The offset just past it.
+ */
+static void find_delims(TextOut *t, const uint8_t *data, const size_t length,
+                        const size_t from, const size_t to)
+{
+    size_t at = from;
+    size_t end = 0;     /* Offset just past a run. */
+    uint8_t before = 0;
+    uint8_t after = 0;
+    bool left = false;  /* The run is left-flanking. */
+    bool right = false; /* The run is right-flanking. */
+
+    while (at < to) {
+        if (data[at] != '*' && data[at] != '_') {
+            at++;
+            continue;
+        }
+        for (end = at; end < to && data[end] == data[at]; end++) ;
+
+        before = at ? data[at - 1] : t->last;
+        after  = (end < length) ? data[end] : '\n';
+        left   = !is_space(after) &&
+                 (!is_punct(after) || is_space(before) || is_punct(before));
+        right  = !is_space(before) &&
+                 (!is_punct(before) || is_space(after) || is_punct(after));
+
+        if (data[at] == '*') {
+            if (!add_delim(t, at, end - at, left, right)) return;
+        }
+        else if (!add_delim(t, at, end - at,
+                            left && (!right || is_punct(before)),
+                            right && (!left || is_punct(after)))) {
+            return;
+        }
+        at = end;
+    }
+}
+
+
+/** Get the bytes of a run not yet matched. */
+static size_t unmatched(const Delim *d)
+{
+    return d->length - d->open - d->close;
+}
+
+
+/**
+ * Check if a run opens the emphasis a later run closes: they are runs
+ * of one byte, and unless both are multiples of three long, the sum of
+ * their lengths is not one when either run may both open and close.
+ */
+static bool opens(const uint8_t *data, const Delim *opener,
+                  const Delim *closer)
+{
+    if (!opener->can_open || unmatched(opener) == 0) return false;
+    if (data[opener->start] != data[closer->start]) return false;
+    if (!opener->can_close && !closer->can_open) return true;
+    return (opener->length + closer->length) % 3 != 0 ||
+           (opener->length % 3 == 0 && closer->length % 3 == 0);
+}
+
+
+/**
+ * Match each run that may close emphasis with the runs before it that
+ * open it, from the nearest. The runs between a pair that match are
+ * left as text.
+ *
+ * - parameter t: The renderer, holding the runs.
+ * - parameter data: The kept text.
+ * - parameter base: The index of the first run to match.
+ */
+static void match_delims(TextOut *t, const uint8_t *data, const size_t base)
+{
+    Delim *d = t->delims;
+    size_t i = 0;
+    size_t j = 0;
+    size_t k = 0;
+    size_t n = 0;       /* Bytes matched. */
+
+    for (i = base; i < t->delim_count; i++) {
+        if (!d[i].can_close) continue;
+        for (j = i; j > base && unmatched(&d[i]); ) {
+            if (!opens(data, &d[--j], &d[i])) continue;
+            n = unmatched(&d[j]);
+            if (unmatched(&d[i]) < n) n = unmatched(&d[i]);
+            d[j].open  += n;
+            d[i].close += n;
+            for (k = j + 1; k < i; k++) {
+                d[k].can_open  = false;
+                d[k].can_close = false;
+            }
+        }
+    }
+}
+
+
+/**
+ * Write a stretch of text between spans, leaving out the bytes of its
+ * runs that open or close emphasis.
+ *
+ * - parameter t: The renderer.
+ * - parameter data: The kept text.
+ * - parameter from: The offset of the stretch.
+ * - parameter to: The offset just past it.
+ * - parameter next: The index of the first run not yet written.
+ *
+ * - returns: The index of the first run after the stretch.
+ */
+static size_t write_stretch(TextOut *t, const uint8_t *data, size_t from,
+                            const size_t to, size_t next)
+{
+    const Delim *d = NULL;
+
+    for (; next < t->delim_count && t->delims[next].start < to; next++) {
+        d = &t->delims[next];
+        if (d->open == 0 && d->close == 0) continue;
+        write_visible(t, data + from, d->start - from, false);
+        write_span(t, data + d->start + d->close, unmatched(d));
+        from = d->start + d->length;
+    }
+    write_visible(t, data + from, to - from, false);
+    return next;
+}
+
+
+/**
+ * Write kept text as a reader sees it: escapes as the bytes they
+ * escape, code spans as their code, links and images as their text,
+ * and the stretches between them without the runs that open or close
+ * emphasis.
+ *
+ * - parameter t: The renderer.
+ * - parameter data: The kept text.
+ * - parameter length: The bytes of the kept text.
+ * - parameter from: The offset of the text to write.
+ * - parameter to: The offset just past it.
+ */
+static void write_inline(TextOut *t, const uint8_t *data, const size_t length,
+                         const size_t from, const size_t to)
+{
+    const size_t base = t->delim_count;
+    size_t next = base;     /* The first run not yet written. */
+    size_t at = from;       /* Offset of the text not yet written. */
+    bool found = false;
+    InlineSpan span;
+
+    /* The runs of every stretch are matched before any is written. */
+    while (at < to) {
+        found = find_span(data, at, to, false, &span);
+        find_delims(t, data, length, at, found ? span.start : to);
+        if (!found) break;
+        at = span.end;
+    }
+    match_delims(t, data, base);
+
+    for (at = from; at < to; at = span.end) {
+        found = find_span(data, at, to, false, &span);
+        next  = write_stretch(t, data, at, found ? span.start : to, next);
+        if (!found) break;
+
+        if (span.type == SPAN_ESCAPE || span.type == SPAN_CODE) {
+            write_span(t, data + span.text, span.length);
+        }
+        else write_inline(t, data, length, span.text, span.text + span.length);
+    }
+    t->delim_count = base;
+}
+
+
+/** Write the text kept from a block's first span, as a reader sees it. */
+static void write_kept(TextOut *t)
+{
+    if (!t->kept || t->kept->length == 0) return;
+    write_inline(t, t->kept->data, t->kept->length, 0, t->kept->length);
+    t->kept->length = 0;
+}
+
+
+/** Check if a block is a header. */
+static bool is_header(const mdblock_t type)
+{
+    switch (type) {
+        case ATX_HEADER_1:
+        case ATX_HEADER_2:
+        case ATX_HEADER_3:
+        case ATX_HEADER_4:
+        case ATX_HEADER_5:
+        case ATX_HEADER_6:
+        case SETEXT_HEADER_1:
+        case SETEXT_HEADER_2:
+            return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * text.h -- rendering of parsed blocks as plain text
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef TEXT_DOT_H
+#define TEXT_DOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "entities.h"
+#include "libpatdown.h"
+#include "patdown.h"
+#include "strings.h"
+
+/************************************************************************
+ * # Text Rendering
+ ************************************************************************/
+
+/**
+ * A type to hold a run of `*` or `_` in the text of a block, which may
+ * open or close emphasis.
+ *
+ * - member start: The offset of the run in the text.
+ * - member length: The bytes of the run.
+ * - member open: The bytes at the end of the run that open emphasis.
+ * - member close: The bytes at the start of the run that close it.
+ * - member can_open: The run may open emphasis.
+ * - member can_close: The run may close emphasis.
+ */
+typedef struct Delim
+{
+    size_t start;       /* Offset of the run. */
+    size_t length;      /* Bytes of the run. */
+    size_t open;        /* Bytes at its end that open emphasis. */
+    size_t close;       /* Bytes at its start that close emphasis. */
+    bool can_open;      /* Run may open emphasis. */
+    bool can_close;     /* Run may close emphasis. */
+} Delim;
+
+/**
+ * A type to hold the state of a plain text renderer.
+ *
+ * - member sink: Where the text is written.
+ * - member code: The text of code blocks is written too.
+ * - member block: The block being rendered.
+ * - member shown: The text of the block is written.
+ * - member open: The block has started its line of output.
+ * - member plain: The block's text holds no inline metacharacter that
+ *   changes what a reader sees, so it is written as it is.
+ * - member flat: The block's text holds no byte that starts a span of
+ *   inline syntax or emphasis, so it is written as it is reported.
+ * - member any: Some block has been written, so the next one is set
+ *   off by a blank line.
+ * - member newline: The last byte written was a newline.
+ * - member decoder: Decodes the character references of the text.
+ * - member last: The last byte of the block's text before the kept
+ *   text, which tells if a run of `*` or `_` at its start is in a word.
+ * - member kept: The text of the block from its first span of inline
+ *   syntax or emphasis, written once the block is exited, or `NULL`.
+ * - member delims: The runs of `*` and `_` of the kept text.
+ * - member delim_count: The number of runs.
+ * - member delim_allocd: The number of runs allocated.
+ */
+typedef struct TextOut
+{
+    PdSink sink;        /* Where the text is written. */
+    bool code;          /* Text of code blocks is written too. */
+    mdblock_t block;    /* Block being rendered. */
+    bool shown;         /* Text of the block is written. */
+    bool open;          /* Block has started its output. */
+    bool plain;         /* Block's text holds no metacharacter seen. */
+    bool flat;          /* Block's text starts no span or emphasis. */
+    bool any;           /* Some block has been written. */
+    bool newline;       /* Last byte written was a newline. */
+    Decoder decoder;    /* Decodes the character references of the text. */
+    uint8_t last;       /* Last byte of text before the kept text. */
+    String *kept;       /* Text of the block from its first span. */
+    Delim *delims;      /* Runs of `*` and `_` of the kept text. */
+    size_t delim_count;     /* Number of runs. */
+    size_t delim_allocd;    /* Number of runs allocated. */
+} TextOut;
+
+/** Get the callbacks that render the visible text of each block. */
+Callbacks text_callbacks(TextOut *t, const PdSink *sink, const bool code);
+
+/** Free the memory held by a plain text renderer. */
+void free_text_out(TextOut *t);
+
+#endif
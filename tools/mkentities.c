@@ -0,0 +1,317 @@
+/**
+ * mkentities.c -- generate the perfect hash of HTML5's named references
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ *   Reads entities.txt and writes entities.inc, the tables that
+ *   entities.c looks names up in, to stdout. It runs at build time, so
+ *   the list is the only thing kept in the tree.
+ *
+ *   USAGE: mkentities <entities.txt>
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************************************************************************
+ * # Hash and Displace
+ *
+ *  Each name is hashed once. The low bits of its hash pick one of
+ *  `BUCKETS` buckets, and every bucket gets a seed that is mixed into
+ *  the hash of its names to pick their slots in a table of `SLOTS`. The
+ *  buckets with the most names are seeded first, each with the first
+ *  seed that puts all of its names in free slots, so a lookup is one
+ *  hash, two loads and one compare.
+ *
+ *  The hash, its mix and the sizes must be those of entities.c.
+ *
+ ************************************************************************/
+
+/** The number of buckets; a power of two. */
+#define BUCKETS 512
+
+/** The number of slots; a power of two, more than there are names. */
+#define SLOTS 4096
+
+/** The most names in the list. */
+#define MOST_NAMES 4096
+
+/** The most bytes of a name, so its length fits a bit of a mask. */
+#define MOST_BYTES 31
+
+/** The most bytes of the UTF-8 of a reference. */
+#define MOST_UTF8 8
+
+/** A named reference of the list. */
+typedef struct Name
+{
+    char name[MOST_BYTES + 1];      /* The name, without `&` and `;`. */
+    size_t length;                  /* Bytes of the name. */
+    uint8_t utf8[MOST_UTF8];        /* The UTF-8 it stands for. */
+    size_t size;                    /* Bytes of the UTF-8. */
+    uint32_t hash;                  /* The hash of the name. */
+} Name;
+
+/** The names of the list, in its order. */
+static Name names[MOST_NAMES];
+
+/** The number of names in each bucket. */
+static size_t bucket_sizes[BUCKETS];
+
+
+/** Hash a name -- 32-bit FNV-1a. */
+static uint32_t hash_name(const uint8_t *name, const size_t length)
+{
+    uint32_t h = UINT32_C(2166136261);
+    size_t i = 0;
+
+    for (i = 0; i < length; i++) h = (h ^ name[i]) * UINT32_C(16777619);
+    return h;
+}
+
+
+/** Get the bucket of a name from its hash. */
+static size_t bucket_of(const uint32_t h)
+{
+    return h & (BUCKETS - 1);
+}
+
+
+/** Mix the seed of a bucket into the hash of a name to pick its slot. */
+static uint32_t mix_slot(uint32_t h, const uint32_t seed)
+{
+    h ^= seed * UINT32_C(0x9e3779b9);
+    h ^= h >> 16;
+    h *= UINT32_C(0x85ebca6b);
+    h ^= h >> 13;
+    h *= UINT32_C(0xc2b2ae35);
+    h ^= h >> 16;
+    return h & (SLOTS - 1);
+}
+
+
+/** Encode a code point as UTF-8, returning the bytes written. */
+static size_t encode_utf8(const unsigned long c, uint8_t *out)
+{
+    if (c < 0x80) {
+        out[0] = c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = 0xC0 | (c >> 6);
+        out[1] = 0x80 | (c & 0x3F);
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = 0xE0 | (c >> 12);
+        out[1] = 0x80 | ((c >> 6) & 0x3F);
+        out[2] = 0x80 | (c & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (c >> 18);
+    out[1] = 0x80 | ((c >> 12) & 0x3F);
+    out[2] = 0x80 | ((c >> 6) & 0x3F);
+    out[3] = 0x80 | (c & 0x3F);
+    return 4;
+}
+
+
+/** Exit the generator with a message. */
+static void fail(const char *message, const char *detail)
+{
+    fprintf(stderr, "mkentities: %s: %s\n", message, detail);
+    exit(EXIT_FAILURE);
+}
+
+
+/**
+ * Read the list of names.
+ *
+ * - returns: The number of names read.
+ */
+static size_t read_names(FILE *fp)
+{
+    char line[256];
+    char *field = NULL;
+    unsigned long c = 0;
+    size_t count = 0;
+    Name *n = NULL;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (count == MOST_NAMES) fail("too many names", line);
+
+        n = &names[count++];
+        if (!(field = strtok(line, " \n")) || strlen(field) > MOST_BYTES) {
+            fail("bad name", line);
+        }
+        strcpy(n->name, field);
+        n->length = strlen(field);
+        n->hash   = hash_name((const uint8_t *)n->name, n->length);
+
+        while ((field = strtok(NULL, " \n"))) {
+            c = strtoul(field, NULL, 16);
+            if (c == 0 || c > 0x10FFFF || n->size + 4 > MOST_UTF8) {
+                fail("bad code point", n->name);
+            }
+            n->size += encode_utf8(c, n->utf8 + n->size);
+        }
+        if (n->size == 0) fail("no code points", n->name);
+    }
+    return count;
+}
+
+
+/** Compare two buckets, by the number of names in each, largest first. */
+static int compare_buckets(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a;
+    size_t y = *(const size_t *)b;
+
+    if (bucket_sizes[x] != bucket_sizes[y]) {
+        return bucket_sizes[x] > bucket_sizes[y] ? -1 : 1;
+    }
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * Seed every bucket, so that each name has a slot of its own.
+ *
+ * - parameter count: The number of names.
+ * - parameter seeds: Receives the seed of each bucket.
+ * - parameter slots: Receives the index of each slot's name, plus one,
+ *   or zero for a free slot.
+ */
+static void seed_buckets(const size_t count, uint16_t *seeds,
+                         uint16_t *slots)
+{
+    size_t order[BUCKETS];      /* Buckets, largest first. */
+    size_t members[MOST_NAMES]; /* The names of a bucket. */
+    uint32_t taken[MOST_NAMES]; /* The slots a seed would take. */
+    size_t size = 0;
+    uint32_t seed = 0;
+    bool placed = false;
+    size_t b = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+    for (i = 0; i < count; i++) bucket_sizes[bucket_of(names[i].hash)]++;
+    for (b = 0; b < BUCKETS; b++) order[b] = b;
+    qsort(order, BUCKETS, sizeof(size_t), compare_buckets);
+
+    for (b = 0; b < BUCKETS && bucket_sizes[order[b]]; b++) {
+        for (i = 0, size = 0; i < count; i++) {
+            if (bucket_of(names[i].hash) == order[b]) members[size++] = i;
+        }
+
+        placed = false;
+        for (seed = 0; !placed && seed <= UINT16_MAX; seed++) {
+            placed = true;
+            for (i = 0; placed && i < size; i++) {
+                taken[i] = mix_slot(names[members[i]].hash, seed);
+                placed = !slots[taken[i]];
+                for (j = 0; placed && j < i; j++) {
+                    placed = taken[j] != taken[i];
+                }
+            }
+        }
+        if (!placed) {
+            fail("no seed places every name", names[members[0]].name);
+        }
+
+        seeds[order[b]] = seed - 1;
+        for (i = 0; i < size; i++) slots[taken[i]] = members[i] + 1;
+    }
+}
+
+
+/** Write an array of 16-bit numbers, twelve to a line. */
+static void write_array(const char *decl, const uint16_t *values,
+                        const size_t count)
+{
+    size_t i = 0;
+
+    printf("%s = {", decl);
+    for (i = 0; i < count; i++) {
+        printf("%s%u,", (i % 12) ? " " : "\n    ", values[i]);
+    }
+    printf("\n};\n\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    static uint16_t seeds[BUCKETS];
+    static uint16_t slots[SLOTS];
+    FILE *fp = NULL;
+    uint32_t lengths = 0;       /* A bit for each length of a name. */
+    size_t count = 0;
+    size_t offset = 0;
+    size_t shortest = MOST_BYTES;
+    size_t longest = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "USAGE: %s <entities.txt>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!(fp = fopen(argv[1], "r"))) fail("list could not be read", argv[1]);
+    count = read_names(fp);
+    fclose(fp);
+    if (count == 0 || count >= SLOTS) fail("bad number of names", argv[1]);
+
+    seed_buckets(count, seeds, slots);
+    for (i = 0; i < count; i++) {
+        lengths |= UINT32_C(1) << names[i].length;
+        if (names[i].length < shortest) shortest = names[i].length;
+        if (names[i].length > longest) longest = names[i].length;
+    }
+
+    printf("/* entities.inc -- generated from %s by mkentities. */\n\n",
+           argv[1]);
+    printf("#define ENTITY_COUNT    %zu\n", count);
+    printf("#define ENTITY_BUCKETS  %d\n", BUCKETS);
+    printf("#define ENTITY_SLOTS    %d\n", SLOTS);
+    printf("#define ENTITY_SHORTEST %zu\n", shortest);
+    printf("#define ENTITY_LONGEST  %zu\n", longest);
+    printf("#define ENTITY_LENGTHS  UINT32_C(0x%08lx)\n\n",
+           (unsigned long)lengths);
+
+    /* One literal would be longer than C99 asks compilers to take. */
+    printf("static const char entity_names[] = {\n");
+    for (i = 0; i < count; i++) {
+        printf("   ");
+        for (j = 0; j < names[i].length; j++) {
+            printf(" '%c',", names[i].name[j]);
+        }
+        printf("\n");
+    }
+    printf("};\n\n");
+
+    printf("static const Entity entity_list[ENTITY_COUNT] = {\n");
+    for (i = 0; i < count; i++) {
+        printf("    { %zu, %zu, %zu, {", offset, names[i].length,
+               names[i].size);
+        for (j = 0; j < names[i].size; j++) {
+            printf("%s0x%02X", j ? ", " : " ", names[i].utf8[j]);
+        }
+        printf(" } },\n");
+        offset += names[i].length;
+    }
+    printf("};\n\n");
+
+    write_array("static const uint16_t entity_seeds[ENTITY_BUCKETS]",
+                seeds, BUCKETS);
+    write_array("static const uint16_t entity_slots[ENTITY_SLOTS]",
+                slots, SLOTS);
+    return EXIT_SUCCESS;
+}
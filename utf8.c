@@ -0,0 +1,202 @@
+/**
+ * utf8.c -- UTF-8 validation and repair
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "strings.h"
+#include "utf8.h"
+
+
+/************************************************************************
+ * # UTF-8 Input Validation
+ *
+ *  CommonMark requires every U+0000 in the input to be replaced by
+ *  U+FFFD, and we never want to pass malformed UTF-8 through to the
+ *  output. Input is checked in two steps:
+ *
+ *  1. `validate_utf8()` finds the longest prefix that needs no repair.
+ *     Runs of ASCII are skipped a whole vector (or word) at a time, and
+ *     only multi-byte sequences are decoded byte-by-byte. For valid
+ *     input this is the only pass, and no bytes are copied.
+ *
+ *  2. `repair_utf8()` is called only when a problem was found. It copies
+ *     the input into a new `String`, replacing each NULL-byte and each
+ *     maximal subpart of an ill-formed sequence with U+FFFD.
+ *
+ ************************************************************************/
+
+/** The UTF-8 encoding of U+FFFD REPLACEMENT CHARACTER. */
+static const uint8_t replacement[3] = { 0xEF, 0xBF, 0xBD };
+
+/** Bytes with the high bit set in each lane of a 64-bit word. */
+#define HIGH_BITS 0x8080808080808080ULL
+
+/** Bytes with the low bit set in each lane of a 64-bit word. */
+#define LOW_BITS  0x0101010101010101ULL
+
+
+/**
+ * Skip the run of non-NULL ASCII bytes at the start of an array.
+ *
+ * With SSE2 sixteen bytes are checked at once, otherwise eight bytes
+ * are checked at once as a 64-bit word. The remaining bytes (and any
+ * block that held something other than ASCII) are checked one at a time.
+ *
+ * - parameter data: The first byte to check.
+ * - parameter end: The byte just past the end of the array.
+ *
+ * - returns: A pointer to the first byte that is not ASCII, is a
+ *   NULL-byte, or is `end`.
+ */
+static const uint8_t *skip_ascii(const uint8_t *data, const uint8_t *end)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    while (end - data >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)data);
+
+        /* The high bit marks non-ASCII, the compare marks NULL-bytes. */
+        if (_mm_movemask_epi8(v) |
+            _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))) break;
+        data += 16;
+    }
+#else
+    while (end - data >= 8) {
+        uint64_t w;
+        memcpy(&w, data, sizeof(w));
+
+        /* The high bit marks non-ASCII, the borrow marks NULL-bytes. */
+        if ((w & HIGH_BITS) || ((w - LOW_BITS) & ~w & HIGH_BITS)) break;
+        data += 8;
+    }
+#endif
+
+    while (data < end && *data && *data < 0x80) data++;
+    return data;
+}
+
+
+/**
+ * Decode the length of the UTF-8 sequence at the start of an array.
+ *
+ * The well-formed sequences are those of table 3-7 in the Unicode
+ * standard, which rules out overlong forms, surrogates, and anything
+ * above U+10FFFF. A NULL-byte is treated as ill-formed.
+ *
+ * - parameter data: The first byte of the sequence.
+ * - parameter end: The byte just past the end of the array.
+ * - parameter bad: Set to the length of the maximal subpart of an
+ *   ill-formed sequence, which is the number of bytes to replace.
+ *
+ * - returns: The length of a well-formed sequence, or zero.
+ */
+static size_t decode_sequence(const uint8_t *data, const uint8_t *end,
+                              size_t *bad)
+{
+    uint8_t lo = 0x80;  /* Smallest valid second byte. */
+    uint8_t hi = 0xBF;  /* Largest valid second byte. */
+    size_t len = 0;     /* Length of the sequence. */
+    size_t k   = 0;     /* Index of the current continuation byte. */
+
+    if (*data > 0x00 && *data < 0x80) return 1;
+
+    if (*data >= 0xC2 && *data <= 0xDF) len = 2;
+    else if (*data >= 0xE0 && *data <= 0xEF) {
+        len = 3;
+        if (*data == 0xE0) lo = 0xA0;
+        if (*data == 0xED) hi = 0x9F;
+    }
+    else if (*data >= 0xF0 && *data <= 0xF4) {
+        len = 4;
+        if (*data == 0xF0) lo = 0x90;
+        if (*data == 0xF4) hi = 0x8F;
+    }
+    else {
+        *bad = 1;
+        return 0;
+    }
+
+    for (k = 1; k < len; k++) {
+        if (data + k >= end || data[k] < lo || data[k] > hi) {
+            *bad = k;
+            return 0;
+        }
+        lo = 0x80, hi = 0xBF;
+    }
+    return len;
+}
+
+
+/**
+ * Get the length of the valid UTF-8 prefix of a byte array.
+ *
+ * - parameter data: An array of byte data.
+ * - parameter length: The number of bytes in the array.
+ *
+ * - returns: The offset of the first NULL-byte or ill-formed sequence,
+ *   which is `length` when the whole array is valid.
+ */
+size_t validate_utf8(const uint8_t *data, const size_t length)
+{
+    const uint8_t *p   = data;
+    const uint8_t *end = data + length;
+    size_t len = 0;     /* Length of a multi-byte sequence. */
+    size_t bad = 0;     /* Unused: length of an ill-formed sequence. */
+
+    while ((p = skip_ascii(p, end)) < end) {
+        if ((len = decode_sequence(p, end, &bad)) == 0) break;
+        p += len;
+    }
+    return p - data;
+}
+
+
+/**
+ * Copy a byte array, replacing NULL-bytes and invalid UTF-8 with U+FFFD.
+ *
+ * - parameter data: An array of byte data.
+ * - parameter length: The number of bytes in the array.
+ * - parameter valid: The length of the valid prefix, as returned from
+ *   `validate_utf8()`. It is copied without being checked again.
+ *
+ * - returns: A `String` node holding the repaired bytes, or `NULL` if
+ *   memory could not be allocated.
+ */
+String *repair_utf8(const uint8_t *data, const size_t length, size_t valid)
+{
+    const uint8_t *p   = data;
+    const uint8_t *end = data + length;
+    size_t bad = 0;     /* Length of an ill-formed sequence. */
+    String *s  = try_init_string(length + sizeof(replacement) + 1);
+
+    if (!s) return NULL;
+
+    while (true) {
+        if (!try_append_span(s, p, valid)) break;
+        p += valid;
+        if (p >= end) return s;
+
+        decode_sequence(p, end, &bad);
+        if (!try_append_span(s, replacement, sizeof(replacement))) break;
+        p += bad;
+
+        valid = validate_utf8(p, end - p);
+    }
+    free_string(s);
+    return NULL;
+}
@@ -0,0 +1,29 @@
+/**
+ * utf8.h -- UTF-8 validation and repair
+ *
+ *  author:     Pat Gaffney <pat@hypepat.com>
+ *  created:    2026-10-18
+ *  modified:   2026-10-18
+ *  project:    patdown
+ *
+ ************************************************************************/
+
+#ifndef UTF8_DOT_H
+#define UTF8_DOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "strings.h"
+
+/************************************************************************
+ * # UTF-8 Input Validation
+ ************************************************************************/
+
+/** Get the length of the valid UTF-8 prefix of a byte array. */
+size_t validate_utf8(const uint8_t *data, const size_t length);
+
+/** Copy a byte array, replacing NULL-bytes and invalid UTF-8 with U+FFFD. */
+String *repair_utf8(const uint8_t *data, const size_t length, size_t valid);
+
+#endif